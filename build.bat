@@ -6,5 +6,7 @@ if ERRORLEVEL 1 (
 )
 if NOT EXIST build mkdir build
 pushd build
-cl -Zi ..\src\win32_platform.cpp User32.lib Gdi32.lib Ole32.lib Winmm.lib
+cl ..\src\raika_packer.cpp /I..\include
+raika_packer assets.pak ..\textures\texture.bmp
+cl -Zi ..\src\win32_platform.cpp /I..\include User32.lib Gdi32.lib Ole32.lib Winmm.lib
 popd
\ No newline at end of file
@@ -0,0 +1,9 @@
+#!/bin/sh
+
+set -e
+
+mkdir -p build
+cd build
+
+g++ $BUILD_OPTIONS -O2 -o raika_bench -Wall ../src/raika_bench.cpp \
+  -I ../include -lm -lpthread
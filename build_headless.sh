@@ -0,0 +1,9 @@
+#!/bin/sh
+set -e
+
+mkdir -p build
+cd build
+g++ $BUILD_OPTIONS -O2 -o raika_packer -Wall ../src/raika_packer.cpp -I ../include -lm
+./raika_packer assets.pak ../textures/texture.bmp
+
+g++ $BUILD_OPTIONS -O2 -o raika_headless -Wall ../src/headless_platform.cpp -I ../include -lm -lpthread
@@ -28,6 +28,12 @@ pushd build
 
 glslc ../shaders/shader.vert -o vert.spv
 glslc ../shaders/shader.frag -o frag.spv
+glslc ../shaders/quad.vert -o quad_vert.spv
+glslc ../shaders/quad.frag -o quad_frag.spv
+glslc ../shaders/sprite.frag -o sprite_frag.spv
+
+cl ..\src\raika_packer.cpp /I..\include
+raika_packer assets.pak vert.spv frag.spv quad_vert.spv quad_frag.spv sprite_frag.spv ..\textures\texture.bmp
 
 cl %debugFlags% %rkdebugFlags% %vkdebugFlags% ..\src\sdl_platform.cpp ^
   %VULKAN_SDK%\Lib\vulkan-1.lib %VULKAN_SDK%\Lib\SDL2.lib %VULKAN_SDK%\Lib\SDL2main.lib Shell32.lib ^
@@ -7,6 +7,12 @@ cd build
 
 glslc ../shaders/shader.vert -o vert.spv
 glslc ../shaders/shader.frag -o frag.spv
+glslc ../shaders/quad.vert -o quad_vert.spv
+glslc ../shaders/quad.frag -o quad_frag.spv
+glslc ../shaders/sprite.frag -o sprite_frag.spv
+
+g++ $BUILD_OPTIONS -O2 -o raika_packer -Wall ../src/raika_packer.cpp -I ../include -lm
+./raika_packer assets.pak vert.spv frag.spv quad_vert.spv quad_frag.spv sprite_frag.spv ../textures/texture.bmp
 
 if [ -z "${RAIKA_DEBUG}" ]
 then
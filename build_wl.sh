@@ -15,5 +15,16 @@ wayland-scanner client-header \
   > xdg-shell-client-protocol.h
 fi
 
-gcc $BUILD_OPTIONS -o raika -Wall ../src/wl_platform.cpp xdg-shell-protocol.c \
-  -lm -lrt $(pkg-config --cflags --libs xkbcommon wayland-client libpipewire-0.3)
\ No newline at end of file
+g++ $BUILD_OPTIONS -O2 -o raika_packer -Wall ../src/raika_packer.cpp -I ../include -lm
+./raika_packer assets.pak ../textures/texture.bmp || exit 1
+
+if [ -z "${RAIKA_DEBUG}" ]
+then
+  export debugFlags=""
+else
+  echo "Building in debug mode..."
+  export debugFlags='-g -DRAIKA_DEBUG'
+fi
+
+gcc $BUILD_OPTIONS $debugFlags -o raika -Wall ../src/wl_platform.cpp xdg-shell-protocol.c -I ../include \
+  -lm -lrt -lpthread $(pkg-config --cflags --libs xkbcommon wayland-client libpipewire-0.3)
\ No newline at end of file
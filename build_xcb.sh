@@ -2,4 +2,4 @@
 
 mkdir -p build
 cd build
-gcc $BUILD_OPTIONS -o raika -Wall ../src/xcb_platform.cpp -lxcb -lm
\ No newline at end of file
+gcc $BUILD_OPTIONS -o raika -Wall ../src/xcb_platform.cpp -I ../include -lxcb -lm -lpthread
\ No newline at end of file
@@ -0,0 +1,32 @@
+#version 450
+
+layout(push_constant) uniform QuadData {
+  vec4 rect;
+  vec4 color;
+  vec2 extent;
+  ivec2 gradientOffset;
+  int mode;
+  int srgbTarget;
+} quad;
+
+layout(location = 0) out vec4 outColor;
+
+// The game's bytes are sRGB, which an sRGB target encodes again on write
+vec3 toTarget(vec3 encoded) {
+  if(quad.srgbTarget == 0) {
+    return encoded;
+  }
+  return mix(encoded / 12.92, pow((encoded + 0.055) / 1.055, vec3(2.4)), step(0.04045, encoded));
+}
+
+void main() {
+  if(quad.mode == 1) {
+    // The gradient, blue counting up across and green down as the software
+    // kernels write it
+    ivec2 pixel = ivec2(gl_FragCoord.xy) + quad.gradientOffset;
+    outColor = vec4(toTarget(vec3(0, pixel.y & 0xFF, pixel.x & 0xFF) / 255.0), 1.0);
+  } else {
+    // Premultiplied, already converted for the target
+    outColor = quad.color;
+  }
+}
@@ -0,0 +1,18 @@
+#version 450
+
+// A screen rectangle in pixels, for everything the game draws in 2D
+layout(push_constant) uniform QuadData {
+  vec4 rect;
+  vec4 color;
+  vec2 extent;
+  ivec2 gradientOffset;
+  int mode;
+  int srgbTarget;
+} quad;
+
+void main() {
+  // A strip of four corners
+  vec2 corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1);
+  vec2 pixel = quad.rect.xy + corner * quad.rect.zw;
+  gl_Position = vec4(pixel / quad.extent * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -1,11 +1,14 @@
 #version 450
 
 layout(binding = 0) uniform ViewData {
-  mat4 model;
   mat4 view;
   mat4 proj;
 } vd;
 
+layout(push_constant) uniform MeshData {
+  mat4 model;
+} mesh;
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexPos;
@@ -14,7 +17,7 @@ layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexPos;
 
 void main() {
-    gl_Position = vd.proj * vd.view * vd.model * vec4(inPosition, 1.0);
+    gl_Position = vd.proj * vd.view * mesh.model * vec4(inPosition, 1.0);
     fragColor = inColor;
     fragTexPos = inTexPos;
 }
@@ -0,0 +1,32 @@
+#version 450
+
+layout(push_constant) uniform QuadData {
+  vec4 rect;
+  vec4 color;
+  vec2 extent;
+  ivec2 gradientOffset;
+  int mode;
+  int srgbTarget;
+} quad;
+
+layout(binding = 0) uniform sampler2D sprite;
+
+layout(location = 0) out vec4 outColor;
+
+vec3 toTarget(vec3 encoded) {
+  if(quad.srgbTarget == 0) {
+    return encoded;
+  }
+  return mix(encoded / 12.92, pow((encoded + 0.055) / 1.055, vec3(2.4)), step(0.04045, encoded));
+}
+
+void main() {
+  // Whole texels scaled up by whole pixels, as the software path does
+  ivec2 size = textureSize(sprite, 0);
+  ivec2 at = ivec2((gl_FragCoord.xy - quad.rect.xy) * vec2(size) / quad.rect.zw);
+  vec4 texel = texelFetch(sprite, clamp(at, ivec2(0), size - 1), 0);
+  // Premultiplied sRGB bytes, so convert the straight colour and multiply
+  // again
+  vec3 straight = texel.a > 0.0 ? min(texel.rgb / texel.a, vec3(1.0)) : vec3(0.0);
+  outColor = vec4(toTarget(straight) * texel.a, texel.a);
+}
@@ -0,0 +1,427 @@
+#include "raika.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "raika_work_queue.cpp"
+#include "raika_posix_file.cpp"
+#include "raika_present.cpp"
+#include "raika_game_memory.cpp"
+#include "raika_file_queue.cpp"
+
+// Headless platform. Drives GameUpdateAndRender with no window or audio
+// device, times every frame and checksums what comes out.
+//
+// Usage: raika_headless [options]
+//   --frames N            frames per run (default 600)
+//   --resolution WxH      add a resolution to run, repeatable (default 1920x1080)
+//   --rate HZ             add a sample rate to run, repeatable (default 48000)
+//   --fps N               game update rate, sets the samples per frame (default 60)
+//   --threads N           render worker threads (default one less than the cores)
+//   --write-golden DIR    save the last frame of each run to DIR
+//   --check-golden DIR    compare the last frame of each run against DIR
+//   --help                print the options and exit
+//
+// Every resolution runs at every sample rate, in the order given. The game
+// keeps its state between runs, so goldens are only comparable between
+// identical command lines.
+
+#define HEADLESS_USAGE \
+  "usage: %s [options]\n" \
+  "  --frames N            frames per run (default 600)\n" \
+  "  --resolution WxH      add a resolution to run, repeatable (default 1920x1080)\n" \
+  "  --rate HZ             add a sample rate to run, repeatable (default 48000)\n" \
+  "  --fps N               game update rate, sets the samples per frame (default 60)\n" \
+  "  --threads N           render worker threads (default one less than the cores)\n" \
+  "  --write-golden DIR    save the last frame of each run to DIR\n" \
+  "  --check-golden DIR    compare the last frame of each run against DIR\n" \
+  "  --help                print this and exit\n"
+
+#define HEADLESS_MAX_RUNS 16
+#define HEADLESS_CHANNELS 2
+#define HEADLESS_BYTES_PER_SAMPLE 2
+
+struct headless_resolution {
+  int width;
+  int height;
+};
+
+struct headless_options {
+  int frames;
+  int fps;
+  int threads;
+  int resolutionCount;
+  headless_resolution resolutions[HEADLESS_MAX_RUNS];
+  int rateCount;
+  int rates[HEADLESS_MAX_RUNS];
+  char *writeGolden;
+  char *checkGolden;
+  bool help;
+};
+
+struct headless_frame_time {
+  double totalMs;
+  double gameMs;
+  double renderMs;
+};
+
+static double HeadlessMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// CRC-32
+// The usual reflected 0xEDB88320 polynomial, so results can be checked with
+// any zlib-style tool
+static uint32_t globalCrcTable[256];
+
+static void InitCrcTable() {
+  for(uint32_t i = 0; i < 256; ++i) {
+    uint32_t c = i;
+    for(int bit = 0; bit < 8; ++bit) {
+      c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+    }
+    globalCrcTable[i] = c;
+  }
+}
+
+static uint32_t UpdateCrc(uint32_t crc, void *data, size_t size) {
+  uint8_t *byte = (uint8_t *) data;
+  crc = ~crc;
+  for(size_t i = 0; i < size; ++i) {
+    crc = globalCrcTable[(crc ^ byte[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+// Rows only, the pitch padding is not part of the image
+static uint32_t ImageCrc(uint32_t crc, graphics_buffer *buffer) {
+  uint8_t *row = (uint8_t *) buffer->memory;
+  for(int y = 0; y < buffer->height; ++y) {
+    crc = UpdateCrc(crc, row, (size_t) buffer->width * 4);
+    row += buffer->pitch;
+  }
+  return crc;
+}
+
+// Golden images
+// 32 bit bottom up BMPs, which ReadBitmap loads back through stb
+#pragma pack(push, 1)
+struct bmp_header {
+  uint16_t type;
+  uint32_t fileSize;
+  uint32_t reserved;
+  uint32_t pixelOffset;
+  uint32_t headerSize;
+  int32_t width;
+  int32_t height;
+  uint16_t planes;
+  uint16_t bitsPerPixel;
+  uint32_t compression;
+  uint32_t imageSize;
+  int32_t xPixelsPerMeter;
+  int32_t yPixelsPerMeter;
+  uint32_t colorsUsed;
+  uint32_t colorsImportant;
+};
+#pragma pack(pop)
+
+static bool WriteGoldenImage(char *filename, graphics_buffer *buffer) {
+  uint32_t imageSize = (uint32_t) buffer->width * buffer->height * 4;
+  file_data file = {};
+  file.size = sizeof(bmp_header) + imageSize;
+  file.memory = malloc(file.size);
+
+  bmp_header *header = (bmp_header *) file.memory;
+  *header = {};
+  header->type = 0x4D42;
+  header->fileSize = file.size;
+  header->pixelOffset = sizeof(bmp_header);
+  header->headerSize = 40;
+  header->width = buffer->width;
+  header->height = buffer->height;
+  header->planes = 1;
+  header->bitsPerPixel = 32;
+  header->imageSize = imageSize;
+  ConvertImageWith(
+    CopyPixelRow, header + 1, buffer->width * 4, buffer->memory, buffer->pitch,
+    buffer->width, buffer->height, true
+  );
+
+  bool result = PlatformWriteFile(filename, file);
+  free(file.memory);
+  return result;
+}
+
+// Alpha is not compared, stb fills it in for BMPs that leave it empty
+static bool CheckGoldenImage(char *filename, graphics_buffer *buffer) {
+  loaded_bitmap golden = ReadBitmap(filename);
+  if(!golden.memory) {
+    printf("  golden %s: missing\n", filename);
+    return false;
+  }
+  if(golden.width != buffer->width || golden.height != buffer->height) {
+    printf("  golden %s: size %dx%d, expected %dx%d\n",
+      filename, golden.width, golden.height, buffer->width, buffer->height);
+    free(golden.memory);
+    return false;
+  }
+
+  int mismatches = 0;
+  int firstX = 0, firstY = 0;
+  uint32_t maxDelta = 0;
+  for(int y = 0; y < buffer->height; ++y) {
+    uint32_t *expected = (uint32_t *) ((uint8_t *) golden.memory + (size_t) y * golden.pitch);
+    uint32_t *actual = (uint32_t *) ((uint8_t *) buffer->memory + (size_t) y * buffer->pitch);
+    for(int x = 0; x < buffer->width; ++x) {
+      uint32_t a = expected[x] & 0xFFFFFF;
+      uint32_t b = actual[x] & 0xFFFFFF;
+      if(a == b) {
+        continue;
+      }
+      if(mismatches++ == 0) {
+        firstX = x;
+        firstY = y;
+      }
+      for(int shift = 0; shift < 24; shift += 8) {
+        int delta = (int) ((a >> shift) & 0xFF) - (int) ((b >> shift) & 0xFF);
+        uint32_t magnitude = delta < 0 ? -delta : delta;
+        maxDelta = magnitude > maxDelta ? magnitude : maxDelta;
+      }
+    }
+  }
+  free(golden.memory);
+
+  if(mismatches) {
+    printf("  golden %s: %d pixels differ, first at %d,%d, max channel delta %u\n",
+      filename, mismatches, firstX, firstY, maxDelta);
+    return false;
+  }
+  printf("  golden %s: match\n", filename);
+  return true;
+}
+
+// Statistics
+static int CompareDoubles(const void *a, const void *b) {
+  double x = *(double *) a;
+  double y = *(double *) b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// Nearest rank on a sorted array
+static double Percentile(double *sorted, int count, double percent) {
+  int rank = (int) (percent / 100.0 * count + 0.999999);
+  rank = rank < 1 ? 1 : (rank > count ? count : rank);
+  return sorted[rank - 1];
+}
+
+static void PrintFrameTimes(const char *name, double *times, int count) {
+  double sum = 0;
+  for(int i = 0; i < count; ++i) {
+    sum += times[i];
+  }
+  qsort(times, count, sizeof(double), CompareDoubles);
+  printf("  %-7s %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f\n",
+    name, times[0], Percentile(times, count, 50), Percentile(times, count, 90),
+    Percentile(times, count, 99), times[count - 1], sum / count);
+}
+
+// Runs
+static bool RunHeadless(
+    headless_options *options,
+    game_memory *memory,
+    platform_work_queue *queue,
+    render_commands *commands,
+    headless_resolution resolution,
+    int rate
+) {
+  graphics_buffer graphicsBuffer = {};
+  graphicsBuffer.width = resolution.width;
+  graphicsBuffer.height = resolution.height;
+  graphicsBuffer.pitch = resolution.width * 4;
+  graphicsBuffer.memory = calloc((size_t) graphicsBuffer.pitch, graphicsBuffer.height);
+  graphicsBuffer.contentsLost = true;
+  graphicsBuffer.commands = commands;
+
+  sound_buffer soundBuffer = {};
+  soundBuffer.samplesPerSecond = rate;
+  soundBuffer.samplesRequested = rate / options->fps;
+  soundBuffer.bytesPerSample = HEADLESS_BYTES_PER_SAMPLE;
+  soundBuffer.channels = HEADLESS_CHANNELS;
+  size_t soundSize = (size_t) soundBuffer.samplesRequested * HEADLESS_CHANNELS * HEADLESS_BYTES_PER_SAMPLE;
+  soundBuffer.memory = calloc(1, soundSize);
+
+  game_input input = {};
+  double *total = (double *) malloc(sizeof(double) * options->frames * 3);
+  double *game = total + options->frames;
+  double *render = game + options->frames;
+  uint32_t imageCrc = 0;
+  uint32_t soundCrc = 0;
+  present_stats stats = {};
+  ResetSoftwareStats();
+
+  for(int frame = 0; frame < options->frames; ++frame) {
+    double start = HeadlessMs();
+    ResetRenderCommands(commands);
+    bool initialized = memory->isInitialized;
+    uint64_t heapAllocations = PlatformHeapAllocationCount();
+    GameUpdateAndRender(memory, &graphicsBuffer, &soundBuffer, &input);
+    // Past its first frame the game lives in its arenas
+    Assert(!initialized || PlatformHeapAllocationCount() == heapAllocations);
+    double gameEnd = HeadlessMs();
+    SoftwareRenderCommands(queue, &graphicsBuffer, commands);
+    PlatformCompleteAllWork(queue);
+    double end = HeadlessMs();
+    graphicsBuffer.contentsLost = false;
+
+    total[frame] = end - start;
+    game[frame] = gameEnd - start;
+    render[frame] = end - gameEnd;
+    RecordPresent(&stats, &graphicsBuffer);
+    imageCrc = ImageCrc(imageCrc, &graphicsBuffer);
+    soundCrc = UpdateCrc(soundCrc, soundBuffer.memory, soundSize);
+  }
+
+  printf("%dx%d @ %dHz, %d frames\n", resolution.width, resolution.height, rate, options->frames);
+  printf("  %-7s %8s %8s %8s %8s %8s %8s\n", "ms", "min", "p50", "p90", "p99", "max", "mean");
+  PrintFrameTimes("frame", total, options->frames);
+  PrintFrameTimes("game", game, options->frames);
+  PrintFrameTimes("render", render, options->frames);
+  char statsText[256];
+  FormatPresentStats(&stats, statsText, sizeof(statsText));
+  printf("%s", statsText);
+  FormatSoftwareStats(statsText, sizeof(statsText));
+  printf("%s", statsText);
+  printf("  crc image %08x sound %08x, last frame %08x\n", imageCrc, soundCrc, ImageCrc(0, &graphicsBuffer));
+
+  bool passed = true;
+  char filename[512];
+  if(options->writeGolden) {
+    snprintf(filename, sizeof(filename), "%s/frame_%dx%d_%d.bmp",
+      options->writeGolden, resolution.width, resolution.height, rate);
+    if(WriteGoldenImage(filename, &graphicsBuffer)) {
+      printf("  golden %s: written\n", filename);
+    } else {
+      printf("  golden %s: write failed\n", filename);
+      passed = false;
+    }
+  }
+  if(options->checkGolden) {
+    snprintf(filename, sizeof(filename), "%s/frame_%dx%d_%d.bmp",
+      options->checkGolden, resolution.width, resolution.height, rate);
+    passed = CheckGoldenImage(filename, &graphicsBuffer) && passed;
+  }
+
+  free(total);
+  free(soundBuffer.memory);
+  free(graphicsBuffer.memory);
+  return passed;
+}
+
+static bool ParseOptions(int argc, char *argv[], headless_options *options) {
+  options->frames = 600;
+  options->fps = 60;
+  options->threads = -1;
+  for(int i = 1; i < argc; ++i) {
+    char *arg = argv[i];
+    if(strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+      printf(HEADLESS_USAGE, argv[0]);
+      options->help = true;
+      return true;
+    }
+    char *value = i + 1 < argc ? argv[i + 1] : 0;
+    if(!value) {
+      printf("%s needs a value\n", arg);
+      return false;
+    }
+    ++i;
+    if(strcmp(arg, "--frames") == 0) {
+      options->frames = atoi(value);
+    } else if(strcmp(arg, "--fps") == 0) {
+      options->fps = atoi(value);
+    } else if(strcmp(arg, "--threads") == 0) {
+      options->threads = atoi(value);
+    } else if((strcmp(arg, "--resolution") == 0 && options->resolutionCount == HEADLESS_MAX_RUNS) ||
+              (strcmp(arg, "--rate") == 0 && options->rateCount == HEADLESS_MAX_RUNS)) {
+      printf("at most %d of %s\n", HEADLESS_MAX_RUNS, arg);
+      return false;
+    } else if(strcmp(arg, "--resolution") == 0) {
+      headless_resolution *resolution = options->resolutions + options->resolutionCount++;
+      if(sscanf(value, "%dx%d", &resolution->width, &resolution->height) != 2 ||
+         resolution->width <= 0 || resolution->height <= 0) {
+        printf("bad resolution %s\n", value);
+        return false;
+      }
+    } else if(strcmp(arg, "--rate") == 0) {
+      int rate = atoi(value);
+      if(rate < 1) {
+        printf("bad rate %s\n", value);
+        return false;
+      }
+      options->rates[options->rateCount++] = rate;
+    } else if(strcmp(arg, "--write-golden") == 0) {
+      options->writeGolden = value;
+    } else if(strcmp(arg, "--check-golden") == 0) {
+      options->checkGolden = value;
+    } else {
+      printf("unknown option %s, see --help\n", arg);
+      return false;
+    }
+  }
+  if(options->frames < 1 || options->fps < 1) {
+    printf("--frames and --fps must be positive\n");
+    return false;
+  }
+  if(!options->resolutionCount) {
+    options->resolutions[options->resolutionCount++] = {1920, 1080};
+  }
+  if(!options->rateCount) {
+    options->rates[options->rateCount++] = 48000;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  headless_options options = {};
+  if(!ParseOptions(argc, argv, &options)) {
+    return 2;
+  }
+  if(options.help) {
+    return 0;
+  }
+  InitCrcTable();
+
+  static game_memory memory;
+  if(!PlatformAllocateGameMemory(&memory, GAME_PERMANENT_STORAGE_SIZE, GAME_TRANSIENT_STORAGE_SIZE)) {
+    printf("could not reserve game memory\n");
+    return 2;
+  }
+  static platform_file_queue fileQueue;
+  MakeFileQueue(&fileQueue);
+  memory.fileQueue = &fileQueue;
+  printf("game memory %lluMB permanent, %lluMB transient, %s, file reads through %s\n",
+    (unsigned long long) (memory.permanentStorageSize >> 20), (unsigned long long) (memory.transientStorageSize >> 20),
+    memory.hugePages ? "huge pages" : "4KB pages", FileQueueName(&fileQueue));
+  memory.assetPack = PlatformMapFile((char *) ASSET_PACK_FILENAME);
+  PlatformPrefetchFile(&memory.assetPack, 0, memory.assetPack.size);
+  printf("assets from %s\n", memory.assetPack.memory ? ASSET_PACK_FILENAME : "loose files");
+
+  static platform_work_queue queue;
+  int threads = options.threads >= 0 ? options.threads : GetLogicalProcessorCount() - 1;
+  MakeWorkQueue(&queue, threads);
+  render_commands commands = MakeRenderCommands(malloc(RENDER_PUSH_BUFFER_SIZE), RENDER_PUSH_BUFFER_SIZE);
+
+  bool passed = true;
+  for(int r = 0; r < options.resolutionCount; ++r) {
+    for(int s = 0; s < options.rateCount; ++s) {
+      passed = RunHeadless(&options, &memory, &queue, &commands, options.resolutions[r], options.rates[s]) && passed;
+    }
+  }
+  free(commands.pushBufferBase);
+  FreeFileQueue(&fileQueue);
+  PlatformUnmapFile(&memory.assetPack);
+  PlatformFreeGameMemory(&memory);
+  return passed ? 0 : 1;
+}
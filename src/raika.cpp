@@ -3,68 +3,172 @@
 #include <math.h>
 #include <cstring>
 
-#define Pi32 3.1415926535897f
+#include "raika_arena.cpp"
 
-static void GameOutputSound(sound_buffer *buffer, int waveHz) {
-  static int currentAudioPos = 0;
+#include "raika_pixel.cpp"
+#include "raika_fill.cpp"
+#include "raika_bitmap.cpp"
+#include "raika_asset_pack.cpp"
+#include "raika_raster.cpp"
+#include "raika_render.cpp"
+#include "raika_sprite.cpp"
+#include "raika_render_commands.cpp"
+#include "raika_software.cpp"
+#include "raika_scale.cpp"
 
-  int64_t waveAmplitude = (((int64_t) 1) << ((buffer->bytesPerSample) * 8) - 1) / 5; // 20% volume
+#include "raika_oscillator.cpp"
+#include "raika_resampler.cpp"
+#include "raika_sound_stream.cpp"
+#include "raika_effects.cpp"
+#include "raika_mixer.cpp"
+#include "raika_spatial.cpp"
 
-  char * bufferPointer = (char *) (buffer->memory);
-  double sinValue;
-  int64_t writeValue;
+// What the last frame drew, to work out what changed
+struct frame_record {
+  bool valid;
+  int width;
+  int height;
+  int gradientX;
+  int gradientY;
+  graphics_rect sceneBounds;
+};
 
-  int wavePeriod = buffer->samplesPerSecond / waveHz;
-  for(int i = 0; i < buffer->samplesRequested; ++i) {
-    sinValue = sinf(((float) currentAudioPos / (float) wavePeriod) * 2 * Pi32);
-    writeValue = waveAmplitude * sinValue;
-    for(int j = 0; j < buffer->channels; j++) {
-      memcpy(bufferPointer, &writeValue, buffer->bytesPerSample);
-      bufferPointer += buffer->bytesPerSample;
-    }
+// Everything the game keeps between frames, at the start of permanent storage
+struct game_state {
+  // The rest of permanent storage, and all of transient storage which is
+  // emptied every frame
+  memory_arena permanentArena;
+  memory_arena transientArena;
 
-    currentAudioPos++;
-    if(currentAudioPos == wavePeriod) {
-      currentAudioPos = 0;
-    }
-  }
-}
+  mixer mix;
+  uint32_t toneVoice;
 
-static void RenderGradient(
-    graphics_buffer *buffer, 
-    int xoffset, 
-    int yoffset
-) {
-  uint8_t *row = (uint8_t *) buffer->memory;
-  for(int y = 0; y < buffer->height; ++y) {
-      uint32_t *pixel = (uint32_t *) row;
-      for(int x = 0; x < buffer->width; ++x) {
-        uint8_t blue = x + xoffset;
-        uint8_t green = y + yoffset;
-        uint8_t red = 0;
-
-        *pixel++ = (red << 16) | (green << 8) | (blue);
-      }
-      row += buffer->pitch;
+  int xoffset;
+  int yoffset;
+  uint32_t sceneFrame;
+  bool sceneTextureLoaded;
+  loaded_bitmap sceneTexture;
+  render_mesh sceneMesh;
+  frame_record lastFrame;
+};
+
+static void GameOutputSound(game_state *state, sound_buffer *buffer, int waveHz) {
+  if(buffer->samplesRequested <= 0 || buffer->samplesPerSecond <= 0) {
+    return;
+  }
+  if(!state->mix.samplesPerSecond) {
+    InitMixer(&state->mix, buffer->samplesPerSecond);
+    // 20% in each channel once the centre pan takes its 3dB
+    state->toneVoice = PlayOscillator(&state->mix, Waveform_Sine, waveHz, 0.2f * 1.41421356f, 0.0f);
   }
+  SetVoiceFrequency(&state->mix, state->toneVoice, waveHz);
+  MixSound(&state->mix, buffer);
 }
 
-static int xoffset = 0;
-static int yoffset = 0;
-
 static void GameUpdateAndRender(
+    game_memory *memory,
     graphics_buffer *graphicsBuffer,
     sound_buffer *soundBuffer,
     game_input *gameInput
 ) {
+    Assert(sizeof(game_state) <= memory->permanentStorageSize);
+    game_state *state = (game_state *) memory->permanentStorage;
+    if(!memory->isInitialized) {
+      InitializeArena(
+        &state->permanentArena, (uint8_t *) memory->permanentStorage + sizeof(game_state),
+        memory->permanentStorageSize - sizeof(game_state)
+      );
+      InitializeArena(&state->transientArena, memory->transientStorage, memory->transientStorageSize);
+      memory->isInitialized = true;
+    }
+    temporary_memory frameMemory = BeginTemporaryMemory(&state->transientArena);
+
+    // The texture comes out of the asset pack when there is one, already
+    // cooked if the packer could, otherwise its file is read while the first
+    // frame's sound mixes
+    asset_pack assets = {};
+    asset_pack_entry *textureAsset = 0;
+    if(!state->sceneTextureLoaded && OpenAssetPack(&assets, memory->assetPack)) {
+      textureAsset = FindAsset(&assets, SCENE_TEXTURE_ASSET);
+    }
+    platform_file textureFile = {};
+    void *textureData = 0;
+    uint32_t textureRead = 0;
+    if(!state->sceneTextureLoaded && !textureAsset && memory->fileQueue) {
+      textureFile = PlatformOpenFile((char *) SCENE_TEXTURE_PATH);
+      if(textureFile.handle && textureFile.size <= ArenaRemaining(&state->transientArena)) {
+        textureData = PushSize(&state->transientArena, textureFile.size);
+        textureRead = PlatformQueueFileRead(
+          memory->fileQueue, &textureFile, 0, textureFile.size, textureData, FileReadPriority_High
+        );
+      }
+    }
+
     player_controller playerInput = gameInput->keyboard;
     int waveHz = 256 + (playerInput.buttons[0] ? 200 : 0);
-    xoffset += playerInput.dpad[0] ? 10 : 0;
-    yoffset += playerInput.dpad[1] ? 10 : 0;
-    GameOutputSound(soundBuffer, waveHz);
-    if(playerInput.buttons[0]) {
-      RenderGradient(graphicsBuffer, xoffset, yoffset);
+    state->xoffset += playerInput.dpad[0] ? 10 : 0;
+    state->yoffset += playerInput.dpad[1] ? 10 : 0;
+    GameOutputSound(state, soundBuffer, waveHz);
+
+    if(!state->sceneTextureLoaded) {
+      // Falls back to vertex colours when the texture is missing
+      cooked_texture_header *cookedTexture = textureAsset ? FindCookedTexture(&assets, textureAsset) : 0;
+      if(cookedTexture) {
+        state->sceneTexture = LoadCookedBitmap(cookedTexture, &state->permanentArena);
+      } else if(textureAsset) {
+        void *data = LoadAsset(&assets, textureAsset, &state->transientArena);
+        if(data) {
+          state->sceneTexture = DecodeBitmap(data, textureAsset->size, &state->permanentArena);
+        }
+      } else if(memory->fileQueue) {
+        uint64_t bytesRead = 0;
+        if(textureRead && PlatformWaitFileRead(memory->fileQueue, textureRead, &bytesRead) == FileRead_Done) {
+          state->sceneTexture = DecodeBitmap(textureData, bytesRead, &state->permanentArena);
+        }
+        PlatformCloseFile(&textureFile);
+      } else {
+        state->sceneTexture = ReadBitmap((char *) SCENE_TEXTURE_PATH, &state->permanentArena);
+      }
+      state->sceneTextureLoaded = true;
+      state->sceneMesh.vertices = SCENE_VERTICES;
+      state->sceneMesh.vertexCount = SCENE_VERTEX_COUNT;
+      state->sceneMesh.indices = SCENE_INDICES;
+      state->sceneMesh.indexCount = SCENE_INDEX_COUNT;
+      state->sceneMesh.texture = &state->sceneTexture;
+    }
+    scene_view view = MakeSceneView(state->sceneFrame++, graphicsBuffer->width / (float) graphicsBuffer->height);
+
+    int gradientX = playerInput.buttons[0] ? state->xoffset : state->yoffset;
+    int gradientY = playerInput.buttons[0] ? state->yoffset : state->xoffset;
+    graphics_rect sceneBounds = ProjectedMeshBounds(
+      view.proj * view.view * view.model, SCENE_VERTICES, SCENE_VERTEX_COUNT,
+      graphicsBuffer->width, graphicsBuffer->height
+    );
+
+    // The background only changes when it scrolls, otherwise just the old
+    // and new footprint of the cube need redrawing
+    frame_record *lastFrame = &state->lastFrame;
+    graphicsBuffer->dirtyRectCount = 0;
+    if(!lastFrame->valid || graphicsBuffer->contentsLost ||
+       lastFrame->width != graphicsBuffer->width || lastFrame->height != graphicsBuffer->height ||
+       lastFrame->gradientX != gradientX || lastFrame->gradientY != gradientY) {
+      MarkAllDirty(graphicsBuffer);
     } else {
-      RenderGradient(graphicsBuffer, yoffset, xoffset);
+      MarkDirty(graphicsBuffer, lastFrame->sceneBounds);
+      MarkDirty(graphicsBuffer, sceneBounds);
     }
+    lastFrame->valid = true;
+    lastFrame->width = graphicsBuffer->width;
+    lastFrame->height = graphicsBuffer->height;
+    lastFrame->gradientX = gradientX;
+    lastFrame->gradientY = gradientY;
+    lastFrame->sceneBounds = sceneBounds;
+
+    render_commands *commands = graphicsBuffer->commands;
+    PushGradient(commands, 0, gradientX, gradientY);
+    PushCamera(commands, 1, view.view, view.proj);
+    PushMesh(commands, 1, &state->sceneMesh, view.model);
+
+    EndTemporaryMemory(frameMemory);
+    CheckArena(&state->transientArena);
 }
@@ -2,27 +2,266 @@
 
 #include <stdint.h>
 
+#include "raika_math.h"
+
 #define ArrayCount(array) (sizeof(array) / sizeof((array)[0]))
 #define Assert(value) if(!(value)) { *(int *) 0 = 0; }
 
 // This includes everything that the platform will provide to the game
 // File IO
-// NOTE: This is super crappy and should be revamped before release
+// Whole files at once. The platform may hand back a read-only mapping of the
+// file instead of a copy, which costs nothing until the pages are touched;
+// mapped says which it did and memory must not be written when it is set.
+// PlatformFreeFile releases either. Files the game builds itself to write
+// out leave mapped false.
 struct file_data {
-  uint32_t size;
+  uint64_t size;
   void * memory;
+  bool mapped;
 };
 static bool PlatformWriteFile(char * filename, file_data file);
 static file_data PlatformReadFile(char * filename);
 static void PlatformFreeFile(file_data file);
 
+// Read-only views of whole files, for data read a piece at a time over a long
+// while like streamed music. Pages come in as they are touched, so a mapping
+// costs address space rather than memory. Prefetch asks for a range to be
+// paged in ahead of the reader and evict drops a range it is done with; both
+// are hints and either may do nothing.
+struct mapped_file {
+  uint64_t size;
+  void *memory;
+};
+static mapped_file PlatformMapFile(char *filename);
+static void PlatformPrefetchFile(mapped_file *file, uint64_t offset, uint64_t size);
+static void PlatformEvictFile(mapped_file *file, uint64_t offset, uint64_t size);
+static void PlatformUnmapFile(mapped_file *file);
+
+// Async file reads
+// For loads that overlap their IO with decoding and uploads. A file opens
+// once, then any number of reads from it into memory the caller owns can be
+// queued. The platform keeps many going at once, starting higher
+// priorities first, and the game polls or waits on each. A read that comes
+// back short of its size hit the end of the file. Once a poll or wait has
+// reported a read as done or failed, the queue forgets it. Files must stay
+// open until their reads finish.
+struct platform_file_queue;
+
+struct platform_file {
+  // Zero when the open failed
+  uint64_t handle;
+  uint64_t size;
+};
+
+enum file_read_priority {
+  FileReadPriority_Low,
+  FileReadPriority_Normal,
+  FileReadPriority_High,
+  FileReadPriority_Count,
+};
+
+enum file_read_state {
+  // Not a read the queue knows, or one already reported
+  FileRead_Unknown,
+  FileRead_Pending,
+  FileRead_Done,
+  FileRead_Failed,
+};
+
+static platform_file PlatformOpenFile(char *filename);
+static void PlatformCloseFile(platform_file *file);
+// Returns zero when the queue is full
+static uint32_t PlatformQueueFileRead(
+  platform_file_queue *queue, platform_file *file, uint64_t offset, uint64_t size,
+  void *dest, file_read_priority priority
+);
+static file_read_state PlatformPollFileRead(platform_file_queue *queue, uint32_t read, uint64_t *bytesRead);
+static file_read_state PlatformWaitFileRead(platform_file_queue *queue, uint32_t read, uint64_t *bytesRead);
+
+// Work queue
+// The game pushes entries from the thread that called GameUpdateAndRender.
+// Entries run on the platform's worker threads and on whoever calls
+// PlatformCompleteAllWork, which returns once every entry has finished.
+struct platform_work_queue;
+typedef void platform_work_callback(platform_work_queue *queue, void *data);
+static void PlatformAddWorkEntry(platform_work_queue *queue, platform_work_callback *callback, void *data);
+static void PlatformCompleteAllWork(platform_work_queue *queue);
+
+// Memory
+// One block the platform reserves before the first frame and never moves or
+// frees while the game runs. Permanent storage starts zeroed and keeps the
+// game's state from frame to frame; transient storage is scratch the game
+// may throw away at any time. Once past its first frame the game allocates
+// only from these, and the platform asserts it made no heap allocations
+// inside GameUpdateAndRender.
+struct game_memory {
+  // Set by the game once it has laid out its state
+  bool isInitialized;
+  uint64_t permanentStorageSize;
+  void *permanentStorage;
+  uint64_t transientStorageSize;
+  void *transientStorage;
+  // Backed by 2MB pages, explicitly reserved or transparent ones
+  bool hugePages;
+  // For reads the game wants to overlap with other work, null when the
+  // platform has none and the game must read files whole
+  platform_file_queue *fileQueue;
+  // The asset pack, mapped once at startup, empty when the platform found
+  // none and the game must read loose files
+  mapped_file assetPack;
+};
+
+// Audio stats
+// What the platform measured of its audio output since the device opened, for
+// tuning buffer sizes against. The platform updates it between frames.
+#define AUDIO_STATS_BUCKETS 32
+#define AUDIO_STATS_BUCKET_MS 2
+
+struct audio_stats {
+  int samplesPerSecond;
+  // Audio still queued for the device each time the game was asked for more,
+  // in AUDIO_STATS_BUCKET_MS buckets with the last taking everything above
+  uint32_t fills;
+  uint32_t queuedHistogram[AUDIO_STATS_BUCKETS];
+  // The device ran dry and played silence. Backends that cannot tell for how
+  // long count the underruns with no samples.
+  uint32_t underruns;
+  uint64_t underrunSamples;
+  // The game made more than there was room for and the rest was dropped
+  uint32_t overruns;
+  uint64_t overrunSamples;
+  // From the play cursor to the newest sample written, after each write
+  float writeAheadMs;
+  float minWriteAheadMs;
+  float maxWriteAheadMs;
+  // How much faster the audio clock runs than the wall clock in parts per
+  // million, fitted over clockSeconds of wall time
+  float driftPpm;
+  double clockSeconds;
+};
+
 // This includes everything that the game will provide to the platform.
+// Interleaved frames of channels samples. Samples are signed integers of
+// bytesPerSample (2, 3 packed or 4) unless floatSamples is set, then 4 byte
+// floats. Channels past the first two are 5.1 or wider layouts and get
+// silence.
 struct sound_buffer {
     void *memory;
     int samplesPerSecond;
     int samplesRequested;
     int bytesPerSample;
     int channels;
+    bool floatSamples;
+    // Null when the platform keeps none
+    const audio_stats *stats;
+};
+
+#define GRAPHICS_MAX_DIRTY_RECTS 16
+
+struct graphics_rect {
+  int x;
+  int y;
+  int width;
+  int height;
+};
+
+// Render commands
+// The game describes a frame as commands pushed into memory the platform
+// provides. Command data grows up from the base and a sort entry per command
+// grows down from the end, so nothing is allocated per draw. Backends sort
+// the entries by key and walk them in that order.
+
+// Pixels are 0xAARRGGBB per 32 bit word with the top row first
+struct loaded_bitmap {
+  int width;
+  int height;
+  int pitch;
+  void *memory;
+};
+
+struct render_vertex {
+  v3 pos;
+  v3 color;
+  v2 texPos;
+};
+
+// Backends may cache GPU copies keyed on the address, so a mesh has to stay
+// put and unchanged once it has been drawn
+struct render_mesh {
+  const render_vertex *vertices;
+  uint32_t vertexCount;
+  const uint32_t *indices;
+  uint32_t indexCount;
+  loaded_bitmap *texture;
+};
+
+// Also the sort order of commands that share a layer
+enum render_command_type {
+  RenderCommand_Clear,
+  RenderCommand_Camera,
+  RenderCommand_Gradient,
+  RenderCommand_Mesh,
+  RenderCommand_Rect,
+  RenderCommand_Sprite,
+};
+
+struct render_command_header {
+  uint32_t type;
+  uint32_t size;
+};
+
+struct render_command_clear {
+  uint32_t color;
+};
+
+// Applies to the meshes that follow it
+struct render_command_camera {
+  m4x4 view;
+  m4x4 proj;
+};
+
+// The procedural background
+struct render_command_gradient {
+  int xoffset;
+  int yoffset;
+};
+
+struct render_command_mesh {
+  render_mesh *mesh;
+  m4x4 model;
+};
+
+// Premultiplied colour
+struct render_command_rect {
+  graphics_rect rect;
+  uint32_t color;
+};
+
+// Premultiplied bitmap
+struct render_command_sprite {
+  loaded_bitmap *bitmap;
+  int x;
+  int y;
+  int scale;
+};
+
+// Plenty for tens of thousands of sprites
+#define RENDER_PUSH_BUFFER_SIZE (4 * 1024 * 1024)
+
+struct render_sort_entry {
+  uint64_t sortKey;
+  uint32_t offset;
+};
+
+struct render_commands {
+  uint8_t *pushBufferBase;
+  uint32_t maxPushBufferSize;
+  uint32_t pushBufferSize;
+  // Sort entries live in [sortEntryAt, maxPushBufferSize)
+  uint32_t sortEntryAt;
+  uint32_t commandCount;
+  // Commands that did not fit this frame
+  uint32_t droppedCount;
 };
 
 struct graphics_buffer {
@@ -30,6 +269,18 @@ struct graphics_buffer {
   int width;
   int height;
   int pitch;
+  // Filled in by the game: the regions that changed since the last frame,
+  // which are all the platform has to present. In return the platform must
+  // hand the game a buffer that already holds the last frame's pixels.
+  int dirtyRectCount;
+  graphics_rect dirtyRects[GRAPHICS_MAX_DIRTY_RECTS];
+  // Set by the platform when memory no longer holds the last frame, after
+  // reallocating it for example. The game then redraws everything.
+  bool contentsLost;
+  // Required. The game pushes the frame here and the platform hands it to a
+  // backend after GameUpdateAndRender returns; memory may be null when that
+  // backend does not draw into it.
+  render_commands *commands;
 };
 
 struct player_controller {
@@ -47,6 +298,7 @@ struct game_input {
 };
 
 static void GameUpdateAndRender(
+  game_memory *memory,
   graphics_buffer *graphicsBuffer, 
   sound_buffer *soundBuffer, 
   game_input *gameInput
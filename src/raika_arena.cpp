@@ -0,0 +1,95 @@
+// Arenas
+// Linear allocators over memory someone else owns, game_memory's storage or
+// a piece of another arena. Pushes bump a cursor and never touch the heap;
+// nothing is freed on its own. PopMemory rewinds to an earlier push, and a
+// temporary_memory scope rewinds to where it began, so scratch that lives
+// for a frame or a function costs nothing to throw away. Pushed memory is
+// not cleared unless the push asks for it.
+#define ARENA_DEFAULT_ALIGNMENT 16
+
+struct memory_arena {
+  uint8_t *base;
+  size_t size;
+  size_t used;
+  // Highest used ever reached, to size the arena against
+  size_t peakUsed;
+  // Open temporary_memory scopes, which must all close before the arena
+  // is checked
+  int temporaryCount;
+};
+
+struct temporary_memory {
+  memory_arena *arena;
+  size_t used;
+};
+
+static void InitializeArena(memory_arena *arena, void *base, size_t size) {
+  arena->base = (uint8_t *) base;
+  arena->size = size;
+  arena->used = 0;
+  arena->peakUsed = 0;
+  arena->temporaryCount = 0;
+}
+
+inline size_t ArenaAlignmentOffset(memory_arena *arena, size_t alignment) {
+  size_t at = (size_t) (arena->base + arena->used);
+  return (alignment - (at & (alignment - 1))) & (alignment - 1);
+}
+
+// Zero when even the alignment padding does not fit
+inline size_t ArenaRemaining(memory_arena *arena, size_t alignment = ARENA_DEFAULT_ALIGNMENT) {
+  size_t offset = ArenaAlignmentOffset(arena, alignment);
+  return arena->used + offset < arena->size ? arena->size - arena->used - offset : 0;
+}
+
+// Alignment must be a power of two. Running out is a bug in how the game
+// sized its arenas, so it asserts rather than returning null.
+static void *PushSize(memory_arena *arena, size_t size, size_t alignment = ARENA_DEFAULT_ALIGNMENT, bool clear = false) {
+  Assert(alignment && (alignment & (alignment - 1)) == 0);
+  size_t offset = ArenaAlignmentOffset(arena, alignment);
+  Assert(arena->used + offset + size <= arena->size);
+  void *result = arena->base + arena->used + offset;
+  arena->used += offset + size;
+  arena->peakUsed = arena->used > arena->peakUsed ? arena->used : arena->peakUsed;
+  if(clear) {
+    memset(result, 0, size);
+  }
+  return result;
+}
+
+#define PushStruct(arena, type, ...) (type *) PushSize(arena, sizeof(type), ##__VA_ARGS__)
+#define PushArray(arena, count, type, ...) (type *) PushSize(arena, (count) * sizeof(type), ##__VA_ARGS__)
+
+// Frees memory, which came from a push on this arena, and everything pushed
+// after it
+static void PopMemory(memory_arena *arena, void *memory) {
+  uint8_t *at = (uint8_t *) memory;
+  Assert(at >= arena->base && at <= arena->base + arena->used);
+  arena->used = (size_t) (at - arena->base);
+}
+
+// Pushes size bytes onto arena and makes them an arena of their own
+inline void SubArena(memory_arena *result, memory_arena *arena, size_t size, size_t alignment = ARENA_DEFAULT_ALIGNMENT) {
+  InitializeArena(result, PushSize(arena, size, alignment), size);
+}
+
+static temporary_memory BeginTemporaryMemory(memory_arena *arena) {
+  temporary_memory result;
+  result.arena = arena;
+  result.used = arena->used;
+  ++arena->temporaryCount;
+  return result;
+}
+
+static void EndTemporaryMemory(temporary_memory temp) {
+  memory_arena *arena = temp.arena;
+  Assert(arena->used >= temp.used);
+  Assert(arena->temporaryCount > 0);
+  arena->used = temp.used;
+  --arena->temporaryCount;
+}
+
+// Every scope opened on the arena has closed again
+static void CheckArena(memory_arena *arena) {
+  Assert(arena->temporaryCount == 0);
+}
@@ -0,0 +1,151 @@
+// Asset lookup
+// Works in place on a pack the platform has mapped, see raika_asset_pack.h.
+// Opening checks that every table and blob lies inside the file, so lookups
+// afterwards trust it. A lookup hashes the name and probes the slot table;
+// nothing is built or allocated per pack.
+#include "raika_asset_pack.h"
+#include "raika_cooked_texture.h"
+
+struct asset_pack {
+  uint8_t *base;
+  uint64_t size;
+  asset_pack_header *header;
+  uint32_t *slots;
+  asset_pack_entry *entries;
+  char *names;
+};
+
+inline bool AssetPackRangeInside(uint64_t offset, uint64_t size, uint64_t fileSize) {
+  return offset <= fileSize && size <= fileSize - offset;
+}
+
+static bool OpenAssetPack(asset_pack *pack, mapped_file file) {
+  *pack = {};
+  asset_pack_header *header = (asset_pack_header *) file.memory;
+  if(!header || file.size < sizeof(asset_pack_header) || header->magic != ASSET_PACK_MAGIC ||
+     header->version != ASSET_PACK_VERSION || header->fileSize != file.size ||
+     !header->slotCount || (header->slotCount & (header->slotCount - 1)) ||
+     header->slotCount < 2 * (uint64_t) header->entryCount || header->slotsOffset % 4 || header->entriesOffset % 8 ||
+     !AssetPackRangeInside(header->slotsOffset, (uint64_t) header->slotCount * sizeof(uint32_t), file.size) ||
+     !AssetPackRangeInside(header->entriesOffset, (uint64_t) header->entryCount * sizeof(asset_pack_entry), file.size) ||
+     header->namesOffset > file.size) {
+    return false;
+  }
+  uint8_t *base = (uint8_t *) file.memory;
+  asset_pack_entry *entries = (asset_pack_entry *) (base + header->entriesOffset);
+  uint64_t namesSize = file.size - header->namesOffset;
+  char *names = (char *) (base + header->namesOffset);
+  for(uint32_t i = 0; i < header->entryCount; ++i) {
+    asset_pack_entry *entry = &entries[i];
+    if(!AssetPackRangeInside(entry->nameOffset, (uint64_t) entry->nameLength + 1, namesSize) ||
+       names[entry->nameOffset + entry->nameLength] != 0 ||
+       !AssetPackRangeInside(entry->offset, entry->storedSize, file.size) ||
+       (entry->compression == AssetCompression_None && entry->storedSize != entry->size) ||
+       entry->compression > AssetCompression_LZ4) {
+      return false;
+    }
+  }
+  uint32_t *slots = (uint32_t *) (base + header->slotsOffset);
+  for(uint32_t i = 0; i < header->slotCount; ++i) {
+    if(slots[i] > header->entryCount) {
+      return false;
+    }
+  }
+  pack->base = base;
+  pack->size = file.size;
+  pack->header = header;
+  pack->slots = slots;
+  pack->entries = entries;
+  pack->names = names;
+  return true;
+}
+
+inline char *AssetName(asset_pack *pack, asset_pack_entry *entry) {
+  return pack->names + entry->nameOffset;
+}
+
+// Null when the pack has no asset of that name
+static asset_pack_entry *FindAsset(asset_pack *pack, const char *name) {
+  asset_pack_entry *result = 0;
+  if(pack->header) {
+    uint64_t length = strlen(name);
+    uint64_t hash = AssetNameHash(name, length);
+    uint32_t mask = pack->header->slotCount - 1;
+    // A table at least half empty always ends a probe
+    for(uint32_t slot = (uint32_t) hash & mask, probes = 0; probes <= mask; slot = (slot + 1) & mask, ++probes) {
+      uint32_t index = pack->slots[slot];
+      if(!index) {
+        break;
+      }
+      asset_pack_entry *entry = &pack->entries[index - 1];
+      if(entry->nameHash == hash && entry->nameLength == length && !memcmp(AssetName(pack, entry), name, length)) {
+        result = entry;
+        break;
+      }
+    }
+  }
+  return result;
+}
+
+// The asset's bytes inside the mapping when it is stored as is, otherwise null
+inline void *AssetMemory(asset_pack *pack, asset_pack_entry *entry) {
+  return entry->compression == AssetCompression_None ? pack->base + entry->offset : 0;
+}
+
+// Copies or decompresses the asset into entry->size bytes at dest
+static bool UnpackAsset(asset_pack *pack, asset_pack_entry *entry, void *dest) {
+  bool result = false;
+  if(entry->compression == AssetCompression_None) {
+    memcpy(dest, pack->base + entry->offset, entry->size);
+    result = true;
+  } else if(entry->compression == AssetCompression_LZ4) {
+    result = DecompressLZ4(pack->base + entry->offset, entry->storedSize, dest, entry->size);
+  }
+  return result;
+}
+
+// Stored assets come straight from the mapping; compressed ones are
+// unpacked into the arena. Null when one does not decompress or fit.
+static void *LoadAsset(asset_pack *pack, asset_pack_entry *entry, memory_arena *arena) {
+  void *result = AssetMemory(pack, entry);
+  if(!result && entry->size <= ArenaRemaining(arena)) {
+    result = PushSize(arena, entry->size);
+    if(!UnpackAsset(pack, entry, result)) {
+      PopMemory(arena, result);
+      result = 0;
+    }
+  }
+  return result;
+}
+
+// The packer's cook of a source image, null when the pack has none for
+// these exact bytes
+static cooked_texture_header *FindCookedTexture(asset_pack *pack, asset_pack_entry *source) {
+  cooked_texture_header *result = 0;
+  char name[COOKED_TEXTURE_NAME_SIZE];
+  CookedTextureName(name, source->contentHash);
+  asset_pack_entry *entry = FindAsset(pack, name);
+  if(entry && OpenCookedTexture(&result, AssetMemory(pack, entry), entry->size) &&
+     result->sourceHash != source->contentHash) {
+    result = 0;
+  }
+  return result;
+}
+
+// The base level as a bitmap in the arena, swizzled back to 0xAARRGGBB
+static loaded_bitmap LoadCookedBitmap(cooked_texture_header *cooked, memory_arena *arena) {
+  loaded_bitmap result = {};
+  cooked_texture_mip *mip = &cooked->mips[0];
+  size_t pixelsSize = (size_t) mip->width * mip->height * 4;
+  if(pixelsSize <= ArenaRemaining(arena)) {
+    result.width = (int) mip->width;
+    result.height = (int) mip->height;
+    result.pitch = result.width * 4;
+    result.memory = PushSize(arena, pixelsSize);
+    ConvertImage(
+      PixelConversion_SwizzleRB, result.memory, result.pitch, CookedTextureMip(cooked, 0), mip->rowPitch,
+      result.width, result.height, false
+    );
+  }
+  return result;
+}
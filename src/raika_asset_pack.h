@@ -0,0 +1,374 @@
+#if !defined(RAIKA_ASSET_PACK_H)
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Asset packs
+// Every asset the game ships in one file, so startup is one open and a
+// mapping instead of a directory walk. The file starts with a header, then
+// an open addressed hash table of entry indices, the entries and their
+// names; the blobs follow. Blobs start on 4KB pages, or 64KB boundaries
+// once they are that big, so each can be mapped, prefetched or read with
+// direct IO on its own. A blob may be LZ4 block compressed when that saves
+// enough to be worth decoding. Everything is little endian.
+//
+// raika_packer builds packs from the build scripts, and the game layer
+// looks assets up with raika_asset_pack.cpp.
+// Where the build scripts put the game's pack, beside the executables
+#define ASSET_PACK_FILENAME "assets.pak"
+#define ASSET_PACK_MAGIC 0x4B415052 // "RPAK"
+#define ASSET_PACK_VERSION 2
+#define ASSET_PACK_PAGE (4 * 1024)
+#define ASSET_PACK_LARGE_PAGE (64 * 1024)
+
+enum asset_compression {
+  AssetCompression_None,
+  AssetCompression_LZ4,
+};
+
+struct asset_pack_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entryCount;
+  // A power of two at least twice entryCount
+  uint32_t slotCount;
+  // All from the start of the file
+  uint64_t slotsOffset;
+  uint64_t entriesOffset;
+  uint64_t namesOffset;
+  uint64_t fileSize;
+};
+
+struct asset_pack_entry {
+  uint64_t nameHash;
+  uint64_t offset;
+  // Once decompressed
+  uint64_t size;
+  // In the file, size when stored as is
+  uint64_t storedSize;
+  // From namesOffset, null terminated
+  uint32_t nameOffset;
+  uint32_t nameLength;
+  uint32_t compression;
+  uint32_t reserved;
+  // Of the decompressed bytes, which is what cooked assets are keyed on
+  uint64_t contentHash;
+};
+
+// FNV-1a
+inline uint64_t AssetContentHash(const void *memory, uint64_t size) {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for(uint64_t i = 0; i < size; ++i) {
+    hash = (hash ^ ((const uint8_t *) memory)[i]) * 0x100000001B3ull;
+  }
+  return hash;
+}
+
+// Slots hold an entry index plus one, zero when empty, and probe linearly
+// from the name's hash
+inline uint64_t AssetNameHash(const char *name, uint64_t length) {
+  return AssetContentHash(name, length);
+}
+
+inline uint64_t AssetPackAlignment(uint64_t size) {
+  return size >= ASSET_PACK_LARGE_PAGE ? ASSET_PACK_LARGE_PAGE : ASSET_PACK_PAGE;
+}
+
+// LZ4 blocks
+// Sequences of a token, literals and a match back into what was already
+// decoded. The token's high nibble is the literal count and its low nibble
+// the match length less four; 15 in either means more follows as bytes
+// added on until one is under 255. Matches reach back at most 64KB. The last
+// five bytes are always literals and the last match starts at least twelve
+// bytes from the end, which is what lets other decoders copy in wide
+// chunks, so blocks from here decode anywhere LZ4 does.
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_BITS 16
+
+inline uint32_t LZ4Read32(uint8_t *at) {
+  uint32_t result;
+  memcpy(&result, at, sizeof(result));
+  return result;
+}
+
+inline uint32_t LZ4Hash(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+static uint8_t *LZ4WriteLength(uint8_t *out, uint8_t *outEnd, uint64_t length) {
+  for(; length >= 255; length -= 255) {
+    if(out >= outEnd) {
+      return 0;
+    }
+    *out++ = 255;
+  }
+  if(out >= outEnd) {
+    return 0;
+  }
+  *out++ = (uint8_t) length;
+  return out;
+}
+
+static uint8_t *LZ4WriteSequence(uint8_t *out, uint8_t *outEnd, uint8_t *literals, uint64_t literalCount,
+                                 uint32_t offset, uint64_t matchLength) {
+  if(out >= outEnd) {
+    return 0;
+  }
+  uint8_t *token = out++;
+  *token = (uint8_t) ((literalCount >= 15 ? 15 : literalCount) << 4);
+  if(literalCount >= 15) {
+    out = LZ4WriteLength(out, outEnd, literalCount - 15);
+  }
+  if(!out || (uint64_t) (outEnd - out) < literalCount) {
+    return 0;
+  }
+  memcpy(out, literals, literalCount);
+  out += literalCount;
+  if(matchLength) {
+    if(outEnd - out < 2) {
+      return 0;
+    }
+    *out++ = (uint8_t) offset;
+    *out++ = (uint8_t) (offset >> 8);
+    uint64_t length = matchLength - LZ4_MIN_MATCH;
+    *token |= (uint8_t) (length >= 15 ? 15 : length);
+    if(length >= 15) {
+      out = LZ4WriteLength(out, outEnd, length - 15);
+    }
+  }
+  return out;
+}
+
+// Greedy, one candidate per hash, which is most of LZ4's own fast mode.
+// table has 1 << LZ4_HASH_BITS entries and size must be under 4GB. Returns
+// the compressed size, or zero when it would not fit in capacity bytes.
+static uint64_t CompressLZ4(void *source, uint64_t size, void *dest, uint64_t capacity, uint32_t *table) {
+  uint8_t *base = (uint8_t *) source;
+  uint8_t *in = base;
+  uint8_t *end = base + size;
+  uint8_t *literals = base;
+  uint8_t *out = (uint8_t *) dest;
+  uint8_t *outEnd = out + capacity;
+  memset(table, 0xFF, sizeof(uint32_t) << LZ4_HASH_BITS);
+  if(size > LZ4_MATCH_LIMIT) {
+    uint8_t *matchLimit = end - LZ4_MATCH_LIMIT;
+    uint8_t *lengthLimit = end - LZ4_LAST_LITERALS;
+    while(in < matchLimit) {
+      uint32_t sequence = LZ4Read32(in);
+      uint32_t *slot = &table[LZ4Hash(sequence)];
+      uint32_t candidate = *slot;
+      *slot = (uint32_t) (in - base);
+      if(candidate == 0xFFFFFFFF || (uint64_t) (in - base) - candidate > LZ4_MAX_OFFSET ||
+         LZ4Read32(base + candidate) != sequence) {
+        ++in;
+        continue;
+      }
+      uint8_t *match = base + candidate;
+      uint64_t length = LZ4_MIN_MATCH;
+      while(in + length < lengthLimit && in[length] == match[length]) {
+        ++length;
+      }
+      // Grow the match back over literals that also agree
+      while(in > literals && match > base && in[-1] == match[-1]) {
+        --in;
+        --match;
+        ++length;
+      }
+      out = LZ4WriteSequence(out, outEnd, literals, in - literals, (uint32_t) (in - match), length);
+      if(!out) {
+        return 0;
+      }
+      in += length;
+      literals = in;
+      if(in < matchLimit) {
+        table[LZ4Hash(LZ4Read32(in - 2))] = (uint32_t) (in - 2 - base);
+      }
+    }
+  }
+  out = LZ4WriteSequence(out, outEnd, literals, end - literals, 0, 0);
+  return out ? (uint64_t) (out - (uint8_t *) dest) : 0;
+}
+
+// Decodes exactly size bytes. Checks every length and offset against both
+// buffers, so damaged data fails rather than reading or writing outside.
+static bool DecompressLZ4(void *source, uint64_t storedSize, void *dest, uint64_t size) {
+  uint8_t *in = (uint8_t *) source;
+  uint8_t *inEnd = in + storedSize;
+  uint8_t *outBase = (uint8_t *) dest;
+  uint8_t *out = outBase;
+  uint8_t *outEnd = out + size;
+  while(in < inEnd) {
+    uint32_t token = *in++;
+    uint64_t literalCount = token >> 4;
+    if(literalCount == 15) {
+      uint32_t more;
+      do {
+        if(in >= inEnd) {
+          return false;
+        }
+        more = *in++;
+        literalCount += more;
+      } while(more == 255);
+    }
+    if(literalCount > (uint64_t) (inEnd - in) || literalCount > (uint64_t) (outEnd - out)) {
+      return false;
+    }
+    memcpy(out, in, literalCount);
+    in += literalCount;
+    out += literalCount;
+    if(in == inEnd) {
+      // Only the last sequence has no match
+      break;
+    }
+    if(inEnd - in < 2) {
+      return false;
+    }
+    uint64_t offset = in[0] | ((uint64_t) in[1] << 8);
+    in += 2;
+    uint64_t length = (token & 15) + LZ4_MIN_MATCH;
+    if((token & 15) == 15) {
+      uint32_t more;
+      do {
+        if(in >= inEnd) {
+          return false;
+        }
+        more = *in++;
+        length += more;
+      } while(more == 255);
+    }
+    if(!offset || offset > (uint64_t) (out - outBase) || length > (uint64_t) (outEnd - out)) {
+      return false;
+    }
+    uint8_t *match = out - offset;
+    if(offset >= length) {
+      memcpy(out, match, length);
+      out += length;
+    } else {
+      // Overlapping, which repeats the last offset bytes
+      for(uint64_t i = 0; i < length; ++i) {
+        *out++ = match[i];
+      }
+    }
+  }
+  return out == outEnd;
+}
+
+// Building packs
+// For the packer and the bench; the game only reads them.
+struct asset_source {
+  const char *name;
+  void *memory;
+  uint64_t size;
+  // Never compressed, for assets used straight from the mapping
+  bool store;
+};
+
+// Blobs are compressed when that saves at least an eighth
+inline bool AssetWorthCompressing(uint64_t size, uint64_t storedSize) {
+  return storedSize && storedSize <= size - size / 8;
+}
+
+inline uint64_t AlignAssetOffset(uint64_t offset, uint64_t alignment) {
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+// Lays the sources out as a pack in memory from malloc, which the caller
+// frees. Fails on an empty or repeated name, or when out of memory.
+inline bool BuildAssetPack(asset_source *sources, uint32_t count, bool compress, void **result, uint64_t *resultSize) {
+  *result = 0;
+  *resultSize = 0;
+  uint32_t slotCount = 16;
+  while(slotCount < 2 * (uint64_t) count) {
+    slotCount *= 2;
+  }
+  asset_pack_header header = {};
+  header.magic = ASSET_PACK_MAGIC;
+  header.version = ASSET_PACK_VERSION;
+  header.entryCount = count;
+  header.slotCount = slotCount;
+  header.slotsOffset = sizeof(asset_pack_header);
+  header.entriesOffset = header.slotsOffset + (uint64_t) slotCount * sizeof(uint32_t);
+  header.entriesOffset = AlignAssetOffset(header.entriesOffset, 8);
+  header.namesOffset = header.entriesOffset + (uint64_t) count * sizeof(asset_pack_entry);
+
+  uint32_t *slots = (uint32_t *) calloc(slotCount, sizeof(uint32_t));
+  asset_pack_entry *entries = (asset_pack_entry *) calloc(count ? count : 1, sizeof(asset_pack_entry));
+  void **stored = (void **) calloc(count ? count : 1, sizeof(void *));
+  uint32_t *table = (uint32_t *) malloc(sizeof(uint32_t) << LZ4_HASH_BITS);
+  bool ok = slots && entries && stored && table;
+
+  // Names first, so the blobs can start after them
+  uint64_t namesSize = 0;
+  for(uint32_t i = 0; ok && i < count; ++i) {
+    uint64_t nameLength = strlen(sources[i].name);
+    asset_pack_entry *entry = &entries[i];
+    entry->nameHash = AssetNameHash(sources[i].name, nameLength);
+    entry->nameOffset = (uint32_t) namesSize;
+    entry->nameLength = (uint32_t) nameLength;
+    namesSize += nameLength + 1;
+    ok = nameLength > 0;
+    uint32_t slot = (uint32_t) entry->nameHash & (slotCount - 1);
+    while(ok && slots[slot]) {
+      asset_pack_entry *other = &entries[slots[slot] - 1];
+      ok = other->nameHash != entry->nameHash || strcmp(sources[slots[slot] - 1].name, sources[i].name) != 0;
+      slot = (slot + 1) & (slotCount - 1);
+    }
+    slots[slot] = i + 1;
+  }
+
+  uint64_t offset = header.namesOffset + namesSize;
+  for(uint32_t i = 0; ok && i < count; ++i) {
+    asset_pack_entry *entry = &entries[i];
+    entry->size = sources[i].size;
+    entry->storedSize = sources[i].size;
+    entry->compression = AssetCompression_None;
+    entry->contentHash = AssetContentHash(sources[i].memory, sources[i].size);
+    stored[i] = sources[i].memory;
+    if(compress && !sources[i].store && sources[i].size > LZ4_MATCH_LIMIT && sources[i].size < 0xFFFFFFFF) {
+      void *compressed = malloc(sources[i].size);
+      uint64_t compressedSize = compressed ?
+        CompressLZ4(sources[i].memory, sources[i].size, compressed, sources[i].size, table) : 0;
+      if(AssetWorthCompressing(sources[i].size, compressedSize)) {
+        entry->storedSize = compressedSize;
+        entry->compression = AssetCompression_LZ4;
+        stored[i] = compressed;
+      } else {
+        free(compressed);
+      }
+    }
+    entry->offset = AlignAssetOffset(offset, AssetPackAlignment(entry->storedSize));
+    offset = entry->offset + entry->storedSize;
+  }
+  header.fileSize = offset;
+
+  uint8_t *pack = ok ? (uint8_t *) calloc(1, header.fileSize) : 0;
+  if(pack) {
+    memcpy(pack, &header, sizeof(header));
+    memcpy(pack + header.slotsOffset, slots, (uint64_t) slotCount * sizeof(uint32_t));
+    memcpy(pack + header.entriesOffset, entries, (uint64_t) count * sizeof(asset_pack_entry));
+    for(uint32_t i = 0; i < count; ++i) {
+      memcpy(pack + header.namesOffset + entries[i].nameOffset, sources[i].name, entries[i].nameLength);
+      memcpy(pack + entries[i].offset, stored[i], entries[i].storedSize);
+    }
+    *result = pack;
+    *resultSize = header.fileSize;
+  }
+
+  for(uint32_t i = 0; stored && i < count; ++i) {
+    if(stored[i] != sources[i].memory) {
+      free(stored[i]);
+    }
+  }
+  free(table);
+  free(stored);
+  free(entries);
+  free(slots);
+  return pack != 0;
+}
+
+#define RAIKA_ASSET_PACK_H
+#endif
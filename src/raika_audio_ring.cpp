@@ -0,0 +1,137 @@
+// Audio ring shared by the platform layers. Include after raika.cpp and
+// raika_audio_stats.cpp.
+//
+// Single producer (the game thread, copying out what GameUpdateAndRender put
+// in sound_buffer) and single consumer (the device callback). Each side only
+// writes its own cursor and both cursors only grow, wrapping at 2^32, so no
+// locks are needed: the producer publishes writeAt after the samples land and
+// the consumer publishes readAt once it has copied them out.
+//
+// A sample here is what sound_buffer calls one: a value for every channel.
+// The game keeps the ring a fixed amount ahead of the device. When a frame
+// runs long the device eats into that lead instead of running dry, and if it
+// does run dry the callback plays silence and counts an underrun.
+
+struct audio_ring {
+  uint8_t *memory;
+  // A power of two
+  uint32_t sampleCount;
+  uint32_t sampleBytes;
+  volatile uint32_t writeAt;
+  volatile uint32_t readAt;
+
+  // Kept by the consumer, approximate from the producer's side. Underruns
+  // count from when the ring was made, the rest from the last reset.
+  volatile uint32_t reads;
+  volatile uint32_t underruns;
+  volatile uint32_t underrunSamples;
+  // Lowest fill the consumer found since the stats were last reset
+  volatile uint32_t minQueued;
+};
+
+static void MakeAudioRing(audio_ring *ring, void *memory, uint32_t sampleCount, uint32_t sampleBytes) {
+  Assert((sampleCount & (sampleCount - 1)) == 0);
+  *ring = {};
+  ring->memory = (uint8_t *) memory;
+  ring->sampleCount = sampleCount;
+  ring->sampleBytes = sampleBytes;
+  ring->minQueued = 0xFFFFFFFF;
+}
+
+inline uint32_t AudioRingQueued(audio_ring *ring) {
+  return ring->writeAt - ring->readAt;
+}
+
+// How many samples the game should make to bring the ring back up to target
+static uint32_t AudioRingRequest(audio_ring *ring, uint32_t target) {
+  target = target < ring->sampleCount ? target : ring->sampleCount;
+  uint32_t queued = AudioRingQueued(ring);
+  return queued < target ? target - queued : 0;
+}
+
+// Copies count samples to or from the ring starting at cursor, in up to two
+// pieces where it wraps
+static void CopyAudioRing(audio_ring *ring, uint32_t cursor, void *other, uint32_t count, bool toRing) {
+  uint32_t start = cursor & (ring->sampleCount - 1);
+  uint32_t first = ring->sampleCount - start;
+  first = first < count ? first : count;
+  uint8_t *ringAt = ring->memory + (size_t) start * ring->sampleBytes;
+  uint8_t *otherAt = (uint8_t *) other;
+  size_t firstBytes = (size_t) first * ring->sampleBytes;
+  size_t restBytes = (size_t) (count - first) * ring->sampleBytes;
+  if(toRing) {
+    memcpy(ringAt, otherAt, firstBytes);
+    memcpy(ring->memory, otherAt + firstBytes, restBytes);
+  } else {
+    memcpy(otherAt, ringAt, firstBytes);
+    memcpy(otherAt + firstBytes, ring->memory, restBytes);
+  }
+}
+
+// Producer. Returns how many samples fit, the rest are dropped.
+static uint32_t WriteAudioRing(audio_ring *ring, void *source, uint32_t count) {
+  uint32_t readAt = ring->readAt;
+  ReadBarrier();
+  uint32_t writeAt = ring->writeAt;
+  uint32_t space = ring->sampleCount - (writeAt - readAt);
+  count = count < space ? count : space;
+  CopyAudioRing(ring, writeAt, source, count, true);
+  WriteBarrier();
+  ring->writeAt = writeAt + count;
+  return count;
+}
+
+// Consumer. Always fills count samples, with silence past what was queued.
+static void ReadAudioRing(audio_ring *ring, void *dest, uint32_t count) {
+  uint32_t writeAt = ring->writeAt;
+  ReadBarrier();
+  uint32_t readAt = ring->readAt;
+  uint32_t queued = writeAt - readAt;
+  uint32_t available = queued < count ? queued : count;
+  CopyAudioRing(ring, readAt, dest, available, false);
+  if(available < count) {
+    memset((uint8_t *) dest + (size_t) available * ring->sampleBytes, 0, (size_t) (count - available) * ring->sampleBytes);
+    ++ring->underruns;
+    ring->underrunSamples += count - available;
+  }
+  ++ring->reads;
+  if(queued < ring->minQueued) {
+    ring->minQueued = queued;
+  }
+  WriteBarrier();
+  ring->readAt = readAt + available;
+}
+
+static void ResetAudioRingStats(audio_ring *ring) {
+  ring->reads = 0;
+  ring->minQueued = 0xFFFFFFFF;
+}
+
+static void FormatAudioRingStats(audio_ring *ring, int samplesPerSecond, char *out, int outSize) {
+  double msPerSample = 1000.0 / (samplesPerSecond ? samplesPerSecond : 1);
+  uint32_t minQueued = ring->reads ? ring->minQueued : AudioRingQueued(ring);
+  snprintf(
+    out, outSize, "  audio queued %6.1fms (min %6.1fms) over %u reads, %u underruns so far (%u samples)\n",
+    AudioRingQueued(ring) * msPerSample, minQueued * msPerSample,
+    ring->reads, ring->underruns, ring->underrunSamples
+  );
+}
+
+// Picks up what the device thread counted since the last call. The ring only
+// advances by what it had, so underrun silence is added back in for the
+// clock.
+static void RecordAudioRing(audio_recorder *recorder, audio_ring *ring, double wallSeconds) {
+  uint32_t readAt = ring->readAt;
+  uint32_t underruns = ring->underruns;
+  uint32_t underrunSamples = ring->underrunSamples;
+  uint32_t newUnderruns = underruns - recorder->ringUnderruns;
+  uint32_t newUnderrunSamples = underrunSamples - recorder->ringUnderrunSamples;
+  if(newUnderruns) {
+    RecordAudioUnderruns(recorder, newUnderruns, newUnderrunSamples);
+  }
+  recorder->ringPlayed += (uint32_t) (readAt - recorder->ringReadAt) + newUnderrunSamples;
+  recorder->ringReadAt = readAt;
+  recorder->ringUnderruns = underruns;
+  recorder->ringUnderrunSamples = underrunSamples;
+  RecordAudioClock(recorder, (double) recorder->ringPlayed / recorder->stats.samplesPerSecond, wallSeconds);
+}
@@ -0,0 +1,192 @@
+// Audio stats shared by the platform layers. Include after raika.cpp.
+//
+// The platform records into an audio_recorder on the game thread once per
+// frame, around the game's fill of sound_buffer, and hands the game the
+// audio_stats inside it through sound_buffer::stats. Nothing here runs on the
+// device thread; backends behind an audio_ring pick up what that thread
+// counted with RecordAudioRing.
+//
+// Drift is the slope of a least squares fit of audio played against wall
+// time. Devices consume in bursts, so the slope between two single points
+// would swing by a burst over the time between them; the fit averages that
+// out.
+//
+// Environment:
+//   RAIKA_AUDIO_CSV=audio.csv  writes the stats as a row a second
+
+#define AUDIO_CSV_SECONDS 1.0
+// Drift is left at zero until the fit covers this much wall time
+#define AUDIO_DRIFT_MIN_SECONDS 1.0
+
+struct audio_recorder {
+  audio_stats stats;
+  bool wrote;
+
+  // The fit, relative to the first time the device had played anything
+  bool clockStarted;
+  double wallStart;
+  double audioStart;
+  double fitCount;
+  double fitWall;
+  double fitAudio;
+  double fitWallWall;
+  double fitWallAudio;
+
+  // Ring counters as of the last RecordAudioRing
+  uint32_t ringReadAt;
+  uint32_t ringUnderruns;
+  uint32_t ringUnderrunSamples;
+  uint64_t ringPlayed;
+
+  FILE *csv;
+  double csvStart;
+  double csvNext;
+};
+
+static void InitAudioRecorder(audio_recorder *recorder, int samplesPerSecond) {
+  *recorder = {};
+  recorder->stats.samplesPerSecond = samplesPerSecond;
+}
+
+inline float AudioStatsMs(audio_stats *stats, double samples) {
+  return (float) (samples * 1000.0 / (stats->samplesPerSecond ? stats->samplesPerSecond : 1));
+}
+
+// Before the game fills: how much the device still had to play
+static void RecordAudioQueued(audio_recorder *recorder, uint32_t queued) {
+  audio_stats *stats = &recorder->stats;
+  int bucket = (int) (AudioStatsMs(stats, queued) / AUDIO_STATS_BUCKET_MS);
+  bucket = bucket < AUDIO_STATS_BUCKETS ? bucket : AUDIO_STATS_BUCKETS - 1;
+  ++stats->queuedHistogram[bucket];
+  ++stats->fills;
+}
+
+// After: how far ahead of the play cursor the newest sample now is, and how
+// many of the game's samples did not fit
+static void RecordAudioWrite(audio_recorder *recorder, double aheadSamples, uint32_t dropped) {
+  audio_stats *stats = &recorder->stats;
+  float ahead = AudioStatsMs(stats, aheadSamples);
+  stats->writeAheadMs = ahead;
+  if(!recorder->wrote || ahead < stats->minWriteAheadMs) {
+    stats->minWriteAheadMs = ahead;
+  }
+  if(!recorder->wrote || ahead > stats->maxWriteAheadMs) {
+    stats->maxWriteAheadMs = ahead;
+  }
+  recorder->wrote = true;
+  if(dropped) {
+    ++stats->overruns;
+    stats->overrunSamples += dropped;
+  }
+}
+
+static void RecordAudioUnderruns(audio_recorder *recorder, uint32_t count, uint64_t samples) {
+  recorder->stats.underruns += count;
+  recorder->stats.underrunSamples += samples;
+}
+
+// The device had played audioSeconds by wallSeconds, both from any origin
+static void RecordAudioClock(audio_recorder *recorder, double audioSeconds, double wallSeconds) {
+  if(!recorder->clockStarted) {
+    if(audioSeconds > 0) {
+      recorder->clockStarted = true;
+      recorder->wallStart = wallSeconds;
+      recorder->audioStart = audioSeconds;
+    }
+    return;
+  }
+  double x = wallSeconds - recorder->wallStart;
+  double y = audioSeconds - recorder->audioStart;
+  recorder->fitCount += 1;
+  recorder->fitWall += x;
+  recorder->fitAudio += y;
+  recorder->fitWallWall += x * x;
+  recorder->fitWallAudio += x * y;
+
+  audio_stats *stats = &recorder->stats;
+  stats->clockSeconds = x;
+  double n = recorder->fitCount;
+  double spread = n * recorder->fitWallWall - recorder->fitWall * recorder->fitWall;
+  if(x >= AUDIO_DRIFT_MIN_SECONDS && spread > 0) {
+    double slope = (n * recorder->fitWallAudio - recorder->fitWall * recorder->fitAudio) / spread;
+    stats->driftPpm = (float) ((slope - 1.0) * 1e6);
+  }
+}
+
+// Upper edge of the bucket holding fraction of the fills, in ms
+static int AudioQueuedPercentileMs(audio_stats *stats, double fraction) {
+  uint32_t target = (uint32_t) (stats->fills * fraction);
+  uint32_t seen = 0;
+  for(int i = 0; i < AUDIO_STATS_BUCKETS; ++i) {
+    seen += stats->queuedHistogram[i];
+    if(seen > target) {
+      return (i + 1) * AUDIO_STATS_BUCKET_MS;
+    }
+  }
+  return AUDIO_STATS_BUCKETS * AUDIO_STATS_BUCKET_MS;
+}
+
+static void FormatAudioStats(audio_stats *stats, char *out, int outSize) {
+  snprintf(
+    out, outSize,
+    "  audio ahead %5.1fms (%5.1f to %5.1f), queued p50 <%dms p1 <%dms, "
+    "%u underruns (%llu samples), %u overruns (%llu samples), drift %+.1fppm over %.0fs\n",
+    stats->writeAheadMs, stats->minWriteAheadMs, stats->maxWriteAheadMs,
+    AudioQueuedPercentileMs(stats, 0.5), AudioQueuedPercentileMs(stats, 0.01),
+    stats->underruns, (unsigned long long) stats->underrunSamples,
+    stats->overruns, (unsigned long long) stats->overrunSamples,
+    stats->driftPpm, stats->clockSeconds
+  );
+}
+
+// Opens the file RAIKA_AUDIO_CSV names, if it is set
+static void OpenAudioCsv(audio_recorder *recorder, double wallSeconds) {
+  char *path = getenv("RAIKA_AUDIO_CSV");
+  if(!path || !*path) {
+    return;
+  }
+  recorder->csv = fopen(path, "w");
+  if(!recorder->csv) {
+    return;
+  }
+  recorder->csvStart = wallSeconds;
+  recorder->csvNext = wallSeconds;
+  fprintf(
+    recorder->csv,
+    "seconds,fills,underruns,underrun_samples,overruns,overrun_samples,"
+    "write_ahead_ms,min_write_ahead_ms,max_write_ahead_ms,drift_ppm"
+  );
+  for(int i = 0; i < AUDIO_STATS_BUCKETS; ++i) {
+    fprintf(recorder->csv, ",queued_%dms", i * AUDIO_STATS_BUCKET_MS);
+  }
+  fprintf(recorder->csv, "\n");
+}
+
+// Call every frame, writes a row once AUDIO_CSV_SECONDS have passed. Every
+// column counts from when the device opened.
+static void WriteAudioCsv(audio_recorder *recorder, double wallSeconds) {
+  if(!recorder->csv || wallSeconds < recorder->csvNext) {
+    return;
+  }
+  recorder->csvNext = wallSeconds + AUDIO_CSV_SECONDS;
+  audio_stats *stats = &recorder->stats;
+  fprintf(
+    recorder->csv, "%.3f,%u,%u,%llu,%u,%llu,%.2f,%.2f,%.2f,%.2f",
+    wallSeconds - recorder->csvStart, stats->fills,
+    stats->underruns, (unsigned long long) stats->underrunSamples,
+    stats->overruns, (unsigned long long) stats->overrunSamples,
+    stats->writeAheadMs, stats->minWriteAheadMs, stats->maxWriteAheadMs, stats->driftPpm
+  );
+  for(int i = 0; i < AUDIO_STATS_BUCKETS; ++i) {
+    fprintf(recorder->csv, ",%u", stats->queuedHistogram[i]);
+  }
+  fprintf(recorder->csv, "\n");
+  fflush(recorder->csv);
+}
+
+static void CloseAudioCsv(audio_recorder *recorder) {
+  if(recorder->csv) {
+    fclose(recorder->csv);
+    recorder->csv = 0;
+  }
+}
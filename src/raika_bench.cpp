@@ -0,0 +1,2534 @@
+#include "raika.cpp"
+
+#include <stdio.h>
+#include <time.h>
+
+#include "raika_work_queue.cpp"
+#include "raika_posix_file.cpp"
+#include "raika_present.cpp"
+#include "raika_file_queue.cpp"
+
+// Micro-benchmarks for the game layer kernels. No window, no audio device.
+// Usage: raika_bench [suite...]. With no arguments every suite runs.
+
+struct bench_resolution {
+  const char *name;
+  int width;
+  int height;
+};
+
+static const bench_resolution BENCH_RESOLUTIONS[] = {
+  {"720p", 1280, 720},
+  {"1080p", 1920, 1080},
+  {"4K", 3840, 2160},
+};
+
+static double BenchSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static graphics_buffer BenchAllocGraphics(int width, int height) {
+  graphics_buffer buffer = {};
+  buffer.width = width;
+  buffer.height = height;
+  buffer.pitch = width * 4;
+  buffer.memory = aligned_alloc(64, (size_t) buffer.pitch * height);
+  memset(buffer.memory, 0, (size_t) buffer.pitch * height);
+  MarkAllDirty(&buffer);
+  return buffer;
+}
+
+// Gradient
+static void BenchGradient() {
+  printf("== gradient ==\n");
+  printf("%-8s %-8s %12s %10s\n", "res", "kernel", "Mpixels/s", "ms/frame");
+  for(int r = 0; r < (int) ArrayCount(BENCH_RESOLUTIONS); ++r) {
+    bench_resolution res = BENCH_RESOLUTIONS[r];
+    graphics_buffer reference = BenchAllocGraphics(res.width, res.height);
+    graphics_buffer buffer = BenchAllocGraphics(res.width, res.height);
+    RenderGradientWith(GradientRowScalar, &reference, 37, -11);
+
+    for(int k = 0; k < GRADIENT_KERNEL_COUNT; ++k) {
+      gradient_kernel_info info = GetGradientKernel(k);
+      if(!info.kernel) {
+        continue;
+      }
+
+      RenderGradientWith(info.kernel, &buffer, 37, -11);
+      bool identical = memcmp(reference.memory, buffer.memory, (size_t) buffer.pitch * buffer.height) == 0;
+
+      // Warm up then run for a fixed wall time
+      int frames = 0;
+      RenderGradientWith(info.kernel, &buffer, 0, 0);
+      double start = BenchSeconds();
+      double elapsed = 0;
+      while(elapsed < 0.5) {
+        RenderGradientWith(info.kernel, &buffer, frames, frames);
+        ++frames;
+        elapsed = BenchSeconds() - start;
+      }
+      double pixels = (double) res.width * res.height * frames;
+      printf("%-8s %-8s %12.1f %10.3f%s\n",
+        res.name, info.name, pixels / elapsed * 1e-6, elapsed * 1000.0 / frames,
+        identical ? "" : "  MISMATCH");
+    }
+    free(reference.memory);
+    free(buffer.memory);
+  }
+}
+
+// Tiles
+static platform_work_queue benchTileQueues[4];
+
+static void BenchTiles() {
+  static const int threadCounts[] = {1, 2, 4, 8};
+  int cores = GetLogicalProcessorCount();
+  printf("== tiles == (%d logical processors)\n", cores);
+  printf("%-8s %-8s %10s %8s\n", "res", "threads", "ms/frame", "speedup");
+
+  for(int q = 0; q < (int) ArrayCount(threadCounts); ++q) {
+    MakeWorkQueue(benchTileQueues + q, threadCounts[q] - 1);
+  }
+
+  for(int r = 1; r < (int) ArrayCount(BENCH_RESOLUTIONS); ++r) {
+    bench_resolution res = BENCH_RESOLUTIONS[r];
+    graphics_buffer reference = BenchAllocGraphics(res.width, res.height);
+    graphics_buffer buffer = BenchAllocGraphics(res.width, res.height);
+    RenderGradient(&reference, 5, 9);
+    double singleThreaded = 0;
+
+    for(int q = 0; q < (int) ArrayCount(threadCounts); ++q) {
+      platform_work_queue *queue = benchTileQueues + q;
+
+      RenderGradientTiled(queue, &buffer, 5, 9);
+      PlatformCompleteAllWork(queue);
+      bool identical = memcmp(reference.memory, buffer.memory, (size_t) buffer.pitch * buffer.height) == 0;
+      ResetWorkQueueStats(queue);
+
+      int frames = 0;
+      double start = BenchSeconds();
+      double elapsed = 0;
+      while(elapsed < 0.5) {
+        RenderGradientTiled(queue, &buffer, frames, frames);
+        PlatformCompleteAllWork(queue);
+        ++frames;
+        elapsed = BenchSeconds() - start;
+      }
+      double msPerFrame = elapsed * 1000.0 / frames;
+      if(q == 0) {
+        singleThreaded = msPerFrame;
+      }
+      printf("%-8s %-8d %10.3f %7.2fx%s\n",
+        res.name, threadCounts[q], msPerFrame, singleThreaded / msPerFrame,
+        identical ? "" : "  MISMATCH");
+
+      // Per thread busy time averaged over the run
+      for(int t = 0; t <= queue->threadCount; ++t) {
+        platform_work_thread_stats *stats = queue->stats + t;
+        printf("    thread %2d: %6.1f tiles/frame %8.3f ms/frame busy\n",
+          t, (double) stats->entriesDone / frames, (double) stats->busyNanos / 1e6 / frames);
+      }
+    }
+    free(reference.memory);
+    free(buffer.memory);
+  }
+}
+
+// Raster
+// Run from the build directory so the scene texture resolves.
+static void BenchRaster() {
+  loaded_bitmap texture = ReadBitmap((char *) SCENE_TEXTURE_PATH);
+  printf("== raster == (texture %s)\n", texture.memory ? "loaded" : "missing, vertex colours");
+  printf("%-8s %-10s %10s %10s\n", "res", "path", "ms/frame", "covered");
+
+  static platform_work_queue queue;
+  static raster_scene scene;
+  static raster_scene referenceScene;
+  MakeWorkQueue(&queue, 0);
+
+  for(int r = 0; r < (int) ArrayCount(BENCH_RESOLUTIONS); ++r) {
+    bench_resolution res = BENCH_RESOLUTIONS[r];
+    graphics_buffer reference = BenchAllocGraphics(res.width, res.height);
+    graphics_buffer buffer = BenchAllocGraphics(res.width, res.height);
+    float aspect = res.width / (float) res.height;
+
+    // Gradient only, to count what the rasterizer changed
+    RenderGradient(&reference, 0, 0);
+    scene_view view = MakeSceneView(30, aspect);
+    BuildRasterScene(&referenceScene, &reference, &view, SCENE_VERTICES, SCENE_INDICES, SCENE_INDEX_COUNT, &texture);
+    RenderSceneTiled(0, &buffer, 0, 0, &referenceScene);
+    int covered = 0;
+    uint32_t *a = (uint32_t *) reference.memory;
+    uint32_t *b = (uint32_t *) buffer.memory;
+    for(int i = 0; i < res.width * res.height; ++i) {
+      covered += a[i] != b[i];
+    }
+
+    // The tiled path has to produce the same image as one big tile
+    memcpy(reference.memory, buffer.memory, (size_t) buffer.pitch * buffer.height);
+    BuildRasterScene(&scene, &buffer, &view, SCENE_VERTICES, SCENE_INDICES, SCENE_INDEX_COUNT, &texture);
+    RenderSceneTiled(&queue, &buffer, 0, 0, &scene);
+    PlatformCompleteAllWork(&queue);
+    bool identical = memcmp(reference.memory, buffer.memory, (size_t) buffer.pitch * buffer.height) == 0;
+
+    for(int pass = 0; pass < 2; ++pass) {
+      int frames = 0;
+      double start = BenchSeconds();
+      double elapsed = 0;
+      while(elapsed < 0.5) {
+        view = MakeSceneView(frames, aspect);
+        BuildRasterScene(&scene, &buffer, &view, SCENE_VERTICES, SCENE_INDICES, SCENE_INDEX_COUNT, &texture);
+        if(pass == 0) {
+          RenderGradientTiled(&queue, &buffer, 0, 0);
+        } else {
+          RenderSceneTiled(&queue, &buffer, 0, 0, &scene);
+        }
+        PlatformCompleteAllWork(&queue);
+        ++frames;
+        elapsed = BenchSeconds() - start;
+      }
+      printf("%-8s %-10s %10.3f %10d%s\n",
+        res.name, pass == 0 ? "gradient" : "gradient+cube", elapsed * 1000.0 / frames, covered,
+        (pass == 1 && !identical) ? "  TILE MISMATCH" : "");
+    }
+    free(reference.memory);
+    free(buffer.memory);
+  }
+
+  // Overfilling a scene keeps the first triangles and counts the rest
+  graphics_buffer buffer = BenchAllocGraphics(BENCH_RESOLUTIONS[0].width, BENCH_RESOLUTIONS[0].height);
+  scene_view view = MakeSceneView(30, buffer.width / (float) buffer.height);
+  BuildRasterScene(&referenceScene, &buffer, &view, SCENE_VERTICES, SCENE_INDICES, SCENE_INDEX_COUNT, &texture);
+  int meshTriangles = referenceScene.triangleCount;
+  int meshCount = RASTER_MAX_TRIANGLES / meshTriangles + 2;
+  BeginRasterScene(&scene, buffer.width, buffer.height);
+  for(int i = 0; i < meshCount; ++i) {
+    PushRasterMesh(&scene, view.proj * view.view * view.model, SCENE_VERTICES, SCENE_INDICES, SCENE_INDEX_COUNT, &texture);
+  }
+  RenderSceneTiled(&queue, &buffer, 0, 0, &scene);
+  PlatformCompleteAllWork(&queue);
+  printf("%d triangles pushed, %d kept, %d dropped%s\n", meshCount * meshTriangles, scene.triangleCount,
+    scene.droppedTriangleCount,
+    (scene.triangleCount == RASTER_MAX_TRIANGLES &&
+     scene.droppedTriangleCount == meshCount * meshTriangles - RASTER_MAX_TRIANGLES) ? "" : "  MISMATCH");
+  free(buffer.memory);
+}
+
+// Dirty
+// Full redraws against redrawing only where the cube was and is, the way
+// GameUpdateAndRender does while the background holds still.
+static void BenchDirty() {
+  loaded_bitmap texture = ReadBitmap((char *) SCENE_TEXTURE_PATH);
+  printf("== dirty ==\n");
+  printf("%-8s %-6s %10s %14s\n", "res", "mode", "ms/frame", "KB/frame");
+
+  static platform_work_queue queue;
+  static raster_scene scene;
+  MakeWorkQueue(&queue, 0);
+
+  for(int r = 0; r < (int) ArrayCount(BENCH_RESOLUTIONS); ++r) {
+    bench_resolution res = BENCH_RESOLUTIONS[r];
+    graphics_buffer reference = BenchAllocGraphics(res.width, res.height);
+    graphics_buffer buffer = BenchAllocGraphics(res.width, res.height);
+    float aspect = res.width / (float) res.height;
+    bool identical = true;
+
+    for(int pass = 0; pass < 2; ++pass) {
+      present_stats stats = {};
+      graphics_rect lastBounds = {};
+      MarkAllDirty(&buffer);
+      int frames = 0;
+      double start = BenchSeconds();
+      double elapsed = 0;
+      while(elapsed < 0.5) {
+        scene_view view = MakeSceneView(frames, aspect);
+        BuildRasterScene(&scene, &buffer, &view, SCENE_VERTICES, SCENE_INDICES, SCENE_INDEX_COUNT, &texture);
+        graphics_rect bounds = RasterSceneBounds(&scene);
+        if(pass == 0 || frames == 0) {
+          MarkAllDirty(&buffer);
+        } else {
+          buffer.dirtyRectCount = 0;
+          MarkDirty(&buffer, lastBounds);
+          MarkDirty(&buffer, bounds);
+        }
+        lastBounds = bounds;
+        RenderSceneTiled(&queue, &buffer, 0, 0, &scene);
+        PlatformCompleteAllWork(&queue);
+        RecordPresent(&stats, &buffer);
+        ++frames;
+        elapsed = BenchSeconds() - start;
+      }
+
+      // Redraw the final frame in full, the partial updates must match it
+      if(pass == 1) {
+        memcpy(reference.memory, buffer.memory, (size_t) buffer.pitch * buffer.height);
+        MarkAllDirty(&buffer);
+        RenderSceneTiled(&queue, &buffer, 0, 0, &scene);
+        PlatformCompleteAllWork(&queue);
+        identical = memcmp(reference.memory, buffer.memory, (size_t) buffer.pitch * buffer.height) == 0;
+      }
+      printf("%-8s %-6s %10.3f %14.1f%s\n",
+        res.name, pass == 0 ? "full" : "dirty", elapsed * 1000.0 / frames,
+        (double) stats.bytesPresented / stats.frames / 1024.0,
+        (pass == 1 && !identical) ? "  MISMATCH" : "");
+    }
+    free(reference.memory);
+    free(buffer.memory);
+  }
+}
+
+// Sprites
+// 32x32 discs with a soft edge, so a sprite has opaque, blended and fully
+// transparent pixels, drawn at 1080p.
+#define BENCH_SPRITE_COUNT 4096
+
+struct bench_sprite_case {
+  const char *name;
+  int scale;
+  bool opaque;
+  bool clipped;
+};
+
+static loaded_bitmap BenchMakeSprite() {
+  loaded_bitmap result = {};
+  result.width = 32;
+  result.height = 32;
+  result.pitch = result.width * 4;
+  result.memory = malloc((size_t) result.pitch * result.height);
+  uint32_t *pixel = (uint32_t *) result.memory;
+  for(int y = 0; y < result.height; ++y) {
+    for(int x = 0; x < result.width; ++x) {
+      float dx = x - 15.5f, dy = y - 15.5f;
+      float edge = (16.0f - sqrtf(dx * dx + dy * dy)) / 4.0f;
+      uint32_t alpha = edge <= 0 ? 0 : edge >= 1 ? 255 : (uint32_t) (edge * 255.0f);
+      *pixel++ = (alpha << 24) | ((x * 8) << 16) | ((y * 8) << 8) | 0x80;
+    }
+  }
+  PremultiplyBitmap(&result);
+  return result;
+}
+
+static void BenchDrawSprites(
+    sprite_row_kernel *kernel,
+    graphics_buffer *buffer,
+    loaded_bitmap *sprite,
+    bench_sprite_case *test,
+    uint32_t seed
+) {
+  graphics_rect clip = {0, 0, buffer->width, buffer->height};
+  int size = sprite->width * test->scale;
+  for(int i = 0; i < BENCH_SPRITE_COUNT; ++i) {
+    seed = seed * 1664525 + 1013904223;
+    int x, y;
+    if(test->clipped) {
+      // Every sprite straddles an edge of the buffer
+      x = (seed >> 8) % (buffer->width + size) - size + size / 2;
+      y = (i & 1) ? -size / 2 : buffer->height - size / 2;
+      if(i & 2) {
+        int t = x * buffer->height / buffer->width;
+        x = y * buffer->width / buffer->height;
+        y = t;
+      }
+    } else {
+      x = (seed >> 8) % (buffer->width - size);
+      y = (seed >> 20) % (buffer->height - size);
+    }
+    DrawSpriteWith(kernel, buffer, clip, sprite, x, y, test->scale);
+  }
+}
+
+static void BenchSprites() {
+  static bench_sprite_case cases[] = {
+    {"opaque", 1, true, false},
+    {"alpha", 1, false, false},
+    {"clipped", 1, false, true},
+    {"alpha x2", 2, false, false},
+  };
+  printf("== sprites == (%d 32x32 sprites per frame, 1080p)\n", BENCH_SPRITE_COUNT);
+  printf("%-10s %-8s %10s %12s\n", "case", "kernel", "ms/frame", "Mpixels/s");
+
+  loaded_bitmap sprite = BenchMakeSprite();
+  graphics_buffer reference = BenchAllocGraphics(1920, 1080);
+  graphics_buffer buffer = BenchAllocGraphics(1920, 1080);
+
+  for(int c = 0; c < (int) ArrayCount(cases); ++c) {
+    bench_sprite_case *test = cases + c;
+    RenderGradient(&reference, 0, 0);
+    BenchDrawSprites(test->opaque ? SpriteRowCopy : SpriteRowBlendScalar, &reference, &sprite, test, 1);
+
+    for(int k = 0; k < SPRITE_KERNEL_COUNT; ++k) {
+      sprite_kernel_info info = GetSpriteBlendKernel(k);
+      if(test->opaque) {
+        if(k > 0) {
+          break;
+        }
+        info.name = "copy";
+        info.kernel = SpriteRowCopy;
+      }
+      if(!info.kernel) {
+        continue;
+      }
+
+      RenderGradient(&buffer, 0, 0);
+      BenchDrawSprites(info.kernel, &buffer, &sprite, test, 1);
+      bool identical = memcmp(reference.memory, buffer.memory, (size_t) buffer.pitch * buffer.height) == 0;
+
+      int frames = 0;
+      double start = BenchSeconds();
+      double elapsed = 0;
+      while(elapsed < 0.5) {
+        BenchDrawSprites(info.kernel, &buffer, &sprite, test, frames + 1);
+        ++frames;
+        elapsed = BenchSeconds() - start;
+      }
+      double pixels = (double) BENCH_SPRITE_COUNT * 32 * 32 * test->scale * test->scale * frames;
+      printf("%-10s %-8s %10.3f %12.1f%s\n",
+        test->name, info.name, elapsed * 1000.0 / frames, pixels / elapsed * 1e-6,
+        identical ? "" : "  MISMATCH");
+    }
+  }
+  free(sprite.memory);
+  free(reference.memory);
+  free(buffer.memory);
+}
+
+// Commands
+// A frame pushed as render commands and drawn by the software backend,
+// against drawing the same thing directly.
+static void BenchPushFrame(
+    render_commands *commands,
+    scene_view *view,
+    render_mesh *mesh,
+    loaded_bitmap *sprite,
+    graphics_buffer *buffer
+) {
+  ResetRenderCommands(commands);
+  PushGradient(commands, 0, 3, 7);
+  PushCamera(commands, 1, view->view, view->proj);
+  PushMesh(commands, 1, mesh, view->model);
+  uint32_t seed = 1;
+  for(int i = 0; i < BENCH_SPRITE_COUNT; ++i) {
+    seed = seed * 1664525 + 1013904223;
+    PushSprite(
+      commands, 2, sprite,
+      (seed >> 8) % (buffer->width - sprite->width), (seed >> 20) % (buffer->height - sprite->height), 1
+    );
+  }
+}
+
+static void BenchCommands() {
+  loaded_bitmap texture = ReadBitmap((char *) SCENE_TEXTURE_PATH);
+  loaded_bitmap sprite = BenchMakeSprite();
+  render_mesh mesh = {SCENE_VERTICES, SCENE_VERTEX_COUNT, SCENE_INDICES, SCENE_INDEX_COUNT, &texture};
+  printf("== commands == (gradient, cube and %d sprites at 1080p)\n", BENCH_SPRITE_COUNT);
+  printf("%-16s %10s\n", "path", "ms/frame");
+
+  static platform_work_queue queue;
+  static raster_scene scene;
+  MakeWorkQueue(&queue, 0);
+  render_commands commands = MakeRenderCommands(malloc(RENDER_PUSH_BUFFER_SIZE), RENDER_PUSH_BUFFER_SIZE);
+  graphics_buffer reference = BenchAllocGraphics(1920, 1080);
+  graphics_buffer buffer = BenchAllocGraphics(1920, 1080);
+  scene_view view = MakeSceneView(30, 1920 / 1080.0f);
+
+  // Direct: the scene through the tiles, then the sprites in push order
+  BuildRasterScene(&scene, &reference, &view, SCENE_VERTICES, SCENE_INDICES, SCENE_INDEX_COUNT, &texture);
+  RenderSceneTiled(&queue, &reference, 3, 7, &scene);
+  PlatformCompleteAllWork(&queue);
+  uint32_t seed = 1;
+  for(int i = 0; i < BENCH_SPRITE_COUNT; ++i) {
+    seed = seed * 1664525 + 1013904223;
+    DrawSprite(
+      &reference, &sprite,
+      (seed >> 8) % (reference.width - sprite.width), (seed >> 20) % (reference.height - sprite.height), 1
+    );
+  }
+
+  BenchPushFrame(&commands, &view, &mesh, &sprite, &buffer);
+  SoftwareRenderCommands(&queue, &buffer, &commands);
+  PlatformCompleteAllWork(&queue);
+  bool identical = memcmp(reference.memory, buffer.memory, (size_t) buffer.pitch * buffer.height) == 0;
+
+  static const char *passNames[] = {"direct", "push+sort", "push+sort+draw"};
+  for(int pass = 0; pass < (int) ArrayCount(passNames); ++pass) {
+    int frames = 0;
+    double start = BenchSeconds();
+    double elapsed = 0;
+    while(elapsed < 0.5) {
+      if(pass == 0) {
+        BuildRasterScene(&scene, &buffer, &view, SCENE_VERTICES, SCENE_INDICES, SCENE_INDEX_COUNT, &texture);
+        RenderSceneTiled(&queue, &buffer, 3, 7, &scene);
+        PlatformCompleteAllWork(&queue);
+        seed = 1;
+        for(int i = 0; i < BENCH_SPRITE_COUNT; ++i) {
+          seed = seed * 1664525 + 1013904223;
+          DrawSprite(
+            &buffer, &sprite,
+            (seed >> 8) % (buffer.width - sprite.width), (seed >> 20) % (buffer.height - sprite.height), 1
+          );
+        }
+      } else {
+        BenchPushFrame(&commands, &view, &mesh, &sprite, &buffer);
+        if(pass == 1) {
+          SortRenderCommands(&commands);
+        } else {
+          SoftwareRenderCommands(&queue, &buffer, &commands);
+          PlatformCompleteAllWork(&queue);
+        }
+      }
+      ++frames;
+      elapsed = BenchSeconds() - start;
+    }
+    printf("%-16s %10.3f%s\n",
+      passNames[pass], elapsed * 1000.0 / frames,
+      (pass == 2 && !identical) ? "  MISMATCH" : "");
+  }
+  printf("%u commands, %u bytes of command data\n", commands.commandCount, commands.pushBufferSize);
+
+  // Past the limits: a mesh run per layer, then more rects than there are steps
+  int extraRuns = 2;
+  int extraRects = 100;
+  ResetRenderCommands(&commands);
+  for(int layer = 0; layer < SOFTWARE_MAX_SCENES + extraRuns; ++layer) {
+    PushCamera(&commands, layer, view.view, view.proj);
+    PushMesh(&commands, layer, &mesh, view.model);
+  }
+  graphics_rect dot = {0, 0, 1, 1};
+  for(int i = 0; i < SOFTWARE_MAX_STEPS + extraRects; ++i) {
+    PushRect(&commands, 255, dot, 0xFFFFFFFF);
+  }
+  ResetSoftwareStats();
+  SoftwareRenderCommands(&queue, &buffer, &commands);
+  PlatformCompleteAllWork(&queue);
+  char statsText[256];
+  FormatSoftwareStats(statsText, sizeof(statsText));
+  printf("%s%s", statsText,
+    (globalSoftwareStats.droppedMeshes == (uint64_t) extraRuns &&
+     globalSoftwareStats.droppedCommands == (uint64_t) (SOFTWARE_MAX_SCENES + extraRects)) ? "" : "  MISMATCH\n");
+
+  free(commands.pushBufferBase);
+  free(sprite.memory);
+  free(reference.memory);
+  free(buffer.memory);
+}
+
+// Pixels
+// Every conversion at 1080p with each kernel level, checked against scalar.
+// Odd widths are checked too so the tails get exercised.
+#define BENCH_PIXEL_WIDTH 1920
+#define BENCH_PIXEL_HEIGHT 1080
+
+static int BenchPixelBytes(pixel_conversion conversion, bool dest) {
+  switch(conversion) {
+    case PixelConversion_ExpandRGB: return dest ? 4 : 3;
+    case PixelConversion_PackRGB565: return dest ? 2 : 4;
+    case PixelConversion_UnpackRGB565: return dest ? 4 : 2;
+    case PixelConversion_SrgbToLinear: return dest ? 16 : 4;
+    case PixelConversion_LinearToSrgb: return dest ? 4 : 16;
+    default: return 4;
+  }
+}
+
+static void BenchPixels() {
+  printf("== pixels == (%dx%d)\n", BENCH_PIXEL_WIDTH, BENCH_PIXEL_HEIGHT);
+  printf("%-10s %-8s %12s %10s\n", "convert", "kernel", "Mpixels/s", "ms/frame");
+  InitSrgbTables();
+
+  size_t pixelCount = (size_t) BENCH_PIXEL_WIDTH * BENCH_PIXEL_HEIGHT;
+  uint8_t *source = (uint8_t *) aligned_alloc(64, pixelCount * 16);
+  uint8_t *reference = (uint8_t *) aligned_alloc(64, pixelCount * 16);
+  uint8_t *dest = (uint8_t *) aligned_alloc(64, pixelCount * 16);
+
+  for(int c = 0; c < PixelConversion_Count; ++c) {
+    pixel_conversion conversion = (pixel_conversion) c;
+    int sourceBytes = BenchPixelBytes(conversion, false);
+    int destBytes = BenchPixelBytes(conversion, true);
+    uint32_t seed = 12345;
+    if(conversion == PixelConversion_LinearToSrgb) {
+      // A little outside 0..1 so the clamps are covered
+      float *values = (float *) source;
+      for(size_t i = 0; i < pixelCount * 4; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        values[i] = (seed >> 8) * (1.2f / 16777216.0f) - 0.1f;
+      }
+    } else {
+      for(size_t i = 0; i < pixelCount * sourceBytes; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        source[i] = (uint8_t) (seed >> 24);
+      }
+    }
+    pixel_row_kernel *scalar = GetPixelKernel(conversion, 0).kernel;
+    ConvertImageWith(
+      scalar, reference, BENCH_PIXEL_WIDTH * destBytes, source, BENCH_PIXEL_WIDTH * sourceBytes,
+      BENCH_PIXEL_WIDTH, BENCH_PIXEL_HEIGHT, false
+    );
+
+    for(int k = 0; k < PIXEL_KERNEL_COUNT; ++k) {
+      pixel_kernel_info info = GetPixelKernel(conversion, k);
+      if(!info.kernel) {
+        continue;
+      }
+
+      ConvertImageWith(
+        info.kernel, dest, BENCH_PIXEL_WIDTH * destBytes, source, BENCH_PIXEL_WIDTH * sourceBytes,
+        BENCH_PIXEL_WIDTH, BENCH_PIXEL_HEIGHT, false
+      );
+      bool identical = memcmp(reference, dest, pixelCount * destBytes) == 0;
+      for(int count = 1; count < 40 && identical; ++count) {
+        scalar(reference, source, count);
+        info.kernel(dest, source, count);
+        identical = memcmp(reference, dest, (size_t) count * destBytes) == 0;
+      }
+      scalar(reference, source, 40);
+
+      int frames = 0;
+      double start = BenchSeconds();
+      double elapsed = 0;
+      while(elapsed < 0.5) {
+        ConvertImageWith(
+          info.kernel, dest, BENCH_PIXEL_WIDTH * destBytes, source, BENCH_PIXEL_WIDTH * sourceBytes,
+          BENCH_PIXEL_WIDTH, BENCH_PIXEL_HEIGHT, false
+        );
+        ++frames;
+        elapsed = BenchSeconds() - start;
+      }
+      printf("%-10s %-8s %12.1f %10.3f%s\n",
+        PIXEL_CONVERSION_NAMES[c], info.name, (double) pixelCount * frames / elapsed * 1e-6,
+        elapsed * 1000.0 / frames, identical ? "" : "  MISMATCH");
+    }
+  }
+
+  // Every byte value has to survive sRGB -> linear -> sRGB
+  uint32_t ramp[256];
+  uint32_t roundTrip[256];
+  float linear[256 * 4];
+  for(uint32_t i = 0; i < 256; ++i) {
+    ramp[i] = (i << 24) | (i << 16) | (i << 8) | i;
+  }
+  ConvertImage(PixelConversion_SrgbToLinear, linear, sizeof(linear), ramp, sizeof(ramp), 256, 1, false);
+  ConvertImage(PixelConversion_LinearToSrgb, roundTrip, sizeof(roundTrip), linear, sizeof(linear), 256, 1, false);
+  printf("srgb round trip %s\n", memcmp(ramp, roundTrip, sizeof(ramp)) == 0 ? "exact" : "MISMATCH");
+
+  // A flipped copy flipped back in place is the original
+  int pitch = BENCH_PIXEL_WIDTH * 4;
+  ConvertImageWith(CopyPixelRow, dest, pitch, source, pitch, BENCH_PIXEL_WIDTH, BENCH_PIXEL_HEIGHT, true);
+  int frames = 0;
+  double start = BenchSeconds();
+  double elapsed = 0;
+  while(elapsed < 0.5) {
+    FlipImage(dest, pitch, BENCH_PIXEL_HEIGHT);
+    ++frames;
+    elapsed = BenchSeconds() - start;
+  }
+  if(frames & 1) {
+    FlipImage(dest, pitch, BENCH_PIXEL_HEIGHT);
+  }
+  FlipImage(dest, pitch, BENCH_PIXEL_HEIGHT);
+  printf("%-10s %-8s %12.1f %10.3f%s\n",
+    "flip", "memcpy", (double) pixelCount * frames / elapsed * 1e-6, elapsed * 1000.0 / frames,
+    memcmp(source, dest, pixelCount * 4) == 0 ? "" : "  MISMATCH");
+
+  free(source);
+  free(reference);
+  free(dest);
+}
+
+// Scale
+// Upscaling internal resolutions to 1080p with each kernel set, checked
+// against scalar and against the banded path the platforms use. Then a full
+// gradient and cube frame at a few render scales, drawn and upscaled, which is
+// what dynamic resolution trades between.
+struct bench_scale_source {
+  const char *name;
+  int width;
+  int height;
+};
+
+static void BenchScale() {
+  static const bench_scale_source sources[] = {
+    {"1440x810", 1440, 810},
+    {"1280x720", 1280, 720},
+    {"960x540", 960, 540},
+  };
+  static const char *filterNames[] = {"nearest", "bilinear"};
+  printf("== scale == (to 1920x1080)\n");
+  printf("%-10s %-9s %-8s %10s %12s\n", "source", "filter", "kernel", "ms/frame", "Mpixels/s");
+
+  static platform_work_queue queue;
+  MakeWorkQueue(&queue, 0);
+  graphics_buffer reference = BenchAllocGraphics(1920, 1080);
+  graphics_buffer buffer = BenchAllocGraphics(1920, 1080);
+  graphics_rect all = {0, 0, buffer.width, buffer.height};
+
+  for(int s = 0; s < (int) ArrayCount(sources); ++s) {
+    graphics_buffer source = BenchAllocGraphics(sources[s].width, sources[s].height);
+    RenderGradient(&source, 37, -11);
+    // Something with hard edges over the gradient
+    uint32_t *pixel = (uint32_t *) source.memory;
+    for(int i = 0; i < source.width * source.height; i += 7) {
+      pixel[i] = 0xFFFFFFFF;
+    }
+
+    for(int f = 0; f < (int) ArrayCount(filterNames); ++f) {
+      scale_filter filter = (scale_filter) f;
+      scale_kernels scalar = GetScaleKernels(0);
+      ScaleImageWith(&scalar, filter, &reference, &source, all);
+
+      for(int k = 0; k < SCALE_KERNEL_COUNT; ++k) {
+        scale_kernels kernels = GetScaleKernels(k);
+        if(!kernels.name) {
+          continue;
+        }
+        memset(buffer.memory, 0, (size_t) buffer.pitch * buffer.height);
+        ScaleImageWith(&kernels, filter, &buffer, &source, all);
+        bool identical = memcmp(reference.memory, buffer.memory, (size_t) buffer.pitch * buffer.height) == 0;
+
+        int frames = 0;
+        double start = BenchSeconds();
+        double elapsed = 0;
+        while(elapsed < 0.5) {
+          ScaleImageWith(&kernels, filter, &buffer, &source, all);
+          ++frames;
+          elapsed = BenchSeconds() - start;
+        }
+        printf("%-10s %-9s %-8s %10.3f %12.1f%s\n",
+          sources[s].name, filterNames[f], kernels.name, elapsed * 1000.0 / frames,
+          (double) buffer.width * buffer.height * frames / elapsed * 1e-6,
+          identical ? "" : "  MISMATCH");
+      }
+
+      // Scaling a few dirty rects in bands must match the full image there
+      memset(buffer.memory, 0, (size_t) buffer.pitch * buffer.height);
+      source.dirtyRectCount = 0;
+      graphics_rect rects[] = {{0, 0, 37, 29}, {101, 203, 317, 150}, {source.width - 50, source.height - 41, 50, 41}};
+      for(int i = 0; i < (int) ArrayCount(rects); ++i) {
+        MarkDirty(&source, rects[i]);
+      }
+      ScaleDirtyRects(&buffer, &source);
+      ScaleImageTiled(&queue, filter, &buffer, &source);
+      PlatformCompleteAllWork(&queue);
+      bool banded = true;
+      for(int i = 0; i < buffer.dirtyRectCount && banded; ++i) {
+        graphics_rect rect = buffer.dirtyRects[i];
+        for(int y = rect.y; y < rect.y + rect.height && banded; ++y) {
+          size_t offset = (size_t) y * buffer.pitch + rect.x * 4;
+          banded = memcmp((uint8_t *) reference.memory + offset, (uint8_t *) buffer.memory + offset, rect.width * 4) == 0;
+        }
+      }
+      if(!banded) {
+        printf("%-10s %-9s dirty rect bands MISMATCH\n", sources[s].name, filterNames[f]);
+      }
+    }
+    free(source.memory);
+  }
+
+  loaded_bitmap texture = ReadBitmap((char *) SCENE_TEXTURE_PATH);
+  render_mesh mesh = {SCENE_VERTICES, SCENE_VERTEX_COUNT, SCENE_INDICES, SCENE_INDEX_COUNT, &texture};
+  render_commands commands = MakeRenderCommands(malloc(RENDER_PUSH_BUFFER_SIZE), RENDER_PUSH_BUFFER_SIZE);
+  graphics_buffer internal = BenchAllocGraphics(1920, 1080);
+  // Every step dynamic resolution takes, full size first
+  static const float scales[] = {1.0f, 0.875f, 0.75f, 0.625f, 0.5f};
+  double totalMs[ArrayCount(scales)];
+  printf("%-8s %-10s %10s %10s %10s\n", "scale", "internal", "draw ms", "scale ms", "total ms");
+  for(int i = 0; i < (int) ArrayCount(scales); ++i) {
+    dynamic_resolution resolution = {};
+    resolution.scale = scales[i];
+    int width, height;
+    GetInternalResolution(&resolution, 1920, 1080, &width, &height);
+    internal.width = width;
+    internal.height = height;
+    internal.pitch = width * 4;
+    scene_view view = MakeSceneView(30, width / (float) height);
+
+    int frames = 0;
+    double drawSeconds = 0;
+    double scaleSeconds = 0;
+    double start = BenchSeconds();
+    while(BenchSeconds() - start < 0.5) {
+      double drawStart = BenchSeconds();
+      MarkAllDirty(&internal);
+      ResetRenderCommands(&commands);
+      PushGradient(&commands, 0, 3, 7);
+      PushCamera(&commands, 1, view.view, view.proj);
+      PushMesh(&commands, 1, &mesh, view.model);
+      SoftwareRenderCommands(&queue, &internal, &commands);
+      PlatformCompleteAllWork(&queue);
+      double scaleStart = BenchSeconds();
+      ScaleDirtyRects(&buffer, &internal);
+      ScaleImageTiled(&queue, ScaleFilter_Bilinear, &buffer, &internal);
+      PlatformCompleteAllWork(&queue);
+      double end = BenchSeconds();
+      drawSeconds += scaleStart - drawStart;
+      scaleSeconds += end - scaleStart;
+      ++frames;
+    }
+    char internalName[32];
+    snprintf(internalName, sizeof(internalName), "%dx%d", width, height);
+    totalMs[i] = (drawSeconds + scaleSeconds) * 1000.0 / frames;
+    printf("%-8.3f %-10s %10.3f %10.3f %10.3f\n",
+      scales[i], internalName, drawSeconds * 1000.0 / frames, scaleSeconds * 1000.0 / frames, totalMs[i]);
+  }
+
+  // Dynamic resolution fed those times with a budget nothing meets. It has
+  // to stop where a lower step stops being cheaper, not run down to the
+  // smallest.
+  dynamic_resolution resolution = MakeDynamicResolution((float) totalMs[0] * 0.5f);
+  resolution.dynamic = true;
+  for(int frame = 0; frame < 100 * RESOLUTION_SETTLE_FRAMES; ++frame) {
+    int i = 0;
+    while(i + 1 < (int) ArrayCount(scales) && scales[i] > resolution.scale + 0.001f) {
+      ++i;
+    }
+    UpdateDynamicResolution(&resolution, (float) totalMs[i]);
+  }
+  int settled = 0;
+  while(settled + 1 < (int) ArrayCount(scales) && scales[settled] > resolution.scale + 0.001f) {
+    ++settled;
+  }
+  bool cheapest = true;
+  for(int i = 0; i < settled; ++i) {
+    cheapest = cheapest && totalMs[settled] < totalMs[i];
+  }
+  printf("dynamic, %.2fms budget: settled at %.3f, %.3fms%s\n", resolution.budgetMs, resolution.scale,
+    totalMs[settled], cheapest ? "" : "  MISMATCH");
+
+  free(commands.pushBufferBase);
+  free(texture.memory);
+  free(internal.memory);
+  free(reference.memory);
+  free(buffer.memory);
+}
+
+// Fill
+// Cached against streaming stores for whole frame fills, copies and the
+// gradient, then what each leaves behind: a workload walking a table as big
+// as the cache really holds, timed right after the frame was written. Every
+// line a frame pushes out comes back from memory.
+//
+// The system's last level cache size is only a start. Under a hypervisor it
+// is the whole host's, so the table halves until a warm walk costs no more
+// than BENCH_WORKLOAD_SPILL times one through a table the size of an L2.
+//
+// Environment:
+//   RAIKA_BENCH_LLC_KB=N  starts from N KB instead
+#define BENCH_CACHE_LINE 64
+// When the system does not say
+#define BENCH_DEFAULT_LLC_BYTES (8 * 1024 * 1024)
+#define BENCH_WORKLOAD_MIN_BYTES (256 * 1024)
+#define BENCH_WORKLOAD_SPILL 3.0
+// Lines between loads, prime so the walk reaches every line once and too
+// far apart for the prefetchers to follow
+#define BENCH_WORKLOAD_STRIDE 1009
+
+static uint64_t BenchLastLevelCacheBytes() {
+  long result = 0;
+  char *kb = getenv("RAIKA_BENCH_LLC_KB");
+  if(kb && atol(kb) > 0) {
+    return (uint64_t) atol(kb) * 1024;
+  }
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+  result = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  if(result <= 0) {
+    result = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  }
+#endif
+  return result > 0 ? (uint64_t) result : BENCH_DEFAULT_LLC_BYTES;
+}
+
+// One load from each line, in an order the prefetchers cannot guess
+static uint32_t BenchWorkload(uint8_t *table, uint64_t lines) {
+  uint64_t line = 0;
+  uint32_t sum = 0;
+  for(uint64_t i = 0; i < lines; ++i) {
+    sum += *(uint32_t *) (table + line * BENCH_CACHE_LINE);
+    line += BENCH_WORKLOAD_STRIDE;
+    if(line >= lines) {
+      line -= lines;
+    }
+  }
+  return sum;
+}
+
+// Lines the walk covers at size bytes, never a multiple of the stride
+inline uint64_t BenchWorkloadLines(uint64_t size) {
+  uint64_t lines = size / BENCH_CACHE_LINE;
+  return lines % BENCH_WORKLOAD_STRIDE ? lines : lines - 1;
+}
+
+// The best of a few warm walks
+static double BenchWorkloadLineNs(uint8_t *table, uint64_t lines, uint32_t *sink) {
+  double best = 0;
+  *sink += BenchWorkload(table, lines);
+  for(int run = 0; run < 5; ++run) {
+    double start = BenchSeconds();
+    *sink += BenchWorkload(table, lines);
+    double ns = (BenchSeconds() - start) * 1e9 / lines;
+    best = run == 0 || ns < best ? ns : best;
+  }
+  return best;
+}
+
+static void BenchFillPass(int pass, fill_kernels *kernels, bool stream, graphics_buffer *dest, graphics_buffer *source, int frame) {
+  switch(pass) {
+    case 0: {
+      FillImageWith(
+        stream ? kernels->fillStream : kernels->fill,
+        dest->memory, dest->pitch, dest->width, dest->height, 0xFF000000 | frame
+      );
+    } break;
+    case 1: {
+      CopyImageWith(
+        stream ? kernels->copyStream : kernels->copy,
+        dest->memory, dest->pitch, source->memory, source->pitch, dest->width, dest->height
+      );
+    } break;
+    case 2: {
+      RenderGradientWith(stream ? PickGradientStreamKernel() : PickGradientKernel(), dest, frame, frame);
+    } break;
+  }
+  if(stream) {
+    StreamFence();
+  }
+}
+
+static void BenchFill() {
+  static const char *passNames[] = {"fill", "copy", "gradient"};
+  printf("== fill ==\n");
+  printf("%-8s %-9s %-8s %-7s %10s %10s\n", "res", "pass", "kernel", "stores", "ms/frame", "GB/s");
+
+  for(int r = 1; r < (int) ArrayCount(BENCH_RESOLUTIONS); ++r) {
+    bench_resolution res = BENCH_RESOLUTIONS[r];
+    graphics_buffer reference = BenchAllocGraphics(res.width, res.height);
+    graphics_buffer buffer = BenchAllocGraphics(res.width, res.height);
+    graphics_buffer source = BenchAllocGraphics(res.width, res.height);
+    RenderGradientWith(GradientRowScalar, &source, 37, -11);
+    size_t size = (size_t) buffer.pitch * buffer.height;
+
+    for(int p = 0; p < (int) ArrayCount(passNames); ++p) {
+      // Gradients have their own kernel suite, only compare the store kinds
+      int kernelCount = p == 2 ? 1 : FILL_KERNEL_COUNT;
+      for(int k = 0; k < kernelCount; ++k) {
+        fill_kernels kernels = p == 2 ? *PickFillKernels() : GetFillKernels(k);
+        if(!kernels.name) {
+          continue;
+        }
+        fill_kernels scalar = GetFillKernels(0);
+        BenchFillPass(p, &scalar, false, &reference, &source, 1);
+        for(int stream = 0; stream < 2; ++stream) {
+          memset(buffer.memory, 0, size);
+          BenchFillPass(p, &kernels, stream, &buffer, &source, 1);
+          bool identical = memcmp(reference.memory, buffer.memory, size) == 0;
+
+          int frames = 0;
+          double start = BenchSeconds();
+          double elapsed = 0;
+          while(elapsed < 0.5) {
+            BenchFillPass(p, &kernels, stream, &buffer, &source, frames);
+            ++frames;
+            elapsed = BenchSeconds() - start;
+          }
+          printf("%-8s %-9s %-8s %-7s %10.3f %10.2f%s\n",
+            res.name, passNames[p], p == 2 ? "picked" : kernels.name, stream ? "stream" : "cached",
+            elapsed * 1000.0 / frames, (double) size * frames / elapsed * 1e-9,
+            identical ? "" : "  MISMATCH");
+        }
+      }
+    }
+    free(reference.memory);
+    free(buffer.memory);
+    free(source.memory);
+  }
+
+  // Cache pollution. The workload alone runs with its table warm, after a
+  // cached pass the frame has pushed part of it out.
+  static const char *orderNames[] = {"alone", "cached", "stream"};
+  bench_resolution res = BENCH_RESOLUTIONS[ArrayCount(BENCH_RESOLUTIONS) - 1];
+  uint64_t llcSize = BenchLastLevelCacheBytes();
+  uint64_t tableSize = llcSize > BENCH_WORKLOAD_MIN_BYTES ? llcSize : BENCH_WORKLOAD_MIN_BYTES;
+  uint8_t *table = (uint8_t *) aligned_alloc(BENCH_CACHE_LINE, tableSize);
+  for(uint64_t i = 0; i < tableSize / sizeof(uint32_t); ++i) {
+    ((uint32_t *) table)[i] = (uint32_t) i * 2654435761u;
+  }
+  uint32_t sink = 0;
+  double cachedNs = BenchWorkloadLineNs(table, BenchWorkloadLines(BENCH_WORKLOAD_MIN_BYTES), &sink);
+  double lineNs = BenchWorkloadLineNs(table, BenchWorkloadLines(tableSize), &sink);
+  while(tableSize > BENCH_WORKLOAD_MIN_BYTES && lineNs > BENCH_WORKLOAD_SPILL * cachedNs) {
+    tableSize /= 2;
+    lineNs = BenchWorkloadLineNs(table, BenchWorkloadLines(tableSize), &sink);
+  }
+  uint64_t lines = BenchWorkloadLines(tableSize);
+  printf("workload of %lluKB at %.2f ns/line, %.2f in L2, last level cache %lluKB\n",
+    (unsigned long long) (tableSize / 1024), lineNs, cachedNs, (unsigned long long) (llcSize / 1024));
+  printf("%-8s %-9s %-7s %12s %12s\n", "res", "pass", "after", "workload ms", "pass ms");
+  graphics_buffer buffer = BenchAllocGraphics(res.width, res.height);
+  graphics_buffer source = BenchAllocGraphics(res.width, res.height);
+  for(int p = 0; p < (int) ArrayCount(passNames); ++p) {
+    for(int o = 0; o < (int) ArrayCount(orderNames); ++o) {
+      int frames = 0;
+      double passSeconds = 0;
+      double workloadSeconds = 0;
+      sink += BenchWorkload(table, lines);
+      double start = BenchSeconds();
+      while(BenchSeconds() - start < 0.5) {
+        double passStart = BenchSeconds();
+        if(o > 0) {
+          BenchFillPass(p, PickFillKernels(), o == 2, &buffer, &source, frames);
+        }
+        double workloadStart = BenchSeconds();
+        sink += BenchWorkload(table, lines);
+        double end = BenchSeconds();
+        passSeconds += workloadStart - passStart;
+        workloadSeconds += end - workloadStart;
+        ++frames;
+      }
+      printf("%-8s %-9s %-7s %12.3f %12.3f\n",
+        res.name, passNames[p], orderNames[o],
+        workloadSeconds * 1000.0 / frames, passSeconds * 1000.0 / frames);
+    }
+  }
+  // Keeps the workload from being optimised out
+  if(sink == 1) {
+    printf("\n");
+  }
+  free(table);
+  free(buffer.memory);
+  free(source.memory);
+}
+
+// Oscillators
+// A bank of oscillators rendered into one 60Hz frame of 48kHz audio with
+// each kernel, then how far the phase accumulator and the old whole sample
+// period land from the pitch asked for.
+#define BENCH_OSCILLATORS 256
+#define BENCH_AUDIO_RATE 48000
+#define BENCH_AUDIO_FRAME (BENCH_AUDIO_RATE / 60)
+
+static void BenchOscillators() {
+  static const char *interpolationNames[] = {"linear", "cubic"};
+  printf("== oscillators == (%d oscillators, %d samples per frame)\n", BENCH_OSCILLATORS, BENCH_AUDIO_FRAME);
+  printf("%-8s %-8s %10s %10s %12s\n", "interp", "kernel", "ms/frame", "% of 60Hz", "ns/sample");
+
+  static oscillator oscs[BENCH_OSCILLATORS];
+  static float reference[BENCH_AUDIO_FRAME];
+  static float out[BENCH_AUDIO_FRAME];
+  for(int i = 0; i < BENCH_OSCILLATORS; ++i) {
+    oscs[i].waveform = (oscillator_waveform) (i % Waveform_Count);
+    oscs[i].amplitude = 1.0f / BENCH_OSCILLATORS;
+    SetOscillatorFrequency(oscs + i, 55.0 * pow(2.0, (i % 96) / 12.0), BENCH_AUDIO_RATE);
+  }
+
+  for(int interp = 0; interp < Interpolation_Count; ++interp) {
+    for(int i = 0; i < BENCH_OSCILLATORS; ++i) {
+      oscs[i].interpolation = (oscillator_interpolation) interp;
+    }
+    oscillator_kernels scalar = GetOscillatorKernels(0);
+    memset(reference, 0, sizeof(reference));
+    for(int i = 0; i < BENCH_OSCILLATORS; ++i) {
+      oscillator osc = oscs[i];
+      osc.phase = i * 0x9E3779B9u;
+      RenderOscillatorWith(&scalar, &osc, reference, BENCH_AUDIO_FRAME);
+    }
+
+    for(int k = 0; k < OSCILLATOR_KERNEL_COUNT; ++k) {
+      oscillator_kernels kernels = GetOscillatorKernels(k);
+      if(!kernels.name) {
+        continue;
+      }
+      memset(out, 0, sizeof(out));
+      for(int i = 0; i < BENCH_OSCILLATORS; ++i) {
+        oscillator osc = oscs[i];
+        osc.phase = i * 0x9E3779B9u;
+        RenderOscillatorWith(&kernels, &osc, out, BENCH_AUDIO_FRAME);
+      }
+      bool identical = memcmp(reference, out, sizeof(out)) == 0;
+
+      int frames = 0;
+      double start = BenchSeconds();
+      double elapsed = 0;
+      while(elapsed < 0.5) {
+        memset(out, 0, sizeof(out));
+        for(int i = 0; i < BENCH_OSCILLATORS; ++i) {
+          RenderOscillatorWith(&kernels, oscs + i, out, BENCH_AUDIO_FRAME);
+        }
+        ++frames;
+        elapsed = BenchSeconds() - start;
+      }
+      double msPerFrame = elapsed * 1000.0 / frames;
+      printf("%-8s %-8s %10.4f %9.2f%% %12.3f%s\n",
+        interpolationNames[interp], kernels.name, msPerFrame, msPerFrame * 100.0 / (1000.0 / 60.0),
+        msPerFrame * 1e6 / ((double) BENCH_OSCILLATORS * BENCH_AUDIO_FRAME),
+        identical ? "" : "  MISMATCH");
+    }
+  }
+
+  static const int rates[] = {22050, 44100, 48000, 96000};
+  static const double pitches[] = {261.6256, 440.0, 1000.5, 4186.009, 12345.6};
+  printf("%-8s %16s %16s\n", "rate", "phase max cents", "period max cents");
+  for(int r = 0; r < (int) ArrayCount(rates); ++r) {
+    double phaseCents = 0;
+    double periodCents = 0;
+    for(int p = 0; p < (int) ArrayCount(pitches) && pitches[p] < rates[r] / 2; ++p) {
+      double actual = OscillatorFrequency(OscillatorIncrement(pitches[p], rates[r]), rates[r]);
+      double period = (double) rates[r] / (rates[r] / (int) pitches[p]);
+      double a = fabs(1200.0 * log2(actual / pitches[p]));
+      double b = fabs(1200.0 * log2(period / pitches[p]));
+      phaseCents = a > phaseCents ? a : phaseCents;
+      periodCents = b > periodCents ? b : periodCents;
+    }
+    printf("%-8d %16.6f %16.3f\n", rates[r], phaseCents, periodCents);
+  }
+}
+
+// Mixer
+// 256 voices, half oscillators and half looping samples, mixed into one
+// 60Hz frame of 48kHz 16 bit stereo. The voices and mixing run at the same
+// kernel level. Gains and pans move every frame so the ramps are exercised.
+#define BENCH_MIXER_VOICES 256
+
+static void BenchStartVoices(mixer *mix, sound_sample *sample) {
+  InitMixer(mix, BENCH_AUDIO_RATE);
+  for(int i = 0; i < BENCH_MIXER_VOICES; ++i) {
+    float pan = (i % 17) / 8.0f - 1.0f;
+    uint32_t id = (i & 1) ?
+      PlaySample(mix, sample, 1.0f / BENCH_MIXER_VOICES, pan, true) :
+      PlayOscillator(mix, (oscillator_waveform) (i % Waveform_Count), 55.0 * pow(2.0, (i % 96) / 12.0), 1.0f / BENCH_MIXER_VOICES, pan);
+    SetVoicePitch(mix, id, 0.5f + (i % 13) * 0.1f);
+  }
+}
+
+static void BenchMoveVoices(mixer *mix, int frame) {
+  for(int i = 0; i < mix->activeCount; ++i) {
+    mixer_voice *voice = mix->voices + mix->active[i];
+    voice->pan = sinf(frame * 0.1f + i);
+    voice->gain = (1.0f + 0.5f * cosf(frame * 0.07f + i)) / BENCH_MIXER_VOICES;
+  }
+}
+
+static void BenchMixer() {
+  printf("== mixer == (%d voices, %d samples of 48kHz 16 bit stereo per frame)\n", BENCH_MIXER_VOICES, BENCH_AUDIO_FRAME);
+  printf("%-8s %10s %10s %12s\n", "kernel", "ms/frame", "% of 60Hz", "ns/sample");
+
+  static float sampleData[4801];
+  for(int i = 0; i < (int) ArrayCount(sampleData); ++i) {
+    sampleData[i] = sinf(i * 0.05f) * (1.0f - i / (float) ArrayCount(sampleData));
+  }
+  sound_sample sample = {sampleData, ArrayCount(sampleData), 44100};
+
+  static mixer mix;
+  static int16_t reference[BENCH_AUDIO_FRAME * 2];
+  static int16_t out[BENCH_AUDIO_FRAME * 2];
+  sound_buffer buffer = {};
+  buffer.samplesPerSecond = BENCH_AUDIO_RATE;
+  buffer.samplesRequested = BENCH_AUDIO_FRAME;
+  buffer.bytesPerSample = 2;
+  buffer.channels = 2;
+
+  for(int k = 0; k < MIX_KERNEL_COUNT; ++k) {
+    mix_kernels kernels = GetMixKernels(k);
+    oscillator_kernels oscKernels = GetOscillatorKernels(k);
+    resample_kernels resampleKernels = GetResampleKernels(k);
+    effect_kernels effectKernels = GetEffectKernels(k);
+    if(!kernels.name || !oscKernels.name || !resampleKernels.name || !effectKernels.name) {
+      continue;
+    }
+
+    // A few frames from the same start must come out the same at every level
+    BenchStartVoices(&mix, &sample);
+    buffer.memory = k == 0 ? reference : out;
+    for(int frame = 0; frame < 4; ++frame) {
+      BenchMoveVoices(&mix, frame);
+      MixSoundWith(&kernels, &oscKernels, &resampleKernels, &effectKernels, &mix, &buffer);
+    }
+    bool identical = memcmp(reference, out, sizeof(out)) == 0 || k == 0;
+
+    buffer.memory = out;
+    int frames = 0;
+    double start = BenchSeconds();
+    double elapsed = 0;
+    while(elapsed < 0.5) {
+      BenchMoveVoices(&mix, frames);
+      MixSoundWith(&kernels, &oscKernels, &resampleKernels, &effectKernels, &mix, &buffer);
+      ++frames;
+      elapsed = BenchSeconds() - start;
+    }
+    double msPerFrame = elapsed * 1000.0 / frames;
+    printf("%-8s %10.4f %9.2f%% %12.1f%s\n",
+      kernels.name, msPerFrame, msPerFrame * 100.0 / (1000.0 / 60.0),
+      msPerFrame * 1e6 / ((double) BENCH_MIXER_VOICES * BENCH_AUDIO_FRAME),
+      identical ? "" : "  MISMATCH");
+  }
+}
+
+// Resampler
+// A sine at a fifth of the input rate through every quality and kernel at a
+// few ratios. Cost is per channel-second of output, and the SNR is against
+// the exact sine at each output time.
+struct bench_resample_ratio {
+  const char *name;
+  double ratio;
+};
+
+static const bench_resample_ratio BENCH_RESAMPLE_RATIOS[] = {
+  {"44.1k-48k", 44100.0 / 48000.0},
+  {"22k-48k", 22050.0 / 48000.0},
+  {"48k-44.1k", 48000.0 / 44100.0},
+  {"drift", 1.0005},
+};
+
+static void BenchResampler() {
+  printf("== resampler == (%d outputs per run)\n", BENCH_AUDIO_RATE);
+  printf("%-8s %-10s %-8s %10s %10s %8s\n", "quality", "ratio", "kernel", "ms/ch-s", "ns/sample", "SNR dB");
+
+  int outputs = BENCH_AUDIO_RATE;
+  int inputs = (int) (outputs * RESAMPLE_MAX_RATIO) + RESAMPLE_MAX_TAPS;
+  float *in = (float *) malloc(inputs * sizeof(float));
+  float *reference = (float *) malloc(outputs * sizeof(float));
+  float *out = (float *) malloc(outputs * sizeof(float));
+  double pi = 3.14159265358979323846;
+  double tone = 0.2;
+
+  for(int q = 0; q < Resample_Count; ++q) {
+    resample_quality quality = (resample_quality) q;
+    int before = ResampleTapsBefore(quality);
+    for(int j = 0; j < inputs; ++j) {
+      in[j] = (float) (0.5 * sin(2.0 * pi * tone * (j - before)));
+    }
+    for(int r = 0; r < (int) ArrayCount(BENCH_RESAMPLE_RATIOS); ++r) {
+      bench_resample_ratio ratio = BENCH_RESAMPLE_RATIOS[r];
+      uint64_t step = ResampleStep(ratio.ratio);
+      resample_table *table = GetResampleTable(quality, ratio.ratio);
+
+      resample_kernels scalar = GetResampleKernels(0);
+      ResampleWith(&scalar, table, reference, outputs, in, 0, step);
+      double signal = 0.0, noise = 0.0;
+      for(int i = RESAMPLE_MAX_TAPS; i < outputs; ++i) {
+        double expected = 0.5 * sin(2.0 * pi * tone * ((double) step * i / 4294967296.0));
+        signal += expected * expected;
+        noise += (reference[i] - expected) * (reference[i] - expected);
+      }
+      double snr = 10.0 * log10(signal / (noise > 0.0 ? noise : 1e-30));
+
+      for(int k = 0; k < RESAMPLE_KERNEL_COUNT; ++k) {
+        resample_kernels kernels = GetResampleKernels(k);
+        if(!kernels.name) {
+          continue;
+        }
+        ResampleWith(&kernels, table, out, outputs, in, 0, step);
+        bool identical = memcmp(reference, out, outputs * sizeof(float)) == 0;
+
+        int runs = 0;
+        double start = BenchSeconds();
+        double elapsed = 0;
+        while(elapsed < 0.25) {
+          ResampleWith(&kernels, table, out, outputs, in, 0, step);
+          ++runs;
+          elapsed = BenchSeconds() - start;
+        }
+        double seconds = elapsed / runs;
+        printf("%-8s %-10s %-8s %10.3f %10.2f %8.1f%s\n",
+          RESAMPLE_QUALITIES[q].name, ratio.name, kernels.name,
+          seconds * 1000.0, seconds * 1e9 / outputs, snr,
+          identical ? "" : "  MISMATCH");
+      }
+    }
+  }
+  free(in);
+  free(reference);
+  free(out);
+}
+
+// Streams
+// Writes a WAV in each encoding, checks the stream decodes every frame of it
+// and then plays it through the mixer, watching how much of the file is
+// mapped in at once.
+#define BENCH_STREAM_SECONDS 30
+#define BENCH_STREAM_RATE 44100
+#define BENCH_STREAM_ADPCM_BLOCK 2048
+
+struct bench_stream_format {
+  const char *name;
+  uint16_t formatTag;
+  uint16_t bitsPerSample;
+};
+
+static const bench_stream_format BENCH_STREAM_FORMATS[] = {
+  {"pcm16", 1, 16},
+  {"float32", 3, 32},
+  {"ima-adpcm", 0x11, 4},
+};
+
+inline void BenchPut16(uint8_t *at, uint32_t value) {
+  at[0] = (uint8_t) value;
+  at[1] = (uint8_t) (value >> 8);
+}
+
+inline void BenchPut32(uint8_t *at, uint32_t value) {
+  BenchPut16(at, value);
+  BenchPut16(at + 2, value >> 16);
+}
+
+// The encoder runs the decoder alongside so it tracks the same state
+static int BenchImaEncode(ima_state *state, int sample) {
+  int step = IMA_STEP_TABLE[state->index];
+  int diff = sample - state->predictor;
+  int nibble = 0;
+  if(diff < 0) {
+    nibble = 8;
+    diff = -diff;
+  }
+  if(diff >= step) { nibble |= 4; diff -= step; }
+  step >>= 1;
+  if(diff >= step) { nibble |= 2; diff -= step; }
+  step >>= 1;
+  if(diff >= step) { nibble |= 1; }
+  ImaDecodeNibble(state, nibble);
+  return nibble;
+}
+
+// Stereo test signal in 16 bit. Fills expected with what a decoder should
+// give back for it, and returns the whole file.
+static file_data BenchMakeWav(bench_stream_format format, int frames, float *expected) {
+  int channels = 2;
+  uint32_t blockAlign = format.formatTag == 0x11 ? BENCH_STREAM_ADPCM_BLOCK : format.bitsPerSample / 8 * channels;
+  uint32_t framesPerBlock = format.formatTag == 0x11 ? ImaBlockFrames(blockAlign, channels) : 1;
+  uint32_t blocks = (frames + framesPerBlock - 1) / framesPerBlock;
+  frames = blocks * framesPerBlock;
+  uint32_t dataSize = blocks * blockAlign;
+
+  file_data file = {};
+  file.size = 44 + dataSize;
+  file.memory = calloc(file.size, 1);
+  uint8_t *header = (uint8_t *) file.memory;
+  memcpy(header, "RIFF", 4);
+  BenchPut32(header + 4, file.size - 8);
+  memcpy(header + 8, "WAVEfmt ", 8);
+  BenchPut32(header + 16, 16);
+  BenchPut16(header + 20, format.formatTag);
+  BenchPut16(header + 22, channels);
+  BenchPut32(header + 24, BENCH_STREAM_RATE);
+  BenchPut32(header + 28, BENCH_STREAM_RATE * blockAlign / framesPerBlock);
+  BenchPut16(header + 32, blockAlign);
+  BenchPut16(header + 34, format.bitsPerSample);
+  memcpy(header + 36, "data", 4);
+  BenchPut32(header + 40, dataSize);
+
+  int16_t *pcm = (int16_t *) malloc((size_t) frames * channels * sizeof(int16_t));
+  uint32_t noise = 12345;
+  for(int i = 0; i < frames; ++i) {
+    for(int c = 0; c < channels; ++c) {
+      noise = noise * 1664525 + 1013904223;
+      float v = 0.4f * sinf(i * (0.031f + 0.007f * c)) + 0.2f * sinf(i * 0.0007f) + ((noise >> 16) / 65536.0f - 0.5f) * 0.1f;
+      pcm[channels * i + c] = (int16_t) (v * 32767.0f);
+    }
+  }
+
+  uint8_t *data = header + 44;
+  if(format.formatTag == 0x11) {
+    ima_state state[2] = {};
+    for(uint32_t b = 0; b < blocks; ++b) {
+      uint8_t *block = data + (size_t) b * blockAlign;
+      int16_t *in = pcm + (size_t) b * framesPerBlock * channels;
+      float *out = expected + (size_t) b * framesPerBlock * channels;
+      for(int c = 0; c < channels; ++c) {
+        state[c].predictor = in[c];
+        BenchPut16(block + 4 * c, (uint16_t) in[c]);
+        block[4 * c + 2] = (uint8_t) state[c].index;
+        out[c] = in[c] * (1.0f / 32768.0f);
+      }
+      uint8_t *at = block + 4 * channels;
+      for(uint32_t f = 1; f < framesPerBlock; f += 8) {
+        for(int c = 0; c < channels; ++c) {
+          for(int i = 0; i < 8; i += 2) {
+            int low = BenchImaEncode(state + c, in[(f + i) * channels + c]);
+            out[(f + i) * channels + c] = state[c].predictor * (1.0f / 32768.0f);
+            int high = BenchImaEncode(state + c, in[(f + i + 1) * channels + c]);
+            out[(f + i + 1) * channels + c] = state[c].predictor * (1.0f / 32768.0f);
+            *at++ = (uint8_t) (low | (high << 4));
+          }
+        }
+      }
+    }
+  } else {
+    for(int i = 0; i < frames * channels; ++i) {
+      expected[i] = pcm[i] * (1.0f / 32768.0f);
+      if(format.formatTag == 3) {
+        memcpy(data + 4 * i, expected + i, sizeof(float));
+      } else {
+        BenchPut16(data + 2 * i, (uint16_t) pcm[i]);
+      }
+    }
+  }
+  free(pcm);
+  return file;
+}
+
+// How much of the mapping starting at memory is resident, from its smaps entry
+static long BenchMappedResidentKB(void *memory) {
+  long kb = 0;
+  FILE *smaps = fopen("/proc/self/smaps", "r");
+  if(smaps) {
+    char line[512];
+    bool found = false;
+    while(fgets(line, sizeof(line), smaps)) {
+      unsigned long start = 0;
+      if(!found) {
+        found = sscanf(line, "%lx-", &start) == 1 && start == (unsigned long) memory;
+      } else if(sscanf(line, "Rss: %ld", &kb) == 1) {
+        break;
+      }
+    }
+    fclose(smaps);
+  }
+  return kb;
+}
+
+static void BenchStreams() {
+  printf("== streams == (%ds of %dHz stereo, mixed to %dHz in %d sample frames)\n",
+    BENCH_STREAM_SECONDS, BENCH_STREAM_RATE, BENCH_AUDIO_RATE, BENCH_AUDIO_FRAME);
+  printf("%-10s %10s %12s %10s %12s %12s\n", "format", "file KB", "Mframes/s", "ms/frame", "peak map KB", "stream KB");
+
+  char filename[] = "raika_bench_stream.wav";
+  int frames = BENCH_STREAM_SECONDS * BENCH_STREAM_RATE;
+  float *expected = (float *) malloc(((size_t) frames + BENCH_STREAM_ADPCM_BLOCK) * 2 * sizeof(float));
+  static sound_stream stream;
+  static mixer mix;
+  static int16_t out[BENCH_AUDIO_FRAME * 2];
+  sound_buffer buffer = {};
+  buffer.memory = out;
+  buffer.samplesPerSecond = BENCH_AUDIO_RATE;
+  buffer.samplesRequested = BENCH_AUDIO_FRAME;
+  buffer.bytesPerSample = 2;
+  buffer.channels = 2;
+
+  for(int f = 0; f < (int) ArrayCount(BENCH_STREAM_FORMATS); ++f) {
+    bench_stream_format format = BENCH_STREAM_FORMATS[f];
+    file_data file = BenchMakeWav(format, frames, expected);
+    bool written = PlatformWriteFile(filename, file);
+    free(file.memory);
+    if(!written || !OpenSoundStream(&stream, filename)) {
+      printf("%-10s could not write or open %s\n", format.name, filename);
+      continue;
+    }
+
+    // Decode the whole file in mixer sized steps
+    bool identical = true;
+    uint64_t frame = 0;
+    double start = BenchSeconds();
+    while(!stream.ended) {
+      FillSoundStream(&stream, frame, frame + MIXER_BLOCK_SAMPLES);
+      for(; frame < stream.decodedTo; ++frame) {
+        for(int c = 0; c < 2; ++c) {
+          identical = identical && SoundStreamSample(&stream, c, frame) == expected[2 * frame + c];
+        }
+      }
+    }
+    double decodeSeconds = BenchSeconds() - start;
+    identical = identical && frame == stream.frameCount;
+
+    // Then play it once through the mixer
+    InitMixer(&mix, BENCH_AUDIO_RATE);
+    long peakKB = 0;
+    PlayStream(&mix, &stream, 1.0f, 0.0f, false);
+    int mixed = 0;
+    start = BenchSeconds();
+    while(mix.activeCount) {
+      MixSound(&mix, &buffer);
+      if(++mixed % 60 == 0) {
+        long kb = BenchMappedResidentKB(stream.file.memory);
+        peakKB = kb > peakKB ? kb : peakKB;
+      }
+    }
+    double mixSeconds = BenchSeconds() - start;
+
+    printf("%-10s %10.0f %12.1f %10.4f %12ld %12.1f%s\n",
+      format.name, stream.file.size / 1024.0, frame / decodeSeconds * 1e-6,
+      mixSeconds * 1000.0 / mixed, peakKB, sizeof(sound_stream) / 1024.0,
+      identical ? "" : "  MISMATCH");
+    CloseSoundStream(&stream);
+  }
+  remove(filename);
+  free(expected);
+}
+
+// Effects
+// A second of stereo through each effect at every level, in blocks of a few
+// sizes so the tails past whole vectors run too. Cost is per second of
+// audio, which is the share of one core the effect takes.
+struct bench_effect {
+  const char *name;
+  audio_effect_type type;
+};
+
+static const bench_effect BENCH_EFFECTS[] = {
+  {"eq 1", Effect_EQ},
+  {"eq 4", Effect_EQ},
+  {"delay", Effect_Delay},
+  {"reverb", Effect_Reverb},
+};
+
+static const int BENCH_EFFECT_BLOCKS[] = {256, 250, 131};
+
+static void BenchSetupEffect(audio_effect *effect, int which, float *memory) {
+  bench_effect config = BENCH_EFFECTS[which];
+  InitEffect(effect, config.type, BENCH_AUDIO_RATE, memory);
+  switch(which) {
+    case 0: {
+      SetEQBand(effect, 0, {EQBand_LowPass, 2000.0f, 0.707f, 0.0f});
+    } break;
+    case 1: {
+      SetEQBand(effect, 0, {EQBand_LowShelf, 120.0f, 0.707f, 4.0f});
+      SetEQBand(effect, 1, {EQBand_Peak, 1000.0f, 1.0f, -3.0f});
+      SetEQBand(effect, 2, {EQBand_Peak, 3000.0f, 2.0f, 2.0f});
+      SetEQBand(effect, 3, {EQBand_HighShelf, 8000.0f, 0.707f, -6.0f});
+    } break;
+    case 2: {
+      SetDelay(effect, 0.35f, 0.4f, 1.0f, 0.3f);
+    } break;
+    case 3: {
+      SetReverb(effect, 2.0f, 0.3f, 1.0f, 0.3f);
+    } break;
+  }
+}
+
+// Runs count samples through in the bench's block sizes
+static void BenchRunEffect(effect_kernels *kernels, audio_effect *effect, float *left, float *right, int count) {
+  int done = 0;
+  for(int b = 0; done < count; ++b) {
+    int n = BENCH_EFFECT_BLOCKS[b % ArrayCount(BENCH_EFFECT_BLOCKS)];
+    n = n < count - done ? n : count - done;
+    ProcessEffect(kernels, effect, left + done, right + done, n);
+    done += n;
+  }
+}
+
+static void BenchEffects() {
+  printf("== effects == (%d stereo samples per run)\n", BENCH_AUDIO_RATE);
+  printf("%-8s %-8s %10s %10s %14s\n", "effect", "kernel", "ms/s", "% of core", "cycles/sample");
+
+  int count = BENCH_AUDIO_RATE;
+  float *input[2], *reference[2], *out[2];
+  for(int c = 0; c < 2; ++c) {
+    input[c] = (float *) malloc(count * sizeof(float));
+    reference[c] = (float *) malloc(count * sizeof(float));
+    out[c] = (float *) malloc(count * sizeof(float));
+  }
+  uint32_t state = 0x9E3779B9;
+  for(int i = 0; i < count; ++i) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    float noise = (state >> 8) * (1.0f / 16777216.0f) - 0.5f;
+    input[0][i] = 0.3f * sinf(i * 0.013f) + 0.2f * noise;
+    input[1][i] = 0.3f * sinf(i * 0.029f) - 0.2f * noise;
+  }
+  float *memory = (float *) malloc(EffectMemorySize(Effect_Delay, BENCH_AUDIO_RATE) * sizeof(float) +
+                                   EffectMemorySize(Effect_Reverb, BENCH_AUDIO_RATE) * sizeof(float));
+  static audio_effect effect;
+  uint32_t csr = _mm_getcsr();
+  _mm_setcsr(csr | 0x8040);
+
+  for(int e = 0; e < (int) ArrayCount(BENCH_EFFECTS); ++e) {
+    for(int k = 0; k < EFFECT_KERNEL_COUNT; ++k) {
+      effect_kernels kernels = GetEffectKernels(k);
+      if(!kernels.name) {
+        continue;
+      }
+      float **result = k == 0 ? reference : out;
+      BenchSetupEffect(&effect, e, memory);
+      for(int c = 0; c < 2; ++c) {
+        memcpy(result[c], input[c], count * sizeof(float));
+      }
+      BenchRunEffect(&kernels, &effect, result[0], result[1], count);
+      bool identical = k == 0 ||
+        (memcmp(reference[0], out[0], count * sizeof(float)) == 0 &&
+         memcmp(reference[1], out[1], count * sizeof(float)) == 0);
+
+      // Keeps running on its own output, the state carries on
+      int runs = 0;
+      effect.cycles = 0;
+      effect.samples = 0;
+      double start = BenchSeconds();
+      double elapsed = 0;
+      while(elapsed < 0.5) {
+        for(int c = 0; c < 2; ++c) {
+          memcpy(out[c], input[c], count * sizeof(float));
+        }
+        BenchRunEffect(&kernels, &effect, out[0], out[1], count);
+        ++runs;
+        elapsed = BenchSeconds() - start;
+      }
+      double msPerSecond = elapsed * 1000.0 / runs;
+      printf("%-8s %-8s %10.3f %9.3f%% %14.1f%s\n",
+        BENCH_EFFECTS[e].name, kernels.name, msPerSecond, msPerSecond / 10.0,
+        (double) effect.cycles / effect.samples, identical ? "" : "  MISMATCH");
+    }
+
+    // The four sample closed form against the plain recursion
+    if(BENCH_EFFECTS[e].type == Effect_EQ) {
+      BenchSetupEffect(&effect, e, memory);
+      for(int c = 0; c < 2; ++c) {
+        memcpy(out[c], input[c], count * sizeof(float));
+        for(int s = 0; s < effect.eq.sectionCount; ++s) {
+          BiquadTail(effect.eq.sections + s, c, out[c], count);
+        }
+      }
+      float maxError = 0.0f;
+      for(int c = 0; c < 2; ++c) {
+        for(int i = 0; i < count; ++i) {
+          float error = fabsf(out[c][i] - reference[c][i]);
+          maxError = error > maxError ? error : maxError;
+        }
+      }
+      printf("%-8s %-8s %10s  max %.2g from the plain recursion\n", BENCH_EFFECTS[e].name, "", "", maxError);
+    }
+  }
+  _mm_setcsr(csr);
+  free(memory);
+  for(int c = 0; c < 2; ++c) {
+    free(input[c]);
+    free(reference[c]);
+    free(out[c]);
+  }
+}
+
+// File loading
+// PlatformReadFile, which maps, against reading the whole file into a
+// buffer. "load" is from the open to having the memory, "touched" adds
+// summing every byte, which for a mapping is when the pages come in. Cold
+// runs drop the file from the page cache first; the cached column says how
+// much of it that left behind, as filesystems like tmpfs cannot drop it.
+#define BENCH_FILE_COLD_RUNS 3
+
+static const uint64_t BENCH_FILE_SIZES[] = {256 * 1024, 16 * 1024 * 1024, 128 * 1024 * 1024};
+
+typedef file_data bench_file_loader(char *filename);
+
+static file_data BenchReadFileCopy(char *filename) {
+  file_data file = {};
+  int fd = open(filename, O_RDONLY);
+  if(fd >= 0) {
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) == 0) {
+      file = ReadFileIntoMemory(fd, (uint64_t) fileStat.st_size);
+    }
+    close(fd);
+  }
+  return file;
+}
+
+struct bench_file_method {
+  const char *name;
+  bench_file_loader *load;
+};
+
+static const bench_file_method BENCH_FILE_METHODS[] = {
+  {"read", BenchReadFileCopy},
+  {"map", PlatformReadFile},
+};
+
+static uint64_t BenchSumFile(file_data file) {
+  uint64_t sum = 0;
+  uint64_t *words = (uint64_t *) file.memory;
+  for(uint64_t i = 0; i < file.size / 8; ++i) {
+    sum += words[i];
+  }
+  return sum;
+}
+
+static void BenchEvictFile(char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if(fd >= 0) {
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+// Share of the file's pages in the page cache
+static double BenchCachedFraction(char *filename, uint64_t size) {
+  double result = 0;
+  int fd = open(filename, O_RDONLY);
+  if(fd >= 0) {
+    void *memory = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(memory != MAP_FAILED) {
+      uint64_t pageSize = (uint64_t) sysconf(_SC_PAGESIZE);
+      uint64_t pages = (size + pageSize - 1) / pageSize;
+      unsigned char *resident = (unsigned char *) malloc(pages);
+      if(mincore(memory, size, resident) == 0) {
+        uint64_t count = 0;
+        for(uint64_t i = 0; i < pages; ++i) {
+          count += resident[i] & 1;
+        }
+        result = (double) count / pages;
+      }
+      free(resident);
+      munmap(memory, size);
+    }
+    close(fd);
+  }
+  return result;
+}
+
+// Milliseconds to load, and to load and sum, averaged over runs
+static void BenchLoadFile(bench_file_method method, char *filename, uint64_t size, bool cold, int runs, uint64_t expected,
+                          double *loadMs, double *touchedMs, double *cached, bool *identical) {
+  double loadSum = 0, touchedSum = 0, cachedSum = 0;
+  for(int r = 0; r < runs; ++r) {
+    if(cold) {
+      BenchEvictFile(filename);
+    }
+    cachedSum += BenchCachedFraction(filename, size);
+    double start = BenchSeconds();
+    file_data file = method.load(filename);
+    double loaded = BenchSeconds();
+    uint64_t sum = BenchSumFile(file);
+    double touched = BenchSeconds();
+    *identical = *identical && file.memory && sum == expected;
+    PlatformFreeFile(file);
+    loadSum += loaded - start;
+    touchedSum += touched - start;
+  }
+  *loadMs = loadSum * 1000.0 / runs;
+  *touchedMs = touchedSum * 1000.0 / runs;
+  *cached = cachedSum / runs;
+}
+
+static void BenchFiles() {
+  printf("== files == (cold is %d runs after dropping the page cache, warm runs for 0.5s)\n", BENCH_FILE_COLD_RUNS);
+  printf("%-10s %-6s %8s %12s %12s %12s %12s %10s\n",
+    "size KB", "method", "cached", "cold load", "cold touched", "warm load", "warm touched", "warm GB/s");
+
+  char filename[] = "raika_bench_file.bin";
+  for(int f = 0; f < (int) ArrayCount(BENCH_FILE_SIZES); ++f) {
+    uint64_t size = BENCH_FILE_SIZES[f];
+    file_data file = {};
+    file.size = size;
+    file.memory = malloc(size);
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    uint64_t expected = 0;
+    for(uint64_t i = 0; i < size / 8; ++i) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      ((uint64_t *) file.memory)[i] = state;
+      expected += state;
+    }
+    bool written = PlatformWriteFile(filename, file);
+    free(file.memory);
+    if(!written) {
+      printf("%-10llu could not write %s\n", (unsigned long long) (size / 1024), filename);
+      continue;
+    }
+
+    for(int m = 0; m < (int) ArrayCount(BENCH_FILE_METHODS); ++m) {
+      bench_file_method method = BENCH_FILE_METHODS[m];
+      bool identical = true;
+      double coldLoad, coldTouched, cached;
+      BenchLoadFile(method, filename, size, true, BENCH_FILE_COLD_RUNS, expected, &coldLoad, &coldTouched, &cached, &identical);
+
+      int runs = 0;
+      double warmLoad = 0, warmTouched = 0;
+      double start = BenchSeconds();
+      while(BenchSeconds() - start < 0.5) {
+        double load, touched, warmCached;
+        BenchLoadFile(method, filename, size, false, 1, expected, &load, &touched, &warmCached, &identical);
+        warmLoad += load;
+        warmTouched += touched;
+        ++runs;
+      }
+      warmLoad /= runs;
+      warmTouched /= runs;
+      printf("%-10llu %-6s %7.0f%% %12.3f %12.3f %12.3f %12.3f %10.2f%s\n",
+        (unsigned long long) (size / 1024), method.name, cached * 100.0, coldLoad, coldTouched,
+        warmLoad, warmTouched, size / (warmTouched * 1e6), identical ? "" : "  MISMATCH");
+    }
+  }
+  remove(filename);
+}
+
+// Async reads
+// BENCH_ASYNC_READS pieces of a file at scattered offsets, a third at each
+// priority, waited on high priority first and summed as each arrives, the
+// way a loader decodes one asset while the rest are still coming in. The
+// blocking row reads each piece only when it is needed. "high" is when the
+// last high priority piece arrived.
+#define BENCH_ASYNC_READS 128
+#define BENCH_ASYNC_READ_SIZE (512 * 1024)
+
+struct bench_async_piece {
+  uint64_t offset;
+  file_read_priority priority;
+  uint32_t read;
+};
+
+static void BenchAsyncRun(platform_file_queue *queue, char *filename, bench_async_piece *pieces, uint8_t *memory,
+                          double *totalMs, double *highMs, uint64_t *sum) {
+  platform_file file = PlatformOpenFile(filename);
+  double start = BenchSeconds();
+  *sum = 0;
+  *highMs = 0;
+  if(queue) {
+    for(int i = 0; i < BENCH_ASYNC_READS; ++i) {
+      pieces[i].read = PlatformQueueFileRead(queue, &file, pieces[i].offset, BENCH_ASYNC_READ_SIZE,
+                                             memory + (size_t) i * BENCH_ASYNC_READ_SIZE, pieces[i].priority);
+    }
+  }
+  for(int priority = FileReadPriority_Count - 1; priority >= 0; --priority) {
+    for(int i = 0; i < BENCH_ASYNC_READS; ++i) {
+      if(pieces[i].priority != priority) {
+        continue;
+      }
+      uint8_t *piece = memory + (size_t) i * BENCH_ASYNC_READ_SIZE;
+      uint64_t bytesRead = 0;
+      if(queue) {
+        PlatformWaitFileRead(queue, pieces[i].read, &bytesRead);
+      } else {
+        bytesRead = pread((int) (file.handle - 1), piece, BENCH_ASYNC_READ_SIZE, pieces[i].offset);
+      }
+      file_data data = {bytesRead, piece};
+      *sum += BenchSumFile(data);
+    }
+    if(priority == FileReadPriority_High) {
+      *highMs = (BenchSeconds() - start) * 1000.0;
+    }
+  }
+  *totalMs = (BenchSeconds() - start) * 1000.0;
+  PlatformCloseFile(&file);
+}
+
+static void BenchAsync() {
+  printf("== async == (%d reads of %dKB, cold after dropping the page cache)\n",
+    BENCH_ASYNC_READS, BENCH_ASYNC_READ_SIZE / 1024);
+  printf("%-12s %-5s %10s %10s %10s\n", "method", "cache", "ms", "high ms", "MB/s");
+
+  // Twice the pieces' worth, so they are spread out rather than back to back
+  char filename[] = "raika_bench_async.bin";
+  uint64_t size = (uint64_t) 2 * BENCH_ASYNC_READS * BENCH_ASYNC_READ_SIZE;
+  file_data file = {};
+  file.size = size;
+  file.memory = malloc(size);
+  uint64_t state = 0x9E3779B97F4A7C15ull;
+  for(uint64_t i = 0; i < size / 8; ++i) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    ((uint64_t *) file.memory)[i] = state;
+  }
+  bool written = PlatformWriteFile(filename, file);
+
+  static bench_async_piece pieces[BENCH_ASYNC_READS];
+  uint64_t expected = 0;
+  for(int i = 0; i < BENCH_ASYNC_READS; ++i) {
+    // Every other slot, shuffled
+    uint64_t slot = ((uint64_t) i * 73) % BENCH_ASYNC_READS;
+    pieces[i].offset = slot * 2 * BENCH_ASYNC_READ_SIZE;
+    pieces[i].priority = (file_read_priority) (i % FileReadPriority_Count);
+    file_data piece = {BENCH_ASYNC_READ_SIZE, (uint8_t *) file.memory + pieces[i].offset};
+    expected += BenchSumFile(piece);
+  }
+  free(file.memory);
+  if(!written) {
+    printf("could not write %s\n", filename);
+    return;
+  }
+
+  uint8_t *memory = (uint8_t *) malloc((size_t) BENCH_ASYNC_READS * BENCH_ASYNC_READ_SIZE);
+  static platform_file_queue queue;
+  for(int method = 0; method < 3; ++method) {
+    platform_file_queue *useQueue = 0;
+    if(method == 1) {
+      setenv("RAIKA_FILE_QUEUE", "pool", 1);
+      MakeFileQueue(&queue);
+      unsetenv("RAIKA_FILE_QUEUE");
+      useQueue = &queue;
+    } else if(method == 2) {
+      MakeFileQueue(&queue);
+      if(!queue.ring) {
+        FreeFileQueue(&queue);
+        printf("%-12s no io_uring here\n", "io_uring");
+        continue;
+      }
+      useQueue = &queue;
+    }
+    const char *name = useQueue ? FileQueueName(useQueue) : "blocking";
+    for(int warm = 0; warm < 2; ++warm) {
+      double totalMs = 0, highMs = 0;
+      int runs = 0;
+      bool identical = true;
+      double start = BenchSeconds();
+      do {
+        if(!warm) {
+          BenchEvictFile(filename);
+        }
+        double runMs, runHighMs;
+        uint64_t sum;
+        BenchAsyncRun(useQueue, filename, pieces, memory, &runMs, &runHighMs, &sum);
+        identical = identical && sum == expected;
+        totalMs += runMs;
+        highMs += runHighMs;
+        ++runs;
+      } while(warm ? BenchSeconds() - start < 0.5 : runs < BENCH_FILE_COLD_RUNS);
+      totalMs /= runs;
+      highMs /= runs;
+      printf("%-12s %-5s %10.3f %10.3f %10.0f%s\n", name, warm ? "warm" : "cold", totalMs, highMs,
+        BENCH_ASYNC_READS * (BENCH_ASYNC_READ_SIZE / 1048576.0) / (totalMs / 1000.0), identical ? "" : "  MISMATCH");
+    }
+    // Reads on a ring that can no longer be entered fail rather than wait forever
+    if(useQueue && useQueue->ring) {
+      platform_file file = PlatformOpenFile(filename);
+      int devNull = open("/dev/null", O_RDONLY);
+      bool replaced = devNull >= 0 && dup2(devNull, useQueue->ringFd) >= 0;
+      close(devNull);
+      uint32_t waited = PlatformQueueFileRead(useQueue, &file, 0, BENCH_ASYNC_READ_SIZE, memory, FileReadPriority_High);
+      bool failed = PlatformWaitFileRead(useQueue, waited, 0) == FileRead_Failed;
+      uint32_t polled = PlatformQueueFileRead(useQueue, &file, 0, BENCH_ASYNC_READ_SIZE, memory, FileReadPriority_Low);
+      failed = failed && PlatformPollFileRead(useQueue, polled, 0) == FileRead_Failed;
+      printf("%-12s broken ring: reads %s%s\n", name, failed ? "fail" : "do not fail",
+        replaced && failed ? "" : "  MISMATCH");
+      PlatformCloseFile(&file);
+    }
+    if(useQueue) {
+      FreeFileQueue(useQueue);
+    }
+  }
+  free(memory);
+  remove(filename);
+}
+
+// Asset packs
+// Lookups in a pack of BENCH_ASSET_COUNT names against scanning the names in
+// order. Then loading BENCH_ASSET_LOOSE_COUNT small assets one file each
+// against mapping a single pack of them, cold and warm. Then LZ4 on the
+// scene texture and a rendered frame. Last, what a cooked texture saves at
+// startup over decoding its source into the staging buffer.
+#define BENCH_ASSET_COUNT 4096
+#define BENCH_ASSET_LOOSE_COUNT 256
+#define BENCH_ASSET_LOOSE_SIZE (16 * 1024)
+
+static void BenchAssetLookups() {
+  static char names[BENCH_ASSET_COUNT][32];
+  static asset_source sources[BENCH_ASSET_COUNT];
+  uint64_t blob = 0x0123456789ABCDEFull;
+  for(int i = 0; i < BENCH_ASSET_COUNT; ++i) {
+    snprintf(names[i], sizeof(names[i]), "textures/asset_%04d.bmp", i);
+    sources[i].name = names[i];
+    sources[i].memory = &blob;
+    sources[i].size = sizeof(blob);
+  }
+  void *memory;
+  uint64_t size;
+  if(!BuildAssetPack(sources, BENCH_ASSET_COUNT, false, &memory, &size)) {
+    printf("could not build a pack\n");
+    return;
+  }
+  mapped_file file = {size, memory};
+  asset_pack pack;
+  bool opened = OpenAssetPack(&pack, file);
+
+  printf("%-12s %12s %10s\n", "lookup", "ns/lookup", "found");
+  for(int method = 0; method < 3; ++method) {
+    uint32_t index = 1;
+    int lookups = 0;
+    int found = 0;
+    double start = BenchSeconds();
+    double elapsed = 0;
+    while(elapsed < 0.5) {
+      for(int i = 0; i < 1024; ++i) {
+        index = index * 1664525u + 1013904223u;
+        const char *name = names[(index >> 8) % BENCH_ASSET_COUNT];
+        if(method == 0) {
+          found += opened && FindAsset(&pack, name) != 0;
+        } else if(method == 1) {
+          // Same length, never there
+          char missing[32];
+          memcpy(missing, name, sizeof(missing));
+          missing[0] = 'T';
+          found += opened && FindAsset(&pack, missing) != 0;
+        } else {
+          for(uint32_t e = 0; opened && e < pack.header->entryCount; ++e) {
+            if(strcmp(AssetName(&pack, &pack.entries[e]), name) == 0) {
+              ++found;
+              break;
+            }
+          }
+        }
+      }
+      lookups += 1024;
+      elapsed = BenchSeconds() - start;
+    }
+    const char *methodNames[] = {"hash hit", "hash miss", "linear scan"};
+    printf("%-12s %12.1f %9.0f%%\n", methodNames[method], elapsed * 1e9 / lookups, 100.0 * found / lookups);
+  }
+  free(memory);
+}
+
+static void BenchAssetStartup() {
+  static char names[BENCH_ASSET_LOOSE_COUNT][40];
+  static asset_source sources[BENCH_ASSET_LOOSE_COUNT];
+  uint8_t *memory = (uint8_t *) malloc((size_t) BENCH_ASSET_LOOSE_COUNT * BENCH_ASSET_LOOSE_SIZE);
+  uint64_t state = 0x9E3779B97F4A7C15ull;
+  for(uint64_t i = 0; i < (uint64_t) BENCH_ASSET_LOOSE_COUNT * BENCH_ASSET_LOOSE_SIZE / 8; ++i) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    ((uint64_t *) memory)[i] = state;
+  }
+  bool written = true;
+  uint64_t expected = 0;
+  for(int i = 0; i < BENCH_ASSET_LOOSE_COUNT; ++i) {
+    snprintf(names[i], sizeof(names[i]), "raika_bench_asset_%03d.bin", i);
+    sources[i].name = names[i];
+    sources[i].memory = memory + (size_t) i * BENCH_ASSET_LOOSE_SIZE;
+    sources[i].size = BENCH_ASSET_LOOSE_SIZE;
+    file_data file = {BENCH_ASSET_LOOSE_SIZE, sources[i].memory};
+    written = PlatformWriteFile(names[i], file) && written;
+    expected += BenchSumFile(file);
+  }
+  char packName[] = "raika_bench_assets.pak";
+  file_data pack = {};
+  written = BuildAssetPack(sources, BENCH_ASSET_LOOSE_COUNT, false, &pack.memory, &pack.size) &&
+    PlatformWriteFile(packName, pack) && written;
+  free(pack.memory);
+  free(memory);
+
+  printf("%-12s %-5s %10s %10s\n", "load", "cache", "ms", "opens");
+  for(int method = 0; written && method < 2; ++method) {
+    for(int warm = 0; warm < 2; ++warm) {
+      double totalMs = 0;
+      int runs = 0;
+      bool identical = true;
+      double start = BenchSeconds();
+      do {
+        if(!warm) {
+          for(int i = 0; i < BENCH_ASSET_LOOSE_COUNT; ++i) {
+            BenchEvictFile(names[i]);
+          }
+          BenchEvictFile(packName);
+        }
+        uint64_t sum = 0;
+        double runStart = BenchSeconds();
+        if(method == 0) {
+          for(int i = 0; i < BENCH_ASSET_LOOSE_COUNT; ++i) {
+            file_data file = PlatformReadFile(names[i]);
+            sum += BenchSumFile(file);
+            PlatformFreeFile(file);
+          }
+        } else {
+          mapped_file file = PlatformMapFile(packName);
+          PlatformPrefetchFile(&file, 0, file.size);
+          asset_pack assets;
+          if(OpenAssetPack(&assets, file)) {
+            for(int i = 0; i < BENCH_ASSET_LOOSE_COUNT; ++i) {
+              asset_pack_entry *entry = FindAsset(&assets, names[i]);
+              if(entry) {
+                file_data data = {entry->size, AssetMemory(&assets, entry)};
+                sum += BenchSumFile(data);
+              }
+            }
+          }
+          PlatformUnmapFile(&file);
+        }
+        totalMs += (BenchSeconds() - runStart) * 1000.0;
+        identical = identical && sum == expected;
+        ++runs;
+      } while(warm ? BenchSeconds() - start < 0.5 : runs < BENCH_FILE_COLD_RUNS);
+      printf("%-12s %-5s %10.3f %10d%s\n", method ? "pack" : "loose files", warm ? "warm" : "cold",
+        totalMs / runs, method ? 1 : BENCH_ASSET_LOOSE_COUNT, identical ? "" : "  MISMATCH");
+    }
+  }
+  for(int i = 0; i < BENCH_ASSET_LOOSE_COUNT; ++i) {
+    remove(names[i]);
+  }
+  remove(packName);
+}
+
+static void BenchAssetCompression() {
+  graphics_buffer frame = BenchAllocGraphics(1280, 720);
+  RenderGradientWith(GradientRowScalar, &frame, 37, -11);
+  file_data texture = PlatformReadFile((char *) SCENE_TEXTURE_PATH);
+  struct {
+    const char *name;
+    void *memory;
+    uint64_t size;
+  } inputs[] = {
+    {"texture", texture.memory, texture.size},
+    {"frame", frame.memory, (uint64_t) frame.pitch * frame.height},
+  };
+  uint32_t *table = (uint32_t *) malloc(sizeof(uint32_t) << LZ4_HASH_BITS);
+
+  printf("%-12s %10s %8s %12s %12s %12s\n", "lz4", "KB", "ratio", "pack MB/s", "unpack MB/s", "memcpy MB/s");
+  for(int i = 0; i < (int) ArrayCount(inputs); ++i) {
+    uint64_t size = inputs[i].size;
+    if(!inputs[i].memory || !size) {
+      printf("%-12s missing\n", inputs[i].name);
+      continue;
+    }
+    uint8_t *compressed = (uint8_t *) malloc(size);
+    uint8_t *decompressed = (uint8_t *) malloc(size);
+    uint64_t compressedSize = CompressLZ4(inputs[i].memory, size, compressed, size, table);
+    if(!compressedSize) {
+      printf("%-12s %10llu does not compress\n", inputs[i].name, (unsigned long long) (size / 1024));
+      free(compressed);
+      free(decompressed);
+      continue;
+    }
+    bool identical = DecompressLZ4(compressed, compressedSize, decompressed, size) &&
+      memcmp(decompressed, inputs[i].memory, size) == 0;
+
+    double rates[3];
+    for(int method = 0; method < 3; ++method) {
+      int runs = 0;
+      double start = BenchSeconds();
+      double elapsed = 0;
+      while(elapsed < 0.5) {
+        if(method == 0) {
+          CompressLZ4(inputs[i].memory, size, compressed, size, table);
+        } else if(method == 1) {
+          DecompressLZ4(compressed, compressedSize, decompressed, size);
+        } else {
+          memcpy(decompressed, inputs[i].memory, size);
+        }
+        ++runs;
+        elapsed = BenchSeconds() - start;
+      }
+      rates[method] = size / 1048576.0 * runs / elapsed;
+    }
+    printf("%-12s %10llu %8.2f %12.0f %12.0f %12.0f%s\n", inputs[i].name, (unsigned long long) (size / 1024),
+      (double) size / compressedSize, rates[0], rates[1], rates[2], identical ? "" : "  MISMATCH");
+    free(compressed);
+    free(decompressed);
+  }
+  free(table);
+  PlatformFreeFile(texture);
+  free(frame.memory);
+}
+
+// A 24 bit bottom up BMP of the gradient, for a texture bigger than the
+// scene's
+static file_data BenchMakeBmp(int width, int height) {
+  graphics_buffer frame = BenchAllocGraphics(width, height);
+  RenderGradientWith(GradientRowScalar, &frame, 5, 9);
+  int rowSize = (width * 3 + 3) & ~3;
+  file_data file = {};
+  file.size = 54 + (uint64_t) rowSize * height;
+  uint8_t *bmp = (uint8_t *) calloc(1, file.size);
+  uint32_t fields[] = {(uint32_t) file.size, 0, 54, 40, (uint32_t) width, (uint32_t) height};
+  bmp[0] = 'B';
+  bmp[1] = 'M';
+  memcpy(bmp + 2, fields, sizeof(fields));
+  bmp[26] = 1;
+  bmp[28] = 24;
+  for(int y = 0; y < height; ++y) {
+    uint32_t *row = (uint32_t *) ((uint8_t *) frame.memory + (size_t) (height - 1 - y) * frame.pitch);
+    uint8_t *out = bmp + 54 + (size_t) y * rowSize;
+    for(int x = 0; x < width; ++x) {
+      out[x * 3 + 0] = (uint8_t) row[x];
+      out[x * 3 + 1] = (uint8_t) (row[x] >> 8);
+      out[x * 3 + 2] = (uint8_t) (row[x] >> 16);
+    }
+  }
+  free(frame.memory);
+  file.memory = bmp;
+  return file;
+}
+
+static void BenchAssetTextures() {
+  file_data texture = PlatformReadFile((char *) SCENE_TEXTURE_PATH);
+  file_data large = BenchMakeBmp(2048, 2048);
+  struct {
+    const char *name;
+    file_data file;
+  } inputs[] = {
+    {"texture.bmp", texture},
+    {"large.bmp", large},
+  };
+
+  printf("%-12s %10s %5s %10s %10s %10s %10s\n", "cooked", "size", "mips", "cook ms", "decode ms", "copy ms", "saved ms");
+  for(int i = 0; i < (int) ArrayCount(inputs); ++i) {
+    file_data file = inputs[i].file;
+    int width, height, channels;
+    double start = BenchSeconds();
+    stbi_uc *pixels = file.memory && file.size <= 0x7FFFFFFF ?
+      stbi_load_from_memory((stbi_uc *) file.memory, (int) file.size, &width, &height, &channels, 4) : 0;
+    cooked_texture_header layout;
+    uint64_t cookedSize = pixels ? CookedTextureLayout(&layout, (uint32_t) width, (uint32_t) height) : 0;
+    if(!cookedSize) {
+      printf("%-12s missing\n", inputs[i].name);
+      stbi_image_free(pixels);
+      continue;
+    }
+    uint64_t sourceHash = AssetContentHash(file.memory, file.size);
+    void *cooked = calloc(1, cookedSize);
+    CookTexture(cooked, sourceHash, pixels, (uint32_t) width, (uint32_t) height, (uint32_t) width * 4);
+    double cookMs = (BenchSeconds() - start) * 1000.0;
+    stbi_image_free(pixels);
+
+    char cookedName[COOKED_TEXTURE_NAME_SIZE];
+    CookedTextureName(cookedName, sourceHash);
+    asset_source sources[2] = {
+      {inputs[i].name, file.memory, file.size},
+      {cookedName, cooked, cookedSize, true},
+    };
+    mapped_file pack = {};
+    BuildAssetPack(sources, 2, true, &pack.memory, &pack.size);
+    free(cooked);
+    asset_pack assets;
+    bool opened = OpenAssetPack(&assets, pack);
+
+    // Both paths end with the texture in the staging buffer in Vulkan's
+    // byte order
+    uint8_t *staging = (uint8_t *) malloc(cookedSize > (uint64_t) width * height * 4 ? cookedSize : (uint64_t) width * height * 4);
+    // Room to decompress the source into
+    memory_arena scratch;
+    InitializeArena(&scratch, malloc(file.size + ARENA_DEFAULT_ALIGNMENT), file.size + ARENA_DEFAULT_ALIGNMENT);
+    double times[2];
+    bool identical = opened;
+    for(int method = 0; method < 2; ++method) {
+      int runs = 0;
+      start = BenchSeconds();
+      double elapsed = 0;
+      while(elapsed < 0.5) {
+        asset_pack_entry *source = opened ? FindAsset(&assets, inputs[i].name) : 0;
+        if(method == 0 && source) {
+          temporary_memory temp = BeginTemporaryMemory(&scratch);
+          void *data = LoadAsset(&assets, source, &scratch);
+          loaded_bitmap bitmap = DecodeBitmap(data, source->size);
+          ConvertImage(PixelConversion_SwizzleRB, staging, bitmap.pitch, bitmap.memory, bitmap.pitch,
+            bitmap.width, bitmap.height, false);
+          free(bitmap.memory);
+          EndTemporaryMemory(temp);
+        } else if(source) {
+          cooked_texture_header *found = FindCookedTexture(&assets, source);
+          if(found) {
+            memcpy(staging, found, (size_t) found->size);
+          }
+          identical = identical && found;
+        }
+        ++runs;
+        elapsed = BenchSeconds() - start;
+      }
+      times[method] = elapsed * 1000.0 / runs;
+    }
+    // The base level has to match a plain decode
+    cooked_texture_header *found = opened ? FindCookedTexture(&assets, FindAsset(&assets, inputs[i].name)) : 0;
+    loaded_bitmap bitmap = DecodeBitmap(file.memory, file.size);
+    for(int y = 0; found && bitmap.memory && y < bitmap.height; ++y) {
+      uint32_t *decoded = (uint32_t *) ((uint8_t *) bitmap.memory + (size_t) y * bitmap.pitch);
+      uint8_t *row = CookedTextureMip(found, 0) + (size_t) y * found->mips[0].rowPitch;
+      for(int x = 0; x < bitmap.width; ++x) {
+        uint32_t rgba = row[x * 4] | (row[x * 4 + 1] << 8) | (row[x * 4 + 2] << 16) | ((uint32_t) row[x * 4 + 3] << 24);
+        uint32_t expected = (decoded[x] & 0xFF00FF00) | ((decoded[x] >> 16) & 0xFF) | ((decoded[x] & 0xFF) << 16);
+        identical = identical && rgba == expected;
+      }
+    }
+    free(bitmap.memory);
+
+    char size[32];
+    snprintf(size, sizeof(size), "%dx%d", width, height);
+    printf("%-12s %10s %5u %10.3f %10.3f %10.3f %10.3f%s\n", inputs[i].name, size, layout.mipCount, cookMs,
+      times[0], times[1], times[0] - times[1], identical ? "" : "  MISMATCH");
+    free(scratch.base);
+    free(staging);
+    free(pack.memory);
+  }
+  PlatformFreeFile(texture);
+  free(large.memory);
+}
+
+static void BenchAssets() {
+  printf("== assets == (%d names; %d assets of %dKB; cold after dropping the page cache)\n",
+    BENCH_ASSET_COUNT, BENCH_ASSET_LOOSE_COUNT, BENCH_ASSET_LOOSE_SIZE / 1024);
+  BenchAssetLookups();
+  BenchAssetStartup();
+  BenchAssetCompression();
+  BenchAssetTextures();
+}
+
+// Spatial audio
+// BENCH_EMITTERS emitters scattered around the listeners, spatialized by
+// each kernel against the scalar one, then the whole update with culling
+// and voice changes as the emitters drift about. The mixer runs between
+// updates so stopped voices are freed, but only the update is timed.
+#define BENCH_EMITTERS SPATIAL_MAX_EMITTERS
+
+static float BenchRandom(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+static void BenchSetupSpatial(spatial_scene *scene, sound_sample *sample, int listeners) {
+  InitSpatialScene(scene);
+  uint32_t state = 0x2545F491;
+  for(int i = 0; i < BENCH_EMITTERS; ++i) {
+    v3 position = V3(300.0f * BenchRandom(&state) - 150.0f, 20.0f * BenchRandom(&state), 300.0f * BenchRandom(&state) - 150.0f);
+    v3 velocity = V3(40.0f * BenchRandom(&state) - 20.0f, 0.0f, 40.0f * BenchRandom(&state) - 20.0f);
+    float maxDistance = 20.0f + 80.0f * BenchRandom(&state);
+    int emitter = AddEmitter(scene, sample, position, 0.5f + 0.5f * BenchRandom(&state), 1.0f + 4.0f * BenchRandom(&state), maxDistance, true);
+    MoveEmitter(scene, emitter, position, velocity);
+  }
+  for(int l = 0; l < listeners; ++l) {
+    v3 position = V3(60.0f * l - 90.0f, 1.7f, 30.0f * l - 45.0f);
+    SetSpatialListener(scene, l, position, V3(0.0f, 0.0f, 1.0f), V3(0.0f, 1.0f, 0.0f), V3(0.0f, 0.0f, 5.0f));
+  }
+}
+
+static void BenchSpatial() {
+  printf("== spatial == (%d emitters, %d voice budget)\n", BENCH_EMITTERS, SPATIAL_DEFAULT_VOICES);
+  printf("%-10s %-8s %12s %14s %12s %18s\n", "listeners", "kernel", "ns/emitter", "us all", "us update", "audible/voices");
+
+  static float sampleData[4801];
+  for(int i = 0; i < (int) ArrayCount(sampleData); ++i) {
+    sampleData[i] = sinf(i * 0.05f);
+  }
+  sound_sample sample = {sampleData, ArrayCount(sampleData), 44100};
+  static spatial_scene scene;
+  static float reference[3][SPATIAL_MAX_EMITTERS];
+  static mixer mix;
+  static int16_t out[2 * BENCH_AUDIO_FRAME];
+  sound_buffer buffer = {};
+  buffer.samplesPerSecond = BENCH_AUDIO_RATE;
+  buffer.samplesRequested = BENCH_AUDIO_FRAME;
+  buffer.bytesPerSample = 2;
+  buffer.channels = 2;
+  buffer.memory = out;
+
+  static const int listenerCounts[] = {1, SPATIAL_MAX_LISTENERS};
+  for(int c = 0; c < (int) ArrayCount(listenerCounts); ++c) {
+    for(int k = 0; k < SPATIAL_KERNEL_COUNT; ++k) {
+      spatial_kernels kernels = GetSpatialKernels(k);
+      if(!kernels.name) {
+        continue;
+      }
+      BenchSetupSpatial(&scene, &sample, listenerCounts[c]);
+      kernels.spatialize(&scene, BENCH_EMITTERS);
+      bool identical = true;
+      float *outputs[3] = {scene.outGain, scene.outPan, scene.outPitch};
+      for(int o = 0; o < 3; ++o) {
+        if(k == 0) {
+          memcpy(reference[o], outputs[o], sizeof(reference[o]));
+        } else {
+          identical = identical && memcmp(reference[o], outputs[o], sizeof(reference[o])) == 0;
+        }
+      }
+
+      int runs = 0;
+      double start = BenchSeconds();
+      double elapsed = 0;
+      while(elapsed < 0.5) {
+        kernels.spatialize(&scene, BENCH_EMITTERS);
+        ++runs;
+        elapsed = BenchSeconds() - start;
+      }
+      double kernelSeconds = elapsed / runs;
+
+      // A frame at a time, everything moving
+      InitMixer(&mix, BENCH_AUDIO_RATE);
+      double updateSeconds = 0;
+      int frames = 0;
+      int audible = 0, voices = 0;
+      while(updateSeconds < 0.5 && frames < 600) {
+        for(int i = 0; i < BENCH_EMITTERS; ++i) {
+          scene.x[i] += scene.vx[i] * (1.0f / 60.0f);
+          scene.z[i] += scene.vz[i] * (1.0f / 60.0f);
+        }
+        start = BenchSeconds();
+        UpdateSpatialAudioWith(&kernels, &scene, &mix);
+        updateSeconds += BenchSeconds() - start;
+        MixSound(&mix, &buffer);
+        audible += scene.audibleCount;
+        voices += scene.voiceCount;
+        ++frames;
+      }
+      char counts[32];
+      snprintf(counts, sizeof(counts), "%d/%d", audible / frames, voices / frames);
+      printf("%-10d %-8s %12.2f %14.1f %12.1f %18s%s\n",
+        listenerCounts[c], kernels.name, kernelSeconds * 1e9 / BENCH_EMITTERS, kernelSeconds * 1e6,
+        updateSeconds * 1e6 / frames, counts, identical ? "" : "  MISMATCH");
+    }
+  }
+}
+
+// Sample writers
+// The bus converted to every device format, against a scalar reference of
+// the same rounding. The generic row is the same type with the channel count
+// left to run time.
+struct bench_writer_format {
+  const char *name;
+  int bytesPerSample;
+  bool floatSamples;
+  int channels;
+};
+
+static const bench_writer_format BENCH_WRITER_FORMATS[] = {
+  {"s16 mono", 2, false, 1},
+  {"s16 stereo", 2, false, 2},
+  {"s16 5.1", 2, false, 6},
+  {"s24 stereo", 3, false, 2},
+  {"s24 5.1", 3, false, 6},
+  {"s32 stereo", 4, false, 2},
+  {"s32 5.1", 4, false, 6},
+  {"f32 mono", 4, true, 1},
+  {"f32 stereo", 4, true, 2},
+  {"f32 5.1", 4, true, 6},
+};
+
+// One sample as the device should see it, little endian
+static void BenchWriteReference(uint8_t *dest, bench_writer_format format, float sample, float gain, float dither) {
+  float v = sample * gain;
+  v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+  int32_t value;
+  if(format.floatSamples) {
+    memcpy(&value, &v, 4);
+  } else if(format.bytesPerSample == 2) {
+    value = _mm_cvtss_si32(_mm_set_ss(v * 32766.0f + dither));
+  } else if(format.bytesPerSample == 3) {
+    value = _mm_cvtss_si32(_mm_set_ss(v * 8388607.0f));
+  } else {
+    value = _mm_cvtss_si32(_mm_set_ss(v * 2147483520.0f));
+  }
+  for(int b = 0; b < format.bytesPerSample; ++b) {
+    dest[b] = (uint8_t) (value >> (8 * b));
+  }
+}
+
+static void BenchWriters() {
+  printf("== writers == (%d frames per call)\n", BENCH_AUDIO_FRAME);
+  printf("%-12s %-8s %10s\n", "format", "kernel", "ns/frame");
+
+  // Past full scale on both sides so clipping is covered
+  static float left[BENCH_AUDIO_FRAME], right[BENCH_AUDIO_FRAME];
+  for(int i = 0; i < BENCH_AUDIO_FRAME; ++i) {
+    left[i] = 1.2f * sinf(i * 0.031f);
+    right[i] = 1.2f * cosf(i * 0.017f);
+  }
+  BuildDitherTable();
+  float *ditherLeft = globalDither;
+  float *ditherRight = globalDither + MIXER_DITHER_SIZE / 2;
+  float gain = 0.9f;
+  // Odd so the tail goes through the padded group
+  int count = BENCH_AUDIO_FRAME - 3;
+  static uint8_t reference[BENCH_AUDIO_FRAME * 6 * 4];
+  static uint8_t out[BENCH_AUDIO_FRAME * 6 * 4];
+
+  for(int f = 0; f < (int) ArrayCount(BENCH_WRITER_FORMATS); ++f) {
+    bench_writer_format format = BENCH_WRITER_FORMATS[f];
+    size_t frameBytes = (size_t) format.bytesPerSample * format.channels;
+    memset(reference, 0, sizeof(reference));
+    for(int i = 0; i < count; ++i) {
+      uint8_t *frame = reference + i * frameBytes;
+      if(format.channels == 1) {
+        // Each side clips before they are averaged
+        float l = left[i] * gain, r = right[i] * gain;
+        l = l < -1.0f ? -1.0f : (l > 1.0f ? 1.0f : l);
+        r = r < -1.0f ? -1.0f : (r > 1.0f ? 1.0f : r);
+        BenchWriteReference(frame, format, (l + r) * 0.5f, 1.0f, ditherLeft[i]);
+      } else {
+        BenchWriteReference(frame, format, left[i], gain, ditherLeft[i]);
+        BenchWriteReference(frame + format.bytesPerSample, format, right[i], gain, ditherRight[i]);
+      }
+    }
+
+    sound_buffer buffer = {};
+    buffer.bytesPerSample = format.bytesPerSample;
+    buffer.floatSamples = format.floatSamples;
+    buffer.channels = format.channels;
+    sample_writer *specialized = GetSampleWriter(&buffer);
+    buffer.channels = 0;
+    sample_writer *generic = 0;
+    for(int i = 0; i < (int) ArrayCount(SAMPLE_WRITERS); ++i) {
+      sample_writer_info info = SAMPLE_WRITERS[i];
+      if(info.bytesPerSample == format.bytesPerSample && info.floatSamples == format.floatSamples && info.channels == 0) {
+        generic = info.writer;
+      }
+    }
+
+    sample_writer *writers[2] = {specialized, generic};
+    const char *names[2] = {"fixed", "generic"};
+    for(int w = 0; w < 2; ++w) {
+      memset(out, 0xCD, sizeof(out));
+      writers[w](out, format.channels, left, right, ditherLeft, ditherRight, gain, count);
+      bool identical = memcmp(reference, out, count * frameBytes) == 0;
+
+      int calls = 0;
+      double start = BenchSeconds();
+      double elapsed = 0;
+      while(elapsed < 0.5) {
+        writers[w](out, format.channels, left, right, ditherLeft, ditherRight, gain, count);
+        ++calls;
+        elapsed = BenchSeconds() - start;
+      }
+      printf("%-12s %-8s %10.2f%s\n",
+        format.name, names[w], elapsed * 1e9 / ((double) calls * count),
+        identical ? "" : "  MISMATCH");
+    }
+  }
+
+  // The mix kernels' 16 bit stereo output stands in for the writer there
+  for(int k = 0; k < MIX_KERNEL_COUNT; ++k) {
+    mix_kernels kernels = GetMixKernels(k);
+    if(!kernels.name) {
+      continue;
+    }
+    bench_writer_format format = BENCH_WRITER_FORMATS[1];
+    WriteSamples<sample_int16, 2>(reference, 2, left, right, ditherLeft, ditherRight, gain, count);
+    kernels.output((int16_t *) out, left, right, ditherLeft, ditherRight, gain, count);
+    bool identical = memcmp(reference, out, count * 4) == 0;
+    int calls = 0;
+    double start = BenchSeconds();
+    double elapsed = 0;
+    while(elapsed < 0.5) {
+      kernels.output((int16_t *) out, left, right, ditherLeft, ditherRight, gain, count);
+      ++calls;
+      elapsed = BenchSeconds() - start;
+    }
+    printf("%-12s %-8s %10.2f%s\n",
+      format.name, kernels.name, elapsed * 1e9 / ((double) calls * count),
+      identical ? "" : "  MISMATCH");
+  }
+}
+
+struct bench_suite {
+  const char *name;
+  void (*run)();
+};
+
+static const bench_suite BENCH_SUITES[] = {
+  {"gradient", BenchGradient},
+  {"tiles", BenchTiles},
+  {"raster", BenchRaster},
+  {"dirty", BenchDirty},
+  {"sprites", BenchSprites},
+  {"commands", BenchCommands},
+  {"pixels", BenchPixels},
+  {"scale", BenchScale},
+  {"fill", BenchFill},
+  {"oscillators", BenchOscillators},
+  {"mixer", BenchMixer},
+  {"resampler", BenchResampler},
+  {"streams", BenchStreams},
+  {"files", BenchFiles},
+  {"async", BenchAsync},
+  {"assets", BenchAssets},
+  {"effects", BenchEffects},
+  {"spatial", BenchSpatial},
+  {"writers", BenchWriters},
+};
+
+int main(int argc, char *argv[]) {
+  for(int s = 0; s < (int) ArrayCount(BENCH_SUITES); ++s) {
+    bool selected = argc <= 1;
+    for(int a = 1; a < argc; ++a) {
+      if(strcmp(argv[a], BENCH_SUITES[s].name) == 0) {
+        selected = true;
+      }
+    }
+    if(selected) {
+      BENCH_SUITES[s].run();
+    }
+  }
+  return 0;
+}
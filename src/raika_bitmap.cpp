@@ -0,0 +1,41 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// Pixels come from arena when given one, otherwise from malloc for the
+// caller to free
+static loaded_bitmap DecodeBitmap(void *data, uint64_t size, memory_arena *arena = 0) {
+  loaded_bitmap result = {};
+
+  // stb takes the size as an int
+  if(data && size <= 0x7FFFFFFF) {
+    // Three channel images are expanded here rather than by stb, everything
+    // else stb converts to four channels
+    int width, height, channels;
+    stbi_info_from_memory((stbi_uc *) data, (int) size, &width, &height, &channels);
+    int loadChannels = channels == 3 ? 3 : 4;
+    stbi_uc *pixels = stbi_load_from_memory(
+      (stbi_uc *) data, (int) size, &width, &height, &channels, loadChannels
+    );
+    if(pixels) {
+      result.width = width;
+      result.height = height;
+      result.pitch = width * 4;
+      size_t pixelsSize = (size_t) result.pitch * height;
+      result.memory = arena ? PushSize(arena, pixelsSize) : malloc(pixelsSize);
+      ConvertImage(
+        loadChannels == 3 ? PixelConversion_ExpandRGB : PixelConversion_SwizzleRB,
+        result.memory, result.pitch, pixels, width * loadChannels, width, height, false
+      );
+      stbi_image_free(pixels);
+    }
+  }
+
+  return result;
+}
+
+static loaded_bitmap ReadBitmap(char *filename, memory_arena *arena = 0) {
+  file_data file = PlatformReadFile(filename);
+  loaded_bitmap result = DecodeBitmap(file.memory, file.size, arena);
+  PlatformFreeFile(file);
+  return result;
+}
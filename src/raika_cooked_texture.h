@@ -0,0 +1,183 @@
+#if !defined(RAIKA_COOKED_TEXTURE_H)
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Cooked textures
+// A texture laid out the way Vulkan wants it in a staging buffer, so
+// loading one is a copy rather than an image decode. Pixels are
+// R8G8B8A8_SRGB bytes with the full mip chain after the base level. Every
+// level starts on COOKED_TEXTURE_ALIGNMENT and its rows are padded to it,
+// which the optimal buffer copy alignments of common GPUs divide, and each
+// level becomes one VkBufferImageCopy with bufferRowLength of
+// rowPitch / 4. The mips average the colour in linear light.
+//
+// raika_packer cooks every image in a pack into an uncompressed asset named
+// after the source's content hash, see CookedTextureName, so an edited
+// source never picks up a stale cook and identical sources share one.
+#define COOKED_TEXTURE_MAGIC 0x58455452 // "RTEX"
+#define COOKED_TEXTURE_VERSION 1
+#define COOKED_TEXTURE_ALIGNMENT 256
+#define COOKED_TEXTURE_MAX_MIPS 16
+#define COOKED_TEXTURE_NAME_SIZE 32
+
+enum cooked_texture_format {
+  CookedTextureFormat_R8G8B8A8_SRGB = 1,
+};
+
+struct cooked_texture_mip {
+  // From the start of the cooked blob
+  uint64_t offset;
+  uint64_t size;
+  uint32_t width;
+  uint32_t height;
+  uint32_t rowPitch;
+  uint32_t reserved;
+};
+
+struct cooked_texture_header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t sourceHash;
+  uint32_t width;
+  uint32_t height;
+  uint32_t format;
+  uint32_t mipCount;
+  // Of the whole blob
+  uint64_t size;
+  cooked_texture_mip mips[COOKED_TEXTURE_MAX_MIPS];
+};
+
+inline uint64_t AlignCookedTexture(uint64_t value) {
+  return (value + COOKED_TEXTURE_ALIGNMENT - 1) & ~(uint64_t) (COOKED_TEXTURE_ALIGNMENT - 1);
+}
+
+inline void CookedTextureName(char *name, uint64_t sourceHash) {
+  snprintf(name, COOKED_TEXTURE_NAME_SIZE, "cooked/%016llx", (unsigned long long) sourceHash);
+}
+
+// Lays out the mip chain, filling everything but the hash. Returns the blob
+// size, zero for sizes no GPU takes.
+static uint64_t CookedTextureLayout(cooked_texture_header *header, uint32_t width, uint32_t height) {
+  *header = {};
+  if(!width || !height || width > 32768 || height > 32768) {
+    return 0;
+  }
+  header->magic = COOKED_TEXTURE_MAGIC;
+  header->version = COOKED_TEXTURE_VERSION;
+  header->width = width;
+  header->height = height;
+  header->format = CookedTextureFormat_R8G8B8A8_SRGB;
+  uint64_t offset = AlignCookedTexture(sizeof(cooked_texture_header));
+  for(;;) {
+    cooked_texture_mip *mip = &header->mips[header->mipCount++];
+    mip->offset = offset;
+    mip->width = width;
+    mip->height = height;
+    mip->rowPitch = (uint32_t) AlignCookedTexture((uint64_t) width * 4);
+    mip->size = (uint64_t) mip->rowPitch * height;
+    offset = AlignCookedTexture(offset + mip->size);
+    if(width == 1 && height == 1) {
+      break;
+    }
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+  }
+  header->size = offset;
+  return header->size;
+}
+
+// The blob starts with a header that agrees with itself and with size
+inline bool OpenCookedTexture(cooked_texture_header **result, void *memory, uint64_t size) {
+  *result = 0;
+  cooked_texture_header *header = (cooked_texture_header *) memory;
+  if(!header || size < sizeof(cooked_texture_header) || header->magic != COOKED_TEXTURE_MAGIC ||
+     header->version != COOKED_TEXTURE_VERSION || header->format != CookedTextureFormat_R8G8B8A8_SRGB ||
+     header->size != size) {
+    return false;
+  }
+  cooked_texture_header expected;
+  if(CookedTextureLayout(&expected, header->width, header->height) != size || expected.mipCount != header->mipCount ||
+     memcmp(expected.mips, header->mips, sizeof(expected.mips)) != 0) {
+    return false;
+  }
+  *result = header;
+  return true;
+}
+
+inline uint8_t *CookedTextureMip(cooked_texture_header *header, uint32_t level) {
+  return (uint8_t *) header + header->mips[level].offset;
+}
+
+inline float CookedSrgbToLinear(uint8_t value) {
+  float c = value / 255.0f;
+  return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+inline uint8_t CookedLinearToSrgb(float value) {
+  float c = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+  c = c < 0.0f ? 0.0f : (c > 1.0f ? 1.0f : c);
+  return (uint8_t) (c * 255.0f + 0.5f);
+}
+
+// Cooks R8G8B8A8 pixels into memory of CookedTextureLayout's size, which
+// starts zeroed so the padding stays that way. Each mip is a box filter of
+// the one above, with the last row or column of an odd level folded into
+// its neighbour.
+inline void CookTexture(void *memory, uint64_t sourceHash, void *pixels, uint32_t width, uint32_t height, uint32_t pitch) {
+  cooked_texture_header *header = (cooked_texture_header *) memory;
+  CookedTextureLayout(header, width, height);
+  header->sourceHash = sourceHash;
+  float toLinear[256];
+  for(int i = 0; i < 256; ++i) {
+    toLinear[i] = CookedSrgbToLinear((uint8_t) i);
+  }
+
+  for(uint32_t y = 0; y < height; ++y) {
+    memcpy(CookedTextureMip(header, 0) + (uint64_t) y * header->mips[0].rowPitch,
+           (uint8_t *) pixels + (uint64_t) y * pitch, (size_t) width * 4);
+  }
+  for(uint32_t level = 1; level < header->mipCount; ++level) {
+    cooked_texture_mip *above = &header->mips[level - 1];
+    cooked_texture_mip *mip = &header->mips[level];
+    uint8_t *source = CookedTextureMip(header, level - 1);
+    uint8_t *dest = CookedTextureMip(header, level);
+    for(uint32_t y = 0; y < mip->height; ++y) {
+      uint32_t y0 = above->height > 1 ? y * 2 : 0;
+      uint32_t y1 = y0 + 1 < above->height ? y0 + 1 : y0;
+      // Only the last row of an odd level takes the row below as well
+      uint32_t y2 = (y == mip->height - 1 && y1 + 1 < above->height) ? y1 + 1 : y1;
+      for(uint32_t x = 0; x < mip->width; ++x) {
+        uint32_t x0 = above->width > 1 ? x * 2 : 0;
+        uint32_t x1 = x0 + 1 < above->width ? x0 + 1 : x0;
+        uint32_t x2 = (x == mip->width - 1 && x1 + 1 < above->width) ? x1 + 1 : x1;
+        uint32_t rows[3] = {y0, y1, y2};
+        uint32_t columns[3] = {x0, x1, x2};
+        uint32_t rowCount = y2 != y1 ? 3 : 2;
+        uint32_t columnCount = x2 != x1 ? 3 : 2;
+        float sum[4] = {};
+        for(uint32_t r = 0; r < rowCount; ++r) {
+          uint8_t *row = source + (uint64_t) rows[r] * above->rowPitch;
+          for(uint32_t c = 0; c < columnCount; ++c) {
+            uint8_t *texel = row + (uint64_t) columns[c] * 4;
+            sum[0] += toLinear[texel[0]];
+            sum[1] += toLinear[texel[1]];
+            sum[2] += toLinear[texel[2]];
+            sum[3] += texel[3];
+          }
+        }
+        float scale = 1.0f / (rowCount * columnCount);
+        uint8_t *out = dest + (uint64_t) y * mip->rowPitch + (uint64_t) x * 4;
+        out[0] = CookedLinearToSrgb(sum[0] * scale);
+        out[1] = CookedLinearToSrgb(sum[1] * scale);
+        out[2] = CookedLinearToSrgb(sum[2] * scale);
+        out[3] = (uint8_t) (sum[3] * scale + 0.5f);
+      }
+    }
+  }
+}
+
+#define RAIKA_COOKED_TEXTURE_H
+#endif
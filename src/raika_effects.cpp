@@ -0,0 +1,680 @@
+#include "raika_intrinsics.h"
+
+// Effects
+// Block processors for a planar stereo bus: an EQ of up to four biquad bands,
+// a feedback delay and a feedback delay network reverb. Each works in place
+// on at most EFFECT_MAX_BLOCK samples at a time and keeps all of its state in
+// the effect, with delay lines in memory the owner hands over once when the
+// effect is made. Nothing allocates while processing.
+//
+// Biquads are recursive, so their SIMD runs four samples at a time from a
+// closed form: the four outputs are a fixed combination of the four inputs
+// and the two state values the block starts with, and the state after the
+// block comes from the last two samples as usual. Delay lines are at least a
+// chunk long, so the delay and the reverb process whole chunks of them as
+// plain arrays. Every kernel must match the scalar version bit for bit.
+#define EFFECT_MAX_BLOCK 256
+#define EQ_MAX_BANDS 4
+#define DELAY_MAX_SECONDS 1.0
+#define REVERB_LINES 8
+
+enum audio_effect_type {
+  Effect_None,
+  Effect_EQ,
+  Effect_Delay,
+  Effect_Reverb,
+
+  Effect_Count
+};
+
+static const char *EFFECT_NAMES[Effect_Count] = {"none", "eq", "delay", "reverb"};
+
+enum eq_band_type {
+  EQBand_Off,
+  EQBand_LowPass,
+  EQBand_HighPass,
+  EQBand_Peak,
+  EQBand_LowShelf,
+  EQBand_HighShelf,
+};
+
+// Transposed direct form II, a1 and a2 negated so the recursion only adds
+struct biquad {
+  float b0, b1, b2;
+  float a1, a2;
+  // Outputs of a four sample block: columns[j] scaled by input j, then
+  // columns[4] by z1 and columns[5] by z2, summed in that order
+  float columns[6][4];
+  float z1[2];
+  float z2[2];
+};
+
+struct eq_band {
+  eq_band_type type;
+  float frequency;
+  float q;
+  float gainDb;
+};
+
+struct effect_eq {
+  eq_band bands[EQ_MAX_BANDS];
+  biquad sections[EQ_MAX_BANDS];
+  int sectionCount;
+};
+
+struct effect_delay {
+  float *lines[2];
+  uint32_t length;
+  uint32_t delay;
+  uint32_t writeAt;
+  float feedback;
+  float dry;
+  float wet;
+};
+
+// Eight lines mixed through a Hadamard matrix, with a one pole low pass in
+// each for damping. Even lines feed the left output and odd ones the right.
+struct effect_reverb {
+  float *lines[REVERB_LINES];
+  uint32_t lengths[REVERB_LINES];
+  uint32_t at[REVERB_LINES];
+  float gains[REVERB_LINES];
+  float lowPass[REVERB_LINES];
+  float damping;
+  float dry;
+  float wet;
+  float taps[REVERB_LINES][EFFECT_MAX_BLOCK];
+  float input[EFFECT_MAX_BLOCK];
+};
+
+struct audio_effect {
+  audio_effect_type type;
+  bool bypass;
+  int samplesPerSecond;
+  union {
+    effect_eq eq;
+    effect_delay delay;
+    effect_reverb reverb;
+  };
+  // Time stamp counter cycles spent and samples processed since the last
+  // reset
+  uint64_t cycles;
+  uint64_t samples;
+};
+
+// Line lengths at 48kHz, mutually prime and all longer than a block
+static const uint32_t REVERB_LENGTHS[REVERB_LINES] = {1117, 1277, 1423, 1559, 1693, 1847, 1973, 2111};
+
+// Floats of line memory an effect needs at samplesPerSecond
+static uint32_t EffectMemorySize(audio_effect_type type, int samplesPerSecond) {
+  switch(type) {
+    case Effect_Delay: {
+      return 2 * (uint32_t) (samplesPerSecond * DELAY_MAX_SECONDS);
+    } break;
+    case Effect_Reverb: {
+      uint32_t size = 0;
+      for(int i = 0; i < REVERB_LINES; ++i) {
+        size += (uint32_t) ((uint64_t) REVERB_LENGTHS[i] * samplesPerSecond / 48000);
+      }
+      return size;
+    } break;
+    default: {
+      return 0;
+    } break;
+  }
+}
+
+// Biquads
+// Coefficients from the RBJ audio EQ cookbook
+static void SetBiquad(biquad *section, eq_band band, int samplesPerSecond) {
+  double pi = 3.14159265358979323846;
+  double frequency = band.frequency < samplesPerSecond * 0.49 ? band.frequency : samplesPerSecond * 0.49;
+  double w = 2.0 * pi * frequency / samplesPerSecond;
+  double cosw = cos(w);
+  double alpha = sin(w) / (2.0 * (band.q > 0.01f ? band.q : 0.01f));
+  double A = pow(10.0, band.gainDb / 40.0);
+  double shelf = 2.0 * sqrt(A) * alpha;
+  double b0 = 1, b1 = 0, b2 = 0, a0 = 1, a1 = 0, a2 = 0;
+  switch(band.type) {
+    case EQBand_LowPass: {
+      b0 = (1.0 - cosw) / 2.0, b1 = 1.0 - cosw, b2 = b0;
+      a0 = 1.0 + alpha, a1 = -2.0 * cosw, a2 = 1.0 - alpha;
+    } break;
+    case EQBand_HighPass: {
+      b0 = (1.0 + cosw) / 2.0, b1 = -(1.0 + cosw), b2 = b0;
+      a0 = 1.0 + alpha, a1 = -2.0 * cosw, a2 = 1.0 - alpha;
+    } break;
+    case EQBand_Peak: {
+      b0 = 1.0 + alpha * A, b1 = -2.0 * cosw, b2 = 1.0 - alpha * A;
+      a0 = 1.0 + alpha / A, a1 = -2.0 * cosw, a2 = 1.0 - alpha / A;
+    } break;
+    case EQBand_LowShelf: {
+      b0 = A * ((A + 1) - (A - 1) * cosw + shelf);
+      b1 = 2 * A * ((A - 1) - (A + 1) * cosw);
+      b2 = A * ((A + 1) - (A - 1) * cosw - shelf);
+      a0 = (A + 1) + (A - 1) * cosw + shelf;
+      a1 = -2 * ((A - 1) + (A + 1) * cosw);
+      a2 = (A + 1) + (A - 1) * cosw - shelf;
+    } break;
+    case EQBand_HighShelf: {
+      b0 = A * ((A + 1) + (A - 1) * cosw + shelf);
+      b1 = -2 * A * ((A - 1) + (A + 1) * cosw);
+      b2 = A * ((A + 1) + (A - 1) * cosw - shelf);
+      a0 = (A + 1) - (A - 1) * cosw + shelf;
+      a1 = 2 * ((A - 1) - (A + 1) * cosw);
+      a2 = (A + 1) - (A - 1) * cosw - shelf;
+    } break;
+    default: {
+    } break;
+  }
+  section->b0 = (float) (b0 / a0);
+  section->b1 = (float) (b1 / a0);
+  section->b2 = (float) (b2 / a0);
+  section->a1 = (float) (-a1 / a0);
+  section->a2 = (float) (-a2 / a0);
+
+  // Run the recursion on a unit input at each position and on each unit
+  // state to get the columns
+  for(int j = 0; j < 6; ++j) {
+    double z1 = j == 4 ? 1.0 : 0.0;
+    double z2 = j == 5 ? 1.0 : 0.0;
+    for(int n = 0; n < 4; ++n) {
+      double x = n == j ? 1.0 : 0.0;
+      double y = section->b0 * x + z1;
+      z1 = section->b1 * x + section->a1 * y + z2;
+      z2 = section->b2 * x + section->a2 * y;
+      section->columns[j][n] = (float) y;
+    }
+  }
+}
+
+// The plain recursion, for the samples past the last whole block
+inline void BiquadTail(biquad *section, int c, float *samples, int count) {
+  float z1 = section->z1[c];
+  float z2 = section->z2[c];
+  for(int i = 0; i < count; ++i) {
+    float x = samples[i];
+    float y = section->b0 * x + z1;
+    z1 = section->b1 * x + section->a1 * y + z2;
+    z2 = section->b2 * x + section->a2 * y;
+    samples[i] = y;
+  }
+  section->z1[c] = z1;
+  section->z2[c] = z2;
+}
+
+// The state after a block, from its last two inputs and outputs
+inline void BiquadBlockState(biquad *section, int c, float x2, float x3, float y2, float y3) {
+  section->z1[c] = section->b1 * x3 + section->a1 * y3 + (section->b2 * x2 + section->a2 * y2);
+  section->z2[c] = section->b2 * x3 + section->a2 * y3;
+}
+
+typedef void biquad_kernel(float *left, float *right, int count, biquad *sections, int sectionCount);
+
+static void BiquadScalar(float *left, float *right, int count, biquad *sections, int sectionCount) {
+  int blocks = count & ~3;
+  for(int s = 0; s < sectionCount; ++s) {
+    biquad *section = sections + s;
+    for(int c = 0; c < 2; ++c) {
+      float *samples = c ? right : left;
+      for(int i = 0; i < blocks; i += 4) {
+        float x[4] = {samples[i], samples[i + 1], samples[i + 2], samples[i + 3]};
+        float z1 = section->z1[c], z2 = section->z2[c];
+        for(int n = 0; n < 4; ++n) {
+          float y = x[0] * section->columns[0][n];
+          y = y + x[1] * section->columns[1][n];
+          y = y + x[2] * section->columns[2][n];
+          y = y + x[3] * section->columns[3][n];
+          y = y + z1 * section->columns[4][n];
+          y = y + z2 * section->columns[5][n];
+          samples[i + n] = y;
+        }
+        BiquadBlockState(section, c, x[2], x[3], samples[i + 2], samples[i + 3]);
+      }
+      BiquadTail(section, c, samples + blocks, count - blocks);
+    }
+  }
+}
+
+static void BiquadSSE2(float *left, float *right, int count, biquad *sections, int sectionCount) {
+  int blocks = count & ~3;
+  for(int s = 0; s < sectionCount; ++s) {
+    biquad *section = sections + s;
+    __m128 columns[6];
+    for(int j = 0; j < 6; ++j) {
+      columns[j] = _mm_loadu_ps(section->columns[j]);
+    }
+    for(int c = 0; c < 2; ++c) {
+      float *samples = c ? right : left;
+      for(int i = 0; i < blocks; i += 4) {
+        float x2 = samples[i + 2], x3 = samples[i + 3];
+        __m128 y = _mm_mul_ps(_mm_set1_ps(samples[i]), columns[0]);
+        y = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(samples[i + 1]), columns[1]));
+        y = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(x2), columns[2]));
+        y = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(x3), columns[3]));
+        y = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(section->z1[c]), columns[4]));
+        y = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(section->z2[c]), columns[5]));
+        _mm_storeu_ps(samples + i, y);
+        BiquadBlockState(section, c, x2, x3, samples[i + 2], samples[i + 3]);
+      }
+      BiquadTail(section, c, samples + blocks, count - blocks);
+    }
+  }
+}
+
+// Both channels at once, left in the low half
+RAIKA_TARGET_AVX2
+static void BiquadAVX2(float *left, float *right, int count, biquad *sections, int sectionCount) {
+  int blocks = count & ~3;
+  for(int s = 0; s < sectionCount; ++s) {
+    biquad *section = sections + s;
+    __m256 columns[6];
+    for(int j = 0; j < 6; ++j) {
+      columns[j] = _mm256_broadcast_ps((__m128 *) section->columns[j]);
+    }
+    for(int i = 0; i < blocks; i += 4) {
+      __m256 x[4];
+      for(int j = 0; j < 4; ++j) {
+        x[j] = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(left[i + j])), _mm_set1_ps(right[i + j]), 1);
+      }
+      __m256 z1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(section->z1[0])), _mm_set1_ps(section->z1[1]), 1);
+      __m256 z2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(section->z2[0])), _mm_set1_ps(section->z2[1]), 1);
+      __m256 y = _mm256_mul_ps(x[0], columns[0]);
+      y = _mm256_add_ps(y, _mm256_mul_ps(x[1], columns[1]));
+      y = _mm256_add_ps(y, _mm256_mul_ps(x[2], columns[2]));
+      y = _mm256_add_ps(y, _mm256_mul_ps(x[3], columns[3]));
+      y = _mm256_add_ps(y, _mm256_mul_ps(z1, columns[4]));
+      y = _mm256_add_ps(y, _mm256_mul_ps(z2, columns[5]));
+      float x2[2] = {left[i + 2], right[i + 2]};
+      float x3[2] = {left[i + 3], right[i + 3]};
+      _mm_storeu_ps(left + i, _mm256_castps256_ps128(y));
+      _mm_storeu_ps(right + i, _mm256_extractf128_ps(y, 1));
+      BiquadBlockState(section, 0, x2[0], x3[0], left[i + 2], left[i + 3]);
+      BiquadBlockState(section, 1, x2[1], x3[1], right[i + 2], right[i + 3]);
+    }
+    BiquadTail(section, 0, left + blocks, count - blocks);
+    BiquadTail(section, 1, right + blocks, count - blocks);
+  }
+}
+
+// Delay
+// One stretch of a channel: reads what was written delay samples ago, writes
+// the input plus feedback and leaves the dry and wet mix in place
+typedef void delay_kernel(float *samples, float *read, float *write, int count, float feedback, float dry, float wet);
+
+static void DelayScalar(float *samples, float *read, float *write, int count, float feedback, float dry, float wet) {
+  for(int i = 0; i < count; ++i) {
+    float x = samples[i];
+    float y = read[i];
+    write[i] = x + y * feedback;
+    samples[i] = x * dry + y * wet;
+  }
+}
+
+static void DelaySSE2(float *samples, float *read, float *write, int count, float feedback, float dry, float wet) {
+  __m128 feedbackWide = _mm_set1_ps(feedback);
+  __m128 dryWide = _mm_set1_ps(dry);
+  __m128 wetWide = _mm_set1_ps(wet);
+  int i = 0;
+  for(; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(samples + i);
+    __m128 y = _mm_loadu_ps(read + i);
+    _mm_storeu_ps(write + i, _mm_add_ps(x, _mm_mul_ps(y, feedbackWide)));
+    _mm_storeu_ps(samples + i, _mm_add_ps(_mm_mul_ps(x, dryWide), _mm_mul_ps(y, wetWide)));
+  }
+  DelayScalar(samples + i, read + i, write + i, count - i, feedback, dry, wet);
+}
+
+RAIKA_TARGET_AVX2
+static void DelayAVX2(float *samples, float *read, float *write, int count, float feedback, float dry, float wet) {
+  __m256 feedbackWide = _mm256_set1_ps(feedback);
+  __m256 dryWide = _mm256_set1_ps(dry);
+  __m256 wetWide = _mm256_set1_ps(wet);
+  int i = 0;
+  for(; i + 8 <= count; i += 8) {
+    __m256 x = _mm256_loadu_ps(samples + i);
+    __m256 y = _mm256_loadu_ps(read + i);
+    _mm256_storeu_ps(write + i, _mm256_add_ps(x, _mm256_mul_ps(y, feedbackWide)));
+    _mm256_storeu_ps(samples + i, _mm256_add_ps(_mm256_mul_ps(x, dryWide), _mm256_mul_ps(y, wetWide)));
+  }
+  DelayScalar(samples + i, read + i, write + i, count - i, feedback, dry, wet);
+}
+
+// Reverb
+// Mixes a chunk of damped line outputs into the bus, then turns them into
+// what goes back into the lines: scaled by each line's decay, through the
+// Hadamard butterflies and normalised, plus the input.
+typedef void reverb_kernel(
+  float (*taps)[EFFECT_MAX_BLOCK], float *gains, float *input,
+  float *left, float *right, float dry, float wet, int count
+);
+
+#define REVERB_NORMALIZE 0.35355339f
+
+static void ReverbScalar(
+    float (*taps)[EFFECT_MAX_BLOCK], float *gains, float *input,
+    float *left, float *right, float dry, float wet, int count
+) {
+  for(int i = 0; i < count; ++i) {
+    float t[REVERB_LINES];
+    for(int l = 0; l < REVERB_LINES; ++l) {
+      t[l] = taps[l][i];
+    }
+    left[i] = left[i] * dry + ((t[0] + t[2]) + (t[4] + t[6])) * wet;
+    right[i] = right[i] * dry + ((t[1] + t[3]) + (t[5] + t[7])) * wet;
+    for(int l = 0; l < REVERB_LINES; ++l) {
+      t[l] = t[l] * gains[l];
+    }
+    for(int half = 1; half < REVERB_LINES; half *= 2) {
+      for(int l = 0; l < REVERB_LINES; ++l) {
+        if(!(l & half)) {
+          float a = t[l], b = t[l + half];
+          t[l] = a + b;
+          t[l + half] = a - b;
+        }
+      }
+    }
+    for(int l = 0; l < REVERB_LINES; ++l) {
+      taps[l][i] = t[l] * REVERB_NORMALIZE + input[i];
+    }
+  }
+}
+
+static void ReverbSSE2(
+    float (*taps)[EFFECT_MAX_BLOCK], float *gains, float *input,
+    float *left, float *right, float dry, float wet, int count
+) {
+  __m128 dryWide = _mm_set1_ps(dry);
+  __m128 wetWide = _mm_set1_ps(wet);
+  __m128 normalize = _mm_set1_ps(REVERB_NORMALIZE);
+  int i = 0;
+  for(; i + 4 <= count; i += 4) {
+    __m128 t[REVERB_LINES];
+    for(int l = 0; l < REVERB_LINES; ++l) {
+      t[l] = _mm_loadu_ps(taps[l] + i);
+    }
+    __m128 l4 = _mm_add_ps(_mm_add_ps(t[0], t[2]), _mm_add_ps(t[4], t[6]));
+    __m128 r4 = _mm_add_ps(_mm_add_ps(t[1], t[3]), _mm_add_ps(t[5], t[7]));
+    _mm_storeu_ps(left + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(left + i), dryWide), _mm_mul_ps(l4, wetWide)));
+    _mm_storeu_ps(right + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(right + i), dryWide), _mm_mul_ps(r4, wetWide)));
+    for(int l = 0; l < REVERB_LINES; ++l) {
+      t[l] = _mm_mul_ps(t[l], _mm_set1_ps(gains[l]));
+    }
+    for(int half = 1; half < REVERB_LINES; half *= 2) {
+      for(int l = 0; l < REVERB_LINES; ++l) {
+        if(!(l & half)) {
+          __m128 a = t[l], b = t[l + half];
+          t[l] = _mm_add_ps(a, b);
+          t[l + half] = _mm_sub_ps(a, b);
+        }
+      }
+    }
+    __m128 in = _mm_loadu_ps(input + i);
+    for(int l = 0; l < REVERB_LINES; ++l) {
+      _mm_storeu_ps(taps[l] + i, _mm_add_ps(_mm_mul_ps(t[l], normalize), in));
+    }
+  }
+  // Rows shifted to start at i, for the scalar version to finish
+  float (*rest)[EFFECT_MAX_BLOCK] = (float (*)[EFFECT_MAX_BLOCK]) (&taps[0][i]);
+  ReverbScalar(rest, gains, input + i, left + i, right + i, dry, wet, count - i);
+}
+
+RAIKA_TARGET_AVX2
+static void ReverbAVX2(
+    float (*taps)[EFFECT_MAX_BLOCK], float *gains, float *input,
+    float *left, float *right, float dry, float wet, int count
+) {
+  __m256 dryWide = _mm256_set1_ps(dry);
+  __m256 wetWide = _mm256_set1_ps(wet);
+  __m256 normalize = _mm256_set1_ps(REVERB_NORMALIZE);
+  int i = 0;
+  for(; i + 8 <= count; i += 8) {
+    __m256 t[REVERB_LINES];
+    for(int l = 0; l < REVERB_LINES; ++l) {
+      t[l] = _mm256_loadu_ps(taps[l] + i);
+    }
+    __m256 l8 = _mm256_add_ps(_mm256_add_ps(t[0], t[2]), _mm256_add_ps(t[4], t[6]));
+    __m256 r8 = _mm256_add_ps(_mm256_add_ps(t[1], t[3]), _mm256_add_ps(t[5], t[7]));
+    _mm256_storeu_ps(left + i, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(left + i), dryWide), _mm256_mul_ps(l8, wetWide)));
+    _mm256_storeu_ps(right + i, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(right + i), dryWide), _mm256_mul_ps(r8, wetWide)));
+    for(int l = 0; l < REVERB_LINES; ++l) {
+      t[l] = _mm256_mul_ps(t[l], _mm256_set1_ps(gains[l]));
+    }
+    for(int half = 1; half < REVERB_LINES; half *= 2) {
+      for(int l = 0; l < REVERB_LINES; ++l) {
+        if(!(l & half)) {
+          __m256 a = t[l], b = t[l + half];
+          t[l] = _mm256_add_ps(a, b);
+          t[l + half] = _mm256_sub_ps(a, b);
+        }
+      }
+    }
+    __m256 in = _mm256_loadu_ps(input + i);
+    for(int l = 0; l < REVERB_LINES; ++l) {
+      _mm256_storeu_ps(taps[l] + i, _mm256_add_ps(_mm256_mul_ps(t[l], normalize), in));
+    }
+  }
+  float (*rest)[EFFECT_MAX_BLOCK] = (float (*)[EFFECT_MAX_BLOCK]) (&taps[0][i]);
+  ReverbScalar(rest, gains, input + i, left + i, right + i, dry, wet, count - i);
+}
+
+struct effect_kernels {
+  const char *name;
+  biquad_kernel *biquad;
+  delay_kernel *delay;
+  reverb_kernel *reverb;
+};
+
+// Ordered slowest to fastest, the last supported one wins
+static effect_kernels GetEffectKernels(int index) {
+  cpu_features *cpu = GetCpuFeatures();
+  effect_kernels result = {};
+  switch(index) {
+    case 0: {
+      result.name = "scalar";
+      result.biquad = BiquadScalar;
+      result.delay = DelayScalar;
+      result.reverb = ReverbScalar;
+    } break;
+    case 1: {
+      if(cpu->sse2) {
+        result.name = "sse2";
+        result.biquad = BiquadSSE2;
+        result.delay = DelaySSE2;
+        result.reverb = ReverbSSE2;
+      }
+    } break;
+    case 2: {
+      if(cpu->avx2) {
+        result.name = "avx2";
+        result.biquad = BiquadAVX2;
+        result.delay = DelayAVX2;
+        result.reverb = ReverbAVX2;
+      }
+    } break;
+  }
+  return result;
+}
+#define EFFECT_KERNEL_COUNT 3
+
+static effect_kernels globalEffectKernels;
+
+static effect_kernels *PickEffectKernels() {
+  if(!globalEffectKernels.name) {
+    for(int i = 0; i < EFFECT_KERNEL_COUNT; ++i) {
+      effect_kernels kernels = GetEffectKernels(i);
+      if(kernels.name) {
+        globalEffectKernels = kernels;
+      }
+    }
+  }
+  return &globalEffectKernels;
+}
+
+// Setup
+// memory holds EffectMemorySize floats and belongs to the effect from here
+static void InitEffect(audio_effect *effect, audio_effect_type type, int samplesPerSecond, float *memory) {
+  memset(effect, 0, sizeof(*effect));
+  effect->type = type;
+  effect->samplesPerSecond = samplesPerSecond;
+  memset(memory, 0, EffectMemorySize(type, samplesPerSecond) * sizeof(float));
+  switch(type) {
+    case Effect_Delay: {
+      effect_delay *delay = &effect->delay;
+      delay->length = (uint32_t) (samplesPerSecond * DELAY_MAX_SECONDS);
+      delay->lines[0] = memory;
+      delay->lines[1] = memory + delay->length;
+      delay->delay = delay->length / 4;
+      delay->feedback = 0.3f;
+      delay->dry = 1.0f;
+      delay->wet = 0.3f;
+    } break;
+    case Effect_Reverb: {
+      effect_reverb *reverb = &effect->reverb;
+      for(int i = 0; i < REVERB_LINES; ++i) {
+        reverb->lengths[i] = (uint32_t) ((uint64_t) REVERB_LENGTHS[i] * samplesPerSecond / 48000);
+        reverb->lines[i] = memory;
+        memory += reverb->lengths[i];
+      }
+      reverb->dry = 1.0f;
+      reverb->wet = 0.2f;
+    } break;
+    default: {
+    } break;
+  }
+}
+
+static void SetEQBand(audio_effect *effect, int band, eq_band settings) {
+  if(effect->type != Effect_EQ || band < 0 || band >= EQ_MAX_BANDS) {
+    return;
+  }
+  effect_eq *eq = &effect->eq;
+  eq->bands[band] = settings;
+  // Bands that are off drop out of the chain. Sections keep the state of the
+  // one that was in their place so a change does not restart the filter.
+  biquad sections[EQ_MAX_BANDS];
+  int count = 0;
+  for(int b = 0; b < EQ_MAX_BANDS; ++b) {
+    if(eq->bands[b].type == EQBand_Off) {
+      continue;
+    }
+    biquad *section = sections + count;
+    *section = {};
+    SetBiquad(section, eq->bands[b], effect->samplesPerSecond);
+    if(count < eq->sectionCount) {
+      memcpy(section->z1, eq->sections[count].z1, sizeof(section->z1));
+      memcpy(section->z2, eq->sections[count].z2, sizeof(section->z2));
+    }
+    ++count;
+  }
+  memcpy(eq->sections, sections, sizeof(sections));
+  eq->sectionCount = count;
+}
+
+// Changing the time jumps the read position, so it clicks on a busy line
+static void SetDelay(audio_effect *effect, float seconds, float feedback, float dry, float wet) {
+  if(effect->type != Effect_Delay) {
+    return;
+  }
+  effect_delay *delay = &effect->delay;
+  uint32_t samples = (uint32_t) (seconds * effect->samplesPerSecond);
+  delay->delay = samples < 1 ? 1 : (samples > delay->length ? delay->length : samples);
+  delay->feedback = feedback < 0.0f ? 0.0f : (feedback > 0.95f ? 0.95f : feedback);
+  delay->dry = dry;
+  delay->wet = wet;
+}
+
+// Decay is the RT60, damping from 0 to 1 takes highs out of the tail
+static void SetReverb(audio_effect *effect, float decaySeconds, float damping, float dry, float wet) {
+  if(effect->type != Effect_Reverb) {
+    return;
+  }
+  effect_reverb *reverb = &effect->reverb;
+  decaySeconds = decaySeconds > 0.05f ? decaySeconds : 0.05f;
+  for(int i = 0; i < REVERB_LINES; ++i) {
+    reverb->gains[i] = (float) pow(10.0, -3.0 * reverb->lengths[i] / (effect->samplesPerSecond * decaySeconds));
+  }
+  reverb->damping = damping < 0.0f ? 0.0f : (damping > 0.95f ? 0.95f : damping);
+  reverb->dry = dry;
+  reverb->wet = wet;
+}
+
+// Processing
+static void ProcessDelay(effect_kernels *kernels, effect_delay *delay, float *left, float *right, int count) {
+  int done = 0;
+  while(done < count) {
+    uint32_t readAt = (delay->writeAt + delay->length - delay->delay) % delay->length;
+    // Up to the first wrap of either position, and never reading what this
+    // stretch writes
+    uint32_t n = (uint32_t) (count - done);
+    n = n < delay->delay ? n : delay->delay;
+    n = n < delay->length - readAt ? n : delay->length - readAt;
+    n = n < delay->length - delay->writeAt ? n : delay->length - delay->writeAt;
+    for(int c = 0; c < 2; ++c) {
+      float *line = delay->lines[c];
+      kernels->delay((c ? right : left) + done, line + readAt, line + delay->writeAt, (int) n, delay->feedback, delay->dry, delay->wet);
+    }
+    delay->writeAt = (delay->writeAt + n) % delay->length;
+    done += (int) n;
+  }
+}
+
+// Each line's read and write positions are the same sample, so a chunk is
+// read out, damped, mixed and written back in place. Chunks stop where the
+// first line wraps. The damping filters are a recursion in time, so they run
+// across the lines for each sample rather than down one line at a time.
+static void ProcessReverb(effect_kernels *kernels, effect_reverb *reverb, float *left, float *right, int count) {
+  float keep = reverb->damping;
+  float take = 1.0f - keep;
+  int done = 0;
+  while(done < count) {
+    int n = count - done;
+    float *read[REVERB_LINES];
+    for(int l = 0; l < REVERB_LINES; ++l) {
+      int untilWrap = (int) (reverb->lengths[l] - reverb->at[l]);
+      n = n < untilWrap ? n : untilWrap;
+      read[l] = reverb->lines[l] + reverb->at[l];
+    }
+    for(int i = 0; i < n; ++i) {
+      reverb->input[i] = (left[done + i] + right[done + i]) * 0.5f;
+    }
+    float state[REVERB_LINES];
+    memcpy(state, reverb->lowPass, sizeof(state));
+    for(int i = 0; i < n; ++i) {
+      for(int l = 0; l < REVERB_LINES; ++l) {
+        state[l] = read[l][i] * take + state[l] * keep;
+        reverb->taps[l][i] = state[l];
+      }
+    }
+    memcpy(reverb->lowPass, state, sizeof(state));
+    kernels->reverb(reverb->taps, reverb->gains, reverb->input, left + done, right + done, reverb->dry, reverb->wet, n);
+    for(int l = 0; l < REVERB_LINES; ++l) {
+      memcpy(read[l], reverb->taps[l], n * sizeof(float));
+      reverb->at[l] = reverb->at[l] + n < reverb->lengths[l] ? reverb->at[l] + n : 0;
+    }
+    done += n;
+  }
+}
+
+static void ProcessEffect(effect_kernels *kernels, audio_effect *effect, float *left, float *right, int count) {
+  Assert(count <= EFFECT_MAX_BLOCK);
+  if(effect->bypass) {
+    return;
+  }
+  uint64_t start = __rdtsc();
+  switch(effect->type) {
+    case Effect_EQ: {
+      kernels->biquad(left, right, count, effect->eq.sections, effect->eq.sectionCount);
+    } break;
+    case Effect_Delay: {
+      ProcessDelay(kernels, &effect->delay, left, right, count);
+    } break;
+    case Effect_Reverb: {
+      ProcessReverb(kernels, &effect->reverb, left, right, count);
+    } break;
+    default: {
+    } break;
+  }
+  effect->cycles += __rdtsc() - start;
+  effect->samples += count;
+}
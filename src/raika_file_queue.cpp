@@ -0,0 +1,662 @@
+// Async file reads shared by the platform layers. Include after raika.cpp.
+//
+// On Linux reads go through an io_uring driven entirely from the thread that
+// owns the queue: polls and waits reap completions and submit more, so no
+// extra threads are involved. The ring is set up through raw syscalls and
+// needs nothing linked. Kernels or sandboxes without io_uring, Windows, and
+// RAIKA_FILE_QUEUE=pool get a few threads doing blocking positioned reads
+// instead. Either way, reads not yet started wait in a FIFO per priority,
+// and the highest priority with anything waiting feeds the ring or the
+// threads first.
+//
+// Environment:
+//   RAIKA_FILE_QUEUE=pool  skips io_uring
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define FILE_QUEUE_URING 1
+#endif
+#endif
+
+// Reads queued and not yet reported
+#define FILE_QUEUE_MAX_READS 256
+// Reads the ring has going at once
+#define FILE_QUEUE_RING_DEPTH 64
+#define FILE_QUEUE_POOL_THREADS 4
+// The longest piece handed to the kernel at once, longer reads go in pieces
+#define FILE_QUEUE_MAX_CHUNK (1u << 30)
+
+struct file_read {
+  // Handed out with the read so stale ids stop working once it is reused
+  uint16_t generation;
+  file_read_state state;
+  file_read_priority priority;
+  uint64_t handle;
+  uint64_t offset;
+  uint64_t size;
+  uint8_t *dest;
+  uint64_t bytesRead;
+  // The next read waiting at the same priority, -1 for none
+  int next;
+};
+
+struct platform_file_queue {
+  // Otherwise the pool
+  bool ring;
+  // io_uring_enter failed for good, so every read since fails too
+  bool ringFailed;
+  file_read reads[FILE_QUEUE_MAX_READS];
+  uint16_t free[FILE_QUEUE_MAX_READS];
+  int freeCount;
+  int pendingHead[FileReadPriority_Count];
+  int pendingTail[FileReadPriority_Count];
+  int inFlight;
+
+#if defined(FILE_QUEUE_URING)
+  int ringFd;
+  uint8_t *sqMemory;
+  size_t sqSize;
+  uint8_t *cqMemory;
+  size_t cqSize;
+  io_uring_sqe *sqes;
+  size_t sqesSize;
+  uint32_t sqEntries;
+  uint32_t *sqHead;
+  uint32_t *sqTail;
+  uint32_t *sqMask;
+  uint32_t *sqArray;
+  uint32_t *cqHead;
+  uint32_t *cqTail;
+  uint32_t *cqMask;
+  io_uring_cqe *cqes;
+  // Prepared but not yet handed to the kernel
+  uint32_t toSubmit;
+#endif
+
+  // The pool. The lock guards the reads and the waiting lists, the ring
+  // never takes it.
+  int threadCount;
+  bool quit;
+#if defined(_WIN32)
+  CRITICAL_SECTION lock;
+  CONDITION_VARIABLE wake;
+  CONDITION_VARIABLE finished;
+  HANDLE threads[FILE_QUEUE_POOL_THREADS];
+#else
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t finished;
+  pthread_t threads[FILE_QUEUE_POOL_THREADS];
+#endif
+};
+
+// Files
+#if defined(_WIN32)
+static platform_file PlatformOpenFile(char *filename) {
+  platform_file file = {};
+  HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+  if(handle != INVALID_HANDLE_VALUE) {
+    LARGE_INTEGER fileSize;
+    if(GetFileSizeEx(handle, &fileSize)) {
+      file.handle = (uint64_t) handle;
+      file.size = (uint64_t) fileSize.QuadPart;
+    } else {
+      CloseHandle(handle);
+    }
+  }
+  return file;
+}
+
+static void PlatformCloseFile(platform_file *file) {
+  if(file->handle) {
+    CloseHandle((HANDLE) file->handle);
+  }
+  *file = {};
+}
+#else
+// Handles are the descriptor plus one so zero can mean none
+static platform_file PlatformOpenFile(char *filename) {
+  platform_file file = {};
+  int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if(fd >= 0) {
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) == 0) {
+      file.handle = (uint64_t) fd + 1;
+      file.size = (uint64_t) fileStat.st_size;
+    } else {
+      close(fd);
+    }
+  }
+  return file;
+}
+
+static void PlatformCloseFile(platform_file *file) {
+  if(file->handle) {
+    close((int) (file->handle - 1));
+  }
+  *file = {};
+}
+#endif
+
+// Waiting lists
+static void PushPendingRead(platform_file_queue *queue, int index, bool front) {
+  file_read *read = queue->reads + index;
+  int priority = read->priority;
+  if(front) {
+    read->next = queue->pendingHead[priority];
+    queue->pendingHead[priority] = index;
+    if(queue->pendingTail[priority] < 0) {
+      queue->pendingTail[priority] = index;
+    }
+  } else {
+    read->next = -1;
+    if(queue->pendingTail[priority] >= 0) {
+      queue->reads[queue->pendingTail[priority]].next = index;
+    } else {
+      queue->pendingHead[priority] = index;
+    }
+    queue->pendingTail[priority] = index;
+  }
+}
+
+// -1 when nothing is waiting
+static int PopPendingRead(platform_file_queue *queue) {
+  for(int priority = FileReadPriority_Count - 1; priority >= 0; --priority) {
+    int index = queue->pendingHead[priority];
+    if(index >= 0) {
+      queue->pendingHead[priority] = queue->reads[index].next;
+      if(queue->pendingHead[priority] < 0) {
+        queue->pendingTail[priority] = -1;
+      }
+      return index;
+    }
+  }
+  return -1;
+}
+
+// Where a read that made progress goes next
+static void FinishReadPiece(file_read *read, int64_t result, bool *again) {
+  *again = false;
+  if(result < 0) {
+    read->state = FileRead_Failed;
+  } else if(result == 0 || read->bytesRead + result >= read->size) {
+    read->bytesRead += result;
+    read->state = FileRead_Done;
+  } else {
+    read->bytesRead += result;
+    *again = true;
+  }
+}
+
+inline uint32_t FileReadPieceSize(file_read *read) {
+  uint64_t left = read->size - read->bytesRead;
+  return (uint32_t) (left < FILE_QUEUE_MAX_CHUNK ? left : FILE_QUEUE_MAX_CHUNK);
+}
+
+// The ring
+#if defined(FILE_QUEUE_URING)
+static bool SetupFileRing(platform_file_queue *queue) {
+  io_uring_params params = {};
+  int fd = (int) syscall(__NR_io_uring_setup, FILE_QUEUE_RING_DEPTH, &params);
+  if(fd < 0) {
+    return false;
+  }
+
+  // Plain reads need 5.6 or later
+  uint8_t probeMemory[sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op)] = {};
+  io_uring_probe *probe = (io_uring_probe *) probeMemory;
+  bool canRead = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+                 probe->last_op >= IORING_OP_READ && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+
+  queue->sqSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  queue->cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+  if(single) {
+    queue->sqSize = queue->sqSize > queue->cqSize ? queue->sqSize : queue->cqSize;
+    queue->cqSize = queue->sqSize;
+  }
+  queue->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  void *sq = canRead ? mmap(0, queue->sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING) : MAP_FAILED;
+  void *cq = sq;
+  if(sq != MAP_FAILED && !single) {
+    cq = mmap(0, queue->cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  }
+  void *sqes = cq != MAP_FAILED && sq != MAP_FAILED ?
+    mmap(0, queue->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES) : MAP_FAILED;
+  if(sqes == MAP_FAILED) {
+    if(cq != MAP_FAILED && cq != sq) {
+      munmap(cq, queue->cqSize);
+    }
+    if(sq != MAP_FAILED) {
+      munmap(sq, queue->sqSize);
+    }
+    close(fd);
+    return false;
+  }
+
+  queue->ringFd = fd;
+  queue->sqMemory = (uint8_t *) sq;
+  queue->cqMemory = (uint8_t *) cq;
+  queue->sqes = (io_uring_sqe *) sqes;
+  queue->sqEntries = params.sq_entries;
+  queue->sqHead = (uint32_t *) (queue->sqMemory + params.sq_off.head);
+  queue->sqTail = (uint32_t *) (queue->sqMemory + params.sq_off.tail);
+  queue->sqMask = (uint32_t *) (queue->sqMemory + params.sq_off.ring_mask);
+  queue->sqArray = (uint32_t *) (queue->sqMemory + params.sq_off.array);
+  queue->cqHead = (uint32_t *) (queue->cqMemory + params.cq_off.head);
+  queue->cqTail = (uint32_t *) (queue->cqMemory + params.cq_off.tail);
+  queue->cqMask = (uint32_t *) (queue->cqMemory + params.cq_off.ring_mask);
+  queue->cqes = (io_uring_cqe *) (queue->cqMemory + params.cq_off.cqes);
+  return true;
+}
+
+// False when the submission ring is full
+static bool PrepareRingRead(platform_file_queue *queue, int index) {
+  uint32_t tail = *queue->sqTail;
+  if(tail - __atomic_load_n(queue->sqHead, __ATOMIC_ACQUIRE) >= queue->sqEntries) {
+    return false;
+  }
+  file_read *read = queue->reads + index;
+  uint32_t slot = tail & *queue->sqMask;
+  io_uring_sqe *sqe = queue->sqes + slot;
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = (int) (read->handle - 1);
+  sqe->off = read->offset + read->bytesRead;
+  sqe->addr = (uint64_t) (uintptr_t) (read->dest + read->bytesRead);
+  sqe->len = FileReadPieceSize(read);
+  sqe->user_data = (uint64_t) index;
+  queue->sqArray[slot] = slot;
+  __atomic_store_n(queue->sqTail, tail + 1, __ATOMIC_RELEASE);
+  ++queue->toSubmit;
+  ++queue->inFlight;
+  return true;
+}
+
+// Starts waiting reads until the ring is as deep as it goes
+static void FillRing(platform_file_queue *queue) {
+  while(queue->inFlight < FILE_QUEUE_RING_DEPTH) {
+    int index = PopPendingRead(queue);
+    if(index < 0) {
+      break;
+    }
+    if(!PrepareRingRead(queue, index)) {
+      PushPendingRead(queue, index, true);
+      break;
+    }
+  }
+}
+
+// Nothing can submit or wait any more, so every read the queue holds fails,
+// the ones the kernel already had included. A read that fails this way may
+// still have had some of its bytes written.
+static void FailFileRing(platform_file_queue *queue) {
+  queue->ringFailed = true;
+  for(int i = 0; i < FILE_QUEUE_MAX_READS; ++i) {
+    if(queue->reads[i].state == FileRead_Pending) {
+      queue->reads[i].state = FileRead_Failed;
+    }
+  }
+  for(int priority = 0; priority < FileReadPriority_Count; ++priority) {
+    queue->pendingHead[priority] = -1;
+    queue->pendingTail[priority] = -1;
+  }
+  queue->inFlight = 0;
+  queue->toSubmit = 0;
+}
+
+// Hands prepared reads to the kernel, and with wait blocks for at least one
+// completion. A full completion queue comes back at once so the caller can
+// reap. False once the ring has failed, see FailFileRing.
+static bool EnterRing(platform_file_queue *queue, bool wait) {
+  while(!queue->ringFailed) {
+    int result = (int) syscall(
+      __NR_io_uring_enter, queue->ringFd, queue->toSubmit, wait ? 1 : 0,
+      wait ? IORING_ENTER_GETEVENTS : 0, 0, 0
+    );
+    if(result >= 0) {
+      queue->toSubmit -= (uint32_t) result < queue->toSubmit ? (uint32_t) result : queue->toSubmit;
+      return true;
+    }
+    if(errno == EAGAIN || errno == EBUSY) {
+      return true;
+    }
+    if(errno != EINTR) {
+      FailFileRing(queue);
+    }
+  }
+  return false;
+}
+
+// Completions left after a failure may name reads already reused
+static void ReapRing(platform_file_queue *queue) {
+  if(queue->ringFailed) {
+    return;
+  }
+  uint32_t head = *queue->cqHead;
+  uint32_t tail = __atomic_load_n(queue->cqTail, __ATOMIC_ACQUIRE);
+  while(head != tail) {
+    io_uring_cqe *cqe = queue->cqes + (head & *queue->cqMask);
+    int index = (int) cqe->user_data;
+    int result = cqe->res;
+    ++head;
+    --queue->inFlight;
+    file_read *read = queue->reads + index;
+    bool again = false;
+    if(result == -EINTR || result == -EAGAIN) {
+      again = true;
+    } else {
+      FinishReadPiece(read, result, &again);
+    }
+    if(again) {
+      PushPendingRead(queue, index, true);
+    }
+  }
+  __atomic_store_n(queue->cqHead, head, __ATOMIC_RELEASE);
+}
+
+static void FreeFileRing(platform_file_queue *queue) {
+  munmap(queue->sqes, queue->sqesSize);
+  if(queue->cqMemory != queue->sqMemory) {
+    munmap(queue->cqMemory, queue->cqSize);
+  }
+  munmap(queue->sqMemory, queue->sqSize);
+  close(queue->ringFd);
+}
+#endif
+
+// The pool
+static void LockFileQueue(platform_file_queue *queue) {
+  if(!queue->ring) {
+#if defined(_WIN32)
+    EnterCriticalSection(&queue->lock);
+#else
+    pthread_mutex_lock(&queue->lock);
+#endif
+  }
+}
+
+static void UnlockFileQueue(platform_file_queue *queue) {
+  if(!queue->ring) {
+#if defined(_WIN32)
+    LeaveCriticalSection(&queue->lock);
+#else
+    pthread_mutex_unlock(&queue->lock);
+#endif
+  }
+}
+
+// Bytes read, 0 at the end of the file, negative on errors
+static int64_t ReadFilePiece(uint64_t handle, uint8_t *dest, uint32_t size, uint64_t offset) {
+#if defined(_WIN32)
+  OVERLAPPED overlapped = {};
+  overlapped.Offset = (DWORD) offset;
+  overlapped.OffsetHigh = (DWORD) (offset >> 32);
+  DWORD bytesRead = 0;
+  if(!ReadFile((HANDLE) handle, dest, size, &bytesRead, &overlapped)) {
+    return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+  }
+  return bytesRead;
+#else
+  for(;;) {
+    ssize_t result = pread((int) (handle - 1), dest, size, (off_t) offset);
+    if(result >= 0 || errno != EINTR) {
+      return result;
+    }
+  }
+#endif
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI FileQueueThreadProc(LPVOID parameter) {
+#else
+static void *FileQueueThreadProc(void *parameter) {
+#endif
+  platform_file_queue *queue = (platform_file_queue *) parameter;
+  LockFileQueue(queue);
+  while(!queue->quit) {
+    int index = PopPendingRead(queue);
+    if(index < 0) {
+#if defined(_WIN32)
+      SleepConditionVariableCS(&queue->wake, &queue->lock, INFINITE);
+#else
+      pthread_cond_wait(&queue->wake, &queue->lock);
+#endif
+      continue;
+    }
+    file_read *read = queue->reads + index;
+    ++queue->inFlight;
+    bool again = true;
+    while(again) {
+      uint64_t handle = read->handle;
+      uint8_t *dest = read->dest + read->bytesRead;
+      uint64_t offset = read->offset + read->bytesRead;
+      uint32_t size = FileReadPieceSize(read);
+      UnlockFileQueue(queue);
+      int64_t result = ReadFilePiece(handle, dest, size, offset);
+      LockFileQueue(queue);
+      FinishReadPiece(read, result, &again);
+    }
+    --queue->inFlight;
+#if defined(_WIN32)
+    WakeAllConditionVariable(&queue->finished);
+#else
+    pthread_cond_broadcast(&queue->finished);
+#endif
+  }
+  UnlockFileQueue(queue);
+  return 0;
+}
+
+// Setup
+static void MakeFileQueue(platform_file_queue *queue) {
+  *queue = {};
+  for(int i = 0; i < FILE_QUEUE_MAX_READS; ++i) {
+    queue->free[i] = (uint16_t) (FILE_QUEUE_MAX_READS - 1 - i);
+  }
+  queue->freeCount = FILE_QUEUE_MAX_READS;
+  for(int priority = 0; priority < FileReadPriority_Count; ++priority) {
+    queue->pendingHead[priority] = -1;
+    queue->pendingTail[priority] = -1;
+  }
+
+#if defined(FILE_QUEUE_URING)
+  char *mode = getenv("RAIKA_FILE_QUEUE");
+  if(!mode || strcmp(mode, "pool") != 0) {
+    queue->ring = SetupFileRing(queue);
+  }
+#endif
+  if(!queue->ring) {
+#if defined(_WIN32)
+    InitializeCriticalSection(&queue->lock);
+    InitializeConditionVariable(&queue->wake);
+    InitializeConditionVariable(&queue->finished);
+    for(int i = 0; i < FILE_QUEUE_POOL_THREADS; ++i) {
+      queue->threads[i] = CreateThread(0, 0, FileQueueThreadProc, queue, 0, 0);
+      queue->threadCount += queue->threads[i] != 0;
+    }
+#else
+    pthread_mutex_init(&queue->lock, 0);
+    pthread_cond_init(&queue->wake, 0);
+    pthread_cond_init(&queue->finished, 0);
+    for(int i = 0; i < FILE_QUEUE_POOL_THREADS; ++i) {
+      if(pthread_create(queue->threads + queue->threadCount, 0, FileQueueThreadProc, queue) == 0) {
+        ++queue->threadCount;
+      }
+    }
+#endif
+  }
+}
+
+// Reads still going are waited for, not cancelled
+static void FreeFileQueue(platform_file_queue *queue) {
+#if defined(FILE_QUEUE_URING)
+  if(queue->ring) {
+    while(queue->inFlight && EnterRing(queue, true)) {
+      ReapRing(queue);
+    }
+    FreeFileRing(queue);
+    return;
+  }
+#endif
+  LockFileQueue(queue);
+  queue->quit = true;
+#if defined(_WIN32)
+  WakeAllConditionVariable(&queue->wake);
+#else
+  pthread_cond_broadcast(&queue->wake);
+#endif
+  UnlockFileQueue(queue);
+  for(int i = 0; i < queue->threadCount; ++i) {
+#if defined(_WIN32)
+    WaitForSingleObject(queue->threads[i], INFINITE);
+    CloseHandle(queue->threads[i]);
+#else
+    pthread_join(queue->threads[i], 0);
+#endif
+  }
+#if defined(_WIN32)
+  DeleteCriticalSection(&queue->lock);
+#else
+  pthread_cond_destroy(&queue->finished);
+  pthread_cond_destroy(&queue->wake);
+  pthread_mutex_destroy(&queue->lock);
+#endif
+}
+
+inline const char *FileQueueName(platform_file_queue *queue) {
+  return queue->ring ? "io_uring" : "thread pool";
+}
+
+// Reads
+inline uint32_t MakeFileReadId(int index, uint16_t generation) {
+  return ((uint32_t) generation << 16) | (uint32_t) (index + 1);
+}
+
+// Null when id is not a read the queue is holding
+static file_read *GetFileRead(platform_file_queue *queue, uint32_t id) {
+  int index = (int) (id & 0xFFFF) - 1;
+  if(index < 0 || index >= FILE_QUEUE_MAX_READS) {
+    return 0;
+  }
+  file_read *read = queue->reads + index;
+  if(read->state == FileRead_Unknown || read->generation != (id >> 16)) {
+    return 0;
+  }
+  return read;
+}
+
+static uint32_t PlatformQueueFileRead(
+  platform_file_queue *queue, platform_file *file, uint64_t offset, uint64_t size,
+  void *dest, file_read_priority priority
+) {
+  uint32_t id = 0;
+  if(file->handle) {
+    LockFileQueue(queue);
+    if(queue->freeCount) {
+      int index = queue->free[--queue->freeCount];
+      file_read *read = queue->reads + index;
+      uint16_t generation = read->generation + 1;
+      *read = {};
+      read->generation = generation ? generation : 1;
+      read->state = FileRead_Pending;
+      read->priority = priority < FileReadPriority_Count ? priority : FileReadPriority_High;
+      read->handle = file->handle;
+      read->offset = offset;
+      read->size = size;
+      read->dest = (uint8_t *) dest;
+      if(queue->ringFailed) {
+        read->state = FileRead_Failed;
+      } else {
+        PushPendingRead(queue, index, false);
+      }
+      id = MakeFileReadId(index, read->generation);
+    }
+    if(!queue->ring) {
+#if defined(_WIN32)
+      WakeConditionVariable(&queue->wake);
+#else
+      pthread_cond_signal(&queue->wake);
+#endif
+    }
+    UnlockFileQueue(queue);
+  }
+#if defined(FILE_QUEUE_URING)
+  if(queue->ring) {
+    FillRing(queue);
+    EnterRing(queue, false);
+  }
+#endif
+  return id;
+}
+
+// Reports a finished read and lets it go. Takes the lock held.
+static file_read_state ReportFileRead(platform_file_queue *queue, file_read *read, uint64_t *bytesRead) {
+  file_read_state state = read->state;
+  if(bytesRead) {
+    *bytesRead = read->bytesRead;
+  }
+  if(state == FileRead_Done || state == FileRead_Failed) {
+    read->state = FileRead_Unknown;
+    queue->free[queue->freeCount++] = (uint16_t) (read - queue->reads);
+  }
+  return state;
+}
+
+inline file_read_state PlatformPollFileRead(platform_file_queue *queue, uint32_t id, uint64_t *bytesRead) {
+#if defined(FILE_QUEUE_URING)
+  if(queue->ring) {
+    ReapRing(queue);
+    FillRing(queue);
+    EnterRing(queue, false);
+  }
+#endif
+  file_read_state state = FileRead_Unknown;
+  LockFileQueue(queue);
+  file_read *read = GetFileRead(queue, id);
+  if(read) {
+    state = ReportFileRead(queue, read, bytesRead);
+  }
+  UnlockFileQueue(queue);
+  return state;
+}
+
+static file_read_state PlatformWaitFileRead(platform_file_queue *queue, uint32_t id, uint64_t *bytesRead) {
+  file_read_state state = FileRead_Unknown;
+  LockFileQueue(queue);
+  file_read *read = GetFileRead(queue, id);
+  if(read) {
+    while(read->state == FileRead_Pending) {
+#if defined(FILE_QUEUE_URING)
+      if(queue->ring) {
+        ReapRing(queue);
+        FillRing(queue);
+        if(read->state == FileRead_Pending) {
+          EnterRing(queue, true);
+        }
+        continue;
+      }
+#endif
+#if defined(_WIN32)
+      SleepConditionVariableCS(&queue->finished, &queue->lock, INFINITE);
+#else
+      pthread_cond_wait(&queue->finished, &queue->lock);
+#endif
+    }
+    state = ReportFileRead(queue, read, bytesRead);
+  }
+  UnlockFileQueue(queue);
+  return state;
+}
@@ -0,0 +1,251 @@
+#include "raika_intrinsics.h"
+
+// Framebuffer fills and copies
+// A 4K frame is 33MB, more than most caches. Writing one through the cache
+// can evict everything else the frame needs, so large write-once regions can
+// go out with non-temporal stores instead, straight to memory through the
+// write combining buffers. Small regions always keep normal stores: whoever
+// draws next probably reads them back, and a partial line streamed out costs
+// more than it saves.
+//
+// Streaming is off unless asked for. The fill bench has yet to measure it
+// winning: the passes themselves run slower or no faster, and a workload
+// sized to the cache runs no faster after a streamed frame than a cached one.
+//
+// Streaming stores are weakly ordered. Anything that streams fences before it
+// returns, so the pixels are visible by the time another thread or the
+// platform looks at them.
+//
+// Environment:
+//   RAIKA_STORES=stream  streams large regions
+#define STREAM_MIN_BYTES (256 * 1024)
+// How far ahead streaming copies prefetch their source. The source is read
+// once too, but an NTA hint measured slower than T0 with the stores streaming.
+#define STREAM_PREFETCH_BYTES 512
+
+typedef void fill_row_kernel(uint32_t *dest, int count, uint32_t color);
+typedef void copy_row_kernel(uint32_t *dest, uint32_t *source, int count);
+
+static void FillRowScalar(uint32_t *dest, int count, uint32_t color) {
+  for(int x = 0; x < count; ++x) {
+    dest[x] = color;
+  }
+}
+
+static void CopyRowScalar(uint32_t *dest, uint32_t *source, int count) {
+  memcpy(dest, source, count * sizeof(uint32_t));
+}
+
+static void FillRowSSE2(uint32_t *dest, int count, uint32_t color) {
+  __m128i wide = _mm_set1_epi32(color);
+  int x = 0;
+  for(; x + 8 <= count; x += 8) {
+    _mm_storeu_si128((__m128i *) (dest + x), wide);
+    _mm_storeu_si128((__m128i *) (dest + x + 4), wide);
+  }
+  FillRowScalar(dest + x, count - x, color);
+}
+
+// Scalar up to the first aligned pixel, the stream stores need it
+static void FillRowStreamSSE2(uint32_t *dest, int count, uint32_t color) {
+  int head = (int) ((16 - ((uintptr_t) dest & 15)) & 15) / 4;
+  head = head < count ? head : count;
+  FillRowScalar(dest, head, color);
+
+  __m128i wide = _mm_set1_epi32(color);
+  int x = head;
+  for(; x + 8 <= count; x += 8) {
+    _mm_stream_si128((__m128i *) (dest + x), wide);
+    _mm_stream_si128((__m128i *) (dest + x + 4), wide);
+  }
+  FillRowScalar(dest + x, count - x, color);
+}
+
+static void CopyRowStreamSSE2(uint32_t *dest, uint32_t *source, int count) {
+  int head = (int) ((16 - ((uintptr_t) dest & 15)) & 15) / 4;
+  head = head < count ? head : count;
+  CopyRowScalar(dest, source, head);
+
+  int x = head;
+  for(; x + 8 <= count; x += 8) {
+    _mm_prefetch((char *) (source + x) + STREAM_PREFETCH_BYTES, _MM_HINT_T0);
+    __m128i a = _mm_loadu_si128((__m128i *) (source + x));
+    __m128i b = _mm_loadu_si128((__m128i *) (source + x + 4));
+    _mm_stream_si128((__m128i *) (dest + x), a);
+    _mm_stream_si128((__m128i *) (dest + x + 4), b);
+  }
+  CopyRowScalar(dest + x, source + x, count - x);
+}
+
+RAIKA_TARGET_AVX2
+static void FillRowAVX2(uint32_t *dest, int count, uint32_t color) {
+  __m256i wide = _mm256_set1_epi32(color);
+  int x = 0;
+  for(; x + 16 <= count; x += 16) {
+    _mm256_storeu_si256((__m256i *) (dest + x), wide);
+    _mm256_storeu_si256((__m256i *) (dest + x + 8), wide);
+  }
+  _mm256_zeroupper();
+  FillRowScalar(dest + x, count - x, color);
+}
+
+RAIKA_TARGET_AVX2
+static void FillRowStreamAVX2(uint32_t *dest, int count, uint32_t color) {
+  int head = (int) ((32 - ((uintptr_t) dest & 31)) & 31) / 4;
+  head = head < count ? head : count;
+  FillRowScalar(dest, head, color);
+
+  __m256i wide = _mm256_set1_epi32(color);
+  int x = head;
+  for(; x + 16 <= count; x += 16) {
+    _mm256_stream_si256((__m256i *) (dest + x), wide);
+    _mm256_stream_si256((__m256i *) (dest + x + 8), wide);
+  }
+  _mm256_zeroupper();
+  FillRowScalar(dest + x, count - x, color);
+}
+
+RAIKA_TARGET_AVX2
+static void CopyRowStreamAVX2(uint32_t *dest, uint32_t *source, int count) {
+  int head = (int) ((32 - ((uintptr_t) dest & 31)) & 31) / 4;
+  head = head < count ? head : count;
+  CopyRowScalar(dest, source, head);
+
+  int x = head;
+  for(; x + 16 <= count; x += 16) {
+    _mm_prefetch((char *) (source + x) + STREAM_PREFETCH_BYTES, _MM_HINT_T0);
+    __m256i a = _mm256_loadu_si256((__m256i *) (source + x));
+    __m256i b = _mm256_loadu_si256((__m256i *) (source + x + 8));
+    _mm256_stream_si256((__m256i *) (dest + x), a);
+    _mm256_stream_si256((__m256i *) (dest + x + 8), b);
+  }
+  _mm256_zeroupper();
+  CopyRowScalar(dest + x, source + x, count - x);
+}
+
+// Cached copies stay on memcpy at every level, it already picks the widest
+// stores the CPU has
+struct fill_kernels {
+  const char *name;
+  // Whether large regions stream, only for the picked kernels
+  bool stream;
+  fill_row_kernel *fill;
+  fill_row_kernel *fillStream;
+  copy_row_kernel *copy;
+  copy_row_kernel *copyStream;
+};
+
+// Ordered slowest to fastest, the last supported one wins
+static fill_kernels GetFillKernels(int index) {
+  cpu_features *cpu = GetCpuFeatures();
+  fill_kernels result = {};
+  switch(index) {
+    case 0: {
+      result.name = "scalar";
+      result.fill = FillRowScalar;
+      result.fillStream = FillRowScalar;
+      result.copy = CopyRowScalar;
+      result.copyStream = CopyRowScalar;
+    } break;
+    case 1: {
+      if(cpu->sse2) {
+        result.name = "sse2";
+        result.fill = FillRowSSE2;
+        result.fillStream = FillRowStreamSSE2;
+        result.copy = CopyRowScalar;
+        result.copyStream = CopyRowStreamSSE2;
+      }
+    } break;
+    case 2: {
+      if(cpu->avx2) {
+        result.name = "avx2";
+        result.fill = FillRowAVX2;
+        result.fillStream = FillRowStreamAVX2;
+        result.copy = CopyRowScalar;
+        result.copyStream = CopyRowStreamAVX2;
+      }
+    } break;
+  }
+  return result;
+}
+#define FILL_KERNEL_COUNT 3
+
+static fill_kernels globalFillKernels;
+
+static fill_kernels *PickFillKernels() {
+  if(!globalFillKernels.name) {
+    fill_kernels picked = {};
+    for(int i = 0; i < FILL_KERNEL_COUNT; ++i) {
+      fill_kernels kernels = GetFillKernels(i);
+      if(kernels.name) {
+        picked = kernels;
+      }
+    }
+    char *stores = getenv("RAIKA_STORES");
+    picked.stream = stores && strcmp(stores, "stream") == 0;
+    globalFillKernels = picked;
+  }
+  return &globalFillKernels;
+}
+
+inline bool ShouldStream(int width, int height) {
+  return PickFillKernels()->stream && (uint64_t) width * height * sizeof(uint32_t) >= STREAM_MIN_BYTES;
+}
+
+// Pairs with every pass that streamed
+inline void StreamFence() {
+  _mm_sfence();
+}
+
+static void FillImageWith(
+    fill_row_kernel *kernel,
+    void *memory, ptrdiff_t pitch,
+    int width, int height,
+    uint32_t color
+) {
+  uint8_t *row = (uint8_t *) memory;
+  for(int y = 0; y < height; ++y) {
+    kernel((uint32_t *) row, width, color);
+    row += pitch;
+  }
+}
+
+static void CopyImageWith(
+    copy_row_kernel *kernel,
+    void *dest, ptrdiff_t destPitch,
+    void *source, ptrdiff_t sourcePitch,
+    int width, int height
+) {
+  uint8_t *destRow = (uint8_t *) dest;
+  uint8_t *sourceRow = (uint8_t *) source;
+  for(int y = 0; y < height; ++y) {
+    kernel((uint32_t *) destRow, (uint32_t *) sourceRow, width);
+    destRow += destPitch;
+    sourceRow += sourcePitch;
+  }
+}
+
+// Streams when the region is big enough. Pitches may be negative.
+inline void FillImage(void *memory, ptrdiff_t pitch, int width, int height, uint32_t color) {
+  fill_kernels *kernels = PickFillKernels();
+  if(ShouldStream(width, height)) {
+    FillImageWith(kernels->fillStream, memory, pitch, width, height, color);
+    StreamFence();
+  } else {
+    FillImageWith(kernels->fill, memory, pitch, width, height, color);
+  }
+}
+
+static void CopyImage(
+    void *dest, ptrdiff_t destPitch,
+    void *source, ptrdiff_t sourcePitch,
+    int width, int height
+) {
+  fill_kernels *kernels = PickFillKernels();
+  if(ShouldStream(width, height)) {
+    CopyImageWith(kernels->copyStream, dest, destPitch, source, sourcePitch, width, height);
+    StreamFence();
+  } else {
+    CopyImageWith(kernels->copy, dest, destPitch, source, sourcePitch, width, height);
+  }
+}
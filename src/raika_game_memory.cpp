@@ -0,0 +1,185 @@
+// Game memory shared by the platform layers. Include after raika.cpp.
+//
+// All of game_memory is one reservation made at startup. Linux first asks
+// for explicitly reserved huge pages, which only exist when vm.nr_hugepages
+// has set some aside, then falls back to ordinary pages aligned to 2MB and
+// advised for transparent huge pages. Windows tries large pages, which need
+// the SeLockMemoryPrivilege, before ordinary committed memory. Either way
+// pages only become resident as the game first touches them.
+//
+// With glibc the heap counter replaces malloc, calloc, realloc and the
+// aligned allocators with versions that count calls per thread before
+// handing them to glibc's own, so the audio and render threads allocating
+// never trip the game thread's check. Builds under a sanitizer keep its
+// allocator and count nothing, as does Windows.
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#endif
+
+#define GAME_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define GAME_PERMANENT_STORAGE_SIZE (64ull * 1024 * 1024)
+#define GAME_TRANSIENT_STORAGE_SIZE (256ull * 1024 * 1024)
+
+inline uint64_t GameMemoryTotalSize(game_memory *memory) {
+  uint64_t total = memory->permanentStorageSize + memory->transientStorageSize;
+  return (total + GAME_HUGE_PAGE_SIZE - 1) & ~(uint64_t) (GAME_HUGE_PAGE_SIZE - 1);
+}
+
+#if !defined(_WIN32)
+// Transparent huge pages back madvised memory unless they are turned off
+static bool TransparentHugePagesEnabled() {
+  bool result = false;
+  FILE *file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+  if(file) {
+    char text[128] = {};
+    if(fgets(text, sizeof(text), file)) {
+      result = !strstr(text, "[never]");
+    }
+    fclose(file);
+  }
+  return result;
+}
+#endif
+
+static bool PlatformAllocateGameMemory(game_memory *memory, uint64_t permanentSize, uint64_t transientSize) {
+  *memory = {};
+  memory->permanentStorageSize = permanentSize;
+  memory->transientStorageSize = transientSize;
+  uint64_t size = GameMemoryTotalSize(memory);
+  uint8_t *base = 0;
+#if defined(_WIN32)
+  SIZE_T largePage = GetLargePageMinimum();
+  if(largePage) {
+    SIZE_T largeSize = (SIZE_T) ((size + largePage - 1) & ~(uint64_t) (largePage - 1));
+    base = (uint8_t *) VirtualAlloc(0, largeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    memory->hugePages = base != 0;
+  }
+  if(!base) {
+    base = (uint8_t *) VirtualAlloc(0, (SIZE_T) size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  }
+#else
+#if defined(MAP_HUGETLB)
+  void *huge = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if(huge != MAP_FAILED) {
+    base = (uint8_t *) huge;
+    memory->hugePages = true;
+  }
+#endif
+  if(!base) {
+    // Over reserve so the block can start on a huge page boundary, which
+    // transparent huge pages need
+    void *raw = mmap(0, size + GAME_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(raw != MAP_FAILED) {
+      uint8_t *start = (uint8_t *) raw;
+      base = (uint8_t *) (((uintptr_t) start + GAME_HUGE_PAGE_SIZE - 1) & ~(uintptr_t) (GAME_HUGE_PAGE_SIZE - 1));
+      if(base > start) {
+        munmap(start, base - start);
+      }
+      uint8_t *end = start + size + GAME_HUGE_PAGE_SIZE;
+      if(end > base + size) {
+        munmap(base + size, end - (base + size));
+      }
+#if defined(MADV_HUGEPAGE)
+      memory->hugePages = madvise(base, size, MADV_HUGEPAGE) == 0 && TransparentHugePagesEnabled();
+#endif
+    }
+  }
+#endif
+  if(!base) {
+    *memory = {};
+    return false;
+  }
+  memory->permanentStorage = base;
+  memory->transientStorage = base + permanentSize;
+  return true;
+}
+
+static void PlatformFreeGameMemory(game_memory *memory) {
+  if(memory->permanentStorage) {
+#if defined(_WIN32)
+    VirtualFree(memory->permanentStorage, 0, MEM_RELEASE);
+#else
+    munmap(memory->permanentStorage, GameMemoryTotalSize(memory));
+#endif
+  }
+  *memory = {};
+}
+
+// Heap counter
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+static __thread uint64_t threadHeapAllocations;
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *memory, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void *__libc_valloc(size_t size);
+
+void *malloc(size_t size) noexcept {
+  ++threadHeapAllocations;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept {
+  ++threadHeapAllocations;
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *memory, size_t size) noexcept {
+  ++threadHeapAllocations;
+  return __libc_realloc(memory, size);
+}
+
+// glibc exports no __libc_ versions of these two, memalign does the work
+// once the alignment is one they accept
+void *aligned_alloc(size_t alignment, size_t size) noexcept {
+  ++threadHeapAllocations;
+  if(!alignment || (alignment & (alignment - 1))) {
+    errno = EINVAL;
+    return 0;
+  }
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **memory, size_t alignment, size_t size) noexcept {
+  ++threadHeapAllocations;
+  if(alignment % sizeof(void *) || (alignment & (alignment - 1))) {
+    return EINVAL;
+  }
+  void *result = __libc_memalign(alignment, size);
+  if(!result) {
+    return ENOMEM;
+  }
+  *memory = result;
+  return 0;
+}
+
+void *memalign(size_t alignment, size_t size) noexcept {
+  ++threadHeapAllocations;
+  return __libc_memalign(alignment, size);
+}
+
+void *valloc(size_t size) noexcept {
+  ++threadHeapAllocations;
+  return __libc_valloc(size);
+}
+}
+
+// Heap allocations made on the calling thread so far. Zero where the
+// platform cannot count them, which turns the check off.
+static uint64_t PlatformHeapAllocationCount() {
+  return threadHeapAllocations;
+}
+#else
+static uint64_t PlatformHeapAllocationCount() {
+  return 0;
+}
+#endif
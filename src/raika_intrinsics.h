@@ -0,0 +1,113 @@
+#if !defined(RAIKA_INTRINSICS_H)
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// SIMD headers. Everything above SSE2 is compiled per function with a target
+// attribute so the base build flags stay the same and we pick kernels at
+// runtime from CPUID.
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#define RAIKA_TARGET_SSE41
+#define RAIKA_TARGET_AVX2
+#else
+#include <cpuid.h>
+#include <immintrin.h>
+#define RAIKA_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define RAIKA_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Atomics and barriers
+#if defined(_MSC_VER)
+#define WriteBarrier() _WriteBarrier(); _mm_sfence()
+#define ReadBarrier() _ReadBarrier()
+inline uint32_t AtomicCompareExchangeU32(volatile uint32_t *value, uint32_t newValue, uint32_t expected) {
+  return (uint32_t) _InterlockedCompareExchange((volatile long *) value, newValue, expected);
+}
+inline uint32_t AtomicAddU32(volatile uint32_t *value, uint32_t addend) {
+  return (uint32_t) _InterlockedExchangeAdd((volatile long *) value, addend);
+}
+#else
+#define WriteBarrier() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define ReadBarrier() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+inline uint32_t AtomicCompareExchangeU32(volatile uint32_t *value, uint32_t newValue, uint32_t expected) {
+  return __sync_val_compare_and_swap(value, expected, newValue);
+}
+inline uint32_t AtomicAddU32(volatile uint32_t *value, uint32_t addend) {
+  return __sync_fetch_and_add(value, addend);
+}
+#endif
+
+struct cpu_features {
+  bool detected;
+  bool sse2;
+  bool sse41;
+  bool avx2;
+};
+
+static cpu_features globalCpuFeatures;
+
+static void CpuId(int leaf, int subleaf, uint32_t *regs) {
+#if defined(_MSC_VER)
+  __cpuidex((int *) regs, leaf, subleaf);
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t ReadXCR0() {
+#if defined(_MSC_VER)
+  return _xgetbv(0);
+#else
+  uint32_t eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return ((uint64_t) edx << 32) | eax;
+#endif
+}
+
+static cpu_features *GetCpuFeatures() {
+  if(!globalCpuFeatures.detected) {
+    cpu_features features = {};
+    uint32_t regs[4];
+
+    CpuId(0, 0, regs);
+    uint32_t maxLeaf = regs[0];
+
+    if(maxLeaf >= 1) {
+      CpuId(1, 0, regs);
+      features.sse2 = (regs[3] & (1 << 26)) != 0;
+      features.sse41 = (regs[2] & (1 << 19)) != 0;
+      bool osxsave = (regs[2] & (1 << 27)) != 0;
+      bool avx = (regs[2] & (1 << 28)) != 0;
+
+      // The OS has to save the YMM registers or AVX is unusable even if the
+      // CPU has it
+      bool ymmEnabled = osxsave && avx && ((ReadXCR0() & 0x6) == 0x6);
+      if(ymmEnabled && maxLeaf >= 7) {
+        CpuId(7, 0, regs);
+        features.avx2 = (regs[1] & (1 << 5)) != 0;
+      }
+    }
+
+    // Debug override so the fallbacks can be exercised on any machine
+    char *cap = getenv("RAIKA_SIMD");
+    if(cap) {
+      if(strcmp(cap, "scalar") == 0) {
+        features.sse2 = features.sse41 = features.avx2 = false;
+      } else if(strcmp(cap, "sse2") == 0) {
+        features.sse41 = features.avx2 = false;
+      } else if(strcmp(cap, "sse41") == 0) {
+        features.avx2 = false;
+      }
+    }
+
+    features.detected = true;
+    globalCpuFeatures = features;
+  }
+  return &globalCpuFeatures;
+}
+
+#define RAIKA_INTRINSICS_H
+#endif
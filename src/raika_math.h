@@ -0,0 +1,116 @@
+#if !defined(RAIKA_MATH_H)
+
+#include <math.h>
+
+// Just enough vector math for the game layer. Matrices are row major and
+// multiply column vectors (M * v). The camera helpers follow the conventions
+// sdl_platform.cpp sets for GLM: radians, left handed, depth 0..1.
+
+struct v2 {
+  float x, y;
+};
+
+struct v3 {
+  float x, y, z;
+};
+
+struct v4 {
+  float x, y, z, w;
+};
+
+struct m4x4 {
+  float e[4][4];
+};
+
+inline v2 V2(float x, float y) { v2 r = {x, y}; return r; }
+inline v3 V3(float x, float y, float z) { v3 r = {x, y, z}; return r; }
+inline v4 V4(float x, float y, float z, float w) { v4 r = {x, y, z, w}; return r; }
+inline v4 V4(v3 xyz, float w) { v4 r = {xyz.x, xyz.y, xyz.z, w}; return r; }
+
+inline v3 operator+(v3 a, v3 b) { return V3(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline v3 operator-(v3 a, v3 b) { return V3(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline v3 operator*(float s, v3 a) { return V3(s * a.x, s * a.y, s * a.z); }
+inline v3 operator*(v3 a, float s) { return s * a; }
+
+inline float Inner(v3 a, v3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline v3 Cross(v3 a, v3 b) {
+  return V3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+inline v3 Normalize(v3 a) { return (1.0f / sqrtf(Inner(a, a))) * a; }
+
+inline m4x4 Identity() {
+  m4x4 r = {{
+    {1, 0, 0, 0},
+    {0, 1, 0, 0},
+    {0, 0, 1, 0},
+    {0, 0, 0, 1},
+  }};
+  return r;
+}
+
+inline m4x4 operator*(m4x4 a, m4x4 b) {
+  m4x4 r = {};
+  for(int row = 0; row < 4; ++row) {
+    for(int col = 0; col < 4; ++col) {
+      for(int i = 0; i < 4; ++i) {
+        r.e[row][col] += a.e[row][i] * b.e[i][col];
+      }
+    }
+  }
+  return r;
+}
+
+inline v4 operator*(m4x4 a, v4 p) {
+  v4 r;
+  r.x = a.e[0][0] * p.x + a.e[0][1] * p.y + a.e[0][2] * p.z + a.e[0][3] * p.w;
+  r.y = a.e[1][0] * p.x + a.e[1][1] * p.y + a.e[1][2] * p.z + a.e[1][3] * p.w;
+  r.z = a.e[2][0] * p.x + a.e[2][1] * p.y + a.e[2][2] * p.z + a.e[2][3] * p.w;
+  r.w = a.e[3][0] * p.x + a.e[3][1] * p.y + a.e[3][2] * p.z + a.e[3][3] * p.w;
+  return r;
+}
+
+// glm::rotate(mat4(1), angle, (0, 0, 1))
+inline m4x4 ZRotation(float angle) {
+  float c = cosf(angle);
+  float s = sinf(angle);
+  m4x4 r = {{
+    {c, -s, 0, 0},
+    {s,  c, 0, 0},
+    {0,  0, 1, 0},
+    {0,  0, 0, 1},
+  }};
+  return r;
+}
+
+// glm::lookAtLH
+inline m4x4 LookAt(v3 eye, v3 center, v3 up) {
+  v3 f = Normalize(center - eye);
+  v3 s = Normalize(Cross(up, f));
+  v3 u = Cross(f, s);
+  m4x4 r = {{
+    {s.x, s.y, s.z, -Inner(s, eye)},
+    {u.x, u.y, u.z, -Inner(u, eye)},
+    {f.x, f.y, f.z, -Inner(f, eye)},
+    {  0,   0,   0,               1},
+  }};
+  return r;
+}
+
+// glm::perspectiveLH_ZO
+inline m4x4 Perspective(float fovy, float aspect, float zNear, float zFar) {
+  float tanHalfFovy = tanf(fovy / 2.0f);
+  m4x4 r = {};
+  r.e[0][0] = 1.0f / (aspect * tanHalfFovy);
+  r.e[1][1] = 1.0f / tanHalfFovy;
+  r.e[2][2] = zFar / (zFar - zNear);
+  r.e[2][3] = -(zFar * zNear) / (zFar - zNear);
+  r.e[3][2] = 1.0f;
+  return r;
+}
+
+inline float Radians(float degrees) {
+  return degrees * 0.01745329251994329577f;
+}
+
+#define RAIKA_MATH_H
+#endif
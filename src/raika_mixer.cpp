@@ -0,0 +1,1025 @@
+#include "raika_intrinsics.h"
+
+// Mixer
+// A fixed pool of voices, each rendered mono into a scratch block and added
+// to a float stereo bus with its own gain and pan. The bus is clipped,
+// dithered and written out in the device format at the end. Everything lives
+// in the mixer struct, so the audio path never allocates and a block costs at
+// most MIXER_MAX_VOICES voices' worth of work.
+//
+// Gain and pan changes ramp across one block so they do not click.
+//
+// Streams are the one source that can be stereo. Those render both channels
+// and pan acts as a balance control instead.
+//
+// Samples and streams are resampled to the mixer's rate at their voice's
+// quality. The whole bus can also run at its own rate and be resampled to
+// the device's on the way out, which is where drift correction goes.
+//
+// Voices can be put in groups. A group is a bus of its own with a chain of
+// effects, added to the main bus at the group's gain. Group 0 is the main bus
+// itself: its voices mix straight in, and its chain runs on everything last.
+// A group with effects runs every block so tails ring out after its voices
+// stop, one without only runs while it has voices. Effects come from a pool
+// in the mixer and their delay lines from memory it holds, handed out as
+// they are added and given back all at once by ClearMixerEffects.
+#define MIXER_MAX_VOICES 256
+#define MIXER_BLOCK_SAMPLES 256
+// TPDF dither for 16 bit output comes from a table so every kernel adds the
+// same noise. 64KB repeats every third of a second at 48kHz.
+#define MIXER_DITHER_SIZE 16384
+// Input a resampled voice reads for one block at the largest ratio
+#define MIXER_WINDOW_SAMPLES ((int) (MIXER_BLOCK_SAMPLES * RESAMPLE_MAX_RATIO) + RESAMPLE_MAX_TAPS)
+#define MIXER_MAX_GROUPS 8
+#define MIXER_MAX_EFFECTS 16
+#define MIXER_CHAIN_EFFECTS 4
+// Floats, a one second stereo delay at 48kHz takes 96K
+#define MIXER_EFFECT_MEMORY (512 * 1024)
+
+enum mixer_source_type {
+  MixerSource_None,
+  MixerSource_Oscillator,
+  MixerSource_Sample,
+  MixerSource_Stream,
+};
+
+// Mono float samples in memory
+struct sound_sample {
+  float *samples;
+  uint32_t count;
+  int samplesPerSecond;
+};
+
+struct mixer_voice {
+  mixer_source_type type;
+  // Handed out with the voice so stale ids stop working once it is reused
+  uint16_t generation;
+  float gain;
+  float pan;
+  float pitch;
+  resample_quality quality;
+  int group;
+  // What the last block ended on, the next one ramps from here
+  float currentLeft;
+  float currentRight;
+  bool started;
+  // Fading out over its last block
+  bool stopping;
+
+  // MixerSource_Oscillator
+  oscillator osc;
+  double frequency;
+
+  // MixerSource_Sample, position in 32.32 fixed point
+  sound_sample *sample;
+  uint64_t position;
+  bool loop;
+
+  // MixerSource_Stream, position counts stream frames the same way
+  sound_stream *stream;
+};
+
+struct mixer_group {
+  float gain;
+  // What the last block ended on, the next one ramps from here
+  float currentGain;
+  // Indices into the mixer's effects, run in order
+  int chain[MIXER_CHAIN_EFFECTS];
+  int chainCount;
+  // Has had a voice mixed in this block
+  bool used;
+  float left[MIXER_BLOCK_SAMPLES];
+  float right[MIXER_BLOCK_SAMPLES];
+};
+
+struct mixer {
+  int samplesPerSecond;
+  float masterGain;
+  mixer_voice voices[MIXER_MAX_VOICES];
+  // Dense list of playing voices and a stack of free ones
+  uint16_t active[MIXER_MAX_VOICES];
+  uint16_t free[MIXER_MAX_VOICES];
+  int activeCount;
+  int freeCount;
+  uint32_t ditherAt;
+  // Planar stereo bus and the scratch block each voice renders into
+  float left[MIXER_BLOCK_SAMPLES];
+  float right[MIXER_BLOCK_SAMPLES];
+  float scratch[MIXER_BLOCK_SAMPLES];
+  float scratchRight[MIXER_BLOCK_SAMPLES];
+  // Input gathered for resampled voices, per channel
+  float window[2][MIXER_WINDOW_SAMPLES];
+  // Quality new sample and stream voices start with
+  resample_quality quality;
+
+  // Bus resampling, off while busRate is zero. Drift is the device's real
+  // rate over the one it reports.
+  int busRate;
+  double drift;
+  resampler bus;
+  float busLeft[MIXER_BLOCK_SAMPLES];
+  float busRight[MIXER_BLOCK_SAMPLES];
+
+  mixer_group groups[MIXER_MAX_GROUPS];
+  audio_effect effects[MIXER_MAX_EFFECTS];
+  int effectCount;
+  float effectMemory[MIXER_EFFECT_MEMORY];
+  uint32_t effectMemoryUsed;
+};
+
+static float globalDither[MIXER_DITHER_SIZE + MIXER_BLOCK_SAMPLES];
+static bool globalDitherBuilt;
+
+// Difference of two uniform variables, in 16 bit LSBs. The table repeats its
+// start past the end so a block never has to wrap.
+static void BuildDitherTable() {
+  uint32_t state = 0x2545F491;
+  for(int i = 0; i < MIXER_DITHER_SIZE; ++i) {
+    float u[2];
+    for(int j = 0; j < 2; ++j) {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      u[j] = (state >> 8) * (1.0f / 16777216.0f);
+    }
+    globalDither[i] = u[0] - u[1];
+  }
+  memcpy(globalDither + MIXER_DITHER_SIZE, globalDither, MIXER_BLOCK_SAMPLES * sizeof(float));
+  globalDitherBuilt = true;
+}
+
+static void InitMixer(mixer *mix, int samplesPerSecond) {
+  memset(mix, 0, sizeof(*mix));
+  mix->samplesPerSecond = samplesPerSecond;
+  mix->masterGain = 1.0f;
+  mix->quality = Resample_Medium;
+  mix->drift = 1.0;
+  for(int g = 0; g < MIXER_MAX_GROUPS; ++g) {
+    mix->groups[g].gain = 1.0f;
+    mix->groups[g].currentGain = 1.0f;
+  }
+  for(int i = 0; i < MIXER_MAX_VOICES; ++i) {
+    mix->free[mix->freeCount++] = (uint16_t) (MIXER_MAX_VOICES - 1 - i);
+  }
+  if(!globalDitherBuilt) {
+    BuildDitherTable();
+  }
+}
+
+// Voices
+// Ids pack the slot in the low 16 bits and its generation above, zero is
+// never a valid id.
+inline uint32_t MakeVoiceId(int index, uint16_t generation) {
+  return ((uint32_t) generation << 16) | (uint32_t) (index + 1);
+}
+
+static mixer_voice *GetVoice(mixer *mix, uint32_t id) {
+  int index = (int) (id & 0xFFFF) - 1;
+  if(index < 0 || index >= MIXER_MAX_VOICES) {
+    return 0;
+  }
+  mixer_voice *voice = mix->voices + index;
+  if(voice->type == MixerSource_None || voice->stopping || voice->generation != (id >> 16)) {
+    return 0;
+  }
+  return voice;
+}
+
+// Returns zero when every voice is busy
+static uint32_t StartVoice(mixer *mix, mixer_voice *settings) {
+  if(!mix->freeCount) {
+    return 0;
+  }
+  int index = mix->free[--mix->freeCount];
+  mixer_voice *voice = mix->voices + index;
+  uint16_t generation = voice->generation + 1;
+  *voice = *settings;
+  voice->generation = generation ? generation : 1;
+  voice->started = false;
+  mix->active[mix->activeCount++] = (uint16_t) index;
+  return MakeVoiceId(index, voice->generation);
+}
+
+static uint32_t PlayOscillator(mixer *mix, oscillator_waveform waveform, double frequency, float gain, float pan) {
+  mixer_voice settings = {};
+  settings.type = MixerSource_Oscillator;
+  settings.gain = gain;
+  settings.pan = pan;
+  settings.pitch = 1.0f;
+  settings.osc.amplitude = 1.0f;
+  settings.osc.waveform = waveform;
+  settings.frequency = frequency;
+  return StartVoice(mix, &settings);
+}
+
+static uint32_t PlaySample(mixer *mix, sound_sample *sample, float gain, float pan, bool loop) {
+  mixer_voice settings = {};
+  settings.type = MixerSource_Sample;
+  settings.gain = gain;
+  settings.pan = pan;
+  settings.pitch = 1.0f;
+  settings.sample = sample;
+  settings.loop = loop;
+  settings.quality = mix->quality;
+  return StartVoice(mix, &settings);
+}
+
+// The stream plays from its start and belongs to this voice until it stops
+inline uint32_t PlayStream(mixer *mix, sound_stream *stream, float gain, float pan, bool loop) {
+  if(!stream->data) {
+    return 0;
+  }
+  RewindSoundStream(stream);
+  stream->loop = loop;
+  mixer_voice settings = {};
+  settings.type = MixerSource_Stream;
+  settings.gain = gain;
+  settings.pan = pan;
+  settings.pitch = 1.0f;
+  settings.stream = stream;
+  settings.quality = mix->quality;
+  return StartVoice(mix, &settings);
+}
+
+static void StopVoice(mixer *mix, uint32_t id) {
+  mixer_voice *voice = GetVoice(mix, id);
+  if(voice) {
+    voice->stopping = true;
+  }
+}
+
+static void SetVoiceGain(mixer *mix, uint32_t id, float gain) {
+  mixer_voice *voice = GetVoice(mix, id);
+  if(voice) {
+    voice->gain = gain;
+  }
+}
+
+// -1 is hard left, 1 hard right
+static void SetVoicePan(mixer *mix, uint32_t id, float pan) {
+  mixer_voice *voice = GetVoice(mix, id);
+  if(voice) {
+    voice->pan = pan < -1.0f ? -1.0f : (pan > 1.0f ? 1.0f : pan);
+  }
+}
+
+static void SetVoicePitch(mixer *mix, uint32_t id, float pitch) {
+  mixer_voice *voice = GetVoice(mix, id);
+  if(voice) {
+    voice->pitch = pitch > 0 ? pitch : 0;
+  }
+}
+
+inline void SetVoiceQuality(mixer *mix, uint32_t id, resample_quality quality) {
+  mixer_voice *voice = GetVoice(mix, id);
+  if(voice) {
+    voice->quality = quality;
+  }
+}
+
+static void SetVoiceFrequency(mixer *mix, uint32_t id, double frequency) {
+  mixer_voice *voice = GetVoice(mix, id);
+  if(voice) {
+    voice->frequency = frequency;
+  }
+}
+
+// Moves the voice to another group from the next block
+static void SetVoiceGroup(mixer *mix, uint32_t id, int group) {
+  mixer_voice *voice = GetVoice(mix, id);
+  if(voice && group >= 0 && group < MIXER_MAX_GROUPS) {
+    voice->group = group;
+  }
+}
+
+// Groups and effects
+inline void SetGroupGain(mixer *mix, int group, float gain) {
+  if(group >= 0 && group < MIXER_MAX_GROUPS) {
+    mix->groups[group].gain = gain;
+  }
+}
+
+// Appends an effect to the end of the group's chain, tuned for the rate the
+// mixer runs at now. Returns the effect to pass to the Set functions, or -1
+// when the pool, the chain or the line memory is full.
+inline int AddEffect(mixer *mix, int group, audio_effect_type type) {
+  if(group < 0 || group >= MIXER_MAX_GROUPS || type <= Effect_None || type >= Effect_Count) {
+    return -1;
+  }
+  mixer_group *g = mix->groups + group;
+  uint32_t memorySize = EffectMemorySize(type, mix->samplesPerSecond);
+  if(mix->effectCount == MIXER_MAX_EFFECTS || g->chainCount == MIXER_CHAIN_EFFECTS ||
+     mix->effectMemoryUsed + memorySize > MIXER_EFFECT_MEMORY) {
+    return -1;
+  }
+  int index = mix->effectCount++;
+  InitEffect(mix->effects + index, type, mix->samplesPerSecond, mix->effectMemory + mix->effectMemoryUsed);
+  mix->effectMemoryUsed += memorySize;
+  g->chain[g->chainCount++] = index;
+  return index;
+}
+
+static audio_effect *GetEffect(mixer *mix, int effect) {
+  return effect >= 0 && effect < mix->effectCount ? mix->effects + effect : 0;
+}
+
+// Empties every chain and gives back the line memory
+inline void ClearMixerEffects(mixer *mix) {
+  for(int g = 0; g < MIXER_MAX_GROUPS; ++g) {
+    mix->groups[g].chainCount = 0;
+  }
+  mix->effectCount = 0;
+  mix->effectMemoryUsed = 0;
+}
+
+inline void SetEffectBypass(mixer *mix, int effect, bool bypass) {
+  audio_effect *e = GetEffect(mix, effect);
+  if(e) {
+    e->bypass = bypass;
+  }
+}
+
+inline void SetMixerEQBand(mixer *mix, int effect, int band, eq_band_type type, float frequency, float q, float gainDb) {
+  audio_effect *e = GetEffect(mix, effect);
+  if(e) {
+    eq_band settings = {type, frequency, q, gainDb};
+    SetEQBand(e, band, settings);
+  }
+}
+
+inline void SetMixerDelay(mixer *mix, int effect, float seconds, float feedback, float dry, float wet) {
+  audio_effect *e = GetEffect(mix, effect);
+  if(e) {
+    SetDelay(e, seconds, feedback, dry, wet);
+  }
+}
+
+inline void SetMixerReverb(mixer *mix, int effect, float decaySeconds, float damping, float dry, float wet) {
+  audio_effect *e = GetEffect(mix, effect);
+  if(e) {
+    SetReverb(e, decaySeconds, damping, dry, wet);
+  }
+}
+
+// Cost of each effect since the last reset, in time stamp counter cycles per
+// stereo sample
+inline void FormatEffectStats(mixer *mix, char *out, int outSize) {
+  int length = 0;
+  out[0] = 0;
+  for(int g = 0; g < MIXER_MAX_GROUPS; ++g) {
+    mixer_group *group = mix->groups + g;
+    for(int c = 0; c < group->chainCount && length < outSize; ++c) {
+      audio_effect *effect = mix->effects + group->chain[c];
+      double perSample = effect->samples ? (double) effect->cycles / effect->samples : 0.0;
+      length += snprintf(
+        out + length, outSize - length, "  effect %2d %-6s group %d %8.1f cycles/sample%s\n",
+        group->chain[c], EFFECT_NAMES[effect->type], g, perSample, effect->bypass ? " (bypassed)" : ""
+      );
+    }
+  }
+}
+
+inline void ResetEffectStats(mixer *mix) {
+  for(int i = 0; i < mix->effectCount; ++i) {
+    mix->effects[i].cycles = 0;
+    mix->effects[i].samples = 0;
+  }
+}
+
+// Constant power, so a centred voice is 3dB down in each ear
+static void PanGains(float gain, float pan, float *left, float *right) {
+  float angle = (pan + 1.0f) * 0.25f * 3.14159265f;
+  *left = gain * cosf(angle);
+  *right = gain * sinf(angle);
+}
+
+inline bool IsStereoVoice(mixer_voice *voice) {
+  return voice->type == MixerSource_Stream && voice->stream->channels == 2;
+}
+
+// Full gain in the near channel, the far one fades out
+static void BalanceGains(float gain, float pan, float *left, float *right) {
+  *left = pan > 0.0f ? gain * (1.0f - pan) : gain;
+  *right = pan < 0.0f ? gain * (1.0f + pan) : gain;
+}
+
+// How many of count outputs stepping from position start before end
+inline int OutputsBefore(uint64_t position, uint64_t step, uint64_t end, int count) {
+  if(position >= end) {
+    return 0;
+  }
+  uint64_t outputs = (end - position + step - 1) / step;
+  return outputs < (uint64_t) count ? (int) outputs : count;
+}
+
+// Samples in memory are resampled straight from the array when the window
+// stays inside it and through the window buffer when it reaches past an end
+static bool RenderSample(mixer *mix, resample_kernels *resampleKernels, mixer_voice *voice, float *out, int count) {
+  sound_sample *sample = voice->sample;
+  if(!sample->count) {
+    memset(out, 0, count * sizeof(float));
+    return false;
+  }
+  double ratio = (double) voice->pitch * sample->samplesPerSecond / mix->samplesPerSecond;
+  uint64_t step = ResampleStep(ratio);
+  uint64_t end = (uint64_t) sample->count << 32;
+  if(voice->loop) {
+    voice->position %= end;
+  }
+  int outputs = voice->loop ? count : OutputsBefore(voice->position, step, end, count);
+  if(outputs) {
+    resample_table *table = GetResampleTable(voice->quality, ratio);
+    int64_t first = (int64_t) (voice->position >> 32) - ResampleTapsBefore(voice->quality);
+    int64_t last = (int64_t) ((voice->position + step * (outputs - 1)) >> 32) + ResampleTapsAfter(voice->quality);
+    float *window = sample->samples + first;
+    if(first < 0 || last >= (int64_t) sample->count) {
+      window = mix->window[0];
+      for(int64_t n = first; n <= last; ++n) {
+        int64_t index = voice->loop ? ((n % sample->count) + sample->count) % sample->count : n;
+        window[n - first] = index >= 0 && index < (int64_t) sample->count ? sample->samples[index] : 0.0f;
+      }
+    }
+    ResampleWith(resampleKernels, table, out, outputs, window, (uint32_t) voice->position, step);
+    voice->position += step * outputs;
+  }
+  memset(out + outputs, 0, (count - outputs) * sizeof(float));
+  return outputs == count;
+}
+
+// Stream frames are decoded just ahead of use, so the ring only has to hold
+// the frames this block touches. They always go through the window buffer
+// because the ring wraps.
+static bool RenderStream(mixer *mix, resample_kernels *resampleKernels, mixer_voice *voice, float *out, float *outRight, int count) {
+  sound_stream *stream = voice->stream;
+  double ratio = (double) voice->pitch * stream->samplesPerSecond / mix->samplesPerSecond;
+  uint64_t step = ResampleStep(ratio);
+  int64_t first = (int64_t) (voice->position >> 32) - ResampleTapsBefore(voice->quality);
+  int64_t last = (int64_t) ((voice->position + step * (count - 1)) >> 32) + ResampleTapsAfter(voice->quality);
+  FillSoundStream(stream, first > 0 ? first : 0, last + 1);
+
+  // Past the end of a stream that stopped decoding, the window reads silence
+  int outputs = stream->ended ? OutputsBefore(voice->position, step, stream->decodedTo << 32, count) : count;
+  if(outputs) {
+    resample_table *table = GetResampleTable(voice->quality, ratio);
+    for(int c = 0; c < stream->channels; ++c) {
+      float *window = mix->window[c];
+      for(int64_t n = first; n <= last; ++n) {
+        bool decoded = n >= (int64_t) stream->decodedFrom && n < (int64_t) stream->decodedTo;
+        window[n - first] = decoded ? SoundStreamSample(stream, c, n) : 0.0f;
+      }
+      ResampleWith(resampleKernels, table, c ? outRight : out, outputs, window, (uint32_t) voice->position, step);
+    }
+    voice->position += step * outputs;
+  }
+  memset(out + outputs, 0, (count - outputs) * sizeof(float));
+  if(stream->channels == 2) {
+    memset(outRight + outputs, 0, (count - outputs) * sizeof(float));
+  }
+  return outputs == count;
+}
+
+// Fills the scratch block, and the right one for stereo voices. False once
+// the voice has nothing left to play.
+static bool RenderVoice(
+    mixer *mix, oscillator_kernels *oscKernels, resample_kernels *resampleKernels,
+    mixer_voice *voice, float *out, float *outRight, int count
+) {
+  switch(voice->type) {
+    case MixerSource_Oscillator: {
+      memset(out, 0, count * sizeof(float));
+      SetOscillatorFrequency(&voice->osc, voice->frequency * voice->pitch, mix->samplesPerSecond);
+      RenderOscillatorWith(oscKernels, &voice->osc, out, count);
+      return true;
+    } break;
+    case MixerSource_Sample: {
+      return RenderSample(mix, resampleKernels, voice, out, count);
+    } break;
+    case MixerSource_Stream: {
+      return RenderStream(mix, resampleKernels, voice, out, outRight, count);
+    } break;
+    default: {
+      return false;
+    } break;
+  }
+}
+
+// Kernels
+// Mix kernels add a mono block to the bus with gains that ramp linearly
+// across it. Output kernels clip the bus and write it out. Every kernel
+// must match the scalar version bit for bit.
+typedef void mix_kernel(
+  float *left, float *right, float *source, int count,
+  float gainLeft, float stepLeft, float gainRight, float stepRight
+);
+// Interleaved 16 bit stereo, dither in LSBs
+typedef void mix_output_kernel(
+  int16_t *dest, float *left, float *right,
+  float *ditherLeft, float *ditherRight, float gain, int count
+);
+
+static void MixScalar(
+    float *left, float *right, float *source, int count,
+    float gainLeft, float stepLeft, float gainRight, float stepRight
+) {
+  for(int i = 0; i < count; ++i) {
+    float s = source[i];
+    left[i] = left[i] + s * (gainLeft + stepLeft * (float) i);
+    right[i] = right[i] + s * (gainRight + stepRight * (float) i);
+  }
+}
+
+inline int16_t MixToInt16(float sample, float gain, float dither) {
+  float v = sample * gain;
+  v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+  v = v * 32766.0f + dither;
+  return (int16_t) _mm_cvtss_si32(_mm_set_ss(v));
+}
+
+static void MixOutputScalar(
+    int16_t *dest, float *left, float *right,
+    float *ditherLeft, float *ditherRight, float gain, int count
+) {
+  for(int i = 0; i < count; ++i) {
+    dest[2 * i] = MixToInt16(left[i], gain, ditherLeft[i]);
+    dest[2 * i + 1] = MixToInt16(right[i], gain, ditherRight[i]);
+  }
+}
+
+static void MixSSE2(
+    float *left, float *right, float *source, int count,
+    float gainLeft, float stepLeft, float gainRight, float stepRight
+) {
+  __m128 index = _mm_setr_ps(0, 1, 2, 3);
+  __m128 four = _mm_set1_ps(4);
+  __m128 gainL = _mm_set1_ps(gainLeft);
+  __m128 gainR = _mm_set1_ps(gainRight);
+  __m128 stepL = _mm_set1_ps(stepLeft);
+  __m128 stepR = _mm_set1_ps(stepRight);
+  int i = 0;
+  for(; i + 4 <= count; i += 4) {
+    __m128 s = _mm_loadu_ps(source + i);
+    __m128 l = _mm_mul_ps(s, _mm_add_ps(gainL, _mm_mul_ps(stepL, index)));
+    __m128 r = _mm_mul_ps(s, _mm_add_ps(gainR, _mm_mul_ps(stepR, index)));
+    _mm_storeu_ps(left + i, _mm_add_ps(_mm_loadu_ps(left + i), l));
+    _mm_storeu_ps(right + i, _mm_add_ps(_mm_loadu_ps(right + i), r));
+    index = _mm_add_ps(index, four);
+  }
+  for(; i < count; ++i) {
+    float s = source[i];
+    left[i] = left[i] + s * (gainLeft + stepLeft * (float) i);
+    right[i] = right[i] + s * (gainRight + stepRight * (float) i);
+  }
+}
+
+// Rounds to nearest like the scalar path, then packs with saturation
+static void MixOutputSSE2(
+    int16_t *dest, float *left, float *right,
+    float *ditherLeft, float *ditherRight, float gain, int count
+) {
+  __m128 gainWide = _mm_set1_ps(gain);
+  __m128 low = _mm_set1_ps(-1.0f);
+  __m128 high = _mm_set1_ps(1.0f);
+  __m128 scale = _mm_set1_ps(32766.0f);
+  int i = 0;
+  for(; i + 4 <= count; i += 4) {
+    __m128 l = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(left + i), gainWide), low), high);
+    __m128 r = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(right + i), gainWide), low), high);
+    __m128i li = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(l, scale), _mm_loadu_ps(ditherLeft + i)));
+    __m128i ri = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(r, scale), _mm_loadu_ps(ditherRight + i)));
+    __m128i lo = _mm_unpacklo_epi32(li, ri);
+    __m128i hi = _mm_unpackhi_epi32(li, ri);
+    _mm_storeu_si128((__m128i *) (dest + 2 * i), _mm_packs_epi32(lo, hi));
+  }
+  MixOutputScalar(dest + 2 * i, left + i, right + i, ditherLeft + i, ditherRight + i, gain, count - i);
+}
+
+RAIKA_TARGET_AVX2
+static void MixAVX2(
+    float *left, float *right, float *source, int count,
+    float gainLeft, float stepLeft, float gainRight, float stepRight
+) {
+  __m256 index = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256 eight = _mm256_set1_ps(8);
+  __m256 gainL = _mm256_set1_ps(gainLeft);
+  __m256 gainR = _mm256_set1_ps(gainRight);
+  __m256 stepL = _mm256_set1_ps(stepLeft);
+  __m256 stepR = _mm256_set1_ps(stepRight);
+  int i = 0;
+  for(; i + 8 <= count; i += 8) {
+    __m256 s = _mm256_loadu_ps(source + i);
+    __m256 l = _mm256_mul_ps(s, _mm256_add_ps(gainL, _mm256_mul_ps(stepL, index)));
+    __m256 r = _mm256_mul_ps(s, _mm256_add_ps(gainR, _mm256_mul_ps(stepR, index)));
+    _mm256_storeu_ps(left + i, _mm256_add_ps(_mm256_loadu_ps(left + i), l));
+    _mm256_storeu_ps(right + i, _mm256_add_ps(_mm256_loadu_ps(right + i), r));
+    index = _mm256_add_ps(index, eight);
+  }
+  _mm256_zeroupper();
+  for(; i < count; ++i) {
+    float s = source[i];
+    left[i] = left[i] + s * (gainLeft + stepLeft * (float) i);
+    right[i] = right[i] + s * (gainRight + stepRight * (float) i);
+  }
+}
+
+RAIKA_TARGET_AVX2
+static void MixOutputAVX2(
+    int16_t *dest, float *left, float *right,
+    float *ditherLeft, float *ditherRight, float gain, int count
+) {
+  __m256 gainWide = _mm256_set1_ps(gain);
+  __m256 low = _mm256_set1_ps(-1.0f);
+  __m256 high = _mm256_set1_ps(1.0f);
+  __m256 scale = _mm256_set1_ps(32766.0f);
+  int i = 0;
+  for(; i + 8 <= count; i += 8) {
+    __m256 l = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(left + i), gainWide), low), high);
+    __m256 r = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(right + i), gainWide), low), high);
+    __m256i li = _mm256_cvtps_epi32(_mm256_add_ps(_mm256_mul_ps(l, scale), _mm256_loadu_ps(ditherLeft + i)));
+    __m256i ri = _mm256_cvtps_epi32(_mm256_add_ps(_mm256_mul_ps(r, scale), _mm256_loadu_ps(ditherRight + i)));
+    // Lane-wise unpack and pack keep the halves apart, so samples 0-3 land in
+    // the low half and 4-7 in the high one, already in order
+    __m256i lo = _mm256_unpacklo_epi32(li, ri);
+    __m256i hi = _mm256_unpackhi_epi32(li, ri);
+    _mm256_storeu_si256((__m256i *) (dest + 2 * i), _mm256_packs_epi32(lo, hi));
+  }
+  _mm256_zeroupper();
+  MixOutputScalar(dest + 2 * i, left + i, right + i, ditherLeft + i, ditherRight + i, gain, count - i);
+}
+
+struct mix_kernels {
+  const char *name;
+  mix_kernel *mix;
+  mix_output_kernel *output;
+};
+
+// Ordered slowest to fastest, the last supported one wins
+static mix_kernels GetMixKernels(int index) {
+  cpu_features *cpu = GetCpuFeatures();
+  mix_kernels result = {};
+  switch(index) {
+    case 0: {
+      result.name = "scalar";
+      result.mix = MixScalar;
+      result.output = MixOutputScalar;
+    } break;
+    case 1: {
+      if(cpu->sse2) {
+        result.name = "sse2";
+        result.mix = MixSSE2;
+        result.output = MixOutputSSE2;
+      }
+    } break;
+    case 2: {
+      if(cpu->avx2) {
+        result.name = "avx2";
+        result.mix = MixAVX2;
+        result.output = MixOutputAVX2;
+      }
+    } break;
+  }
+  return result;
+}
+#define MIX_KERNEL_COUNT 3
+
+static mix_kernels globalMixKernels;
+
+static mix_kernels *PickMixKernels() {
+  if(!globalMixKernels.name) {
+    for(int i = 0; i < MIX_KERNEL_COUNT; ++i) {
+      mix_kernels kernels = GetMixKernels(i);
+      if(kernels.name) {
+        globalMixKernels = kernels;
+      }
+    }
+  }
+  return &globalMixKernels;
+}
+
+// Mixing
+// Runs each group's chain and adds the group to the main bus, then runs the
+// main chain. Denormals are flushed meanwhile, recursive filters and decaying
+// lines produce them as they fall silent.
+static void MixGroups(mixer *mix, mix_kernels *kernels, effect_kernels *effectKernels, int count) {
+  uint32_t csr = _mm_getcsr();
+  _mm_setcsr(csr | 0x8040);
+  for(int g = 1; g < MIXER_MAX_GROUPS; ++g) {
+    mixer_group *group = mix->groups + g;
+    if(!group->used && !group->chainCount) {
+      continue;
+    }
+    if(!group->used) {
+      memset(group->left, 0, count * sizeof(float));
+      memset(group->right, 0, count * sizeof(float));
+    }
+    for(int c = 0; c < group->chainCount; ++c) {
+      ProcessEffect(effectKernels, mix->effects + group->chain[c], group->left, group->right, count);
+    }
+    float step = (group->gain - group->currentGain) / count;
+    kernels->mix(mix->left, mix->right, group->left, count, group->currentGain, step, 0.0f, 0.0f);
+    kernels->mix(mix->left, mix->right, group->right, count, 0.0f, 0.0f, group->currentGain, step);
+    group->currentGain = group->gain;
+  }
+  mixer_group *master = mix->groups;
+  for(int c = 0; c < master->chainCount; ++c) {
+    ProcessEffect(effectKernels, mix->effects + master->chain[c], mix->left, mix->right, count);
+  }
+  _mm_setcsr(csr);
+}
+
+// Voices that finished are dropped from the active list while it is walked.
+// A stopped voice plays one more block, ramping down to silence.
+static void MixBlock(
+    mixer *mix, mix_kernels *kernels, oscillator_kernels *oscKernels,
+    resample_kernels *resampleKernels, effect_kernels *effectKernels, int count
+) {
+  memset(mix->left, 0, count * sizeof(float));
+  memset(mix->right, 0, count * sizeof(float));
+  for(int g = 0; g < MIXER_MAX_GROUPS; ++g) {
+    mix->groups[g].used = false;
+  }
+  for(int a = 0; a < mix->activeCount;) {
+    int index = mix->active[a];
+    mixer_voice *voice = mix->voices + index;
+    float *left = mix->left;
+    float *right = mix->right;
+    if(voice->group) {
+      mixer_group *group = mix->groups + voice->group;
+      if(!group->used) {
+        memset(group->left, 0, count * sizeof(float));
+        memset(group->right, 0, count * sizeof(float));
+        group->used = true;
+      }
+      left = group->left;
+      right = group->right;
+    }
+    bool playing = RenderVoice(mix, oscKernels, resampleKernels, voice, mix->scratch, mix->scratchRight, count) && !voice->stopping;
+    bool stereo = IsStereoVoice(voice);
+
+    float targetLeft = 0.0f, targetRight = 0.0f;
+    if(!voice->stopping) {
+      if(stereo) {
+        BalanceGains(voice->gain, voice->pan, &targetLeft, &targetRight);
+      } else {
+        PanGains(voice->gain, voice->pan, &targetLeft, &targetRight);
+      }
+    }
+    if(!voice->started) {
+      voice->currentLeft = targetLeft;
+      voice->currentRight = targetRight;
+      voice->started = true;
+    }
+    float stepLeft = (targetLeft - voice->currentLeft) / count;
+    float stepRight = (targetRight - voice->currentRight) / count;
+    if(stereo) {
+      // Each channel goes through the mono kernel with the other's gain at zero
+      kernels->mix(left, right, mix->scratch, count, voice->currentLeft, stepLeft, 0.0f, 0.0f);
+      kernels->mix(left, right, mix->scratchRight, count, 0.0f, 0.0f, voice->currentRight, stepRight);
+    } else {
+      kernels->mix(
+        left, right, mix->scratch, count,
+        voice->currentLeft, stepLeft, voice->currentRight, stepRight
+      );
+    }
+    voice->currentLeft = targetLeft;
+    voice->currentRight = targetRight;
+
+    if(playing) {
+      ++a;
+    } else {
+      voice->type = MixerSource_None;
+      mix->free[mix->freeCount++] = (uint16_t) index;
+      mix->active[a] = mix->active[--mix->activeCount];
+    }
+  }
+  MixGroups(mix, kernels, effectKernels, count);
+}
+
+// Device formats
+// One writer per sample type and channel count, generated from a template so
+// the type's size and the frame stride are constants the compiler can build
+// fixed stores from. Four frames are clipped and scaled at a time with SSE2,
+// then stored. 16 bit stereo goes through the mix kernels' output instead,
+// which match WriteSamples<sample_int16, 2> bit for bit.
+//
+// The sample types scale a clipped value to device units, and store one.
+typedef void sample_writer(
+  void *dest, int channels, float *left, float *right,
+  float *ditherLeft, float *ditherRight, float gain, int count
+);
+
+struct sample_int16 {
+  enum { Bytes = 2, Dither = 1 };
+  static __m128i Scale(__m128 v, __m128 dither) {
+    return _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(32766.0f)), dither));
+  }
+  static void Store(uint8_t *dest, int32_t value) {
+    *(int16_t *) dest = (int16_t) value;
+  }
+};
+
+// Packed little endian, three bytes per sample
+struct sample_int24 {
+  enum { Bytes = 3, Dither = 0 };
+  static __m128i Scale(__m128 v, __m128 dither) {
+    return _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(8388607.0f)));
+  }
+  static void Store(uint8_t *dest, int32_t value) {
+    dest[0] = (uint8_t) value;
+    dest[1] = (uint8_t) (value >> 8);
+    dest[2] = (uint8_t) (value >> 16);
+  }
+};
+
+// The largest float under 2^31, full scale itself would overflow
+struct sample_int32 {
+  enum { Bytes = 4, Dither = 0 };
+  static __m128i Scale(__m128 v, __m128 dither) {
+    return _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(2147483520.0f)));
+  }
+  static void Store(uint8_t *dest, int32_t value) {
+    *(int32_t *) dest = value;
+  }
+};
+
+// Carried through the integer lanes as bits
+struct sample_float32 {
+  enum { Bytes = 4, Dither = 0 };
+  static __m128i Scale(__m128 v, __m128 dither) {
+    return _mm_castps_si128(v);
+  }
+  static void Store(uint8_t *dest, int32_t value) {
+    *(int32_t *) dest = value;
+  }
+};
+
+// Channels is a compile time constant unless Channels is zero, then it
+// comes from the argument. Mono is the average of the bus channels.
+template<typename sample_type, int Channels>
+static void WriteSamples(
+    void *dest, int channels, float *left, float *right,
+    float *ditherLeft, float *ditherRight, float gain, int count
+) {
+  int frameChannels = Channels ? Channels : channels;
+  size_t frameBytes = (size_t) sample_type::Bytes * frameChannels;
+  // The channels past left and right, which get silence
+  size_t extraBytes = frameChannels > 2 ? frameBytes - 2 * sample_type::Bytes : 0;
+  uint8_t *frame = (uint8_t *) dest;
+  __m128 gainWide = _mm_set1_ps(gain);
+  __m128 low = _mm_set1_ps(-1.0f);
+  __m128 high = _mm_set1_ps(1.0f);
+  for(int i = 0; i < count; i += 4) {
+    // The last group reads a zero padded copy
+    int groupCount = count - i < 4 ? count - i : 4;
+    float l4[4] = {}, r4[4] = {}, dl4[4] = {}, dr4[4] = {};
+    float *l = left + i, *r = right + i, *dl = ditherLeft + i, *dr = ditherRight + i;
+    if(groupCount < 4) {
+      memcpy(l4, l, groupCount * sizeof(float));
+      memcpy(r4, r, groupCount * sizeof(float));
+      if(sample_type::Dither) {
+        memcpy(dl4, dl, groupCount * sizeof(float));
+        memcpy(dr4, dr, groupCount * sizeof(float));
+      }
+      l = l4, r = r4, dl = dl4, dr = dr4;
+    }
+    __m128 lv = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(l), gainWide), low), high);
+    __m128 rv = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(r), gainWide), low), high);
+    __m128 dlv = sample_type::Dither ? _mm_loadu_ps(dl) : _mm_setzero_ps();
+    __m128 drv = sample_type::Dither ? _mm_loadu_ps(dr) : _mm_setzero_ps();
+    int32_t lo[4], ro[4];
+    if(frameChannels == 1) {
+      _mm_storeu_si128((__m128i *) lo, sample_type::Scale(_mm_mul_ps(_mm_add_ps(lv, rv), _mm_set1_ps(0.5f)), dlv));
+    } else {
+      _mm_storeu_si128((__m128i *) lo, sample_type::Scale(lv, dlv));
+      _mm_storeu_si128((__m128i *) ro, sample_type::Scale(rv, drv));
+    }
+    for(int g = 0; g < groupCount; ++g) {
+      sample_type::Store(frame, lo[g]);
+      if(frameChannels > 1) {
+        sample_type::Store(frame + sample_type::Bytes, ro[g]);
+        memset(frame + 2 * sample_type::Bytes, 0, extraBytes);
+      }
+      frame += frameBytes;
+    }
+  }
+}
+
+struct sample_writer_info {
+  int bytesPerSample;
+  bool floatSamples;
+  // Zero matches any channel count
+  int channels;
+  sample_writer *writer;
+};
+
+static const sample_writer_info SAMPLE_WRITERS[] = {
+  {2, false, 1, WriteSamples<sample_int16, 1>},
+  {2, false, 2, WriteSamples<sample_int16, 2>},
+  {2, false, 6, WriteSamples<sample_int16, 6>},
+  {2, false, 0, WriteSamples<sample_int16, 0>},
+  {3, false, 1, WriteSamples<sample_int24, 1>},
+  {3, false, 2, WriteSamples<sample_int24, 2>},
+  {3, false, 6, WriteSamples<sample_int24, 6>},
+  {3, false, 0, WriteSamples<sample_int24, 0>},
+  {4, false, 1, WriteSamples<sample_int32, 1>},
+  {4, false, 2, WriteSamples<sample_int32, 2>},
+  {4, false, 6, WriteSamples<sample_int32, 6>},
+  {4, false, 0, WriteSamples<sample_int32, 0>},
+  {4, true, 1, WriteSamples<sample_float32, 1>},
+  {4, true, 2, WriteSamples<sample_float32, 2>},
+  {4, true, 6, WriteSamples<sample_float32, 6>},
+  {4, true, 0, WriteSamples<sample_float32, 0>},
+};
+
+// Zero for formats with no writer
+static sample_writer *GetSampleWriter(sound_buffer *buffer) {
+  for(int i = 0; i < (int) ArrayCount(SAMPLE_WRITERS); ++i) {
+    sample_writer_info info = SAMPLE_WRITERS[i];
+    if(info.bytesPerSample == buffer->bytesPerSample && info.floatSamples == buffer->floatSamples &&
+       (info.channels == buffer->channels || info.channels == 0) && buffer->channels > 0) {
+      return info.writer;
+    }
+  }
+  return 0;
+}
+
+// Voices render at busRate from here on, and the bus is resampled to the
+// device at quality. A rate of zero goes back to mixing at the device rate.
+inline void SetMixerBus(mixer *mix, int busRate, resample_quality quality) {
+  mix->busRate = busRate;
+  InitResampler(&mix->bus, quality, 1.0);
+}
+
+// The measured rate of the device over its nominal one, applied to the bus
+// resampler from the next block. Only does anything with the bus on.
+inline void SetMixerDrift(mixer *mix, double drift) {
+  mix->drift = drift > 0.0 ? drift : 1.0;
+}
+
+// Mixes as many blocks at the bus rate as the resampler needs for count
+// device samples, then pulls them into the bus output
+static void MixBusBlock(
+    mixer *mix, mix_kernels *kernels, oscillator_kernels *oscKernels,
+    resample_kernels *resampleKernels, effect_kernels *effectKernels, int count
+) {
+  uint32_t needed = ResamplerInputNeeded(&mix->bus, count);
+  while(needed) {
+    int blockCount = needed < MIXER_BLOCK_SAMPLES ? (int) needed : MIXER_BLOCK_SAMPLES;
+    MixBlock(mix, kernels, oscKernels, resampleKernels, effectKernels, blockCount);
+    ResamplerPush(&mix->bus, mix->left, mix->right, blockCount);
+    needed -= blockCount;
+  }
+  ResamplerPull(resampleKernels, &mix->bus, mix->busLeft, mix->busRight, count);
+}
+
+static void MixSoundWith(
+    mix_kernels *kernels, oscillator_kernels *oscKernels, resample_kernels *resampleKernels,
+    effect_kernels *effectKernels, mixer *mix, sound_buffer *buffer
+) {
+  if(mix->busRate) {
+    mix->samplesPerSecond = mix->busRate;
+    mix->bus.ratio = (double) mix->busRate / (buffer->samplesPerSecond * mix->drift);
+  } else {
+    mix->samplesPerSecond = buffer->samplesPerSecond;
+  }
+  bool fast = buffer->bytesPerSample == 2 && buffer->channels == 2 && !buffer->floatSamples;
+  sample_writer *writer = fast ? 0 : GetSampleWriter(buffer);
+  size_t frameBytes = (size_t) buffer->bytesPerSample * buffer->channels;
+  for(int start = 0; start < buffer->samplesRequested; start += MIXER_BLOCK_SAMPLES) {
+    int count = buffer->samplesRequested - start;
+    count = count < MIXER_BLOCK_SAMPLES ? count : MIXER_BLOCK_SAMPLES;
+    float *left = mix->left;
+    float *right = mix->right;
+    if(mix->busRate) {
+      MixBusBlock(mix, kernels, oscKernels, resampleKernels, effectKernels, count);
+      left = mix->busLeft;
+      right = mix->busRight;
+    } else {
+      MixBlock(mix, kernels, oscKernels, resampleKernels, effectKernels, count);
+    }
+    if(fast) {
+      // The channels read the table half its length apart so their noise
+      // is not correlated
+      kernels->output(
+        (int16_t *) buffer->memory + 2 * start, left, right,
+        globalDither + mix->ditherAt,
+        globalDither + (mix->ditherAt + MIXER_DITHER_SIZE / 2) % MIXER_DITHER_SIZE,
+        mix->masterGain, count
+      );
+    } else if(writer) {
+      writer(
+        (uint8_t *) buffer->memory + start * frameBytes, buffer->channels, left, right,
+        globalDither + mix->ditherAt,
+        globalDither + (mix->ditherAt + MIXER_DITHER_SIZE / 2) % MIXER_DITHER_SIZE,
+        mix->masterGain, count
+      );
+    } else {
+      memset((uint8_t *) buffer->memory + start * frameBytes, 0, count * frameBytes);
+    }
+    mix->ditherAt = (mix->ditherAt + count) % MIXER_DITHER_SIZE;
+  }
+}
+
+// Fills the whole sound_buffer from the playing voices
+static void MixSound(mixer *mix, sound_buffer *buffer) {
+  MixSoundWith(PickMixKernels(), PickOscillatorKernels(), PickResampleKernels(), PickEffectKernels(), mix, buffer);
+}
@@ -0,0 +1,397 @@
+#include "raika_intrinsics.h"
+
+// Wavetable oscillators
+// Every waveform is a set of single cycle tables, one per octave, each built
+// from only the harmonics that stay under Nyquist for the pitches it serves.
+// An oscillator reads the table for its pitch with a 32 bit phase accumulator
+// that wraps on its own, so any frequency at any sample rate is off by at
+// most rate / 2^33 Hz.
+//
+// The top 11 bits of the phase pick the table entry and the next 16 are the
+// fraction between entries. Tables carry one guard entry before and two after
+// so cubic interpolation never has to wrap. Cubic reads a second table that
+// holds each entry's four polynomial coefficients side by side, worked out
+// once when the tables are built, so a sample is one 16 byte load rather than
+// four scattered ones and the coefficient arithmetic.
+#define OSC_TABLE_BITS 11
+#define OSC_TABLE_SIZE (1 << OSC_TABLE_BITS)
+#define OSC_TABLE_GUARD 3
+// Table k holds harmonics 1 to OSC_MAX_HARMONICS >> k
+#define OSC_TABLE_LEVELS 11
+#define OSC_MAX_HARMONICS (OSC_TABLE_SIZE / 2)
+#define OSC_FRACTION_SHIFT (32 - OSC_TABLE_BITS - 16)
+
+#define Tau64 6.28318530717958647692
+
+enum oscillator_waveform {
+  Waveform_Sine,
+  Waveform_Saw,
+  Waveform_Square,
+  Waveform_Triangle,
+
+  Waveform_Count
+};
+
+enum oscillator_interpolation {
+  Interpolation_Linear,
+  Interpolation_Cubic,
+
+  Interpolation_Count
+};
+
+struct oscillator {
+  uint32_t phase;
+  uint32_t increment;
+  float amplitude;
+  oscillator_waveform waveform;
+  oscillator_interpolation interpolation;
+};
+
+// y1, c1, c2, c3 of the cubic between an entry and the next
+struct oscillator_cubic {
+  float c[4];
+};
+
+// Sine only needs the first level
+static float globalWavetables[Waveform_Count][OSC_TABLE_LEVELS][OSC_TABLE_SIZE + OSC_TABLE_GUARD];
+static oscillator_cubic globalCubicTables[Waveform_Count][OSC_TABLE_LEVELS][OSC_TABLE_SIZE];
+static bool globalWavetablesBuilt;
+
+// Fourier series amplitude of harmonic h, zero where the waveform has none
+static double HarmonicAmplitude(oscillator_waveform waveform, int h) {
+  double pi = Tau64 / 2;
+  switch(waveform) {
+    case Waveform_Sine: {
+      return h == 1 ? 1.0 : 0.0;
+    } break;
+    case Waveform_Saw: {
+      return 2.0 / (pi * h);
+    } break;
+    case Waveform_Square: {
+      return (h & 1) ? 4.0 / (pi * h) : 0.0;
+    } break;
+    case Waveform_Triangle: {
+      double sign = ((h >> 1) & 1) ? -1.0 : 1.0;
+      return (h & 1) ? sign * 8.0 / (pi * pi * h * h) : 0.0;
+    } break;
+    default: {
+      return 0.0;
+    } break;
+  }
+}
+
+// The entries, their guards, and the Catmull-Rom coefficients through the
+// two entries either side of each
+static void StoreWavetable(float *table, oscillator_cubic *cubic, double *sum, double scale) {
+  float *entry = table + 1;
+  for(int i = 0; i < OSC_TABLE_SIZE; ++i) {
+    entry[i] = (float) (sum[i] * scale);
+  }
+  entry[-1] = entry[OSC_TABLE_SIZE - 1];
+  entry[OSC_TABLE_SIZE] = entry[0];
+  entry[OSC_TABLE_SIZE + 1] = entry[1];
+  for(int i = 0; i < OSC_TABLE_SIZE; ++i) {
+    float y0 = entry[i - 1];
+    float y1 = entry[i];
+    float y2 = entry[i + 1];
+    float y3 = entry[i + 2];
+    cubic[i].c[0] = y1;
+    cubic[i].c[1] = 0.5f * (y2 - y0);
+    cubic[i].c[2] = y0 - 2.5f * y1 + 2.0f * y2 - 0.5f * y3;
+    cubic[i].c[3] = 0.5f * (y3 - y0) + 1.5f * (y1 - y2);
+  }
+}
+
+// Levels are built from the fewest harmonics up, each adding what the one
+// before lacks. sin(h * x) comes out of one sine table by indexing it at
+// h * i mod N, which is exact since every harmonic is a whole number of
+// cycles. Every level is scaled by the peak of the full band one so they all
+// play at the same loudness.
+static void BuildWavetables() {
+  static double sine[OSC_TABLE_SIZE];
+  static double sum[OSC_TABLE_SIZE];
+  static double levels[OSC_TABLE_LEVELS][OSC_TABLE_SIZE];
+  for(int i = 0; i < OSC_TABLE_SIZE; ++i) {
+    sine[i] = sin(Tau64 * i / OSC_TABLE_SIZE);
+  }
+
+  for(int w = 0; w < Waveform_Count; ++w) {
+    oscillator_waveform waveform = (oscillator_waveform) w;
+    memset(sum, 0, sizeof(sum));
+    int harmonics = 0;
+    for(int level = OSC_TABLE_LEVELS - 1; level >= 0; --level) {
+      int top = OSC_MAX_HARMONICS >> level;
+      for(int h = harmonics + 1; h <= top; ++h) {
+        double amplitude = HarmonicAmplitude(waveform, h);
+        if(amplitude == 0.0) {
+          continue;
+        }
+        for(int i = 0; i < OSC_TABLE_SIZE; ++i) {
+          sum[i] += amplitude * sine[((size_t) h * i) & (OSC_TABLE_SIZE - 1)];
+        }
+      }
+      harmonics = top;
+      memcpy(levels[level], sum, sizeof(sum));
+    }
+
+    double peak = 0;
+    for(int i = 0; i < OSC_TABLE_SIZE; ++i) {
+      peak = fabs(levels[0][i]) > peak ? fabs(levels[0][i]) : peak;
+    }
+    for(int level = 0; level < OSC_TABLE_LEVELS; ++level) {
+      StoreWavetable(globalWavetables[w][level], globalCubicTables[w][level], levels[level], 1.0 / peak);
+    }
+  }
+  globalWavetablesBuilt = true;
+}
+
+inline uint32_t OscillatorIncrement(double hz, int samplesPerSecond) {
+  double cycles = hz / samplesPerSecond;
+  cycles = cycles < 0 ? 0 : (cycles > 0.5 ? 0.5 : cycles);
+  return (uint32_t) (cycles * 4294967296.0 + 0.5);
+}
+
+inline double OscillatorFrequency(uint32_t increment, int samplesPerSecond) {
+  return increment * (double) samplesPerSecond / 4294967296.0;
+}
+
+// The most harmonics that fit under Nyquist decide the level, so a table
+// never holds anything above half the sample rate
+static int GetWavetableLevel(oscillator_waveform waveform, uint32_t increment) {
+  if(!globalWavetablesBuilt) {
+    BuildWavetables();
+  }
+  int level = 0;
+  if(waveform != Waveform_Sine) {
+    while(level < OSC_TABLE_LEVELS - 1 &&
+          (uint64_t) (OSC_MAX_HARMONICS >> level) * increment > 0x80000000u) {
+      ++level;
+    }
+  }
+  return level;
+}
+
+// Kernels
+// Add count samples of one oscillator to out. Every kernel must match the
+// scalar version bit for bit: the same entries, the same operations in the
+// same order, and no fused multiply-adds. Linear kernels take the entries,
+// cubic ones the coefficients.
+typedef void oscillator_kernel(float *out, void *table, uint32_t phase, uint32_t increment, float amplitude, int count);
+
+inline float OscillatorFraction(uint32_t phase) {
+  return (float) ((phase >> OSC_FRACTION_SHIFT) & 0xFFFF) * (1.0f / 65536.0f);
+}
+
+static void OscillatorLinearScalar(float *out, void *entries, uint32_t phase, uint32_t increment, float amplitude, int count) {
+  float *table = (float *) entries;
+  for(int i = 0; i < count; ++i) {
+    uint32_t index = phase >> (32 - OSC_TABLE_BITS);
+    float t = OscillatorFraction(phase);
+    float a = table[index];
+    float b = table[index + 1];
+    out[i] = out[i] + amplitude * (a + t * (b - a));
+    phase += increment;
+  }
+}
+
+static void OscillatorCubicScalar(float *out, void *coefficients, uint32_t phase, uint32_t increment, float amplitude, int count) {
+  oscillator_cubic *table = (oscillator_cubic *) coefficients;
+  for(int i = 0; i < count; ++i) {
+    uint32_t index = phase >> (32 - OSC_TABLE_BITS);
+    float t = OscillatorFraction(phase);
+    float *c = table[index].c;
+    out[i] = out[i] + amplitude * (((c[3] * t + c[2]) * t + c[1]) * t + c[0]);
+    phase += increment;
+  }
+}
+
+// No gathers before AVX2, the indices go through memory
+inline __m128i OscillatorPhasesSSE2(uint32_t phase, uint32_t increment) {
+  return _mm_setr_epi32(phase, phase + increment, phase + 2 * increment, phase + 3 * increment);
+}
+
+inline __m128 OscillatorFractionSSE2(__m128i phases) {
+  __m128i fraction = _mm_and_si128(_mm_srli_epi32(phases, OSC_FRACTION_SHIFT), _mm_set1_epi32(0xFFFF));
+  return _mm_mul_ps(_mm_cvtepi32_ps(fraction), _mm_set1_ps(1.0f / 65536.0f));
+}
+
+static void OscillatorLinearSSE2(float *out, void *entries, uint32_t phase, uint32_t increment, float amplitude, int count) {
+  float *table = (float *) entries;
+  __m128i phases = OscillatorPhasesSSE2(phase, increment);
+  __m128i step = _mm_set1_epi32(4 * increment);
+  __m128 amplitudeWide = _mm_set1_ps(amplitude);
+  uint32_t index[4];
+
+  int i = 0;
+  for(; i + 4 <= count; i += 4) {
+    _mm_storeu_si128((__m128i *) index, _mm_srli_epi32(phases, 32 - OSC_TABLE_BITS));
+    __m128 t = OscillatorFractionSSE2(phases);
+    __m128 a = _mm_setr_ps(table[index[0]], table[index[1]], table[index[2]], table[index[3]]);
+    __m128 b = _mm_setr_ps(table[index[0] + 1], table[index[1] + 1], table[index[2] + 1], table[index[3] + 1]);
+    __m128 value = _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+    _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(amplitudeWide, value)));
+    phases = _mm_add_epi32(phases, step);
+  }
+  OscillatorLinearScalar(out + i, entries, phase + i * increment, increment, amplitude, count - i);
+}
+
+// Four lanes' coefficients come in as rows and are turned into columns
+static void OscillatorCubicSSE2(float *out, void *coefficients, uint32_t phase, uint32_t increment, float amplitude, int count) {
+  oscillator_cubic *table = (oscillator_cubic *) coefficients;
+  __m128i phases = OscillatorPhasesSSE2(phase, increment);
+  __m128i step = _mm_set1_epi32(4 * increment);
+  __m128 amplitudeWide = _mm_set1_ps(amplitude);
+  uint32_t index[4];
+
+  int i = 0;
+  for(; i + 4 <= count; i += 4) {
+    _mm_storeu_si128((__m128i *) index, _mm_srli_epi32(phases, 32 - OSC_TABLE_BITS));
+    __m128 t = OscillatorFractionSSE2(phases);
+    __m128 c0 = _mm_loadu_ps(table[index[0]].c);
+    __m128 c1 = _mm_loadu_ps(table[index[1]].c);
+    __m128 c2 = _mm_loadu_ps(table[index[2]].c);
+    __m128 c3 = _mm_loadu_ps(table[index[3]].c);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    __m128 value = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(c3, t), c2), t), c1), t), c0);
+    _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(amplitudeWide, value)));
+    phases = _mm_add_epi32(phases, step);
+  }
+  OscillatorCubicScalar(out + i, coefficients, phase + i * increment, increment, amplitude, count - i);
+}
+
+RAIKA_TARGET_AVX2
+inline __m256i OscillatorPhasesAVX2(uint32_t phase, uint32_t increment) {
+  __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  return _mm256_add_epi32(_mm256_set1_epi32(phase), _mm256_mullo_epi32(lane, _mm256_set1_epi32(increment)));
+}
+
+RAIKA_TARGET_AVX2
+inline __m256 OscillatorFractionAVX2(__m256i phases) {
+  __m256i fraction = _mm256_and_si256(_mm256_srli_epi32(phases, OSC_FRACTION_SHIFT), _mm256_set1_epi32(0xFFFF));
+  return _mm256_mul_ps(_mm256_cvtepi32_ps(fraction), _mm256_set1_ps(1.0f / 65536.0f));
+}
+
+RAIKA_TARGET_AVX2
+static void OscillatorLinearAVX2(float *out, void *entries, uint32_t phase, uint32_t increment, float amplitude, int count) {
+  float *table = (float *) entries;
+  __m256i phases = OscillatorPhasesAVX2(phase, increment);
+  __m256i step = _mm256_set1_epi32(8 * increment);
+  __m256 amplitudeWide = _mm256_set1_ps(amplitude);
+
+  int i = 0;
+  for(; i + 8 <= count; i += 8) {
+    __m256i index = _mm256_srli_epi32(phases, 32 - OSC_TABLE_BITS);
+    __m256 t = OscillatorFractionAVX2(phases);
+    __m256 a = _mm256_i32gather_ps(table, index, 4);
+    __m256 b = _mm256_i32gather_ps(table + 1, index, 4);
+    __m256 value = _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+    _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_mul_ps(amplitudeWide, value)));
+    phases = _mm256_add_epi32(phases, step);
+  }
+  _mm256_zeroupper();
+  OscillatorLinearScalar(out + i, entries, phase + i * increment, increment, amplitude, count - i);
+}
+
+// Lanes n and n + 4 share a 256 bit row, so the 4x4 transpose within each
+// half gives whole columns
+RAIKA_TARGET_AVX2
+static void OscillatorCubicAVX2(float *out, void *coefficients, uint32_t phase, uint32_t increment, float amplitude, int count) {
+  oscillator_cubic *table = (oscillator_cubic *) coefficients;
+  __m256i phases = OscillatorPhasesAVX2(phase, increment);
+  __m256i step = _mm256_set1_epi32(8 * increment);
+  __m256 amplitudeWide = _mm256_set1_ps(amplitude);
+  uint32_t index[8];
+
+  int i = 0;
+  for(; i + 8 <= count; i += 8) {
+    _mm256_storeu_si256((__m256i *) index, _mm256_srli_epi32(phases, 32 - OSC_TABLE_BITS));
+    __m256 t = OscillatorFractionAVX2(phases);
+    __m256 r0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(table[index[0]].c)), _mm_loadu_ps(table[index[4]].c), 1);
+    __m256 r1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(table[index[1]].c)), _mm_loadu_ps(table[index[5]].c), 1);
+    __m256 r2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(table[index[2]].c)), _mm_loadu_ps(table[index[6]].c), 1);
+    __m256 r3 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(table[index[3]].c)), _mm_loadu_ps(table[index[7]].c), 1);
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+    __m256 t1 = _mm256_unpacklo_ps(r2, r3);
+    __m256 t2 = _mm256_unpackhi_ps(r0, r1);
+    __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+    __m256 c0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 c1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 c2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 c3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 value = _mm256_add_ps(
+      _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(c3, t), c2), t), c1), t), c0
+    );
+    _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_mul_ps(amplitudeWide, value)));
+    phases = _mm256_add_epi32(phases, step);
+  }
+  _mm256_zeroupper();
+  OscillatorCubicScalar(out + i, coefficients, phase + i * increment, increment, amplitude, count - i);
+}
+
+struct oscillator_kernels {
+  const char *name;
+  oscillator_kernel *interpolate[Interpolation_Count];
+};
+
+// Ordered slowest to fastest, the last supported one wins
+static oscillator_kernels GetOscillatorKernels(int index) {
+  cpu_features *cpu = GetCpuFeatures();
+  oscillator_kernels result = {};
+  switch(index) {
+    case 0: {
+      result.name = "scalar";
+      result.interpolate[Interpolation_Linear] = OscillatorLinearScalar;
+      result.interpolate[Interpolation_Cubic] = OscillatorCubicScalar;
+    } break;
+    case 1: {
+      if(cpu->sse2) {
+        result.name = "sse2";
+        result.interpolate[Interpolation_Linear] = OscillatorLinearSSE2;
+        result.interpolate[Interpolation_Cubic] = OscillatorCubicSSE2;
+      }
+    } break;
+    case 2: {
+      if(cpu->avx2) {
+        result.name = "avx2";
+        result.interpolate[Interpolation_Linear] = OscillatorLinearAVX2;
+        result.interpolate[Interpolation_Cubic] = OscillatorCubicAVX2;
+      }
+    } break;
+  }
+  return result;
+}
+#define OSCILLATOR_KERNEL_COUNT 3
+
+static oscillator_kernels globalOscillatorKernels;
+
+static oscillator_kernels *PickOscillatorKernels() {
+  if(!globalOscillatorKernels.name) {
+    for(int i = 0; i < OSCILLATOR_KERNEL_COUNT; ++i) {
+      oscillator_kernels kernels = GetOscillatorKernels(i);
+      if(kernels.name) {
+        globalOscillatorKernels = kernels;
+      }
+    }
+  }
+  return &globalOscillatorKernels;
+}
+
+static void SetOscillatorFrequency(oscillator *osc, double hz, int samplesPerSecond) {
+  osc->increment = OscillatorIncrement(hz, samplesPerSecond);
+}
+
+// Adds count mono samples to out and moves the phase on
+static void RenderOscillatorWith(oscillator_kernels *kernels, oscillator *osc, float *out, int count) {
+  int level = GetWavetableLevel(osc->waveform, osc->increment);
+  void *table = osc->interpolation == Interpolation_Cubic ?
+    (void *) globalCubicTables[osc->waveform][level] : (void *) (globalWavetables[osc->waveform][level] + 1);
+  kernels->interpolate[osc->interpolation](out, table, osc->phase, osc->increment, osc->amplitude, count);
+  osc->phase += (uint32_t) count * osc->increment;
+}
+
+inline void RenderOscillators(oscillator *oscs, int oscCount, float *out, int count) {
+  oscillator_kernels *kernels = PickOscillatorKernels();
+  for(int i = 0; i < oscCount; ++i) {
+    RenderOscillatorWith(kernels, oscs + i, out, count);
+  }
+}
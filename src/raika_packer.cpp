@@ -0,0 +1,170 @@
+#include "raika_asset_pack.h"
+#include "raika_cooked_texture.h"
+
+#include <stdio.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// Builds an asset pack from loose files, run by the build scripts.
+// Usage: raika_packer [--store] OUTPUT [NAME=]FILE...
+// Assets are named after the file without its directories unless NAME is
+// given. --store leaves every blob uncompressed. Every file stb_image can
+// decode is also cooked, see raika_cooked_texture.h.
+
+static bool ReadWholeFile(const char *filename, void **memory, uint64_t *size) {
+  bool result = false;
+  *memory = 0;
+  *size = 0;
+  FILE *file = fopen(filename, "rb");
+  if(file) {
+    if(fseek(file, 0, SEEK_END) == 0) {
+      long length = ftell(file);
+      if(length >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+        *memory = malloc(length ? (size_t) length : 1);
+        if(*memory && fread(*memory, 1, (size_t) length, file) == (size_t) length) {
+          *size = (uint64_t) length;
+          result = true;
+        }
+      }
+    }
+    fclose(file);
+  }
+  if(!result) {
+    free(*memory);
+    *memory = 0;
+  }
+  return result;
+}
+
+static const char *AssetNameFromPath(const char *path) {
+  const char *name = path;
+  for(const char *at = path; *at; ++at) {
+    if(*at == '/' || *at == '\\') {
+      name = at + 1;
+    }
+  }
+  return name;
+}
+
+int main(int argc, char **argv) {
+  bool compress = true;
+  int arg = 1;
+  if(arg < argc && strcmp(argv[arg], "--store") == 0) {
+    compress = false;
+    ++arg;
+  }
+  if(argc - arg < 2) {
+    fprintf(stderr, "usage: %s [--store] OUTPUT [NAME=]FILE...\n", argv[0]);
+    return 1;
+  }
+  const char *output = argv[arg++];
+  uint32_t count = (uint32_t) (argc - arg);
+  // Room for a cook of every file
+  asset_source *sources = (asset_source *) calloc(2 * (size_t) count, sizeof(asset_source));
+  char (*cookedNames)[COOKED_TEXTURE_NAME_SIZE] = (char (*)[COOKED_TEXTURE_NAME_SIZE]) calloc(count, COOKED_TEXTURE_NAME_SIZE);
+  int result = 0;
+  for(uint32_t i = 0; !result && i < count; ++i) {
+    char *path = argv[arg + i];
+    char *equals = strchr(path, '=');
+    sources[i].name = AssetNameFromPath(path);
+    if(equals) {
+      *equals = 0;
+      sources[i].name = path;
+      path = equals + 1;
+    }
+    if(!ReadWholeFile(path, &sources[i].memory, &sources[i].size)) {
+      fprintf(stderr, "could not read %s\n", path);
+      result = 1;
+    }
+  }
+
+  uint32_t sourceCount = count;
+  for(uint32_t i = 0; !result && i < count; ++i) {
+    int width, height, channels;
+    if(sources[i].size > 0x7FFFFFFF ||
+       !stbi_info_from_memory((stbi_uc *) sources[i].memory, (int) sources[i].size, &width, &height, &channels)) {
+      continue;
+    }
+    uint64_t sourceHash = AssetContentHash(sources[i].memory, sources[i].size);
+    CookedTextureName(cookedNames[i], sourceHash);
+    bool cooked = false;
+    for(uint32_t s = count; s < sourceCount; ++s) {
+      cooked = cooked || strcmp(sources[s].name, cookedNames[i]) == 0;
+    }
+    if(cooked) {
+      continue;
+    }
+    stbi_uc *pixels = stbi_load_from_memory(
+      (stbi_uc *) sources[i].memory, (int) sources[i].size, &width, &height, &channels, 4
+    );
+    cooked_texture_header layout;
+    uint64_t cookedSize = pixels ? CookedTextureLayout(&layout, (uint32_t) width, (uint32_t) height) : 0;
+    void *memory = cookedSize ? calloc(1, cookedSize) : 0;
+    if(memory) {
+      CookTexture(memory, sourceHash, pixels, (uint32_t) width, (uint32_t) height, (uint32_t) width * 4);
+      asset_source *source = &sources[sourceCount++];
+      source->name = cookedNames[i];
+      source->memory = memory;
+      source->size = cookedSize;
+      source->store = true;
+      printf("  cooked %s, %dx%d with %u mips\n", sources[i].name, width, height, layout.mipCount);
+    } else {
+      fprintf(stderr, "could not cook %s\n", sources[i].name);
+      result = 1;
+    }
+    stbi_image_free(pixels);
+  }
+
+  void *pack = 0;
+  uint64_t packSize = 0;
+  if(!result && !BuildAssetPack(sources, sourceCount, compress, &pack, &packSize)) {
+    fprintf(stderr, "could not pack %s, are two assets named the same?\n", output);
+    result = 1;
+  }
+  if(!result) {
+    FILE *file = fopen(output, "wb");
+    bool written = file && fwrite(pack, 1, (size_t) packSize, file) == packSize;
+    if(file && fclose(file) != 0) {
+      written = false;
+    }
+    if(!written) {
+      fprintf(stderr, "could not write %s\n", output);
+      result = 1;
+    }
+  }
+  if(!result) {
+    asset_pack_header *header = (asset_pack_header *) pack;
+    asset_pack_entry *entries = (asset_pack_entry *) ((uint8_t *) pack + header->entriesOffset);
+    for(uint32_t i = 0; i < sourceCount; ++i) {
+      asset_pack_entry *entry = &entries[i];
+      // Every compressed blob has to come back exactly
+      bool identical = true;
+      if(entry->compression == AssetCompression_LZ4) {
+        void *check = malloc(entry->size);
+        identical = check && DecompressLZ4((uint8_t *) pack + entry->offset, entry->storedSize, check, entry->size) &&
+          memcmp(check, sources[i].memory, entry->size) == 0;
+        free(check);
+      }
+      printf("  %-24s %10llu bytes, %10llu stored at %10llu%s%s\n", sources[i].name,
+        (unsigned long long) entry->size, (unsigned long long) entry->storedSize,
+        (unsigned long long) entry->offset, entry->compression == AssetCompression_LZ4 ? ", lz4" : "",
+        identical ? "" : "  MISMATCH");
+      if(!identical) {
+        result = 1;
+      }
+    }
+    printf("%s: %u assets, %llu bytes\n", output, sourceCount, (unsigned long long) packSize);
+    if(result) {
+      remove(output);
+    }
+  }
+
+  for(uint32_t i = 0; i < sourceCount; ++i) {
+    free(sources[i].memory);
+  }
+  free(cookedNames);
+  free(sources);
+  free(pack);
+  return result;
+}
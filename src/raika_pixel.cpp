@@ -0,0 +1,502 @@
+#include "raika_intrinsics.h"
+
+// Pixel formats
+// The game works in 32 bit 0xAARRGGBB words, which is B8G8R8A8 in memory on
+// little endian. That is already what Wayland's XRGB8888, 32bpp DIBs and the
+// preferred Vulkan swapchain format want, so presenting needs no conversion.
+// Everything else goes through the row kernels here: image loading, texture
+// upload and anything written back out.
+//
+// Kernels take (dest, source, count) in pixels and must match the scalar
+// version bit for bit. SIMD kernels finish their tail with the scalar one.
+
+typedef void pixel_row_kernel(void *dest, void *source, int count);
+
+enum pixel_conversion {
+  // 0xAARRGGBB <-> 0xAABBGGRR, B8G8R8A8 <-> R8G8B8A8 in memory
+  PixelConversion_SwizzleRB,
+  // R8G8B8 bytes to 0xFFRRGGBB
+  PixelConversion_ExpandRGB,
+  // 0xAARRGGBB to 16 bit 565, alpha dropped and low bits truncated
+  PixelConversion_PackRGB565,
+  // 16 bit 565 to 0xFFRRGGBB, the high bits are copied into the low ones
+  PixelConversion_UnpackRGB565,
+  // sRGB 0xAARRGGBB to four linear floats r, g, b, a
+  PixelConversion_SrgbToLinear,
+  // Four linear floats r, g, b, a to sRGB 0xAARRGGBB
+  PixelConversion_LinearToSrgb,
+
+  PixelConversion_Count
+};
+
+static const char * const PIXEL_CONVERSION_NAMES[PixelConversion_Count] = {
+  "swizzle", "rgb->rgba", "pack565", "unpack565", "srgb->lin", "lin->srgb",
+};
+
+// sRGB tables
+// Decoding is one float per byte value. Encoding quantizes linear to 12 bits,
+// enough that every byte survives the round trip. The 3 bytes of padding let
+// the AVX2 kernel gather 32 bits from any entry and mask off the rest.
+#define LINEAR_TO_SRGB_BITS 12
+#define LINEAR_TO_SRGB_SIZE (1 << LINEAR_TO_SRGB_BITS)
+
+static bool globalSrgbTablesReady;
+static float globalSrgbToLinear[256];
+static uint8_t globalLinearToSrgb[LINEAR_TO_SRGB_SIZE + 3];
+
+static void InitSrgbTables() {
+  if(globalSrgbTablesReady) {
+    return;
+  }
+  for(int i = 0; i < 256; ++i) {
+    float c = i / 255.0f;
+    globalSrgbToLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+  }
+  for(int i = 0; i < LINEAR_TO_SRGB_SIZE; ++i) {
+    float l = i / (float) (LINEAR_TO_SRGB_SIZE - 1);
+    float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+    globalLinearToSrgb[i] = (uint8_t) (c * 255.0f + 0.5f);
+  }
+  globalSrgbTablesReady = true;
+}
+
+inline uint32_t LinearToSrgbIndex(float value) {
+  value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+  return (uint32_t) (value * (float) (LINEAR_TO_SRGB_SIZE - 1) + 0.5f);
+}
+
+// Scalar
+static void SwizzleRBRowScalar(void *dest, void *source, int count) {
+  uint32_t *d = (uint32_t *) dest;
+  uint32_t *s = (uint32_t *) source;
+  for(int x = 0; x < count; ++x) {
+    uint32_t c = s[x];
+    d[x] = (c & 0xFF00FF00) | ((c >> 16) & 0xFF) | ((c & 0xFF) << 16);
+  }
+}
+
+static void ExpandRGBRowScalar(void *dest, void *source, int count) {
+  uint32_t *d = (uint32_t *) dest;
+  uint8_t *s = (uint8_t *) source;
+  for(int x = 0; x < count; ++x) {
+    d[x] = 0xFF000000 | (s[0] << 16) | (s[1] << 8) | s[2];
+    s += 3;
+  }
+}
+
+static void PackRGB565RowScalar(void *dest, void *source, int count) {
+  uint16_t *d = (uint16_t *) dest;
+  uint32_t *s = (uint32_t *) source;
+  for(int x = 0; x < count; ++x) {
+    uint32_t c = s[x];
+    d[x] = (uint16_t) (((c >> 8) & 0xF800) | ((c >> 5) & 0x07E0) | ((c >> 3) & 0x001F));
+  }
+}
+
+static void UnpackRGB565RowScalar(void *dest, void *source, int count) {
+  uint32_t *d = (uint32_t *) dest;
+  uint16_t *s = (uint16_t *) source;
+  for(int x = 0; x < count; ++x) {
+    uint32_t p = s[x];
+    uint32_t r = (p >> 11) & 0x1F;
+    uint32_t g = (p >> 5) & 0x3F;
+    uint32_t b = p & 0x1F;
+    r = (r << 3) | (r >> 2);
+    g = (g << 2) | (g >> 4);
+    b = (b << 3) | (b >> 2);
+    d[x] = 0xFF000000 | (r << 16) | (g << 8) | b;
+  }
+}
+
+static void SrgbToLinearRowScalar(void *dest, void *source, int count) {
+  float *d = (float *) dest;
+  uint32_t *s = (uint32_t *) source;
+  for(int x = 0; x < count; ++x) {
+    uint32_t c = s[x];
+    d[0] = globalSrgbToLinear[(c >> 16) & 0xFF];
+    d[1] = globalSrgbToLinear[(c >> 8) & 0xFF];
+    d[2] = globalSrgbToLinear[c & 0xFF];
+    d[3] = (float) (c >> 24) * (1.0f / 255.0f);
+    d += 4;
+  }
+}
+
+static void LinearToSrgbRowScalar(void *dest, void *source, int count) {
+  uint32_t *d = (uint32_t *) dest;
+  float *s = (float *) source;
+  for(int x = 0; x < count; ++x) {
+    uint32_t r = globalLinearToSrgb[LinearToSrgbIndex(s[0])];
+    uint32_t g = globalLinearToSrgb[LinearToSrgbIndex(s[1])];
+    uint32_t b = globalLinearToSrgb[LinearToSrgbIndex(s[2])];
+    float alpha = s[3] < 0.0f ? 0.0f : (s[3] > 1.0f ? 1.0f : s[3]);
+    uint32_t a = (uint32_t) (alpha * 255.0f + 0.5f);
+    d[x] = (a << 24) | (r << 16) | (g << 8) | b;
+    s += 4;
+  }
+}
+
+// SSE2
+static void SwizzleRBRowSSE2(void *dest, void *source, int count) {
+  uint32_t *d = (uint32_t *) dest;
+  uint32_t *s = (uint32_t *) source;
+  __m128i keep = _mm_set1_epi32(0xFF00FF00);
+  __m128i low = _mm_set1_epi32(0xFF);
+  int x = 0;
+  for(; x + 4 <= count; x += 4) {
+    __m128i c = _mm_loadu_si128((__m128i *) (s + x));
+    __m128i r = _mm_and_si128(_mm_srli_epi32(c, 16), low);
+    __m128i b = _mm_slli_epi32(_mm_and_si128(c, low), 16);
+    _mm_storeu_si128((__m128i *) (d + x), _mm_or_si128(_mm_and_si128(c, keep), _mm_or_si128(r, b)));
+  }
+  SwizzleRBRowScalar(d + x, s + x, count - x);
+}
+
+// 32 bit lanes holding 16 bit values, narrowed without the signed saturation
+inline __m128i Pack565Lanes(__m128i c) {
+  __m128i r = _mm_and_si128(_mm_srli_epi32(c, 8), _mm_set1_epi32(0xF800));
+  __m128i g = _mm_and_si128(_mm_srli_epi32(c, 5), _mm_set1_epi32(0x07E0));
+  __m128i b = _mm_and_si128(_mm_srli_epi32(c, 3), _mm_set1_epi32(0x001F));
+  __m128i p = _mm_or_si128(r, _mm_or_si128(g, b));
+  return _mm_srai_epi32(_mm_slli_epi32(p, 16), 16);
+}
+
+static void PackRGB565RowSSE2(void *dest, void *source, int count) {
+  uint16_t *d = (uint16_t *) dest;
+  uint32_t *s = (uint32_t *) source;
+  int x = 0;
+  for(; x + 8 <= count; x += 8) {
+    __m128i lo = Pack565Lanes(_mm_loadu_si128((__m128i *) (s + x)));
+    __m128i hi = Pack565Lanes(_mm_loadu_si128((__m128i *) (s + x + 4)));
+    _mm_storeu_si128((__m128i *) (d + x), _mm_packs_epi32(lo, hi));
+  }
+  PackRGB565RowScalar(d + x, s + x, count - x);
+}
+
+inline __m128i Unpack565Lanes(__m128i p) {
+  __m128i r = _mm_and_si128(_mm_srli_epi32(p, 11), _mm_set1_epi32(0x1F));
+  __m128i g = _mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x3F));
+  __m128i b = _mm_and_si128(p, _mm_set1_epi32(0x1F));
+  r = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+  g = _mm_or_si128(_mm_slli_epi32(g, 2), _mm_srli_epi32(g, 4));
+  b = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+  __m128i rgb = _mm_or_si128(_mm_slli_epi32(r, 16), _mm_or_si128(_mm_slli_epi32(g, 8), b));
+  return _mm_or_si128(rgb, _mm_set1_epi32(0xFF000000));
+}
+
+static void UnpackRGB565RowSSE2(void *dest, void *source, int count) {
+  uint32_t *d = (uint32_t *) dest;
+  uint16_t *s = (uint16_t *) source;
+  __m128i zero = _mm_setzero_si128();
+  int x = 0;
+  for(; x + 8 <= count; x += 8) {
+    __m128i p = _mm_loadu_si128((__m128i *) (s + x));
+    _mm_storeu_si128((__m128i *) (d + x), Unpack565Lanes(_mm_unpacklo_epi16(p, zero)));
+    _mm_storeu_si128((__m128i *) (d + x + 4), Unpack565Lanes(_mm_unpackhi_epi16(p, zero)));
+  }
+  UnpackRGB565RowScalar(d + x, s + x, count - x);
+}
+
+// SSE4.1, for the byte shuffles from SSSE3
+RAIKA_TARGET_SSE41
+static void SwizzleRBRowSSE41(void *dest, void *source, int count) {
+  uint32_t *d = (uint32_t *) dest;
+  uint32_t *s = (uint32_t *) source;
+  __m128i order = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+  int x = 0;
+  for(; x + 4 <= count; x += 4) {
+    __m128i c = _mm_loadu_si128((__m128i *) (s + x));
+    _mm_storeu_si128((__m128i *) (d + x), _mm_shuffle_epi8(c, order));
+  }
+  SwizzleRBRowScalar(d + x, s + x, count - x);
+}
+
+// Four pixels from the low 12 bytes, the load reads 4 past them so the loop
+// stops while 6 pixels are left
+RAIKA_TARGET_SSE41
+static void ExpandRGBRowSSE41(void *dest, void *source, int count) {
+  uint32_t *d = (uint32_t *) dest;
+  uint8_t *s = (uint8_t *) source;
+  __m128i order = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+  __m128i alpha = _mm_set1_epi32(0xFF000000);
+  int x = 0;
+  for(; x + 6 <= count; x += 4) {
+    __m128i c = _mm_loadu_si128((__m128i *) (s + x * 3));
+    _mm_storeu_si128((__m128i *) (d + x), _mm_or_si128(_mm_shuffle_epi8(c, order), alpha));
+  }
+  ExpandRGBRowScalar(d + x, s + x * 3, count - x);
+}
+
+// AVX2
+RAIKA_TARGET_AVX2
+static void SwizzleRBRowAVX2(void *dest, void *source, int count) {
+  uint32_t *d = (uint32_t *) dest;
+  uint32_t *s = (uint32_t *) source;
+  __m256i order = _mm256_setr_epi8(
+    2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+    2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+  );
+  int x = 0;
+  for(; x + 8 <= count; x += 8) {
+    __m256i c = _mm256_loadu_si256((__m256i *) (s + x));
+    _mm256_storeu_si256((__m256i *) (d + x), _mm256_shuffle_epi8(c, order));
+  }
+  _mm256_zeroupper();
+  SwizzleRBRowScalar(d + x, s + x, count - x);
+}
+
+// Each 128 bit lane expands four pixels, the high lane loads 12 bytes in
+RAIKA_TARGET_AVX2
+static void ExpandRGBRowAVX2(void *dest, void *source, int count) {
+  uint32_t *d = (uint32_t *) dest;
+  uint8_t *s = (uint8_t *) source;
+  __m256i order = _mm256_setr_epi8(
+    2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+    2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1
+  );
+  __m256i alpha = _mm256_set1_epi32(0xFF000000);
+  int x = 0;
+  for(; x + 10 <= count; x += 8) {
+    __m256i c = _mm256_inserti128_si256(
+      _mm256_castsi128_si256(_mm_loadu_si128((__m128i *) (s + x * 3))),
+      _mm_loadu_si128((__m128i *) (s + x * 3 + 12)), 1
+    );
+    _mm256_storeu_si256((__m256i *) (d + x), _mm256_or_si256(_mm256_shuffle_epi8(c, order), alpha));
+  }
+  _mm256_zeroupper();
+  ExpandRGBRowScalar(d + x, s + x * 3, count - x);
+}
+
+RAIKA_TARGET_AVX2
+static void PackRGB565RowAVX2(void *dest, void *source, int count) {
+  uint16_t *d = (uint16_t *) dest;
+  uint32_t *s = (uint32_t *) source;
+  __m256i maskR = _mm256_set1_epi32(0xF800);
+  __m256i maskG = _mm256_set1_epi32(0x07E0);
+  __m256i maskB = _mm256_set1_epi32(0x001F);
+  int x = 0;
+  for(; x + 16 <= count; x += 16) {
+    __m256i packed[2];
+    for(int half = 0; half < 2; ++half) {
+      __m256i c = _mm256_loadu_si256((__m256i *) (s + x + half * 8));
+      __m256i p = _mm256_or_si256(
+        _mm256_and_si256(_mm256_srli_epi32(c, 8), maskR),
+        _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(c, 5), maskG), _mm256_and_si256(_mm256_srli_epi32(c, 3), maskB))
+      );
+      packed[half] = _mm256_srai_epi32(_mm256_slli_epi32(p, 16), 16);
+    }
+    // Packing works per lane, put the quarters back in order
+    __m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi32(packed[0], packed[1]), 0xD8);
+    _mm256_storeu_si256((__m256i *) (d + x), p);
+  }
+  _mm256_zeroupper();
+  PackRGB565RowScalar(d + x, s + x, count - x);
+}
+
+RAIKA_TARGET_AVX2
+static void UnpackRGB565RowAVX2(void *dest, void *source, int count) {
+  uint32_t *d = (uint32_t *) dest;
+  uint16_t *s = (uint16_t *) source;
+  __m256i mask5 = _mm256_set1_epi32(0x1F);
+  __m256i mask6 = _mm256_set1_epi32(0x3F);
+  __m256i alpha = _mm256_set1_epi32(0xFF000000);
+  int x = 0;
+  for(; x + 8 <= count; x += 8) {
+    __m256i p = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i *) (s + x)));
+    __m256i r = _mm256_and_si256(_mm256_srli_epi32(p, 11), mask5);
+    __m256i g = _mm256_and_si256(_mm256_srli_epi32(p, 5), mask6);
+    __m256i b = _mm256_and_si256(p, mask5);
+    r = _mm256_or_si256(_mm256_slli_epi32(r, 3), _mm256_srli_epi32(r, 2));
+    g = _mm256_or_si256(_mm256_slli_epi32(g, 2), _mm256_srli_epi32(g, 4));
+    b = _mm256_or_si256(_mm256_slli_epi32(b, 3), _mm256_srli_epi32(b, 2));
+    __m256i rgb = _mm256_or_si256(_mm256_slli_epi32(r, 16), _mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+    _mm256_storeu_si256((__m256i *) (d + x), _mm256_or_si256(rgb, alpha));
+  }
+  _mm256_zeroupper();
+  UnpackRGB565RowScalar(d + x, s + x, count - x);
+}
+
+// Gathers a channel per register, then transposes eight pixels of r, g, b, a
+// into four registers of two interleaved pixels each
+RAIKA_TARGET_AVX2
+static void SrgbToLinearRowAVX2(void *dest, void *source, int count) {
+  float *d = (float *) dest;
+  uint32_t *s = (uint32_t *) source;
+  __m256i mask = _mm256_set1_epi32(0xFF);
+  __m256 inverse255 = _mm256_set1_ps(1.0f / 255.0f);
+  int x = 0;
+  for(; x + 8 <= count; x += 8) {
+    __m256i c = _mm256_loadu_si256((__m256i *) (s + x));
+    __m256 r = _mm256_i32gather_ps(globalSrgbToLinear, _mm256_and_si256(_mm256_srli_epi32(c, 16), mask), 4);
+    __m256 g = _mm256_i32gather_ps(globalSrgbToLinear, _mm256_and_si256(_mm256_srli_epi32(c, 8), mask), 4);
+    __m256 b = _mm256_i32gather_ps(globalSrgbToLinear, _mm256_and_si256(c, mask), 4);
+    __m256 a = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(c, 24)), inverse255);
+
+    __m256 rgLo = _mm256_unpacklo_ps(r, g);
+    __m256 rgHi = _mm256_unpackhi_ps(r, g);
+    __m256 baLo = _mm256_unpacklo_ps(b, a);
+    __m256 baHi = _mm256_unpackhi_ps(b, a);
+    __m256 p0 = _mm256_shuffle_ps(rgLo, baLo, 0x44);
+    __m256 p1 = _mm256_shuffle_ps(rgLo, baLo, 0xEE);
+    __m256 p2 = _mm256_shuffle_ps(rgHi, baHi, 0x44);
+    __m256 p3 = _mm256_shuffle_ps(rgHi, baHi, 0xEE);
+    float *out = d + x * 4;
+    _mm256_storeu_ps(out, _mm256_permute2f128_ps(p0, p1, 0x20));
+    _mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(p2, p3, 0x20));
+    _mm256_storeu_ps(out + 16, _mm256_permute2f128_ps(p0, p1, 0x31));
+    _mm256_storeu_ps(out + 24, _mm256_permute2f128_ps(p2, p3, 0x31));
+  }
+  _mm256_zeroupper();
+  SrgbToLinearRowScalar(d + x * 4, s + x, count - x);
+}
+
+RAIKA_TARGET_AVX2
+static void LinearToSrgbRowAVX2(void *dest, void *source, int count) {
+  uint32_t *d = (uint32_t *) dest;
+  float *s = (float *) source;
+  __m256 zero = _mm256_setzero_ps();
+  __m256 one = _mm256_set1_ps(1.0f);
+  __m256 half = _mm256_set1_ps(0.5f);
+  __m256 scale = _mm256_set1_ps((float) (LINEAR_TO_SRGB_SIZE - 1));
+  __m256 scale255 = _mm256_set1_ps(255.0f);
+  __m256i mask = _mm256_set1_epi32(0xFF);
+  int x = 0;
+  for(; x + 8 <= count; x += 8) {
+    float *in = s + x * 4;
+    __m256 v0 = _mm256_loadu_ps(in);
+    __m256 v1 = _mm256_loadu_ps(in + 8);
+    __m256 v2 = _mm256_loadu_ps(in + 16);
+    __m256 v3 = _mm256_loadu_ps(in + 24);
+    __m256 t0 = _mm256_permute2f128_ps(v0, v2, 0x20);
+    __m256 t1 = _mm256_permute2f128_ps(v0, v2, 0x31);
+    __m256 t2 = _mm256_permute2f128_ps(v1, v3, 0x20);
+    __m256 t3 = _mm256_permute2f128_ps(v1, v3, 0x31);
+    __m256 rg01 = _mm256_unpacklo_ps(t0, t1);
+    __m256 ba01 = _mm256_unpackhi_ps(t0, t1);
+    __m256 rg23 = _mm256_unpacklo_ps(t2, t3);
+    __m256 ba23 = _mm256_unpackhi_ps(t2, t3);
+    __m256 channels[4] = {
+      _mm256_shuffle_ps(rg01, rg23, 0x44),
+      _mm256_shuffle_ps(rg01, rg23, 0xEE),
+      _mm256_shuffle_ps(ba01, ba23, 0x44),
+      _mm256_shuffle_ps(ba01, ba23, 0xEE),
+    };
+
+    __m256i encoded[3];
+    for(int i = 0; i < 3; ++i) {
+      __m256 v = _mm256_min_ps(_mm256_max_ps(channels[i], zero), one);
+      __m256i index = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, scale), half));
+      encoded[i] = _mm256_and_si256(_mm256_i32gather_epi32((int *) globalLinearToSrgb, index, 1), mask);
+    }
+    __m256 alpha = _mm256_min_ps(_mm256_max_ps(channels[3], zero), one);
+    __m256i a = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(alpha, scale255), half));
+
+    __m256i result = _mm256_or_si256(
+      _mm256_or_si256(_mm256_slli_epi32(a, 24), _mm256_slli_epi32(encoded[0], 16)),
+      _mm256_or_si256(_mm256_slli_epi32(encoded[1], 8), encoded[2])
+    );
+    _mm256_storeu_si256((__m256i *) (d + x), result);
+  }
+  _mm256_zeroupper();
+  LinearToSrgbRowScalar(d + x, s + x * 4, count - x);
+}
+
+// Dispatch
+struct pixel_kernel_info {
+  const char *name;
+  pixel_row_kernel *kernel;
+};
+
+// Ordered slowest to fastest. Levels without their own version of a
+// conversion return nothing for it and the previous level keeps it.
+static pixel_kernel_info GetPixelKernel(pixel_conversion conversion, int index) {
+  static pixel_row_kernel *kernels[][PixelConversion_Count] = {
+    {
+      SwizzleRBRowScalar, ExpandRGBRowScalar, PackRGB565RowScalar,
+      UnpackRGB565RowScalar, SrgbToLinearRowScalar, LinearToSrgbRowScalar,
+    },
+    {SwizzleRBRowSSE2, 0, PackRGB565RowSSE2, UnpackRGB565RowSSE2, 0, 0},
+    {SwizzleRBRowSSE41, ExpandRGBRowSSE41, 0, 0, 0, 0},
+    {
+      SwizzleRBRowAVX2, ExpandRGBRowAVX2, PackRGB565RowAVX2,
+      UnpackRGB565RowAVX2, SrgbToLinearRowAVX2, LinearToSrgbRowAVX2,
+    },
+  };
+  static const char *names[] = {"scalar", "sse2", "sse41", "avx2"};
+
+  cpu_features *cpu = GetCpuFeatures();
+  bool supported[] = {true, cpu->sse2, cpu->sse41, cpu->avx2};
+  pixel_kernel_info result = {};
+  if(supported[index] && kernels[index][conversion]) {
+    result.name = names[index];
+    result.kernel = kernels[index][conversion];
+  }
+  return result;
+}
+#define PIXEL_KERNEL_COUNT 4
+
+static pixel_row_kernel *globalPixelKernels[PixelConversion_Count];
+
+static pixel_row_kernel *PickPixelKernel(pixel_conversion conversion) {
+  if(!globalPixelKernels[conversion]) {
+    InitSrgbTables();
+    for(int i = 0; i < PIXEL_KERNEL_COUNT; ++i) {
+      pixel_kernel_info info = GetPixelKernel(conversion, i);
+      if(info.kernel) {
+        globalPixelKernels[conversion] = info.kernel;
+      }
+    }
+  }
+  return globalPixelKernels[conversion];
+}
+
+// Images
+static void CopyPixelRow(void *dest, void *source, int count) {
+  memcpy(dest, source, count * sizeof(uint32_t));
+}
+
+// Runs a row kernel down an image. With flip the rows land bottom to top,
+// which is how BMP files and bottom up DIBs are stored.
+static void ConvertImageWith(
+    pixel_row_kernel *kernel,
+    void *dest, int destPitch,
+    void *source, int sourcePitch,
+    int width, int height,
+    bool flip
+) {
+  uint8_t *destRow = (uint8_t *) dest;
+  if(flip && height > 0) {
+    destRow += (size_t) (height - 1) * destPitch;
+    destPitch = -destPitch;
+  }
+  uint8_t *sourceRow = (uint8_t *) source;
+  for(int y = 0; y < height; ++y) {
+    kernel(destRow, sourceRow, width);
+    destRow += destPitch;
+    sourceRow += sourcePitch;
+  }
+}
+
+static void ConvertImage(
+    pixel_conversion conversion,
+    void *dest, int destPitch,
+    void *source, int sourcePitch,
+    int width, int height,
+    bool flip
+) {
+  ConvertImageWith(PickPixelKernel(conversion), dest, destPitch, source, sourcePitch, width, height, flip);
+}
+
+// In place, a row pair at a time through a small buffer on the stack
+inline void FlipImage(void *memory, int pitch, int height) {
+  uint8_t chunk[1024];
+  uint8_t *top = (uint8_t *) memory;
+  uint8_t *bottom = top + (size_t) (height - 1) * pitch;
+  for(; top < bottom; top += pitch, bottom -= pitch) {
+    for(int offset = 0; offset < pitch; offset += (int) sizeof(chunk)) {
+      int size = pitch - offset < (int) sizeof(chunk) ? pitch - offset : (int) sizeof(chunk);
+      memcpy(chunk, top + offset, size);
+      memcpy(top + offset, bottom + offset, size);
+      memcpy(bottom + offset, chunk, size);
+    }
+  }
+}
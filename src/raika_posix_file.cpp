@@ -0,0 +1,163 @@
+// File IO for the POSIX platform layers. Include after raika.cpp.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool PlatformWriteFile(
+  char * filename,
+  file_data file
+) {
+  bool ret = false;
+
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd >= 0) {
+    uint64_t bytesWritten = 0;
+    while(bytesWritten < file.size) {
+      ssize_t chunk = write(fd, (uint8_t *) file.memory + bytesWritten, file.size - bytesWritten);
+      if(chunk <= 0) {
+        break;
+      }
+      bytesWritten += chunk;
+    }
+    ret = bytesWritten == file.size;
+    close(fd);
+  }
+
+  return ret;
+}
+
+// The copying read, for what cannot be mapped
+static file_data ReadFileIntoMemory(
+  int fd,
+  uint64_t size
+) {
+  file_data file = {};
+  file.memory = malloc(size ? size : 1);
+  uint64_t bytesRead = 0;
+  while(file.memory && bytesRead < size) {
+    ssize_t chunk = read(fd, (uint8_t *) file.memory + bytesRead, size - bytesRead);
+    if(chunk <= 0) {
+      break;
+    }
+    bytesRead += chunk;
+  }
+  if(file.memory && bytesRead == size) {
+    file.size = size;
+  } else {
+    free(file.memory);
+    file = {};
+  }
+  return file;
+}
+
+// Regular files come back mapped. Loaders read them front to back once, so
+// the kernel is told to read ahead hard and start on it straight away.
+static file_data PlatformReadFile(
+  char * filename
+) {
+  file_data file = {};
+
+  int fd = open(filename, O_RDONLY);
+  if(fd >= 0) {
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) == 0) {
+      uint64_t size = (uint64_t) fileStat.st_size;
+      if(S_ISREG(fileStat.st_mode) && size > 0) {
+        void *memory = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(memory != MAP_FAILED) {
+          madvise(memory, size, MADV_SEQUENTIAL);
+          madvise(memory, size, MADV_WILLNEED);
+          file.memory = memory;
+          file.size = size;
+          file.mapped = true;
+        }
+      }
+      if(!file.memory) {
+        file = ReadFileIntoMemory(fd, size);
+      }
+    }
+    // The mapping keeps the file open
+    close(fd);
+  }
+
+  return file;
+}
+
+static void PlatformFreeFile(
+  file_data file
+) {
+  if(file.memory) {
+    if(file.mapped) {
+      munmap(file.memory, file.size);
+    } else {
+      free(file.memory);
+    }
+  }
+}
+
+static mapped_file PlatformMapFile(
+  char * filename
+) {
+  mapped_file file = {};
+
+  int fd = open(filename, O_RDONLY);
+  if(fd >= 0) {
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) == 0 && fileStat.st_size > 0) {
+      void *memory = mmap(0, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(memory != MAP_FAILED) {
+        // Doubles the kernel's own read-ahead and lets it drop pages behind us
+        madvise(memory, fileStat.st_size, MADV_SEQUENTIAL);
+        file.memory = memory;
+        file.size = (uint64_t) fileStat.st_size;
+      }
+    }
+    // The mapping keeps the file open
+    close(fd);
+  }
+
+  return file;
+}
+
+// Rounds the range out to whole pages
+static void PlatformPrefetchFile(
+  mapped_file *file,
+  uint64_t offset,
+  uint64_t size
+) {
+  uint64_t pageSize = (uint64_t) sysconf(_SC_PAGESIZE);
+  if(file->memory && offset < file->size) {
+    uint64_t end = offset + size < file->size ? offset + size : file->size;
+    uint64_t start = offset & ~(pageSize - 1);
+    madvise((uint8_t *) file->memory + start, end - start, MADV_WILLNEED);
+  }
+}
+
+// Rounds the range in to whole pages so a page still partly needed stays
+static void PlatformEvictFile(
+  mapped_file *file,
+  uint64_t offset,
+  uint64_t size
+) {
+  uint64_t pageSize = (uint64_t) sysconf(_SC_PAGESIZE);
+  if(file->memory && offset < file->size) {
+    uint64_t end = offset + size < file->size ? offset + size : file->size;
+    uint64_t start = (offset + pageSize - 1) & ~(pageSize - 1);
+    // The last page of the file may be partial, it can go whole
+    end = end == file->size ? (end + pageSize - 1) & ~(pageSize - 1) : end & ~(pageSize - 1);
+    if(start < end) {
+      madvise((uint8_t *) file->memory + start, end - start, MADV_DONTNEED);
+    }
+  }
+}
+
+static void PlatformUnmapFile(
+  mapped_file *file
+) {
+  if(file->memory) {
+    munmap(file->memory, file->size);
+  }
+  *file = {};
+}
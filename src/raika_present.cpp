@@ -0,0 +1,183 @@
+// Presentation helpers shared by the platform layers. Include after raika.cpp.
+//
+// The game reports the rects it changed in graphics_buffer::dirtyRects.
+// Platforms present only those and keep count of the bytes that moved, so the
+// saving over full frame blits shows up next to the frame time.
+
+struct present_stats {
+  uint32_t frames;
+  uint64_t bytesPresented;
+  uint64_t bytesFull;
+};
+
+static uint64_t DirtyRectBytes(graphics_buffer *buffer) {
+  uint64_t bytes = 0;
+  for(int i = 0; i < buffer->dirtyRectCount; ++i) {
+    graphics_rect rect = buffer->dirtyRects[i];
+    bytes += (uint64_t) rect.width * rect.height * sizeof(uint32_t);
+  }
+  return bytes;
+}
+
+static void RecordPresent(present_stats *stats, graphics_buffer *buffer) {
+  ++stats->frames;
+  stats->bytesPresented += DirtyRectBytes(buffer);
+  stats->bytesFull += (uint64_t) buffer->width * buffer->height * sizeof(uint32_t);
+}
+
+inline void ResetPresentStats(present_stats *stats) {
+  *stats = {};
+}
+
+static void FormatPresentStats(present_stats *stats, char *out, int outSize) {
+  uint32_t frames = stats->frames ? stats->frames : 1;
+  double presented = (double) stats->bytesPresented / frames / 1024.0;
+  double full = (double) stats->bytesFull / frames / 1024.0;
+  snprintf(
+    out, outSize, "  presented %10.1fKB/frame of %10.1fKB (%5.1f%%)\n",
+    presented, full, full > 0 ? presented * 100.0 / full : 0.0
+  );
+}
+
+// Swap chains hand the game a buffer that is more than one frame old. Copying
+// what the last frame changed out of the newer buffer brings it up to date,
+// which is what the dirty rect contract asks of the platform.
+inline void CopyDirtyRects(
+    graphics_buffer *dest,
+    void *sourceMemory,
+    graphics_rect *rects,
+    int rectCount
+) {
+  for(int i = 0; i < rectCount; ++i) {
+    graphics_rect rect = rects[i];
+    size_t offset = (size_t) rect.y * dest->pitch + (size_t) rect.x * sizeof(uint32_t);
+    CopyImage(
+      (uint8_t *) dest->memory + offset, dest->pitch,
+      (uint8_t *) sourceMemory + offset, dest->pitch,
+      rect.width, rect.height
+    );
+  }
+}
+
+// Internal resolution
+// The game draws at output size times scale and ScaleImageTiled brings it up
+// to the output. With dynamic resolution on, the scale follows the measured
+// render time: it drops a step when the average goes over budget and climbs
+// back when there is plenty of headroom. Each change waits a while before the
+// next so the average can settle at the new size.
+//
+// The upscale is not free, and below some size it costs more than the
+// smaller draw saves. The time last measured at every step is kept, so the
+// scale does not drop to a step known to be no cheaper, and a drop that
+// turns out no cheaper goes back up.
+//
+// Environment overrides:
+//   RAIKA_RENDER_SCALE=0.75  fixed scale, turns dynamic resolution off
+//   RAIKA_UPSCALE=nearest    nearest instead of bilinear
+#define RESOLUTION_SETTLE_FRAMES 30
+#define RESOLUTION_MAX_STEPS 8
+
+struct dynamic_resolution {
+  bool dynamic;
+  scale_filter filter;
+  float scale;
+  float minScale;
+  float maxScale;
+  float step;
+  float budgetMs;
+  float averageMs;
+  int settleFrames;
+  // At each step up from minScale, zero until measured
+  float stepMs[RESOLUTION_MAX_STEPS];
+};
+
+inline int ResolutionStep(dynamic_resolution *resolution, float scale) {
+  int result = (int) ((scale - resolution->minScale) / resolution->step + 0.5f);
+  result = result > 0 ? result : 0;
+  return result < RESOLUTION_MAX_STEPS ? result : RESOLUTION_MAX_STEPS - 1;
+}
+
+inline dynamic_resolution MakeDynamicResolution(float budgetMs) {
+  dynamic_resolution result = {};
+  result.dynamic = true;
+  result.filter = ScaleFilter_Bilinear;
+  result.scale = 1.0f;
+  result.minScale = 0.5f;
+  result.maxScale = 1.0f;
+  result.step = 0.125f;
+  result.budgetMs = budgetMs;
+  Assert(ResolutionStep(&result, result.maxScale) < RESOLUTION_MAX_STEPS - 1);
+
+  char *scale = getenv("RAIKA_RENDER_SCALE");
+  if(scale) {
+    float fixed = (float) atof(scale);
+    if(fixed > 0.0f && fixed <= 1.0f) {
+      result.scale = fixed;
+      result.dynamic = false;
+    }
+  }
+  char *filter = getenv("RAIKA_UPSCALE");
+  if(filter && strcmp(filter, "nearest") == 0) {
+    result.filter = ScaleFilter_Nearest;
+  }
+  return result;
+}
+
+// renderMs should cover the game, the renderer and the upscale, not the wait
+// for the next frame
+inline void UpdateDynamicResolution(dynamic_resolution *resolution, float renderMs) {
+  resolution->averageMs = resolution->averageMs > 0.0f ?
+    resolution->averageMs * 0.9f + renderMs * 0.1f : renderMs;
+  if(!resolution->dynamic) {
+    return;
+  }
+  if(resolution->settleFrames > 0) {
+    --resolution->settleFrames;
+    return;
+  }
+
+  int step = ResolutionStep(resolution, resolution->scale);
+  float averageMs = resolution->averageMs;
+  resolution->stepMs[step] = averageMs;
+  float lowerMs = step > 0 ? resolution->stepMs[step - 1] : 0.0f;
+  float higherMs = resolution->stepMs[step + 1];
+  float scale = resolution->scale;
+  if(higherMs > 0.0f && higherMs <= averageMs) {
+    scale += resolution->step;
+  } else if(averageMs > resolution->budgetMs) {
+    if(lowerMs <= 0.0f || lowerMs < averageMs) {
+      scale -= resolution->step;
+    }
+  } else if(averageMs < resolution->budgetMs * 0.6f) {
+    scale += resolution->step;
+  }
+  scale = scale < resolution->minScale ? resolution->minScale : scale;
+  scale = scale > resolution->maxScale ? resolution->maxScale : scale;
+  if(scale != resolution->scale) {
+    resolution->scale = scale;
+    resolution->settleFrames = RESOLUTION_SETTLE_FRAMES;
+    resolution->averageMs = 0.0f;
+  }
+}
+
+// Full scale is the output size exactly, below that sizes are kept even
+inline void GetInternalResolution(dynamic_resolution *resolution, int outputWidth, int outputHeight, int *width, int *height) {
+  if(resolution->scale >= 1.0f) {
+    *width = outputWidth;
+    *height = outputHeight;
+    return;
+  }
+  int w = ((int) (outputWidth * resolution->scale + 0.5f)) & ~1;
+  int h = ((int) (outputHeight * resolution->scale + 0.5f)) & ~1;
+  w = w < SCALE_MAX_SOURCE_WIDTH ? w : SCALE_MAX_SOURCE_WIDTH;
+  *width = w > 2 ? w : 2;
+  *height = h > 2 ? h : 2;
+}
+
+inline void FormatDynamicResolution(dynamic_resolution *resolution, int width, int height, char *out, int outSize) {
+  snprintf(
+    out, outSize, "  render %dx%d (%.3f%s) %.2fms avg, %.2fms budget\n",
+    width, height, resolution->scale, resolution->dynamic ? " dynamic" : "",
+    resolution->averageMs, resolution->budgetMs
+  );
+}
@@ -0,0 +1,479 @@
+#include "raika_intrinsics.h"
+#include "raika_math.h"
+#include "raika_scene.h"
+
+// Software rasterizer
+// Triangles are set up once per frame on the game thread, then each render
+// tile walks the 8x8 blocks of every triangle that overlap it. Blocks are
+// classified with the half-space edge functions at their corners, and pixels
+// in partially covered blocks are tested four at a time with SSE2.
+//
+// Matches the Vulkan pipeline: clockwise front faces with back faces culled,
+// nearest sampling with repeat, depth 0..1. A LESS depth test is added so the
+// software path does not depend on draw order. Triangles that cross the near
+// plane are dropped rather than clipped, as are any past the scene's limit,
+// which are counted so a frame that loses geometry shows up.
+
+#define RASTER_MAX_TRIANGLES 1024
+#define RASTER_BLOCK_SIZE 8
+
+// value(x, y) = a0 + dadx * x + dady * y in pixel coordinates
+struct raster_plane {
+  float a0;
+  float dadx;
+  float dady;
+};
+
+struct raster_triangle {
+  int minX;
+  int minY;
+  int maxX;
+  int maxY;
+
+  // E(x, y) = a * x + b * y + c, positive inside. Kept in double so block
+  // origins stay exact at 4K, stepping inside a block is done in float.
+  double edgeA[3];
+  double edgeB[3];
+  double edgeC[3];
+  // Top-left rule: pixels exactly on an edge belong to one triangle only
+  bool edgeInclusive[3];
+
+  raster_plane z;
+  raster_plane invW;
+  raster_plane uOverW;
+  raster_plane vOverW;
+  raster_plane rOverW;
+  raster_plane gOverW;
+  raster_plane bOverW;
+
+  // Vertex colours are used without one
+  loaded_bitmap *texture;
+};
+
+struct raster_scene {
+  int triangleCount;
+  raster_triangle triangles[RASTER_MAX_TRIANGLES];
+  // Visible triangles that did not fit
+  int droppedTriangleCount;
+
+  float *depth;
+  int depthPitch;
+  int depthWidth;
+  int depthHeight;
+};
+
+struct raster_vertex {
+  v4 clip;
+  v2 uv;
+  v3 color;
+};
+
+static raster_plane MakePlane(
+  float x0, float y0, float a0,
+  float x1, float y1, float a1,
+  float x2, float y2, float a2,
+  float invArea2
+) {
+  raster_plane result;
+  result.dadx = ((a1 - a0) * (y2 - y0) - (a2 - a0) * (y1 - y0)) * invArea2;
+  result.dady = ((a2 - a0) * (x1 - x0) - (a1 - a0) * (x2 - x0)) * invArea2;
+  result.a0 = a0 - result.dadx * x0 - result.dady * y0;
+  return result;
+}
+
+static void EnsureDepthBuffer(raster_scene *scene, int width, int height) {
+  if(scene->depthWidth != width || scene->depthHeight != height) {
+    free(scene->depth);
+    // Rows are padded to whole blocks so SIMD loads never leave a row
+    scene->depthPitch = ((width + RASTER_BLOCK_SIZE - 1) & ~(RASTER_BLOCK_SIZE - 1)) + 16;
+    scene->depth = (float *) malloc(sizeof(float) * scene->depthPitch * height);
+    scene->depthWidth = width;
+    scene->depthHeight = height;
+  }
+}
+
+static void PushRasterTriangle(
+  raster_scene *scene,
+  raster_vertex *v,
+  loaded_bitmap *texture,
+  int width, int height
+) {
+  // No near plane clipping yet
+  if(v[0].clip.w <= 1e-5f || v[1].clip.w <= 1e-5f || v[2].clip.w <= 1e-5f) {
+    return;
+  }
+
+  float x[3], y[3], z[3], invW[3];
+  for(int i = 0; i < 3; ++i) {
+    invW[i] = 1.0f / v[i].clip.w;
+    x[i] = (v[i].clip.x * invW[i] * 0.5f + 0.5f) * width;
+    y[i] = (v[i].clip.y * invW[i] * 0.5f + 0.5f) * height;
+    z[i] = v[i].clip.z * invW[i];
+  }
+
+  // Positive area is clockwise on screen with Y down, the front face
+  float area2 = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+  if(area2 <= 0) {
+    return;
+  }
+
+  float minXf = fminf(x[0], fminf(x[1], x[2]));
+  float maxXf = fmaxf(x[0], fmaxf(x[1], x[2]));
+  float minYf = fminf(y[0], fminf(y[1], y[2]));
+  float maxYf = fmaxf(y[0], fmaxf(y[1], y[2]));
+  if(maxXf < 0 || maxYf < 0 || minXf > width || minYf > height) {
+    return;
+  }
+
+  if(scene->triangleCount == RASTER_MAX_TRIANGLES) {
+    ++scene->droppedTriangleCount;
+    return;
+  }
+  raster_triangle *tri = scene->triangles + scene->triangleCount++;
+  tri->minX = minXf < 0 ? 0 : (int) minXf;
+  tri->minY = minYf < 0 ? 0 : (int) minYf;
+  tri->maxX = maxXf >= width ? width : (int) maxXf + 1;
+  tri->maxY = maxYf >= height ? height : (int) maxYf + 1;
+  tri->texture = texture;
+
+  for(int i = 0; i < 3; ++i) {
+    int j = (i + 1) % 3;
+    double dx = (double) x[j] - x[i];
+    double dy = (double) y[j] - y[i];
+    tri->edgeA[i] = -dy;
+    tri->edgeB[i] = dx;
+    tri->edgeC[i] = dy * x[i] - dx * y[i];
+    tri->edgeInclusive[i] = (-dy > 0) || (dy == 0 && dx > 0);
+  }
+
+  float invArea2 = 1.0f / area2;
+#define RASTER_PLANE(a0, a1, a2) MakePlane(x[0], y[0], a0, x[1], y[1], a1, x[2], y[2], a2, invArea2)
+  tri->z = RASTER_PLANE(z[0], z[1], z[2]);
+  tri->invW = RASTER_PLANE(invW[0], invW[1], invW[2]);
+  tri->uOverW = RASTER_PLANE(v[0].uv.x * invW[0], v[1].uv.x * invW[1], v[2].uv.x * invW[2]);
+  tri->vOverW = RASTER_PLANE(v[0].uv.y * invW[0], v[1].uv.y * invW[1], v[2].uv.y * invW[2]);
+  tri->rOverW = RASTER_PLANE(v[0].color.x * invW[0], v[1].color.x * invW[1], v[2].color.x * invW[2]);
+  tri->gOverW = RASTER_PLANE(v[0].color.y * invW[0], v[1].color.y * invW[1], v[2].color.y * invW[2]);
+  tri->bOverW = RASTER_PLANE(v[0].color.z * invW[0], v[1].color.z * invW[1], v[2].color.z * invW[2]);
+#undef RASTER_PLANE
+}
+
+static void BeginRasterScene(raster_scene *scene, int width, int height) {
+  EnsureDepthBuffer(scene, width, height);
+  scene->triangleCount = 0;
+  scene->droppedTriangleCount = 0;
+}
+
+// Transforms and sets up an indexed triangle list, transform takes model
+// space to clip space
+static void PushRasterMesh(
+  raster_scene *scene,
+  m4x4 transform,
+  const render_vertex *vertices,
+  const uint32_t *indices,
+  int indexCount,
+  loaded_bitmap *texture
+) {
+  if(texture && !texture->memory) {
+    texture = 0;
+  }
+  for(int i = 0; i + 2 < indexCount; i += 3) {
+    raster_vertex v[3];
+    for(int k = 0; k < 3; ++k) {
+      const render_vertex *source = vertices + indices[i + k];
+      v[k].clip = transform * V4(source->pos, 1.0f);
+      v[k].uv = source->texPos;
+      v[k].color = source->color;
+    }
+    PushRasterTriangle(scene, v, texture, scene->depthWidth, scene->depthHeight);
+  }
+}
+
+inline void BuildRasterScene(
+  raster_scene *scene,
+  graphics_buffer *buffer,
+  scene_view *view,
+  const render_vertex *vertices,
+  const uint32_t *indices,
+  int indexCount,
+  loaded_bitmap *texture
+) {
+  BeginRasterScene(scene, buffer->width, buffer->height);
+  PushRasterMesh(scene, view->proj * view->view * view->model, vertices, indices, indexCount, texture);
+}
+
+// Screen bounds of a mesh without culling, for working out what it dirties.
+// Anything behind the eye makes the answer the whole screen.
+static graphics_rect ProjectedMeshBounds(
+  m4x4 transform,
+  const render_vertex *vertices,
+  int vertexCount,
+  int width, int height
+) {
+  graphics_rect all = {0, 0, width, height};
+  float minX = (float) width, minY = (float) height, maxX = 0, maxY = 0;
+  for(int i = 0; i < vertexCount; ++i) {
+    v4 clip = transform * V4(vertices[i].pos, 1.0f);
+    if(clip.w <= 1e-5f) {
+      return all;
+    }
+    float x = (clip.x / clip.w * 0.5f + 0.5f) * width;
+    float y = (clip.y / clip.w * 0.5f + 0.5f) * height;
+    minX = fminf(minX, x);
+    minY = fminf(minY, y);
+    maxX = fmaxf(maxX, x);
+    maxY = fmaxf(maxY, y);
+  }
+  graphics_rect result = {};
+  if(minX < maxX && minY < maxY) {
+    result.x = (int) floorf(minX);
+    result.y = (int) floorf(minY);
+    result.width = (int) floorf(maxX) + 1 - result.x;
+    result.height = (int) floorf(maxY) + 1 - result.y;
+  }
+  return result;
+}
+
+static void ClearDepthRect(raster_scene *scene, int minX, int minY, int maxX, int maxY) {
+  for(int y = minY; y < maxY; ++y) {
+    float *depth = scene->depth + y * scene->depthPitch;
+    for(int x = minX; x < maxX; ++x) {
+      depth[x] = 1.0f;
+    }
+  }
+}
+
+inline __m128 PlaneAt4(raster_plane p, __m128 x, __m128 y) {
+  return _mm_add_ps(
+    _mm_add_ps(_mm_set1_ps(p.a0), _mm_mul_ps(_mm_set1_ps(p.dadx), x)),
+    _mm_mul_ps(_mm_set1_ps(p.dady), y)
+  );
+}
+
+// floor() for the texel coordinates, SSE2 has no round instruction
+inline __m128i Floor4(__m128 value) {
+  __m128i truncated = _mm_cvttps_epi32(value);
+  __m128 back = _mm_cvtepi32_ps(truncated);
+  __m128i adjust = _mm_castps_si128(_mm_cmpgt_ps(back, value));
+  return _mm_add_epi32(truncated, adjust);
+}
+
+inline uint32_t PackColor(float r, float g, float b) {
+  int ir = (int) (r * 255.0f + 0.5f);
+  int ig = (int) (g * 255.0f + 0.5f);
+  int ib = (int) (b * 255.0f + 0.5f);
+  ir = ir < 0 ? 0 : (ir > 255 ? 255 : ir);
+  ig = ig < 0 ? 0 : (ig > 255 ? 255 : ig);
+  ib = ib < 0 ? 0 : (ib > 255 ? 255 : ib);
+  return 0xFF000000 | (ir << 16) | (ig << 8) | ib;
+}
+
+// Shades four pixels starting at (x, y) where mask says the triangle covers
+// them. Lanes past maxX are never written so neighbouring tiles stay untouched.
+static void ShadeQuad(
+  raster_scene *scene,
+  raster_triangle *tri,
+  graphics_buffer *buffer,
+  int x, int y, int maxX,
+  __m128 coverage
+) {
+  __m128 px = _mm_add_ps(_mm_set1_ps((float) x + 0.5f), _mm_setr_ps(0, 1, 2, 3));
+  __m128 py = _mm_set1_ps((float) y + 0.5f);
+
+  float *depthRow = scene->depth + y * scene->depthPitch + x;
+  __m128 z = PlaneAt4(tri->z, px, py);
+  __m128 oldDepth = _mm_loadu_ps(depthRow);
+  __m128 mask = _mm_and_ps(coverage, _mm_cmplt_ps(z, oldDepth));
+  int laneMask = _mm_movemask_ps(mask);
+  if(x + 4 > maxX) {
+    laneMask &= (1 << (maxX - x)) - 1;
+  }
+  if(!laneMask) {
+    return;
+  }
+
+  __m128 w = _mm_div_ps(_mm_set1_ps(1.0f), PlaneAt4(tri->invW, px, py));
+  uint32_t colors[4];
+  if(tri->texture) {
+    loaded_bitmap *texture = tri->texture;
+    __m128 u = _mm_mul_ps(PlaneAt4(tri->uOverW, px, py), w);
+    __m128 v = _mm_mul_ps(PlaneAt4(tri->vOverW, px, py), w);
+    int texelX[4], texelY[4];
+    _mm_storeu_si128((__m128i *) texelX, Floor4(_mm_mul_ps(u, _mm_set1_ps((float) texture->width))));
+    _mm_storeu_si128((__m128i *) texelY, Floor4(_mm_mul_ps(v, _mm_set1_ps((float) texture->height))));
+    bool powerOfTwo = !(texture->width & (texture->width - 1)) && !(texture->height & (texture->height - 1));
+    for(int lane = 0; lane < 4; ++lane) {
+      int tx, ty;
+      if(powerOfTwo) {
+        tx = texelX[lane] & (texture->width - 1);
+        ty = texelY[lane] & (texture->height - 1);
+      } else {
+        tx = texelX[lane] % texture->width;
+        ty = texelY[lane] % texture->height;
+        tx += tx < 0 ? texture->width : 0;
+        ty += ty < 0 ? texture->height : 0;
+      }
+      colors[lane] = *(uint32_t *) ((uint8_t *) texture->memory + ty * texture->pitch + tx * 4);
+    }
+  } else {
+    float r[4], g[4], b[4];
+    _mm_storeu_ps(r, _mm_mul_ps(PlaneAt4(tri->rOverW, px, py), w));
+    _mm_storeu_ps(g, _mm_mul_ps(PlaneAt4(tri->gOverW, px, py), w));
+    _mm_storeu_ps(b, _mm_mul_ps(PlaneAt4(tri->bOverW, px, py), w));
+    for(int lane = 0; lane < 4; ++lane) {
+      colors[lane] = PackColor(r[lane], g[lane], b[lane]);
+    }
+  }
+
+  uint32_t *pixel = (uint32_t *) ((uint8_t *) buffer->memory + y * buffer->pitch) + x;
+  if(laneMask == 0xF) {
+    _mm_storeu_si128((__m128i *) pixel, _mm_loadu_si128((__m128i *) colors));
+    _mm_storeu_ps(depthRow, z);
+  } else {
+    float newDepth[4];
+    _mm_storeu_ps(newDepth, z);
+    for(int lane = 0; lane < 4; ++lane) {
+      if(laneMask & (1 << lane)) {
+        pixel[lane] = colors[lane];
+        depthRow[lane] = newDepth[lane];
+      }
+    }
+  }
+}
+
+// Draws the part of tri inside [minX, maxX) x [minY, maxY)
+static void RasterizeTriangle(
+  raster_scene *scene,
+  raster_triangle *tri,
+  graphics_buffer *buffer,
+  int minX, int minY,
+  int maxX, int maxY
+) {
+  int x0 = tri->minX > minX ? tri->minX : minX;
+  int y0 = tri->minY > minY ? tri->minY : minY;
+  int x1 = tri->maxX < maxX ? tri->maxX : maxX;
+  int y1 = tri->maxY < maxY ? tri->maxY : maxY;
+  if(x0 >= x1 || y0 >= y1) {
+    return;
+  }
+
+  __m128 laneOffset = _mm_setr_ps(0, 1, 2, 3);
+  float blockSpan = (float) (RASTER_BLOCK_SIZE - 1);
+
+  for(int blockY = y0 & ~(RASTER_BLOCK_SIZE - 1); blockY < y1; blockY += RASTER_BLOCK_SIZE) {
+    for(int blockX = x0 & ~(RASTER_BLOCK_SIZE - 1); blockX < x1; blockX += RASTER_BLOCK_SIZE) {
+      // Edge values at the block's first pixel centre, then the corner
+      // extremes to classify the whole block
+      float origin[3];
+      bool rejected = false;
+      bool covered = true;
+      for(int e = 0; e < 3; ++e) {
+        double value = tri->edgeA[e] * (blockX + 0.5) + tri->edgeB[e] * (blockY + 0.5) + tri->edgeC[e];
+        double a = tri->edgeA[e];
+        double b = tri->edgeB[e];
+        double maxValue = value + (a > 0 ? a : 0) * blockSpan + (b > 0 ? b : 0) * blockSpan;
+        double minValue = value + (a < 0 ? a : 0) * blockSpan + (b < 0 ? b : 0) * blockSpan;
+        if(maxValue < 0 || (maxValue == 0 && !tri->edgeInclusive[e])) {
+          rejected = true;
+        }
+        if(minValue <= 0) {
+          covered = false;
+        }
+        origin[e] = (float) value;
+      }
+      if(rejected) {
+        continue;
+      }
+
+      int rowStart = blockY > y0 ? blockY : y0;
+      int rowEnd = blockY + RASTER_BLOCK_SIZE < y1 ? blockY + RASTER_BLOCK_SIZE : y1;
+      int colEnd = blockX + RASTER_BLOCK_SIZE < maxX ? blockX + RASTER_BLOCK_SIZE : maxX;
+      int colStart = blockX > minX ? blockX : minX;
+      for(int y = rowStart; y < rowEnd; ++y) {
+        for(int x = blockX; x < colEnd; x += 4) {
+          if(x + 4 <= colStart) {
+            continue;
+          }
+          __m128 coverage;
+          if(covered) {
+            coverage = _mm_castsi128_ps(_mm_set1_epi32(-1));
+          } else {
+            __m128 dx = _mm_add_ps(_mm_set1_ps((float) (x - blockX)), laneOffset);
+            float dy = (float) (y - blockY);
+            coverage = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for(int e = 0; e < 3; ++e) {
+              __m128 value = _mm_add_ps(
+                _mm_set1_ps(origin[e] + (float) tri->edgeB[e] * dy),
+                _mm_mul_ps(_mm_set1_ps((float) tri->edgeA[e]), dx)
+              );
+              __m128 inside = tri->edgeInclusive[e] ?
+                _mm_cmpge_ps(value, _mm_setzero_ps()) :
+                _mm_cmpgt_ps(value, _mm_setzero_ps());
+              coverage = _mm_and_ps(coverage, inside);
+            }
+          }
+          // Lanes left of the tile belong to the neighbouring tile
+          if(x < colStart) {
+            int skip = colStart - x;
+            __m128 keep = _mm_cmpge_ps(_mm_setr_ps(0, 1, 2, 3), _mm_set1_ps((float) skip));
+            coverage = _mm_and_ps(coverage, keep);
+          }
+          ShadeQuad(scene, tri, buffer, x, y, colEnd, coverage);
+        }
+      }
+    }
+  }
+}
+
+// Union of the triangle bounding boxes, empty when nothing survived culling
+static graphics_rect RasterSceneBounds(raster_scene *scene) {
+  graphics_rect result = {};
+  if(scene->triangleCount == 0) {
+    return result;
+  }
+  int minX = scene->triangles[0].minX, minY = scene->triangles[0].minY;
+  int maxX = scene->triangles[0].maxX, maxY = scene->triangles[0].maxY;
+  for(int i = 1; i < scene->triangleCount; ++i) {
+    raster_triangle *tri = scene->triangles + i;
+    minX = tri->minX < minX ? tri->minX : minX;
+    minY = tri->minY < minY ? tri->minY : minY;
+    maxX = tri->maxX > maxX ? tri->maxX : maxX;
+    maxY = tri->maxY > maxY ? tri->maxY : maxY;
+  }
+  result.x = minX;
+  result.y = minY;
+  result.width = maxX - minX;
+  result.height = maxY - minY;
+  return result;
+}
+
+static void RasterizeScene(
+  raster_scene *scene,
+  graphics_buffer *buffer,
+  int minX, int minY,
+  int maxX, int maxY
+) {
+  // Depth only has to be valid under the triangles, clearing the whole tile
+  // doubles the memory traffic of a frame
+  graphics_rect bounds = RasterSceneBounds(scene);
+  int clearMinX = bounds.x;
+  int clearMinY = bounds.y;
+  int clearMaxX = bounds.x + bounds.width;
+  int clearMaxY = bounds.y + bounds.height;
+  clearMinX = clearMinX < minX ? minX : clearMinX;
+  clearMinY = clearMinY < minY ? minY : clearMinY;
+  clearMaxX = clearMaxX > maxX ? maxX : clearMaxX;
+  clearMaxY = clearMaxY > maxY ? maxY : clearMaxY;
+  if(clearMinX >= clearMaxX || clearMinY >= clearMaxY) {
+    return;
+  }
+
+  // Blocks round out to whole quads, so clear the quads they touch
+  clearMinX &= ~3;
+  clearMaxX = (clearMaxX + 3) & ~3;
+  clearMaxX = clearMaxX > scene->depthPitch ? scene->depthPitch : clearMaxX;
+  ClearDepthRect(scene, clearMinX, clearMinY, clearMaxX, clearMaxY);
+  for(int i = 0; i < scene->triangleCount; ++i) {
+    RasterizeTriangle(scene, scene->triangles + i, buffer, minX, minY, maxX, maxY);
+  }
+}
@@ -0,0 +1,252 @@
+#include "raika_intrinsics.h"
+
+// Gradient kernels
+// Every kernel fills one row span with (green << 8) | ((blue + i) & 0xFF) and
+// must match the scalar version bit for bit.
+typedef void gradient_row_kernel(uint32_t *pixel, int count, int blue, uint32_t green);
+
+static void GradientRowScalar(uint32_t *pixel, int count, int blue, uint32_t green) {
+  for(int x = 0; x < count; ++x) {
+    uint8_t b = blue + x;
+    *pixel++ = ((green & 0xFF) << 8) | (b);
+  }
+}
+
+static void GradientRowSSE2(uint32_t *pixel, int count, int blue, uint32_t green) {
+  __m128i mask = _mm_set1_epi32(0xFF);
+  __m128i greenWide = _mm_set1_epi32((green & 0xFF) << 8);
+  __m128i step = _mm_set1_epi32(4);
+  __m128i b = _mm_add_epi32(_mm_set1_epi32(blue), _mm_setr_epi32(0, 1, 2, 3));
+
+  int x = 0;
+  for(; x + 16 <= count; x += 16) {
+    __m128i b1 = _mm_add_epi32(b, step);
+    __m128i b2 = _mm_add_epi32(b1, step);
+    __m128i b3 = _mm_add_epi32(b2, step);
+    _mm_storeu_si128((__m128i *) (pixel + x), _mm_or_si128(_mm_and_si128(b, mask), greenWide));
+    _mm_storeu_si128((__m128i *) (pixel + x + 4), _mm_or_si128(_mm_and_si128(b1, mask), greenWide));
+    _mm_storeu_si128((__m128i *) (pixel + x + 8), _mm_or_si128(_mm_and_si128(b2, mask), greenWide));
+    _mm_storeu_si128((__m128i *) (pixel + x + 12), _mm_or_si128(_mm_and_si128(b3, mask), greenWide));
+    b = _mm_add_epi32(b3, step);
+  }
+  GradientRowScalar(pixel + x, count - x, blue + x, green);
+}
+
+RAIKA_TARGET_AVX2
+static void GradientRowAVX2(uint32_t *pixel, int count, int blue, uint32_t green) {
+  __m256i mask = _mm256_set1_epi32(0xFF);
+  __m256i greenWide = _mm256_set1_epi32((green & 0xFF) << 8);
+  __m256i step = _mm256_set1_epi32(8);
+  __m256i b = _mm256_add_epi32(_mm256_set1_epi32(blue), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+  int x = 0;
+  for(; x + 16 <= count; x += 16) {
+    __m256i b1 = _mm256_add_epi32(b, step);
+    _mm256_storeu_si256((__m256i *) (pixel + x), _mm256_or_si256(_mm256_and_si256(b, mask), greenWide));
+    _mm256_storeu_si256((__m256i *) (pixel + x + 8), _mm256_or_si256(_mm256_and_si256(b1, mask), greenWide));
+    b = _mm256_add_epi32(b1, step);
+  }
+  GradientRowScalar(pixel + x, count - x, blue + x, green);
+}
+
+// Streaming versions for passes that cover the whole frame, see raika_fill.cpp
+static void GradientRowStreamSSE2(uint32_t *pixel, int count, int blue, uint32_t green) {
+  int head = (int) ((16 - ((uintptr_t) pixel & 15)) & 15) / 4;
+  head = head < count ? head : count;
+  GradientRowScalar(pixel, head, blue, green);
+
+  __m128i mask = _mm_set1_epi32(0xFF);
+  __m128i greenWide = _mm_set1_epi32((green & 0xFF) << 8);
+  __m128i step = _mm_set1_epi32(4);
+  __m128i b = _mm_add_epi32(_mm_set1_epi32(blue + head), _mm_setr_epi32(0, 1, 2, 3));
+
+  int x = head;
+  for(; x + 16 <= count; x += 16) {
+    __m128i b1 = _mm_add_epi32(b, step);
+    __m128i b2 = _mm_add_epi32(b1, step);
+    __m128i b3 = _mm_add_epi32(b2, step);
+    _mm_stream_si128((__m128i *) (pixel + x), _mm_or_si128(_mm_and_si128(b, mask), greenWide));
+    _mm_stream_si128((__m128i *) (pixel + x + 4), _mm_or_si128(_mm_and_si128(b1, mask), greenWide));
+    _mm_stream_si128((__m128i *) (pixel + x + 8), _mm_or_si128(_mm_and_si128(b2, mask), greenWide));
+    _mm_stream_si128((__m128i *) (pixel + x + 12), _mm_or_si128(_mm_and_si128(b3, mask), greenWide));
+    b = _mm_add_epi32(b3, step);
+  }
+  GradientRowScalar(pixel + x, count - x, blue + x, green);
+}
+
+RAIKA_TARGET_AVX2
+static void GradientRowStreamAVX2(uint32_t *pixel, int count, int blue, uint32_t green) {
+  int head = (int) ((32 - ((uintptr_t) pixel & 31)) & 31) / 4;
+  head = head < count ? head : count;
+  GradientRowScalar(pixel, head, blue, green);
+
+  __m256i mask = _mm256_set1_epi32(0xFF);
+  __m256i greenWide = _mm256_set1_epi32((green & 0xFF) << 8);
+  __m256i step = _mm256_set1_epi32(8);
+  __m256i b = _mm256_add_epi32(_mm256_set1_epi32(blue + head), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+  int x = head;
+  for(; x + 16 <= count; x += 16) {
+    __m256i b1 = _mm256_add_epi32(b, step);
+    _mm256_stream_si256((__m256i *) (pixel + x), _mm256_or_si256(_mm256_and_si256(b, mask), greenWide));
+    _mm256_stream_si256((__m256i *) (pixel + x + 8), _mm256_or_si256(_mm256_and_si256(b1, mask), greenWide));
+    b = _mm256_add_epi32(b1, step);
+  }
+  _mm256_zeroupper();
+  GradientRowScalar(pixel + x, count - x, blue + x, green);
+}
+
+struct gradient_kernel_info {
+  const char *name;
+  gradient_row_kernel *kernel;
+  gradient_row_kernel *stream;
+};
+
+// Ordered slowest to fastest, the last supported one wins
+static gradient_kernel_info GetGradientKernel(int index) {
+  cpu_features *cpu = GetCpuFeatures();
+  gradient_kernel_info result = {};
+  switch(index) {
+    case 0: {
+      result.name = "scalar";
+      result.kernel = GradientRowScalar;
+      result.stream = GradientRowScalar;
+    } break;
+    case 1: {
+      if(cpu->sse2) {
+        result.name = "sse2";
+        result.kernel = GradientRowSSE2;
+        result.stream = GradientRowStreamSSE2;
+      }
+    } break;
+    case 2: {
+      if(cpu->avx2) {
+        result.name = "avx2";
+        result.kernel = GradientRowAVX2;
+        result.stream = GradientRowStreamAVX2;
+      }
+    } break;
+  }
+  return result;
+}
+#define GRADIENT_KERNEL_COUNT 3
+
+static gradient_kernel_info globalGradientKernel;
+
+static gradient_row_kernel *PickGradientKernel() {
+  if(!globalGradientKernel.kernel) {
+    for(int i = 0; i < GRADIENT_KERNEL_COUNT; ++i) {
+      gradient_kernel_info info = GetGradientKernel(i);
+      if(info.kernel) {
+        globalGradientKernel = info;
+      }
+    }
+  }
+  return globalGradientKernel.kernel;
+}
+
+static gradient_row_kernel *PickGradientStreamKernel() {
+  PickGradientKernel();
+  return globalGradientKernel.stream;
+}
+
+static void RenderGradientWith(
+    gradient_row_kernel *kernel,
+    graphics_buffer *buffer,
+    int xoffset,
+    int yoffset
+) {
+  uint8_t *row = (uint8_t *) buffer->memory;
+  for(int y = 0; y < buffer->height; ++y) {
+    uint8_t green = y + yoffset;
+    kernel((uint32_t *) row, buffer->width, xoffset, green);
+    row += buffer->pitch;
+  }
+}
+
+inline void RenderGradient(
+    graphics_buffer *buffer,
+    int xoffset,
+    int yoffset
+) {
+  if(ShouldStream(buffer->width, buffer->height)) {
+    RenderGradientWith(PickGradientStreamKernel(), buffer, xoffset, yoffset);
+    StreamFence();
+  } else {
+    RenderGradientWith(PickGradientKernel(), buffer, xoffset, yoffset);
+  }
+}
+
+static void RenderGradientRect(
+    gradient_row_kernel *kernel,
+    graphics_buffer *buffer,
+    int minX, int minY,
+    int maxX, int maxY,
+    int xoffset,
+    int yoffset
+) {
+  uint8_t *row = (uint8_t *) buffer->memory + minY * buffer->pitch + minX * 4;
+  for(int y = minY; y < maxY; ++y) {
+    uint8_t green = y + yoffset;
+    kernel((uint32_t *) row, maxX - minX, xoffset + minX, green);
+    row += buffer->pitch;
+  }
+}
+
+// Dirty rectangles
+// The game only redraws and reports what changed since the last frame.
+// Overlapping rects are merged so nothing is drawn or presented twice, and
+// when the list fills up everything collapses into one bounding rect.
+static bool RectIsEmpty(graphics_rect rect) {
+  return rect.width <= 0 || rect.height <= 0;
+}
+
+static graphics_rect IntersectRect(graphics_rect a, graphics_rect b) {
+  int minX = a.x > b.x ? a.x : b.x;
+  int minY = a.y > b.y ? a.y : b.y;
+  int maxX = a.x + a.width < b.x + b.width ? a.x + a.width : b.x + b.width;
+  int maxY = a.y + a.height < b.y + b.height ? a.y + a.height : b.y + b.height;
+  graphics_rect result = {minX, minY, maxX - minX, maxY - minY};
+  return result;
+}
+
+static graphics_rect UnionRect(graphics_rect a, graphics_rect b) {
+  int minX = a.x < b.x ? a.x : b.x;
+  int minY = a.y < b.y ? a.y : b.y;
+  int maxX = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+  int maxY = a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+  graphics_rect result = {minX, minY, maxX - minX, maxY - minY};
+  return result;
+}
+
+static void MarkDirty(graphics_buffer *buffer, graphics_rect rect) {
+  graphics_rect bounds = {0, 0, buffer->width, buffer->height};
+  rect = IntersectRect(rect, bounds);
+  if(RectIsEmpty(rect)) {
+    return;
+  }
+
+  for(int i = 0; i < buffer->dirtyRectCount;) {
+    if(!RectIsEmpty(IntersectRect(rect, buffer->dirtyRects[i]))) {
+      rect = UnionRect(rect, buffer->dirtyRects[i]);
+      buffer->dirtyRects[i] = buffer->dirtyRects[--buffer->dirtyRectCount];
+      i = 0;
+    } else {
+      ++i;
+    }
+  }
+
+  if(buffer->dirtyRectCount == GRAPHICS_MAX_DIRTY_RECTS) {
+    for(int i = 0; i < buffer->dirtyRectCount; ++i) {
+      rect = UnionRect(rect, buffer->dirtyRects[i]);
+    }
+    buffer->dirtyRectCount = 0;
+  }
+  buffer->dirtyRects[buffer->dirtyRectCount++] = rect;
+}
+
+static void MarkAllDirty(graphics_buffer *buffer) {
+  graphics_rect all = {0, 0, buffer->width, buffer->height};
+  buffer->dirtyRectCount = 0;
+  MarkDirty(buffer, all);
+}
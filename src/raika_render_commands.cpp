@@ -0,0 +1,186 @@
+// Render command push buffer
+// Sort keys, high bits first:
+//   63..56 layer, 55..48 command type, 47..32 material, 31..0 push order
+// Within a layer clears and cameras sort ahead of the draws they affect and
+// meshes group by texture. 2D draws push a zero material so they keep the
+// order they were pushed in, which is what blending overlapping sprites needs.
+
+static render_commands MakeRenderCommands(void *memory, uint32_t size) {
+  render_commands result = {};
+  result.pushBufferBase = (uint8_t *) memory;
+  result.maxPushBufferSize = size;
+  result.sortEntryAt = size;
+  return result;
+}
+
+static void ResetRenderCommands(render_commands *commands) {
+  commands->pushBufferSize = 0;
+  commands->sortEntryAt = commands->maxPushBufferSize;
+  commands->commandCount = 0;
+  commands->droppedCount = 0;
+}
+
+inline uint64_t RenderSortKey(uint32_t layer, uint32_t type, uint32_t material, uint32_t order) {
+  return ((uint64_t) (layer & 0xFF) << 56) | ((uint64_t) (type & 0xFF) << 48) |
+    ((uint64_t) (material & 0xFFFF) << 32) | order;
+}
+
+// Groups draws that share a resource, collisions only cost a state change
+inline uint32_t RenderMaterial(void *resource) {
+  uint64_t bits = (uint64_t) (uintptr_t) resource;
+  return (uint32_t) ((bits >> 4) ^ (bits >> 20)) & 0xFFFF;
+}
+
+// Returns zero when the buffer is full. Every command keeps room for two
+// sort entries, the second is scratch space for SortRenderCommands.
+static void *PushRenderCommand(
+    render_commands *commands,
+    uint32_t layer,
+    render_command_type type,
+    uint32_t material,
+    uint32_t size
+) {
+  uint32_t totalSize = (sizeof(render_command_header) + size + 7) & ~7;
+  uint64_t needed = (uint64_t) commands->pushBufferSize + totalSize +
+    2 * sizeof(render_sort_entry) * (commands->commandCount + 1);
+  if(needed > commands->maxPushBufferSize) {
+    ++commands->droppedCount;
+    return 0;
+  }
+
+  render_command_header *header = (render_command_header *) (commands->pushBufferBase + commands->pushBufferSize);
+  header->type = type;
+  header->size = totalSize;
+
+  commands->sortEntryAt -= sizeof(render_sort_entry);
+  render_sort_entry *entry = (render_sort_entry *) (commands->pushBufferBase + commands->sortEntryAt);
+  entry->sortKey = RenderSortKey(layer, type, material, commands->commandCount);
+  entry->offset = commands->pushBufferSize;
+
+  commands->pushBufferSize += totalSize;
+  ++commands->commandCount;
+  return header + 1;
+}
+
+inline void PushClear(render_commands *commands, uint32_t layer, uint32_t color) {
+  render_command_clear *command = (render_command_clear *) PushRenderCommand(
+    commands, layer, RenderCommand_Clear, 0, sizeof(render_command_clear)
+  );
+  if(command) {
+    command->color = color;
+  }
+}
+
+static void PushCamera(render_commands *commands, uint32_t layer, m4x4 view, m4x4 proj) {
+  render_command_camera *command = (render_command_camera *) PushRenderCommand(
+    commands, layer, RenderCommand_Camera, 0, sizeof(render_command_camera)
+  );
+  if(command) {
+    command->view = view;
+    command->proj = proj;
+  }
+}
+
+static void PushGradient(render_commands *commands, uint32_t layer, int xoffset, int yoffset) {
+  render_command_gradient *command = (render_command_gradient *) PushRenderCommand(
+    commands, layer, RenderCommand_Gradient, 0, sizeof(render_command_gradient)
+  );
+  if(command) {
+    command->xoffset = xoffset;
+    command->yoffset = yoffset;
+  }
+}
+
+static void PushMesh(render_commands *commands, uint32_t layer, render_mesh *mesh, m4x4 model) {
+  render_command_mesh *command = (render_command_mesh *) PushRenderCommand(
+    commands, layer, RenderCommand_Mesh, RenderMaterial(mesh->texture), sizeof(render_command_mesh)
+  );
+  if(command) {
+    command->mesh = mesh;
+    command->model = model;
+  }
+}
+
+inline void PushRect(render_commands *commands, uint32_t layer, graphics_rect rect, uint32_t color) {
+  render_command_rect *command = (render_command_rect *) PushRenderCommand(
+    commands, layer, RenderCommand_Rect, 0, sizeof(render_command_rect)
+  );
+  if(command) {
+    command->rect = rect;
+    command->color = color;
+  }
+}
+
+inline void PushSprite(
+    render_commands *commands,
+    uint32_t layer,
+    loaded_bitmap *bitmap,
+    int x, int y,
+    int scale
+) {
+  render_command_sprite *command = (render_command_sprite *) PushRenderCommand(
+    commands, layer, RenderCommand_Sprite, 0, sizeof(render_command_sprite)
+  );
+  if(command) {
+    command->bitmap = bitmap;
+    command->x = x;
+    command->y = y;
+    command->scale = scale;
+  }
+}
+
+inline render_sort_entry *GetSortEntries(render_commands *commands) {
+  return (render_sort_entry *) (commands->pushBufferBase + commands->sortEntryAt);
+}
+
+inline render_command_header *GetRenderCommand(render_commands *commands, render_sort_entry *entry) {
+  return (render_command_header *) (commands->pushBufferBase + entry->offset);
+}
+
+// Stable LSD radix sort, one byte per pass. Bytes that are the same in every
+// key are skipped, which leaves about three passes for a typical frame.
+static void SortRenderCommands(render_commands *commands) {
+  uint32_t count = commands->commandCount;
+  render_sort_entry *entries = GetSortEntries(commands);
+  render_sort_entry *scratch = entries - count;
+
+  uint32_t histogram[8][256] = {};
+  for(uint32_t i = 0; i < count; ++i) {
+    uint64_t key = entries[i].sortKey;
+    for(int digit = 0; digit < 8; ++digit) {
+      ++histogram[digit][(key >> (digit * 8)) & 0xFF];
+    }
+  }
+
+  render_sort_entry *source = entries;
+  render_sort_entry *dest = scratch;
+  for(int digit = 0; digit < 8; ++digit) {
+    uint32_t *counts = histogram[digit];
+    bool trivial = false;
+    uint32_t offset = 0;
+    for(int value = 0; value < 256; ++value) {
+      if(counts[value] == count) {
+        trivial = true;
+        break;
+      }
+      uint32_t valueCount = counts[value];
+      counts[value] = offset;
+      offset += valueCount;
+    }
+    if(trivial) {
+      continue;
+    }
+
+    int shift = digit * 8;
+    for(uint32_t i = 0; i < count; ++i) {
+      dest[counts[(source[i].sortKey >> shift) & 0xFF]++] = source[i];
+    }
+    render_sort_entry *swap = source;
+    source = dest;
+    dest = swap;
+  }
+
+  if(source != entries) {
+    memcpy(entries, source, count * sizeof(render_sort_entry));
+  }
+}
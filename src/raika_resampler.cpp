@@ -0,0 +1,347 @@
+#include "raika_intrinsics.h"
+
+// Sample rate conversion
+// Windowed sinc interpolation from a polyphase table. Every output sample is
+// a dot product of RESAMPLE taps input samples with one row of
+// coefficients, picked by the fractional input position. The table holds
+// RESAMPLE_PHASES + 1 rows and the two either side of the position are
+// blended, so any ratio works, not just ones with a small denominator, and
+// the ratio can change between calls for drift correction.
+//
+// Positions are 32.32 fixed point in input samples. Kernels read a window of
+// taps samples starting at in + (position >> 32), centred between taps / 2 - 1
+// and taps / 2. Callers lay the input out so that window is always there.
+//
+// Shrinking (ratio above 1) has to band limit to the output rate instead. A
+// table per quarter step of ratio up to RESAMPLE_MAX_RATIO lowers the cutoff
+// to suit, built the first time it is asked for. Ratios take the table for
+// the step at or below them, so drift correction around 1 keeps the full
+// passband and up to a quarter of the transition band may fold back.
+#define RESAMPLE_PHASE_BITS 7
+#define RESAMPLE_PHASES (1 << RESAMPLE_PHASE_BITS)
+#define RESAMPLE_MAX_TAPS 32
+#define RESAMPLE_MAX_RATIO 4.0
+#define RESAMPLE_RATIO_STEPS 4
+#define RESAMPLE_CUTOFF_COUNT (1 + (int) ((RESAMPLE_MAX_RATIO - 1.0) * RESAMPLE_RATIO_STEPS))
+
+enum resample_quality {
+  // Two taps, the cheapest and the only one that does not band limit
+  Resample_Linear,
+  Resample_Low,
+  Resample_Medium,
+  Resample_High,
+
+  Resample_Count
+};
+
+struct resample_quality_info {
+  const char *name;
+  int taps;
+  // Passband edge as a fraction of Nyquist, and the Kaiser window's beta
+  double cutoff;
+  double beta;
+};
+
+static const resample_quality_info RESAMPLE_QUALITIES[Resample_Count] = {
+  {"linear", 2, 1.0, 0.0},
+  {"low", 8, 0.80, 5.0},
+  {"medium", 16, 0.88, 7.0},
+  {"high", 32, 0.93, 9.0},
+};
+
+struct resample_table {
+  int taps;
+  bool built;
+  // RESAMPLE_PHASES + 1 rows of taps
+  float *coefficients;
+};
+
+static float globalResampleCoefficients[Resample_Count][RESAMPLE_CUTOFF_COUNT][(RESAMPLE_PHASES + 1) * RESAMPLE_MAX_TAPS];
+static resample_table globalResampleTables[Resample_Count][RESAMPLE_CUTOFF_COUNT];
+
+// Zeroth order modified Bessel function, for the Kaiser window
+static double BesselI0(double x) {
+  double sum = 1.0, term = 1.0;
+  for(int k = 1; k < 32; ++k) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if(term < sum * 1e-12) {
+      break;
+    }
+  }
+  return sum;
+}
+
+static void BuildResampleTable(resample_table *table, resample_quality quality, int cutoffIndex) {
+  resample_quality_info info = RESAMPLE_QUALITIES[quality];
+  double pi = 3.14159265358979323846;
+  double cutoff = info.cutoff / (1.0 + (double) cutoffIndex / RESAMPLE_RATIO_STEPS);
+  double half = info.taps / 2;
+  table->taps = info.taps;
+  table->coefficients = globalResampleCoefficients[quality][cutoffIndex];
+  for(int row = 0; row <= RESAMPLE_PHASES; ++row) {
+    double fraction = (double) row / RESAMPLE_PHASES;
+    float *coefficients = table->coefficients + row * info.taps;
+    double weights[RESAMPLE_MAX_TAPS];
+    double sum = 0.0;
+    for(int k = 0; k < info.taps; ++k) {
+      // Distance from the sample under tap k to the position
+      double x = (k - (half - 1)) - fraction;
+      double weight;
+      if(quality == Resample_Linear) {
+        weight = 1.0 - fabs(x);
+      } else {
+        double u = x / half;
+        double window = fabs(u) < 1.0 ? BesselI0(info.beta * sqrt(1.0 - u * u)) / BesselI0(info.beta) : 0.0;
+        double t = pi * cutoff * x;
+        weight = (x == 0.0 ? 1.0 : sin(t) / t) * window;
+      }
+      weights[k] = weight;
+      sum += weight;
+    }
+    // Unity gain at DC for every phase
+    for(int k = 0; k < info.taps; ++k) {
+      coefficients[k] = (float) (weights[k] / sum);
+    }
+  }
+  table->built = true;
+}
+
+static resample_table *GetResampleTable(resample_quality quality, double ratio) {
+  int cutoffIndex = 0;
+  if(ratio > 1.0 && quality != Resample_Linear) {
+    cutoffIndex = (int) ((ratio - 1.0) * RESAMPLE_RATIO_STEPS);
+    cutoffIndex = cutoffIndex < RESAMPLE_CUTOFF_COUNT ? cutoffIndex : RESAMPLE_CUTOFF_COUNT - 1;
+  }
+  resample_table *table = &globalResampleTables[quality][cutoffIndex];
+  if(!table->built) {
+    BuildResampleTable(table, quality, cutoffIndex);
+  }
+  return table;
+}
+
+inline uint64_t ResampleStep(double ratio) {
+  ratio = ratio < RESAMPLE_MAX_RATIO ? ratio : RESAMPLE_MAX_RATIO;
+  return (uint64_t) (ratio * 4294967296.0);
+}
+
+// Kernels
+// Taps are summed in eight lanes, lane l taking taps l, l + 8 and so on,
+// then the lanes are folded in halves. That is the order AVX2 adds in, and
+// the other levels follow it so every kernel matches the scalar one bit for
+// bit. Two tap tables go through ResampleLinear at every level.
+typedef void resample_kernel(float *out, int count, float *in, uint64_t position, uint64_t step, resample_table *table);
+
+inline void ResampleRow(resample_table *table, uint64_t position, float **row, float *blend) {
+  uint32_t fraction = (uint32_t) position;
+  *row = table->coefficients + (fraction >> (32 - RESAMPLE_PHASE_BITS)) * table->taps;
+  *blend = (float) ((fraction >> (32 - RESAMPLE_PHASE_BITS - 16)) & 0xFFFF) * (1.0f / 65536.0f);
+}
+
+static void ResampleLinear(float *out, int count, float *in, uint64_t position, uint64_t step, resample_table *table) {
+  for(int i = 0; i < count; ++i) {
+    float *x = in + (position >> 32);
+    float t = (float) (((uint32_t) position) >> 16) * (1.0f / 65536.0f);
+    out[i] = x[0] + t * (x[1] - x[0]);
+    position += step;
+  }
+}
+
+static void ResampleScalar(float *out, int count, float *in, uint64_t position, uint64_t step, resample_table *table) {
+  int taps = table->taps;
+  for(int i = 0; i < count; ++i) {
+    float *x = in + (position >> 32);
+    float *c0, t;
+    ResampleRow(table, position, &c0, &t);
+    float *c1 = c0 + taps;
+    float lanes[8] = {};
+    for(int k = 0; k < taps; k += 8) {
+      for(int l = 0; l < 8; ++l) {
+        float c = c0[k + l] + t * (c1[k + l] - c0[k + l]);
+        lanes[l] = lanes[l] + x[k + l] * c;
+      }
+    }
+    float a0 = lanes[0] + lanes[4], a1 = lanes[1] + lanes[5];
+    float a2 = lanes[2] + lanes[6], a3 = lanes[3] + lanes[7];
+    out[i] = (a0 + a2) + (a1 + a3);
+    position += step;
+  }
+}
+
+// Folds four lanes the same way as the scalar tail
+inline float ResampleSum4(__m128 lanes) {
+  __m128 pairs = _mm_add_ps(lanes, _mm_movehl_ps(lanes, lanes));
+  __m128 total = _mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1));
+  return _mm_cvtss_f32(total);
+}
+
+static void ResampleSSE2(float *out, int count, float *in, uint64_t position, uint64_t step, resample_table *table) {
+  int taps = table->taps;
+  for(int i = 0; i < count; ++i) {
+    float *x = in + (position >> 32);
+    float *c0, t;
+    ResampleRow(table, position, &c0, &t);
+    float *c1 = c0 + taps;
+    __m128 blend = _mm_set1_ps(t);
+    __m128 low = _mm_setzero_ps();
+    __m128 high = _mm_setzero_ps();
+    for(int k = 0; k < taps; k += 8) {
+      __m128 a0 = _mm_loadu_ps(c0 + k);
+      __m128 a1 = _mm_loadu_ps(c0 + k + 4);
+      __m128 b0 = _mm_loadu_ps(c1 + k);
+      __m128 b1 = _mm_loadu_ps(c1 + k + 4);
+      __m128 cLow = _mm_add_ps(a0, _mm_mul_ps(blend, _mm_sub_ps(b0, a0)));
+      __m128 cHigh = _mm_add_ps(a1, _mm_mul_ps(blend, _mm_sub_ps(b1, a1)));
+      low = _mm_add_ps(low, _mm_mul_ps(_mm_loadu_ps(x + k), cLow));
+      high = _mm_add_ps(high, _mm_mul_ps(_mm_loadu_ps(x + k + 4), cHigh));
+    }
+    out[i] = ResampleSum4(_mm_add_ps(low, high));
+    position += step;
+  }
+}
+
+RAIKA_TARGET_AVX2
+static void ResampleAVX2(float *out, int count, float *in, uint64_t position, uint64_t step, resample_table *table) {
+  int taps = table->taps;
+  for(int i = 0; i < count; ++i) {
+    float *x = in + (position >> 32);
+    float *c0, t;
+    ResampleRow(table, position, &c0, &t);
+    float *c1 = c0 + taps;
+    __m256 blend = _mm256_set1_ps(t);
+    __m256 lanes = _mm256_setzero_ps();
+    for(int k = 0; k < taps; k += 8) {
+      __m256 a = _mm256_loadu_ps(c0 + k);
+      __m256 b = _mm256_loadu_ps(c1 + k);
+      __m256 c = _mm256_add_ps(a, _mm256_mul_ps(blend, _mm256_sub_ps(b, a)));
+      lanes = _mm256_add_ps(lanes, _mm256_mul_ps(_mm256_loadu_ps(x + k), c));
+    }
+    __m128 folded = _mm_add_ps(_mm256_castps256_ps128(lanes), _mm256_extractf128_ps(lanes, 1));
+    out[i] = ResampleSum4(folded);
+    position += step;
+  }
+  _mm256_zeroupper();
+}
+
+struct resample_kernels {
+  const char *name;
+  resample_kernel *resample;
+};
+
+// Ordered slowest to fastest, the last supported one wins
+static resample_kernels GetResampleKernels(int index) {
+  cpu_features *cpu = GetCpuFeatures();
+  resample_kernels result = {};
+  switch(index) {
+    case 0: {
+      result.name = "scalar";
+      result.resample = ResampleScalar;
+    } break;
+    case 1: {
+      if(cpu->sse2) {
+        result.name = "sse2";
+        result.resample = ResampleSSE2;
+      }
+    } break;
+    case 2: {
+      if(cpu->avx2) {
+        result.name = "avx2";
+        result.resample = ResampleAVX2;
+      }
+    } break;
+  }
+  return result;
+}
+#define RESAMPLE_KERNEL_COUNT 3
+
+static resample_kernels globalResampleKernels;
+
+static resample_kernels *PickResampleKernels() {
+  if(!globalResampleKernels.name) {
+    for(int i = 0; i < RESAMPLE_KERNEL_COUNT; ++i) {
+      resample_kernels kernels = GetResampleKernels(i);
+      if(kernels.name) {
+        globalResampleKernels = kernels;
+      }
+    }
+  }
+  return &globalResampleKernels;
+}
+
+// Resamples count outputs from a window laid out as described at the top
+static void ResampleWith(resample_kernels *kernels, resample_table *table, float *out, int count, float *in, uint64_t position, uint64_t step) {
+  if(table->taps == 2) {
+    ResampleLinear(out, count, in, position, step, table);
+  } else {
+    kernels->resample(out, count, in, position, step, table);
+  }
+}
+
+// Input samples either side of a position the window reaches
+inline int ResampleTapsBefore(resample_quality quality) {
+  return RESAMPLE_QUALITIES[quality].taps / 2 - 1;
+}
+
+inline int ResampleTapsAfter(resample_quality quality) {
+  return RESAMPLE_QUALITIES[quality].taps / 2;
+}
+
+// Streaming
+// For sources that arrive a block at a time, like the mixer's bus. Input is
+// pushed in, the resampler keeps the history its window needs and hands out
+// as many outputs as the caller asks for at whatever ratio is current.
+#define RESAMPLER_INPUT_FRAMES 2048
+#define RESAMPLER_CHANNELS 2
+
+struct resampler {
+  resample_quality quality;
+  // Input frames per output frame
+  double ratio;
+  // Window start of the next output, relative to input[c][0]
+  uint64_t position;
+  uint32_t filled;
+  float input[RESAMPLER_CHANNELS][RESAMPLER_INPUT_FRAMES];
+};
+
+static void InitResampler(resampler *r, resample_quality quality, double ratio) {
+  memset(r, 0, sizeof(*r));
+  r->quality = quality;
+  r->ratio = ratio;
+  // Silence before the first sample so it lands in the middle of the window
+  r->filled = ResampleTapsBefore(quality);
+}
+
+// Input frames to push before count more outputs can be pulled
+static uint32_t ResamplerInputNeeded(resampler *r, int count) {
+  uint64_t last = r->position + ResampleStep(r->ratio) * (count - 1);
+  uint32_t end = (uint32_t) (last >> 32) + RESAMPLE_QUALITIES[r->quality].taps;
+  return end > r->filled ? end - r->filled : 0;
+}
+
+// Returns how many frames fit
+static uint32_t ResamplerPush(resampler *r, float *left, float *right, uint32_t count) {
+  uint32_t space = RESAMPLER_INPUT_FRAMES - r->filled;
+  count = count < space ? count : space;
+  memcpy(r->input[0] + r->filled, left, count * sizeof(float));
+  memcpy(r->input[1] + r->filled, right, count * sizeof(float));
+  r->filled += count;
+  return count;
+}
+
+// Pulls count outputs, ResamplerInputNeeded must have been met
+static void ResamplerPull(resample_kernels *kernels, resampler *r, float *left, float *right, int count) {
+  Assert(ResamplerInputNeeded(r, count) == 0);
+  uint64_t step = ResampleStep(r->ratio);
+  resample_table *table = GetResampleTable(r->quality, r->ratio);
+  ResampleWith(kernels, table, left, count, r->input[0], r->position, step);
+  ResampleWith(kernels, table, right, count, r->input[1], r->position, step);
+
+  // Drop what no later window reaches
+  r->position += step * count;
+  uint32_t consumed = (uint32_t) (r->position >> 32);
+  consumed = consumed < r->filled ? consumed : r->filled;
+  memmove(r->input[0], r->input[0] + consumed, (r->filled - consumed) * sizeof(float));
+  memmove(r->input[1], r->input[1] + consumed, (r->filled - consumed) * sizeof(float));
+  r->filled -= consumed;
+  r->position -= (uint64_t) consumed << 32;
+}
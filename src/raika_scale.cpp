@@ -0,0 +1,386 @@
+// Image scaling
+// Resamples the internal resolution buffer the game drew into up to the
+// buffer that gets presented. Positions are 16.16 fixed point with pixel
+// centres lined up, nearest takes the source pixel under each destination
+// centre and bilinear blends the four around it with 8 bit weights.
+//
+// Bilinear runs in two passes per destination row. The two source rows are
+// blended into a scratch row, then the scratch row is sampled across. The
+// scratch row repeats its last pixel so the right edge needs no clamp.
+
+#define SCALE_MAX_SOURCE_WIDTH 4096
+#define SCALE_BAND_HEIGHT 64
+// Like render tiles, no more bands than the work queue holds at once
+#define SCALE_MAX_WORK 1023
+
+enum scale_filter {
+  ScaleFilter_Nearest,
+  ScaleFilter_Bilinear,
+};
+
+// Writes count destination pixels, sampling source at position, position +
+// step, ... in 16.16
+typedef void scale_row_kernel(uint32_t *dest, uint32_t *source, int32_t position, int32_t step, int count);
+// dest = row0 + (row1 - row0) * weight / 256 per channel
+typedef void blend_row_kernel(uint32_t *dest, uint32_t *row0, uint32_t *row1, uint32_t weight, int count);
+
+inline uint32_t LerpPixel(uint32_t a, uint32_t b, uint32_t weight) {
+  uint32_t result = 0;
+  for(int shift = 0; shift < 32; shift += 8) {
+    uint32_t c = (((a >> shift) & 0xFF) * (256 - weight) + ((b >> shift) & 0xFF) * weight + 128) >> 8;
+    result |= c << shift;
+  }
+  return result;
+}
+
+// Scalar
+static void ScaleRowNearestScalar(uint32_t *dest, uint32_t *source, int32_t position, int32_t step, int count) {
+  for(int x = 0; x < count; ++x) {
+    dest[x] = source[position >> 16];
+    position += step;
+  }
+}
+
+static void ScaleRowBilinearScalar(uint32_t *dest, uint32_t *source, int32_t position, int32_t step, int count) {
+  for(int x = 0; x < count; ++x) {
+    int32_t p = position < 0 ? 0 : position;
+    uint32_t *pair = source + (p >> 16);
+    dest[x] = LerpPixel(pair[0], pair[1], (p >> 8) & 0xFF);
+    position += step;
+  }
+}
+
+static void BlendRowScalar(uint32_t *dest, uint32_t *row0, uint32_t *row1, uint32_t weight, int count) {
+  for(int x = 0; x < count; ++x) {
+    dest[x] = LerpPixel(row0[x], row1[x], weight);
+  }
+}
+
+// SSE2
+// Two pixels per register at 16 bits a channel. The products stay under
+// 65536 so plain 16 bit multiplies are enough.
+inline __m128i LerpPixels2(__m128i a, __m128i b, __m128i weight) {
+  __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(256), weight);
+  __m128i sum = _mm_add_epi16(_mm_mullo_epi16(a, inverse), _mm_mullo_epi16(b, weight));
+  return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(128)), 8);
+}
+
+static void ScaleRowBilinearSSE2(uint32_t *dest, uint32_t *source, int32_t position, int32_t step, int count) {
+  __m128i zero = _mm_setzero_si128();
+  int x = 0;
+  for(; x + 4 <= count; x += 4) {
+    int32_t p[4];
+    for(int i = 0; i < 4; ++i) {
+      p[i] = position < 0 ? 0 : position;
+      position += step;
+    }
+    uint32_t *s0 = source + (p[0] >> 16);
+    uint32_t *s1 = source + (p[1] >> 16);
+    uint32_t *s2 = source + (p[2] >> 16);
+    uint32_t *s3 = source + (p[3] >> 16);
+    __m128i a = _mm_setr_epi32(s0[0], s1[0], s2[0], s3[0]);
+    __m128i b = _mm_setr_epi32(s0[1], s1[1], s2[1], s3[1]);
+    __m128i w = _mm_setr_epi32((p[0] >> 8) & 0xFF, (p[1] >> 8) & 0xFF, (p[2] >> 8) & 0xFF, (p[3] >> 8) & 0xFF);
+    w = _mm_or_si128(w, _mm_slli_epi32(w, 16));
+    __m128i lo = LerpPixels2(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi32(w, w));
+    __m128i hi = LerpPixels2(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi32(w, w));
+    _mm_storeu_si128((__m128i *) (dest + x), _mm_packus_epi16(lo, hi));
+  }
+  ScaleRowBilinearScalar(dest + x, source, position, step, count - x);
+}
+
+static void BlendRowSSE2(uint32_t *dest, uint32_t *row0, uint32_t *row1, uint32_t weight, int count) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i w = _mm_set1_epi16((short) weight);
+  int x = 0;
+  for(; x + 4 <= count; x += 4) {
+    __m128i a = _mm_loadu_si128((__m128i *) (row0 + x));
+    __m128i b = _mm_loadu_si128((__m128i *) (row1 + x));
+    __m128i lo = LerpPixels2(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), w);
+    __m128i hi = LerpPixels2(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), w);
+    _mm_storeu_si128((__m128i *) (dest + x), _mm_packus_epi16(lo, hi));
+  }
+  BlendRowScalar(dest + x, row0 + x, row1 + x, weight, count - x);
+}
+
+// AVX2
+RAIKA_TARGET_AVX2
+inline __m256i LerpPixels4(__m256i a, __m256i b, __m256i weight) {
+  __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(256), weight);
+  __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(a, inverse), _mm256_mullo_epi16(b, weight));
+  return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(128)), 8);
+}
+
+RAIKA_TARGET_AVX2
+static void ScaleRowNearestAVX2(uint32_t *dest, uint32_t *source, int32_t position, int32_t step, int count) {
+  __m256i p = _mm256_add_epi32(
+    _mm256_set1_epi32(position),
+    _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(step))
+  );
+  __m256i step8 = _mm256_set1_epi32(step * 8);
+  int x = 0;
+  for(; x + 8 <= count; x += 8) {
+    __m256i c = _mm256_i32gather_epi32((int *) source, _mm256_srli_epi32(p, 16), 4);
+    _mm256_storeu_si256((__m256i *) (dest + x), c);
+    p = _mm256_add_epi32(p, step8);
+  }
+  _mm256_zeroupper();
+  ScaleRowNearestScalar(dest + x, source, position + x * step, step, count - x);
+}
+
+// Unpacking works within 128 bit lanes, so the low half holds pixels 0, 1,
+// 4, 5 and the high half 2, 3, 6, 7. Weights are spread the same way and
+// packing puts the pixels back in order.
+RAIKA_TARGET_AVX2
+static void ScaleRowBilinearAVX2(uint32_t *dest, uint32_t *source, int32_t position, int32_t step, int count) {
+  __m256i zero = _mm256_setzero_si256();
+  __m256i mask = _mm256_set1_epi32(0xFF);
+  __m256i p = _mm256_add_epi32(
+    _mm256_set1_epi32(position),
+    _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(step))
+  );
+  __m256i step8 = _mm256_set1_epi32(step * 8);
+  int x = 0;
+  for(; x + 8 <= count; x += 8) {
+    __m256i clamped = _mm256_max_epi32(p, zero);
+    __m256i index = _mm256_srli_epi32(clamped, 16);
+    __m256i a = _mm256_i32gather_epi32((int *) source, index, 4);
+    __m256i b = _mm256_i32gather_epi32((int *) (source + 1), index, 4);
+    __m256i w = _mm256_and_si256(_mm256_srli_epi32(clamped, 8), mask);
+    w = _mm256_or_si256(w, _mm256_slli_epi32(w, 16));
+    __m256i lo = LerpPixels4(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero), _mm256_unpacklo_epi32(w, w));
+    __m256i hi = LerpPixels4(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero), _mm256_unpackhi_epi32(w, w));
+    _mm256_storeu_si256((__m256i *) (dest + x), _mm256_packus_epi16(lo, hi));
+    p = _mm256_add_epi32(p, step8);
+  }
+  _mm256_zeroupper();
+  ScaleRowBilinearScalar(dest + x, source, position + x * step, step, count - x);
+}
+
+RAIKA_TARGET_AVX2
+static void BlendRowAVX2(uint32_t *dest, uint32_t *row0, uint32_t *row1, uint32_t weight, int count) {
+  __m256i zero = _mm256_setzero_si256();
+  __m256i w = _mm256_set1_epi16((short) weight);
+  int x = 0;
+  for(; x + 8 <= count; x += 8) {
+    __m256i a = _mm256_loadu_si256((__m256i *) (row0 + x));
+    __m256i b = _mm256_loadu_si256((__m256i *) (row1 + x));
+    __m256i lo = LerpPixels4(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero), w);
+    __m256i hi = LerpPixels4(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero), w);
+    _mm256_storeu_si256((__m256i *) (dest + x), _mm256_packus_epi16(lo, hi));
+  }
+  _mm256_zeroupper();
+  BlendRowScalar(dest + x, row0 + x, row1 + x, weight, count - x);
+}
+
+struct scale_kernels {
+  const char *name;
+  scale_row_kernel *nearest;
+  scale_row_kernel *bilinear;
+  blend_row_kernel *blend;
+};
+
+// Ordered slowest to fastest, the last supported set wins. SSE2 has no
+// gather, so nearest stays scalar there.
+static scale_kernels GetScaleKernels(int index) {
+  cpu_features *cpu = GetCpuFeatures();
+  scale_kernels result = {};
+  switch(index) {
+    case 0: {
+      result.name = "scalar";
+      result.nearest = ScaleRowNearestScalar;
+      result.bilinear = ScaleRowBilinearScalar;
+      result.blend = BlendRowScalar;
+    } break;
+    case 1: {
+      if(cpu->sse2) {
+        result.name = "sse2";
+        result.nearest = ScaleRowNearestScalar;
+        result.bilinear = ScaleRowBilinearSSE2;
+        result.blend = BlendRowSSE2;
+      }
+    } break;
+    case 2: {
+      if(cpu->avx2) {
+        result.name = "avx2";
+        result.nearest = ScaleRowNearestAVX2;
+        result.bilinear = ScaleRowBilinearAVX2;
+        result.blend = BlendRowAVX2;
+      }
+    } break;
+  }
+  return result;
+}
+#define SCALE_KERNEL_COUNT 3
+
+static scale_kernels globalScaleKernels;
+
+static scale_kernels *PickScaleKernels() {
+  if(!globalScaleKernels.name) {
+    for(int i = 0; i < SCALE_KERNEL_COUNT; ++i) {
+      scale_kernels kernels = GetScaleKernels(i);
+      if(kernels.name) {
+        globalScaleKernels = kernels;
+      }
+    }
+  }
+  return &globalScaleKernels;
+}
+
+// Scaling
+inline int32_t ScaleStep(int sourceSize, int destSize) {
+  return (int32_t) (((int64_t) sourceSize << 16) / destSize);
+}
+
+// Position of the first sample for destination pixel 0
+inline int32_t ScaleStart(int32_t step, scale_filter filter) {
+  return filter == ScaleFilter_Bilinear ? step / 2 - 0x8000 : step / 2;
+}
+
+// Redraws clip of dest from source. dest may have a negative pitch, which
+// is how bottom up buffers are written top down.
+static void ScaleImageWith(
+    scale_kernels *kernels,
+    scale_filter filter,
+    graphics_buffer *dest,
+    graphics_buffer *source,
+    graphics_rect clip
+) {
+  graphics_rect bounds = {0, 0, dest->width, dest->height};
+  clip = IntersectRect(clip, bounds);
+  if(RectIsEmpty(clip)) {
+    return;
+  }
+  uint8_t *destRow = (uint8_t *) dest->memory + (ptrdiff_t) clip.y * dest->pitch + clip.x * 4;
+
+  // Same size is a copy, whichever filter
+  if(dest->width == source->width && dest->height == source->height) {
+    uint8_t *sourceRow = (uint8_t *) source->memory + (ptrdiff_t) clip.y * source->pitch + clip.x * 4;
+    CopyImage(destRow, dest->pitch, sourceRow, source->pitch, clip.width, clip.height);
+    return;
+  }
+
+  int32_t stepX = ScaleStep(source->width, dest->width);
+  int32_t stepY = ScaleStep(source->height, dest->height);
+  int32_t startX = ScaleStart(stepX, filter) + clip.x * stepX;
+  int32_t positionY = ScaleStart(stepY, filter) + clip.y * stepY;
+
+  if(filter == ScaleFilter_Nearest) {
+    int lastSourceY = -1;
+    uint8_t *lastRow = 0;
+    for(int y = 0; y < clip.height; ++y) {
+      int sourceY = positionY >> 16;
+      if(sourceY == lastSourceY) {
+        memcpy(destRow, lastRow, clip.width * 4);
+      } else {
+        uint32_t *sourceRow = (uint32_t *) ((uint8_t *) source->memory + (ptrdiff_t) sourceY * source->pitch);
+        kernels->nearest((uint32_t *) destRow, sourceRow, startX, stepX, clip.width);
+        lastSourceY = sourceY;
+        lastRow = destRow;
+      }
+      destRow += dest->pitch;
+      positionY += stepY;
+    }
+    return;
+  }
+
+  // Only the source columns this clip samples get blended
+  Assert(source->width <= SCALE_MAX_SOURCE_WIDTH);
+  uint32_t scratch[SCALE_MAX_SOURCE_WIDTH + 1];
+  int32_t endX = startX + (clip.width - 1) * stepX;
+  int spanMin = (startX < 0 ? 0 : startX) >> 16;
+  int spanMax = ((endX < 0 ? 0 : endX) >> 16) + 1;
+  spanMax = spanMax < source->width ? spanMax : source->width - 1;
+  int spanCount = spanMax - spanMin + 1;
+
+  for(int y = 0; y < clip.height; ++y) {
+    int32_t p = positionY < 0 ? 0 : positionY;
+    int sourceY = p >> 16;
+    int nextY = sourceY + 1 < source->height ? sourceY + 1 : sourceY;
+    uint32_t *row0 = (uint32_t *) ((uint8_t *) source->memory + (ptrdiff_t) sourceY * source->pitch);
+    uint32_t *row1 = (uint32_t *) ((uint8_t *) source->memory + (ptrdiff_t) nextY * source->pitch);
+    kernels->blend(scratch + spanMin, row0 + spanMin, row1 + spanMin, (p >> 8) & 0xFF, spanCount);
+    if(spanMax == source->width - 1) {
+      scratch[spanMax + 1] = scratch[spanMax];
+    }
+    kernels->bilinear((uint32_t *) destRow, scratch, startX, stepX, clip.width);
+    destRow += dest->pitch;
+    positionY += stepY;
+  }
+}
+
+inline void ScaleImage(scale_filter filter, graphics_buffer *dest, graphics_buffer *source, graphics_rect clip) {
+  ScaleImageWith(PickScaleKernels(), filter, dest, source, clip);
+}
+
+// Maps source's dirty rects onto dest, grown by the pixel bilinear reaches
+// past each edge
+inline void ScaleDirtyRects(graphics_buffer *dest, graphics_buffer *source) {
+  dest->dirtyRectCount = 0;
+  if(dest->width == source->width && dest->height == source->height) {
+    dest->dirtyRectCount = source->dirtyRectCount;
+    memcpy(dest->dirtyRects, source->dirtyRects, source->dirtyRectCount * sizeof(graphics_rect));
+    return;
+  }
+  for(int i = 0; i < source->dirtyRectCount; ++i) {
+    graphics_rect rect = source->dirtyRects[i];
+    int minX = rect.x - 1;
+    int minY = rect.y - 1;
+    int maxX = rect.x + rect.width + 1;
+    int maxY = rect.y + rect.height + 1;
+    minX = minX < 0 ? 0 : (int) ((int64_t) minX * dest->width / source->width);
+    minY = minY < 0 ? 0 : (int) ((int64_t) minY * dest->height / source->height);
+    maxX = (int) (((int64_t) maxX * dest->width + source->width - 1) / source->width);
+    maxY = (int) (((int64_t) maxY * dest->height + source->height - 1) / source->height);
+    graphics_rect scaled = {minX, minY, maxX - minX, maxY - minY};
+    MarkDirty(dest, scaled);
+  }
+}
+
+// Tiled
+// Dest's dirty rects are cut into bands of rows, one work entry each
+struct scale_work {
+  scale_kernels *kernels;
+  scale_filter filter;
+  graphics_buffer *dest;
+  graphics_buffer *source;
+  graphics_rect clip;
+};
+
+static scale_work globalScaleWork[SCALE_MAX_WORK];
+
+static void DoScaleWork(platform_work_queue *queue, void *data) {
+  scale_work *work = (scale_work *) data;
+  ScaleImageWith(work->kernels, work->filter, work->dest, work->source, work->clip);
+}
+
+// Without a queue the bands run here. Either way dest and source have to
+// stay put until PlatformCompleteAllWork returns.
+inline void ScaleImageTiled(
+    platform_work_queue *queue,
+    scale_filter filter,
+    graphics_buffer *dest,
+    graphics_buffer *source
+) {
+  scale_kernels *kernels = PickScaleKernels();
+  int workCount = 0;
+  for(int i = 0; i < dest->dirtyRectCount; ++i) {
+    graphics_rect rect = dest->dirtyRects[i];
+    for(int y = rect.y; y < rect.y + rect.height; y += SCALE_BAND_HEIGHT) {
+      int bandHeight = rect.y + rect.height - y;
+      bandHeight = bandHeight < SCALE_BAND_HEIGHT ? bandHeight : SCALE_BAND_HEIGHT;
+      graphics_rect band = {rect.x, y, rect.width, bandHeight};
+      if(!queue || workCount == SCALE_MAX_WORK) {
+        ScaleImageWith(kernels, filter, dest, source, band);
+        continue;
+      }
+      scale_work *work = globalScaleWork + workCount++;
+      work->kernels = kernels;
+      work->filter = filter;
+      work->dest = dest;
+      work->source = source;
+      work->clip = band;
+      PlatformAddWorkEntry(queue, DoScaleWork, work);
+    }
+  }
+}
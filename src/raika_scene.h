@@ -0,0 +1,44 @@
+#if !defined(RAIKA_SCENE_H)
+
+#include "raika.h"
+
+// The test scene, drawn by both the Vulkan and the software backends
+static const render_vertex SCENE_VERTICES[8] = {
+  {{-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
+  {{0.5f, -0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
+  {{0.5f, 0.5f, -0.5f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
+  {{-0.5f, 0.5f, -0.5f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}},
+
+  {{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
+  {{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
+  {{0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
+  {{-0.5f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}}
+};
+static const uint32_t SCENE_INDICES[12] = {
+  0, 1, 2, 2, 3, 0,
+  4, 5, 6, 6, 7, 4
+};
+#define SCENE_VERTEX_COUNT 8
+#define SCENE_INDEX_COUNT 12
+#define SCENE_TEXTURE_PATH "../textures/texture.bmp"
+#define SCENE_TEXTURE_ASSET "texture.bmp"
+
+// Model, view and projection for one frame
+struct scene_view {
+  m4x4 model;
+  m4x4 view;
+  m4x4 proj;
+};
+
+// Matches the camera drawFrame sets up, including the Vulkan Y flip
+static scene_view MakeSceneView(uint32_t frame, float aspect) {
+  scene_view result;
+  result.model = ZRotation(Radians(frame + 90.0f));
+  result.view = LookAt(V3(2.0f, 2.0f, 2.0f), V3(0.0f, 0.0f, 0.0f), V3(0.0f, 0.0f, 1.0f));
+  result.proj = Perspective(Radians(45.0f), aspect, 0.1f, 10.0f);
+  result.proj.e[1][1] *= -1;
+  return result;
+}
+
+#define RAIKA_SCENE_H
+#endif
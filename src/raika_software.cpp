@@ -0,0 +1,399 @@
+// Software renderer
+// Turns the sorted render commands into a list of steps on the game thread,
+// then every render tile runs the steps that overlap it, clipped to itself.
+// Consecutive meshes under one camera become a single raster_scene so they
+// share a depth buffer.
+//
+// A 512x32 tile of 32bpp pixels is 64KB, small enough to sit in L2 while a
+// thread works on it. Tiles are wide rather than square: narrow tiles at 4K
+// pitch touch a new page every row and ran several times slower. The work
+// arrays live here rather than on the stack because the platform only waits
+// for the queue after the tiles have been queued. A frame's tiles all go in
+// the work queue before any are waited on, so there can be no more of them
+// than the queue holds, one less than its ring of 1024 entries; bigger
+// buffers get taller tiles.
+#define RENDER_TILE_WIDTH 512
+#define RENDER_TILE_HEIGHT 32
+#define RENDER_TILE_MAX 1023
+#define RENDER_TILE_MAX_ROWS 256
+#define SOFTWARE_MAX_STEPS 16384
+#define SOFTWARE_MAX_SCENES 4
+#define SOFTWARE_MAX_BINNED_STEPS 65536
+
+struct software_step {
+  uint32_t type;
+  // Everything the step can touch
+  graphics_rect bounds;
+  // The command, or the raster_scene for a run of meshes
+  void *data;
+};
+
+struct render_tile_work {
+  graphics_buffer buffer;
+  software_step *steps;
+  // Which steps to run, all of them in order when null
+  uint32_t *stepIndices;
+  int stepCount;
+  int minX;
+  int minY;
+  int maxX;
+  int maxY;
+};
+
+static render_tile_work globalRenderTiles[RENDER_TILE_MAX];
+static software_step globalSoftwareSteps[SOFTWARE_MAX_STEPS];
+static raster_scene globalSoftwareScenes[SOFTWARE_MAX_SCENES];
+static uint32_t globalTileRowStepStart[RENDER_TILE_MAX_ROWS + 1];
+static uint32_t globalTileRowSteps[SOFTWARE_MAX_BINNED_STEPS];
+
+// What SoftwareRenderCommands had no room for since the last reset
+struct software_stats {
+  uint64_t droppedCommands;
+  uint64_t droppedMeshes;
+};
+
+static software_stats globalSoftwareStats;
+
+inline void ResetSoftwareStats() {
+  globalSoftwareStats = {};
+}
+
+static void FormatSoftwareStats(char *out, int outSize) {
+  snprintf(
+    out, outSize, "  dropped %llu commands past %d steps, %llu meshes past %d scenes\n",
+    (unsigned long long) globalSoftwareStats.droppedCommands, SOFTWARE_MAX_STEPS,
+    (unsigned long long) globalSoftwareStats.droppedMeshes, SOFTWARE_MAX_SCENES
+  );
+}
+
+static void FillRect(
+    fill_row_kernel *kernel,
+    graphics_buffer *buffer,
+    int minX, int minY,
+    int maxX, int maxY,
+    uint32_t color
+) {
+  uint8_t *row = (uint8_t *) buffer->memory + minY * buffer->pitch + minX * 4;
+  FillImageWith(kernel, row, buffer->pitch, maxX - minX, maxY - minY, color);
+}
+
+static void BlendRect(graphics_buffer *buffer, int minX, int minY, int maxX, int maxY, uint32_t color) {
+  sprite_row_kernel *kernel = PickSpriteBlendKernel();
+  uint32_t span[SPRITE_SPAN_WIDTH];
+  for(int i = 0; i < SPRITE_SPAN_WIDTH; ++i) {
+    span[i] = color;
+  }
+  uint8_t *row = (uint8_t *) buffer->memory + minY * buffer->pitch + minX * 4;
+  for(int y = minY; y < maxY; ++y) {
+    for(int x = 0; x < maxX - minX; x += SPRITE_SPAN_WIDTH) {
+      int count = maxX - minX - x;
+      kernel((uint32_t *) row + x, span, count < SPRITE_SPAN_WIDTH ? count : SPRITE_SPAN_WIDTH);
+    }
+    row += buffer->pitch;
+  }
+}
+
+// Full screen steps that nothing later in the tile draws over are written
+// once and left for the platform, so they stream past the cache. Where a
+// mesh or sprite lands on top the tile keeps them cached for it to read.
+static bool StepCanStream(render_tile_work *work, int index, graphics_rect area) {
+  software_step *step = work->steps + (work->stepIndices ? work->stepIndices[index] : index);
+  if(!ShouldStream(step->bounds.width, step->bounds.height)) {
+    return false;
+  }
+  for(int i = index + 1; i < work->stepCount; ++i) {
+    software_step *later = work->steps + (work->stepIndices ? work->stepIndices[i] : i);
+    if(!RectIsEmpty(IntersectRect(area, later->bounds))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void RenderTile(render_tile_work *work) {
+  graphics_buffer *buffer = &work->buffer;
+  graphics_rect clip = {work->minX, work->minY, work->maxX - work->minX, work->maxY - work->minY};
+  fill_kernels *fill = PickFillKernels();
+  bool streamed = false;
+
+  for(int i = 0; i < work->stepCount; ++i) {
+    software_step *step = work->steps + (work->stepIndices ? work->stepIndices[i] : i);
+    graphics_rect area = IntersectRect(clip, step->bounds);
+    if(RectIsEmpty(area)) {
+      continue;
+    }
+    int minX = area.x, minY = area.y;
+    int maxX = area.x + area.width, maxY = area.y + area.height;
+
+    switch(step->type) {
+      case RenderCommand_Clear: {
+        render_command_clear *command = (render_command_clear *) step->data;
+        bool stream = StepCanStream(work, i, area);
+        FillRect(stream ? fill->fillStream : fill->fill, buffer, minX, minY, maxX, maxY, command->color);
+        streamed |= stream;
+      } break;
+      case RenderCommand_Gradient: {
+        render_command_gradient *command = (render_command_gradient *) step->data;
+        bool stream = StepCanStream(work, i, area);
+        RenderGradientRect(
+          stream ? PickGradientStreamKernel() : PickGradientKernel(),
+          buffer, minX, minY, maxX, maxY, command->xoffset, command->yoffset
+        );
+        streamed |= stream;
+      } break;
+      case RenderCommand_Mesh: {
+        RasterizeScene((raster_scene *) step->data, buffer, minX, minY, maxX, maxY);
+      } break;
+      case RenderCommand_Rect: {
+        render_command_rect *command = (render_command_rect *) step->data;
+        if((command->color >> 24) == 0xFF) {
+          bool stream = StepCanStream(work, i, area);
+          FillRect(stream ? fill->fillStream : fill->fill, buffer, minX, minY, maxX, maxY, command->color);
+          streamed |= stream;
+        } else {
+          BlendRect(buffer, minX, minY, maxX, maxY, command->color);
+        }
+      } break;
+      case RenderCommand_Sprite: {
+        render_command_sprite *command = (render_command_sprite *) step->data;
+        DrawSpriteWith(
+          PickSpriteBlendKernel(), buffer, area,
+          command->bitmap, command->x, command->y, command->scale
+        );
+      } break;
+    }
+  }
+  if(streamed) {
+    StreamFence();
+  }
+}
+
+static void DoRenderTile(platform_work_queue *queue, void *data) {
+  RenderTile((render_tile_work *) data);
+}
+
+// Queues one entry per tile that touches a dirty rect, clipped to the
+// bounds of the dirty area inside it. Without a queue each dirty rect is
+// rendered as a single tile on this thread.
+static void RenderTiledSteps(
+    platform_work_queue *queue,
+    graphics_buffer *buffer,
+    software_step *steps,
+    int stepCount
+) {
+  if(!queue) {
+    for(int i = 0; i < buffer->dirtyRectCount; ++i) {
+      graphics_rect rect = buffer->dirtyRects[i];
+      render_tile_work work = {};
+      work.buffer = *buffer;
+      work.steps = steps;
+      work.stepCount = stepCount;
+      work.minX = rect.x;
+      work.minY = rect.y;
+      work.maxX = rect.x + rect.width;
+      work.maxY = rect.y + rect.height;
+      RenderTile(&work);
+    }
+    return;
+  }
+
+  // Buffers too big for the queue get taller tiles rather than more of them
+  int tileHeight = RENDER_TILE_HEIGHT;
+  int tileCountX = (buffer->width + RENDER_TILE_WIDTH - 1) / RENDER_TILE_WIDTH;
+  int tileCountY = (buffer->height + tileHeight - 1) / tileHeight;
+  while(tileCountX * tileCountY > RENDER_TILE_MAX || tileCountY > RENDER_TILE_MAX_ROWS) {
+    tileHeight *= 2;
+    tileCountY = (buffer->height + tileHeight - 1) / tileHeight;
+  }
+  Assert(tileCountX * tileCountY <= RENDER_TILE_MAX);
+
+  // Bin steps by tile row so a tile does not test every sprite in the
+  // frame. If the bins overflow every tile gets the full list instead.
+  uint32_t *rowStart = globalTileRowStepStart;
+  memset(rowStart, 0, sizeof(uint32_t) * (tileCountY + 1));
+  uint32_t binnedCount = 0;
+  for(int i = 0; i < stepCount; ++i) {
+    graphics_rect bounds = steps[i].bounds;
+    if(RectIsEmpty(bounds)) {
+      continue;
+    }
+    int firstRow = bounds.y < 0 ? 0 : bounds.y / tileHeight;
+    int lastRow = (bounds.y + bounds.height - 1) / tileHeight;
+    lastRow = lastRow < tileCountY ? lastRow : tileCountY - 1;
+    for(int row = firstRow; row <= lastRow; ++row) {
+      ++rowStart[row + 1];
+      ++binnedCount;
+    }
+  }
+  bool binned = binnedCount <= SOFTWARE_MAX_BINNED_STEPS;
+  if(binned) {
+    for(int row = 0; row < tileCountY; ++row) {
+      rowStart[row + 1] += rowStart[row];
+    }
+    for(int i = 0; i < stepCount; ++i) {
+      graphics_rect bounds = steps[i].bounds;
+      if(RectIsEmpty(bounds)) {
+        continue;
+      }
+      int firstRow = bounds.y < 0 ? 0 : bounds.y / tileHeight;
+      int lastRow = (bounds.y + bounds.height - 1) / tileHeight;
+      lastRow = lastRow < tileCountY ? lastRow : tileCountY - 1;
+      for(int row = firstRow; row <= lastRow; ++row) {
+        globalTileRowSteps[rowStart[row]++] = i;
+      }
+    }
+    // Filling moved every start up to the next row's, shift them back
+    for(int row = tileCountY; row > 0; --row) {
+      rowStart[row] = rowStart[row - 1];
+    }
+    rowStart[0] = 0;
+  }
+
+  int tileIndex = 0;
+  for(int tileY = 0; tileY < tileCountY; ++tileY) {
+    for(int tileX = 0; tileX < tileCountX; ++tileX) {
+      graphics_rect tile = {
+        tileX * RENDER_TILE_WIDTH, tileY * tileHeight,
+        RENDER_TILE_WIDTH, tileHeight
+      };
+      graphics_rect clip = {};
+      for(int i = 0; i < buffer->dirtyRectCount; ++i) {
+        graphics_rect part = IntersectRect(tile, buffer->dirtyRects[i]);
+        if(!RectIsEmpty(part)) {
+          clip = RectIsEmpty(clip) ? part : UnionRect(clip, part);
+        }
+      }
+      if(RectIsEmpty(clip)) {
+        continue;
+      }
+
+      render_tile_work *work = globalRenderTiles + tileIndex++;
+      work->buffer = *buffer;
+      work->steps = steps;
+      if(binned) {
+        work->stepIndices = globalTileRowSteps + rowStart[tileY];
+        work->stepCount = rowStart[tileY + 1] - rowStart[tileY];
+      } else {
+        work->stepIndices = 0;
+        work->stepCount = stepCount;
+      }
+      work->minX = clip.x;
+      work->minY = clip.y;
+      work->maxX = clip.x + clip.width;
+      work->maxY = clip.y + clip.height;
+      PlatformAddWorkEntry(queue, DoRenderTile, work);
+    }
+  }
+}
+
+// The software backend. Sorts the commands and queues the tiles, the caller
+// still has to complete the queue before presenting.
+static void SoftwareRenderCommands(
+    platform_work_queue *queue,
+    graphics_buffer *buffer,
+    render_commands *commands
+) {
+  SortRenderCommands(commands);
+  render_sort_entry *entries = GetSortEntries(commands);
+  graphics_rect all = {0, 0, buffer->width, buffer->height};
+
+  int stepCount = 0;
+  int sceneCount = 0;
+  m4x4 viewProj = Identity();
+  raster_scene *openScene = 0;
+  uint32_t i = 0;
+  for(; i < commands->commandCount && stepCount < SOFTWARE_MAX_STEPS; ++i) {
+    render_command_header *header = GetRenderCommand(commands, entries + i);
+    void *data = header + 1;
+    software_step *step = globalSoftwareSteps + stepCount;
+    step->type = header->type;
+    step->data = data;
+    step->bounds = all;
+
+    switch(header->type) {
+      case RenderCommand_Camera: {
+        render_command_camera *command = (render_command_camera *) data;
+        viewProj = command->proj * command->view;
+        openScene = 0;
+        continue;
+      } break;
+      case RenderCommand_Mesh: {
+        render_command_mesh *command = (render_command_mesh *) data;
+        if(!openScene) {
+          if(sceneCount == SOFTWARE_MAX_SCENES) {
+            ++globalSoftwareStats.droppedMeshes;
+            continue;
+          }
+          openScene = globalSoftwareScenes + sceneCount++;
+          BeginRasterScene(openScene, buffer->width, buffer->height);
+          step->data = openScene;
+          ++stepCount;
+        }
+        render_mesh *mesh = command->mesh;
+        PushRasterMesh(
+          openScene, viewProj * command->model,
+          mesh->vertices, mesh->indices, mesh->indexCount, mesh->texture
+        );
+        continue;
+      } break;
+      case RenderCommand_Rect: {
+        step->bounds = ((render_command_rect *) data)->rect;
+      } break;
+      case RenderCommand_Sprite: {
+        render_command_sprite *command = (render_command_sprite *) data;
+        graphics_rect bounds = {
+          command->x, command->y,
+          command->bitmap->width * command->scale, command->bitmap->height * command->scale
+        };
+        step->bounds = bounds;
+      } break;
+    }
+    openScene = 0;
+    ++stepCount;
+  }
+  globalSoftwareStats.droppedCommands += commands->commandCount - i;
+
+  // Mesh runs only know their extent once every triangle is in
+  for(int i = 0; i < stepCount; ++i) {
+    if(globalSoftwareSteps[i].type == RenderCommand_Mesh) {
+      globalSoftwareSteps[i].bounds = RasterSceneBounds((raster_scene *) globalSoftwareSteps[i].data);
+    }
+  }
+
+  RenderTiledSteps(queue, buffer, globalSoftwareSteps, stepCount);
+}
+
+// The gradient and optionally a prepared scene, without going through render
+// commands. The bench drives the tiles through these.
+static void RenderSceneTiled(
+    platform_work_queue *queue,
+    graphics_buffer *buffer,
+    int xoffset,
+    int yoffset,
+    raster_scene *scene
+) {
+  static render_command_gradient gradient;
+  static software_step steps[2];
+  gradient.xoffset = xoffset;
+  gradient.yoffset = yoffset;
+
+  graphics_rect all = {0, 0, buffer->width, buffer->height};
+  steps[0].type = RenderCommand_Gradient;
+  steps[0].bounds = all;
+  steps[0].data = &gradient;
+  if(scene) {
+    steps[1].type = RenderCommand_Mesh;
+    steps[1].bounds = RasterSceneBounds(scene);
+    steps[1].data = scene;
+  }
+  RenderTiledSteps(queue, buffer, steps, scene ? 2 : 1);
+}
+
+inline void RenderGradientTiled(
+    platform_work_queue *queue,
+    graphics_buffer *buffer,
+    int xoffset,
+    int yoffset
+) {
+  RenderSceneTiled(queue, buffer, xoffset, yoffset, 0);
+}
@@ -0,0 +1,368 @@
+// Streamed sounds
+// WAV files played straight from a memory mapping, decoded a little at a time
+// into a fixed ring of float frames that the mixer reads from. The file is
+// never loaded whole: the platform pages in SOUND_STREAM_CHUNK pieces ahead
+// of the decoder and drops the ones behind it, so a ten minute track and a
+// ten second one cost the same memory, the ring plus a few chunks of pages.
+//
+// Supports PCM at 8, 16 and 24 bits, 32 bit float and IMA ADPCM, in mono or
+// stereo. Decoding runs wherever the mixer runs and never allocates.
+#define SOUND_STREAM_FRAMES 4096
+#define SOUND_STREAM_CHUNK (16 * 1024)
+// Chunks paged in ahead of the decoder
+#define SOUND_STREAM_READ_AHEAD 2
+// A mixer block at the resampler's largest ratio with its widest window,
+// plus one ADPCM block, still fits in the ring
+#define SOUND_STREAM_MAX_BLOCK_FRAMES (SOUND_STREAM_FRAMES / 2)
+
+enum sound_encoding {
+  SoundEncoding_None,
+  SoundEncoding_PCM8,
+  SoundEncoding_PCM16,
+  SoundEncoding_PCM24,
+  SoundEncoding_Float32,
+  SoundEncoding_IMAADPCM,
+};
+
+struct sound_stream {
+  mapped_file file;
+  uint8_t *data;
+  uint64_t dataSize;
+  sound_encoding encoding;
+  int channels;
+  int samplesPerSecond;
+  uint32_t blockAlign;
+  // Frames a whole block decodes to, 1 for PCM
+  uint32_t framesPerBlock;
+  uint64_t frameCount;
+  bool loop;
+
+  // Byte offset into data of the next block to decode
+  uint64_t readAt;
+  // File offsets, in whole chunks from the start of the file so each page
+  // lands in exactly one: the end of what was paged in and the start of what
+  // has not been dropped yet
+  uint64_t prefetchedTo;
+  uint64_t evictedTo;
+  // Frames count up from the start of playback and keep counting through
+  // loops. The ring holds [decodedFrom, decodedTo), frame f at f % FRAMES.
+  uint64_t decodedFrom;
+  uint64_t decodedTo;
+  // Past the last frame of a stream that does not loop
+  bool ended;
+  float samples[2][SOUND_STREAM_FRAMES];
+};
+
+// Unaligned little endian reads from the mapping
+inline uint16_t ReadU16(uint8_t *at) {
+  return (uint16_t) (at[0] | (at[1] << 8));
+}
+
+inline uint32_t ReadU32(uint8_t *at) {
+  return (uint32_t) at[0] | ((uint32_t) at[1] << 8) | ((uint32_t) at[2] << 16) | ((uint32_t) at[3] << 24);
+}
+
+#define RIFF_CODE(a, b, c, d) ((uint32_t) (a) | ((uint32_t) (b) << 8) | ((uint32_t) (c) << 16) | ((uint32_t) (d) << 24))
+
+// IMA ADPCM
+static const int16_t IMA_STEP_TABLE[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+  11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+  32767,
+};
+
+static const int8_t IMA_INDEX_TABLE[16] = {
+  -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8,
+};
+
+struct ima_state {
+  int predictor;
+  int index;
+};
+
+inline int ImaDecodeNibble(ima_state *state, int nibble) {
+  int step = IMA_STEP_TABLE[state->index];
+  int diff = step >> 3;
+  if(nibble & 1) diff += step >> 2;
+  if(nibble & 2) diff += step >> 1;
+  if(nibble & 4) diff += step;
+  int predictor = state->predictor + ((nibble & 8) ? -diff : diff);
+  state->predictor = predictor < -32768 ? -32768 : (predictor > 32767 ? 32767 : predictor);
+  int index = state->index + IMA_INDEX_TABLE[nibble];
+  state->index = index < 0 ? 0 : (index > 88 ? 88 : index);
+  return state->predictor;
+}
+
+// Frames in an ADPCM block of this many bytes, the last block may be short
+inline uint32_t ImaBlockFrames(uint32_t bytes, int channels) {
+  uint32_t header = 4 * channels;
+  return bytes < header ? 0 : (bytes - header) * 2 / channels + 1;
+}
+
+// Opening
+// Fails on anything that is not a WAV we can decode
+inline bool OpenSoundStream(sound_stream *stream, char *filename) {
+  *stream = {};
+  stream->file = PlatformMapFile(filename);
+  uint8_t *at = (uint8_t *) stream->file.memory;
+  uint64_t size = stream->file.size;
+  if(!at || size < 12 || ReadU32(at) != RIFF_CODE('R', 'I', 'F', 'F') || ReadU32(at + 8) != RIFF_CODE('W', 'A', 'V', 'E')) {
+    PlatformUnmapFile(&stream->file);
+    return false;
+  }
+
+  uint16_t formatTag = 0, bitsPerSample = 0;
+  bool haveFormat = false;
+  uint64_t chunkAt = 12;
+  while(chunkAt + 8 <= size && !stream->data) {
+    uint32_t chunkId = ReadU32(at + chunkAt);
+    uint64_t chunkSize = ReadU32(at + chunkAt + 4);
+    uint8_t *chunk = at + chunkAt + 8;
+    uint64_t available = size - (chunkAt + 8);
+    if(chunkId == RIFF_CODE('f', 'm', 't', ' ') && chunkSize >= 16 && available >= 16) {
+      formatTag = ReadU16(chunk);
+      stream->channels = ReadU16(chunk + 2);
+      stream->samplesPerSecond = (int) ReadU32(chunk + 4);
+      stream->blockAlign = ReadU16(chunk + 12);
+      bitsPerSample = ReadU16(chunk + 14);
+      // WAVE_FORMAT_EXTENSIBLE keeps the real tag at the front of its GUID
+      if(formatTag == 0xFFFE && chunkSize >= 26 && available >= 26) {
+        formatTag = ReadU16(chunk + 24);
+      }
+      haveFormat = true;
+    } else if(chunkId == RIFF_CODE('d', 'a', 't', 'a') && haveFormat) {
+      // Writers that never came back to fill in the size leave it too big
+      stream->data = chunk;
+      stream->dataSize = chunkSize < available ? chunkSize : available;
+    }
+    // Chunks are padded to an even size
+    chunkAt += 8 + chunkSize + (chunkSize & 1);
+  }
+
+  if(formatTag == 1 && bitsPerSample == 8) {
+    stream->encoding = SoundEncoding_PCM8;
+  } else if(formatTag == 1 && bitsPerSample == 16) {
+    stream->encoding = SoundEncoding_PCM16;
+  } else if(formatTag == 1 && bitsPerSample == 24) {
+    stream->encoding = SoundEncoding_PCM24;
+  } else if(formatTag == 3 && bitsPerSample == 32) {
+    stream->encoding = SoundEncoding_Float32;
+  } else if(formatTag == 0x11 && bitsPerSample == 4) {
+    stream->encoding = SoundEncoding_IMAADPCM;
+  }
+
+  bool valid = stream->data && stream->encoding != SoundEncoding_None &&
+               (stream->channels == 1 || stream->channels == 2) &&
+               stream->samplesPerSecond > 0 && stream->blockAlign > 0;
+  if(valid) {
+    if(stream->encoding == SoundEncoding_IMAADPCM) {
+      stream->framesPerBlock = ImaBlockFrames(stream->blockAlign, stream->channels);
+      uint64_t wholeBlocks = stream->dataSize / stream->blockAlign;
+      uint32_t lastBytes = (uint32_t) (stream->dataSize % stream->blockAlign);
+      stream->frameCount = wholeBlocks * stream->framesPerBlock + ImaBlockFrames(lastBytes, stream->channels);
+      // Stereo blocks interleave the channels four bytes at a time
+      valid = stream->framesPerBlock > 1 && stream->framesPerBlock <= SOUND_STREAM_MAX_BLOCK_FRAMES &&
+              (stream->blockAlign - 4 * stream->channels) % (4 * stream->channels) == 0;
+    } else {
+      stream->framesPerBlock = 1;
+      stream->frameCount = stream->dataSize / stream->blockAlign;
+      valid = stream->blockAlign == (uint32_t) (bitsPerSample / 8 * stream->channels);
+    }
+  }
+  if(!valid || !stream->frameCount) {
+    PlatformUnmapFile(&stream->file);
+    *stream = {};
+    return false;
+  }
+  return true;
+}
+
+inline void CloseSoundStream(sound_stream *stream) {
+  PlatformUnmapFile(&stream->file);
+  stream->data = 0;
+  stream->encoding = SoundEncoding_None;
+}
+
+inline uint64_t SoundStreamDataOffset(sound_stream *stream) {
+  return stream->data - (uint8_t *) stream->file.memory;
+}
+
+// Drops whatever is still paged in and starts over at the first data chunk
+static void RestartSoundStreamFile(sound_stream *stream) {
+  uint64_t dataOffset = SoundStreamDataOffset(stream);
+  if(stream->prefetchedTo > stream->evictedTo) {
+    PlatformEvictFile(&stream->file, stream->evictedTo, stream->prefetchedTo - stream->evictedTo);
+  }
+  stream->readAt = 0;
+  stream->prefetchedTo = dataOffset & ~(uint64_t) (SOUND_STREAM_CHUNK - 1);
+  stream->evictedTo = stream->prefetchedTo;
+}
+
+// Back to the first frame with nothing decoded
+static void RewindSoundStream(sound_stream *stream) {
+  if(stream->data) {
+    RestartSoundStreamFile(stream);
+  }
+  stream->decodedFrom = 0;
+  stream->decodedTo = 0;
+  stream->ended = false;
+}
+
+// Decoding
+// Writes frames from the file into the ring at decodedTo, count never
+// crosses the end of the ring
+static void DecodePCM(sound_stream *stream, uint8_t *source, uint32_t count) {
+  uint32_t at = (uint32_t) (stream->decodedTo % SOUND_STREAM_FRAMES);
+  int channels = stream->channels;
+  for(int c = 0; c < channels; ++c) {
+    float *dest = stream->samples[c] + at;
+    switch(stream->encoding) {
+      case SoundEncoding_PCM8: {
+        uint8_t *in = source + c;
+        for(uint32_t i = 0; i < count; ++i) {
+          dest[i] = ((int) in[i * channels] - 128) * (1.0f / 128.0f);
+        }
+      } break;
+      case SoundEncoding_PCM16: {
+        uint8_t *in = source + 2 * c;
+        for(uint32_t i = 0; i < count; ++i) {
+          dest[i] = (int16_t) ReadU16(in + 2 * i * channels) * (1.0f / 32768.0f);
+        }
+      } break;
+      case SoundEncoding_PCM24: {
+        uint8_t *in = source + 3 * c;
+        for(uint32_t i = 0; i < count; ++i) {
+          uint8_t *s = in + 3 * i * channels;
+          int32_t value = (int32_t) (((uint32_t) s[0] << 8) | ((uint32_t) s[1] << 16) | ((uint32_t) s[2] << 24)) >> 8;
+          dest[i] = value * (1.0f / 8388608.0f);
+        }
+      } break;
+      case SoundEncoding_Float32: {
+        uint8_t *in = source + 4 * c;
+        for(uint32_t i = 0; i < count; ++i) {
+          memcpy(dest + i, in + 4 * i * channels, sizeof(float));
+        }
+      } break;
+      default: {
+      } break;
+    }
+  }
+}
+
+// One block, possibly short. Decodes through a small stack buffer because a
+// block can wrap the ring.
+static uint32_t DecodeIMABlock(sound_stream *stream, uint8_t *block, uint32_t bytes) {
+  int channels = stream->channels;
+  uint32_t frames = ImaBlockFrames(bytes, channels);
+  ima_state state[2];
+  int16_t decoded[2][SOUND_STREAM_MAX_BLOCK_FRAMES];
+  for(int c = 0; c < channels; ++c) {
+    uint8_t *header = block + 4 * c;
+    state[c].predictor = (int16_t) ReadU16(header);
+    state[c].index = header[2] > 88 ? 88 : header[2];
+    decoded[c][0] = (int16_t) state[c].predictor;
+  }
+  // Every channel takes 4 bytes, 8 frames, in turn
+  uint8_t *in = block + 4 * channels;
+  uint8_t *end = block + bytes;
+  uint32_t frame = 1;
+  while(frame < frames) {
+    for(int c = 0; c < channels; ++c) {
+      for(uint32_t i = 0; i < 4; ++i) {
+        uint32_t f = frame + 2 * i;
+        int byte = in + i < end ? in[i] : 0;
+        if(f < frames) {
+          decoded[c][f] = (int16_t) ImaDecodeNibble(state + c, byte & 0xF);
+        }
+        if(f + 1 < frames) {
+          decoded[c][f + 1] = (int16_t) ImaDecodeNibble(state + c, byte >> 4);
+        }
+      }
+      in += 4;
+    }
+    frame += 8;
+  }
+
+  for(uint32_t i = 0; i < frames; ++i) {
+    uint32_t at = (uint32_t) ((stream->decodedTo + i) % SOUND_STREAM_FRAMES);
+    for(int c = 0; c < channels; ++c) {
+      stream->samples[c][at] = decoded[c][i] * (1.0f / 32768.0f);
+    }
+  }
+  return frames;
+}
+
+// Keeps the platform paging in ahead of readAt and dropping what is behind
+static void AdviseSoundStream(sound_stream *stream) {
+  uint64_t dataOffset = SoundStreamDataOffset(stream);
+  uint64_t readAt = dataOffset + stream->readAt;
+  uint64_t wanted = readAt + SOUND_STREAM_READ_AHEAD * SOUND_STREAM_CHUNK;
+  uint64_t dataEnd = dataOffset + stream->dataSize;
+  wanted = wanted < dataEnd ? wanted : dataEnd;
+  while(stream->prefetchedTo < wanted) {
+    PlatformPrefetchFile(&stream->file, stream->prefetchedTo, SOUND_STREAM_CHUNK);
+    stream->prefetchedTo += SOUND_STREAM_CHUNK;
+  }
+  while(stream->evictedTo + SOUND_STREAM_CHUNK <= readAt) {
+    PlatformEvictFile(&stream->file, stream->evictedTo, SOUND_STREAM_CHUNK);
+    stream->evictedTo += SOUND_STREAM_CHUNK;
+  }
+}
+
+// Drops frames before keepFrom and decodes until the ring holds everything
+// before needTo, or the stream ends
+static void FillSoundStream(sound_stream *stream, uint64_t keepFrom, uint64_t needTo) {
+  if(keepFrom > stream->decodedFrom) {
+    stream->decodedFrom = keepFrom < stream->decodedTo ? keepFrom : stream->decodedTo;
+  }
+  while(stream->decodedTo < needTo && !stream->ended) {
+    if(stream->readAt >= stream->dataSize) {
+      if(!stream->loop) {
+        stream->ended = true;
+        break;
+      }
+      // Frames keep counting, only the file starts over
+      RestartSoundStreamFile(stream);
+    }
+    AdviseSoundStream(stream);
+
+    uint32_t space = (uint32_t) (SOUND_STREAM_FRAMES - (stream->decodedTo - stream->decodedFrom));
+    uint8_t *source = stream->data + stream->readAt;
+    uint64_t left = stream->dataSize - stream->readAt;
+    if(stream->encoding == SoundEncoding_IMAADPCM) {
+      if(space < stream->framesPerBlock) {
+        break;
+      }
+      uint32_t bytes = (uint32_t) (left < stream->blockAlign ? left : stream->blockAlign);
+      stream->decodedTo += DecodeIMABlock(stream, source, bytes);
+      stream->readAt += bytes;
+    } else {
+      uint64_t count = needTo - stream->decodedTo;
+      uint64_t fileFrames = left / stream->blockAlign;
+      uint32_t toRingEnd = SOUND_STREAM_FRAMES - (uint32_t) (stream->decodedTo % SOUND_STREAM_FRAMES);
+      count = count < space ? count : space;
+      count = count < fileFrames ? count : fileFrames;
+      count = count < toRingEnd ? count : toRingEnd;
+      if(!count) {
+        if(!fileFrames) {
+          // A partial frame at the end of the data
+          stream->readAt = stream->dataSize;
+          continue;
+        }
+        break;
+      }
+      DecodePCM(stream, source, (uint32_t) count);
+      stream->decodedTo += count;
+      stream->readAt += count * stream->blockAlign;
+    }
+  }
+}
+
+// The ring slot for a frame known to be in [decodedFrom, decodedTo)
+inline float SoundStreamSample(sound_stream *stream, int channel, uint64_t frame) {
+  return stream->samples[channel][frame % SOUND_STREAM_FRAMES];
+}
@@ -0,0 +1,475 @@
+#include "raika_intrinsics.h"
+
+// Positional audio
+// Emitters are kept as structure of arrays so gain, pan and doppler pitch for
+// all of them come out of one pass that runs eight at a time. Up to
+// SPATIAL_MAX_LISTENERS listeners, one per split screen player; each emitter
+// is heard by whichever listener hears it loudest.
+//
+// Only audible emitters get mixer voices. Anything under SPATIAL_CULL_GAIN
+// has its voice stopped, and when more are audible than the scene's voice
+// budget the quietest go too. A playing emitter holds on to its voice until
+// it drops to half the cull gain, so one sitting at the edge does not start
+// and stop every frame. A culled looping emitter starts again from the top of
+// its sample when it comes back.
+//
+// Distances are in metres. Gain falls off as minDistance over distance past
+// minDistance and fades to nothing over the last tenth of maxDistance. Pan is
+// the sine of the angle off the listener's forward axis. Every kernel must
+// match the scalar version bit for bit.
+#define SPATIAL_MAX_EMITTERS 4096
+#define SPATIAL_MAX_LISTENERS 4
+#define SPATIAL_CULL_GAIN 0.001f
+#define SPATIAL_SPEED_OF_SOUND 343.0f
+#define SPATIAL_DEFAULT_VOICES 64
+
+struct spatial_listener {
+  v3 position;
+  // Right is Cross(up, forward), as in LookAt
+  v3 right;
+  v3 velocity;
+};
+
+struct spatial_scene {
+  // Emitter slots in use are below count, free ones among them are silent
+  int count;
+  int maxVoices;
+  int listenerCount;
+  spatial_listener listeners[SPATIAL_MAX_LISTENERS];
+
+  // Inputs
+  float x[SPATIAL_MAX_EMITTERS];
+  float y[SPATIAL_MAX_EMITTERS];
+  float z[SPATIAL_MAX_EMITTERS];
+  float vx[SPATIAL_MAX_EMITTERS];
+  float vy[SPATIAL_MAX_EMITTERS];
+  float vz[SPATIAL_MAX_EMITTERS];
+  float gain[SPATIAL_MAX_EMITTERS];
+  float pitch[SPATIAL_MAX_EMITTERS];
+  float minDistance[SPATIAL_MAX_EMITTERS];
+  float maxDistance[SPATIAL_MAX_EMITTERS];
+  // One over the width of the fade at maxDistance
+  float fadeScale[SPATIAL_MAX_EMITTERS];
+
+  // Outputs
+  float outGain[SPATIAL_MAX_EMITTERS];
+  float outPan[SPATIAL_MAX_EMITTERS];
+  float outPitch[SPATIAL_MAX_EMITTERS];
+
+  // What each emitter plays and the voice playing it, zero while culled
+  sound_sample *samples[SPATIAL_MAX_EMITTERS];
+  uint32_t voices[SPATIAL_MAX_EMITTERS];
+  uint8_t groups[SPATIAL_MAX_EMITTERS];
+  bool used[SPATIAL_MAX_EMITTERS];
+  bool loop[SPATIAL_MAX_EMITTERS];
+  // A one shot that has played to its end
+  bool finished[SPATIAL_MAX_EMITTERS];
+
+  // From the last update
+  int audibleCount;
+  int voiceCount;
+  // Audible but over the voice budget
+  int droppedCount;
+  // Scratch for picking the loudest
+  uint16_t order[SPATIAL_MAX_EMITTERS];
+};
+
+// Free slots are silent and safe to divide by
+static void ClearEmitterSlot(spatial_scene *scene, int index) {
+  scene->x[index] = scene->y[index] = scene->z[index] = 0.0f;
+  scene->vx[index] = scene->vy[index] = scene->vz[index] = 0.0f;
+  scene->gain[index] = 0.0f;
+  scene->pitch[index] = 1.0f;
+  scene->minDistance[index] = 1.0f;
+  scene->maxDistance[index] = 1.0f;
+  scene->fadeScale[index] = 1.0f;
+  scene->samples[index] = 0;
+  scene->voices[index] = 0;
+  scene->groups[index] = 0;
+  scene->used[index] = false;
+  scene->loop[index] = false;
+  scene->finished[index] = false;
+}
+
+inline void InitSpatialScene(spatial_scene *scene) {
+  memset(scene, 0, sizeof(*scene));
+  scene->maxVoices = SPATIAL_DEFAULT_VOICES;
+  for(int i = 0; i < SPATIAL_MAX_EMITTERS; ++i) {
+    ClearEmitterSlot(scene, i);
+  }
+}
+
+// Listener
+inline void SetSpatialListener(spatial_scene *scene, int index, v3 position, v3 forward, v3 up, v3 velocity) {
+  if(index < 0 || index >= SPATIAL_MAX_LISTENERS) {
+    return;
+  }
+  spatial_listener *listener = scene->listeners + index;
+  listener->position = position;
+  listener->right = Normalize(Cross(up, forward));
+  listener->velocity = velocity;
+  scene->listenerCount = index + 1 > scene->listenerCount ? index + 1 : scene->listenerCount;
+}
+
+// Emitters
+// Returns the emitter, or -1 when every slot is taken. The sample starts
+// playing on the first update that finds it audible.
+inline int AddEmitter(
+    spatial_scene *scene, sound_sample *sample, v3 position,
+    float gain, float minDistance, float maxDistance, bool loop
+) {
+  int index = 0;
+  while(index < scene->count && scene->used[index]) {
+    ++index;
+  }
+  if(index == SPATIAL_MAX_EMITTERS) {
+    return -1;
+  }
+  ClearEmitterSlot(scene, index);
+  minDistance = minDistance > 0.01f ? minDistance : 0.01f;
+  maxDistance = maxDistance > minDistance ? maxDistance : minDistance;
+  scene->x[index] = position.x;
+  scene->y[index] = position.y;
+  scene->z[index] = position.z;
+  scene->gain[index] = gain;
+  scene->minDistance[index] = minDistance;
+  scene->maxDistance[index] = maxDistance;
+  scene->fadeScale[index] = 10.0f / maxDistance;
+  scene->samples[index] = sample;
+  scene->used[index] = true;
+  scene->loop[index] = loop;
+  scene->count = index + 1 > scene->count ? index + 1 : scene->count;
+  return index;
+}
+
+inline void MoveEmitter(spatial_scene *scene, int index, v3 position, v3 velocity) {
+  if(index >= 0 && index < scene->count && scene->used[index]) {
+    scene->x[index] = position.x;
+    scene->y[index] = position.y;
+    scene->z[index] = position.z;
+    scene->vx[index] = velocity.x;
+    scene->vy[index] = velocity.y;
+    scene->vz[index] = velocity.z;
+  }
+}
+
+inline void SetEmitterGain(spatial_scene *scene, int index, float gain, float pitch) {
+  if(index >= 0 && index < scene->count && scene->used[index]) {
+    scene->gain[index] = gain;
+    scene->pitch[index] = pitch;
+  }
+}
+
+// Takes effect when the emitter next gets a voice
+inline void SetEmitterGroup(spatial_scene *scene, int index, int group) {
+  if(index >= 0 && index < scene->count && scene->used[index] && group >= 0 && group < MIXER_MAX_GROUPS) {
+    scene->groups[index] = (uint8_t) group;
+  }
+}
+
+inline void RemoveEmitter(spatial_scene *scene, mixer *mix, int index) {
+  if(index < 0 || index >= scene->count || !scene->used[index]) {
+    return;
+  }
+  if(scene->voices[index]) {
+    StopVoice(mix, scene->voices[index]);
+  }
+  ClearEmitterSlot(scene, index);
+  while(scene->count && !scene->used[scene->count - 1]) {
+    --scene->count;
+  }
+}
+
+// Kernels
+// Fill outGain, outPan and outPitch for emitters [0, count), count a multiple
+// of eight. Listeners after the first only win with a strictly higher gain.
+typedef void spatial_kernel(spatial_scene *scene, int count);
+
+inline float SpatialMax(float a, float b) { return a > b ? a : b; }
+inline float SpatialMin(float a, float b) { return a < b ? a : b; }
+
+static void SpatialScalar(spatial_scene *scene, int count) {
+  float c = SPATIAL_SPEED_OF_SOUND;
+  for(int i = 0; i < count; ++i) {
+    float bestGain = 0.0f, bestPan = 0.0f, bestPitch = 1.0f;
+    for(int l = 0; l < scene->listenerCount; ++l) {
+      spatial_listener *listener = scene->listeners + l;
+      float dx = scene->x[i] - listener->position.x;
+      float dy = scene->y[i] - listener->position.y;
+      float dz = scene->z[i] - listener->position.z;
+      float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+      float attenuation = scene->minDistance[i] / SpatialMax(distance, scene->minDistance[i]);
+      float fade = SpatialMin(SpatialMax((scene->maxDistance[i] - distance) * scene->fadeScale[i], 0.0f), 1.0f);
+      float gain = scene->gain[i] * attenuation * fade;
+      float inverse = 1.0f / SpatialMax(distance, 1e-6f);
+      float side = (dx * listener->right.x + dy * listener->right.y + dz * listener->right.z) * inverse;
+      float pan = SpatialMin(SpatialMax(side, -1.0f), 1.0f);
+      // Speeds along the line from the listener to the emitter
+      float toward = (dx * listener->velocity.x + dy * listener->velocity.y + dz * listener->velocity.z) * inverse;
+      float away = (dx * scene->vx[i] + dy * scene->vy[i] + dz * scene->vz[i]) * inverse;
+      toward = SpatialMin(SpatialMax(toward, -0.5f * c), 0.5f * c);
+      away = SpatialMin(SpatialMax(away, -0.5f * c), 0.5f * c);
+      float doppler = (c + toward) / (c + away);
+      float pitch = scene->pitch[i] * SpatialMin(SpatialMax(doppler, 0.5f), 2.0f);
+      if(l == 0 || gain > bestGain) {
+        bestGain = gain;
+        bestPan = pan;
+        bestPitch = pitch;
+      }
+    }
+    scene->outGain[i] = bestGain;
+    scene->outPan[i] = bestPan;
+    scene->outPitch[i] = bestPitch;
+  }
+}
+
+static void SpatialSSE2(spatial_scene *scene, int count) {
+  __m128 c = _mm_set1_ps(SPATIAL_SPEED_OF_SOUND);
+  __m128 halfC = _mm_set1_ps(0.5f * SPATIAL_SPEED_OF_SOUND);
+  __m128 minusHalfC = _mm_set1_ps(-0.5f * SPATIAL_SPEED_OF_SOUND);
+  __m128 zero = _mm_setzero_ps();
+  __m128 one = _mm_set1_ps(1.0f);
+  __m128 minusOne = _mm_set1_ps(-1.0f);
+  __m128 tiny = _mm_set1_ps(1e-6f);
+  __m128 lowest = _mm_set1_ps(0.5f);
+  __m128 highest = _mm_set1_ps(2.0f);
+  for(int i = 0; i < count; i += 4) {
+    __m128 x = _mm_loadu_ps(scene->x + i);
+    __m128 y = _mm_loadu_ps(scene->y + i);
+    __m128 z = _mm_loadu_ps(scene->z + i);
+    __m128 minDistance = _mm_loadu_ps(scene->minDistance + i);
+    __m128 bestGain = zero, bestPan = zero, bestPitch = one;
+    for(int l = 0; l < scene->listenerCount; ++l) {
+      spatial_listener *listener = scene->listeners + l;
+      __m128 dx = _mm_sub_ps(x, _mm_set1_ps(listener->position.x));
+      __m128 dy = _mm_sub_ps(y, _mm_set1_ps(listener->position.y));
+      __m128 dz = _mm_sub_ps(z, _mm_set1_ps(listener->position.z));
+      __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+      __m128 attenuation = _mm_div_ps(minDistance, _mm_max_ps(distance, minDistance));
+      __m128 fade = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(scene->maxDistance + i), distance), _mm_loadu_ps(scene->fadeScale + i));
+      fade = _mm_min_ps(_mm_max_ps(fade, zero), one);
+      __m128 gain = _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(scene->gain + i), attenuation), fade);
+      __m128 inverse = _mm_div_ps(one, _mm_max_ps(distance, tiny));
+      __m128 side = _mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(dx, _mm_set1_ps(listener->right.x)), _mm_mul_ps(dy, _mm_set1_ps(listener->right.y))),
+        _mm_mul_ps(dz, _mm_set1_ps(listener->right.z)));
+      __m128 pan = _mm_min_ps(_mm_max_ps(_mm_mul_ps(side, inverse), minusOne), one);
+      __m128 toward = _mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(dx, _mm_set1_ps(listener->velocity.x)), _mm_mul_ps(dy, _mm_set1_ps(listener->velocity.y))),
+        _mm_mul_ps(dz, _mm_set1_ps(listener->velocity.z)));
+      __m128 away = _mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(dx, _mm_loadu_ps(scene->vx + i)), _mm_mul_ps(dy, _mm_loadu_ps(scene->vy + i))),
+        _mm_mul_ps(dz, _mm_loadu_ps(scene->vz + i)));
+      toward = _mm_min_ps(_mm_max_ps(_mm_mul_ps(toward, inverse), minusHalfC), halfC);
+      away = _mm_min_ps(_mm_max_ps(_mm_mul_ps(away, inverse), minusHalfC), halfC);
+      __m128 doppler = _mm_div_ps(_mm_add_ps(c, toward), _mm_add_ps(c, away));
+      __m128 pitch = _mm_mul_ps(_mm_loadu_ps(scene->pitch + i), _mm_min_ps(_mm_max_ps(doppler, lowest), highest));
+      __m128 take = l == 0 ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : _mm_cmpgt_ps(gain, bestGain);
+      bestGain = _mm_or_ps(_mm_and_ps(take, gain), _mm_andnot_ps(take, bestGain));
+      bestPan = _mm_or_ps(_mm_and_ps(take, pan), _mm_andnot_ps(take, bestPan));
+      bestPitch = _mm_or_ps(_mm_and_ps(take, pitch), _mm_andnot_ps(take, bestPitch));
+    }
+    _mm_storeu_ps(scene->outGain + i, bestGain);
+    _mm_storeu_ps(scene->outPan + i, bestPan);
+    _mm_storeu_ps(scene->outPitch + i, bestPitch);
+  }
+}
+
+RAIKA_TARGET_AVX2
+static void SpatialAVX2(spatial_scene *scene, int count) {
+  __m256 c = _mm256_set1_ps(SPATIAL_SPEED_OF_SOUND);
+  __m256 halfC = _mm256_set1_ps(0.5f * SPATIAL_SPEED_OF_SOUND);
+  __m256 minusHalfC = _mm256_set1_ps(-0.5f * SPATIAL_SPEED_OF_SOUND);
+  __m256 zero = _mm256_setzero_ps();
+  __m256 one = _mm256_set1_ps(1.0f);
+  __m256 minusOne = _mm256_set1_ps(-1.0f);
+  __m256 tiny = _mm256_set1_ps(1e-6f);
+  __m256 lowest = _mm256_set1_ps(0.5f);
+  __m256 highest = _mm256_set1_ps(2.0f);
+  for(int i = 0; i < count; i += 8) {
+    __m256 x = _mm256_loadu_ps(scene->x + i);
+    __m256 y = _mm256_loadu_ps(scene->y + i);
+    __m256 z = _mm256_loadu_ps(scene->z + i);
+    __m256 minDistance = _mm256_loadu_ps(scene->minDistance + i);
+    __m256 bestGain = zero, bestPan = zero, bestPitch = one;
+    for(int l = 0; l < scene->listenerCount; ++l) {
+      spatial_listener *listener = scene->listeners + l;
+      __m256 dx = _mm256_sub_ps(x, _mm256_set1_ps(listener->position.x));
+      __m256 dy = _mm256_sub_ps(y, _mm256_set1_ps(listener->position.y));
+      __m256 dz = _mm256_sub_ps(z, _mm256_set1_ps(listener->position.z));
+      __m256 distance = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+      __m256 attenuation = _mm256_div_ps(minDistance, _mm256_max_ps(distance, minDistance));
+      __m256 fade = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(scene->maxDistance + i), distance), _mm256_loadu_ps(scene->fadeScale + i));
+      fade = _mm256_min_ps(_mm256_max_ps(fade, zero), one);
+      __m256 gain = _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(scene->gain + i), attenuation), fade);
+      __m256 inverse = _mm256_div_ps(one, _mm256_max_ps(distance, tiny));
+      __m256 side = _mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(dx, _mm256_set1_ps(listener->right.x)), _mm256_mul_ps(dy, _mm256_set1_ps(listener->right.y))),
+        _mm256_mul_ps(dz, _mm256_set1_ps(listener->right.z)));
+      __m256 pan = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(side, inverse), minusOne), one);
+      __m256 toward = _mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(dx, _mm256_set1_ps(listener->velocity.x)), _mm256_mul_ps(dy, _mm256_set1_ps(listener->velocity.y))),
+        _mm256_mul_ps(dz, _mm256_set1_ps(listener->velocity.z)));
+      __m256 away = _mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(dx, _mm256_loadu_ps(scene->vx + i)), _mm256_mul_ps(dy, _mm256_loadu_ps(scene->vy + i))),
+        _mm256_mul_ps(dz, _mm256_loadu_ps(scene->vz + i)));
+      toward = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(toward, inverse), minusHalfC), halfC);
+      away = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(away, inverse), minusHalfC), halfC);
+      __m256 doppler = _mm256_div_ps(_mm256_add_ps(c, toward), _mm256_add_ps(c, away));
+      __m256 pitch = _mm256_mul_ps(_mm256_loadu_ps(scene->pitch + i), _mm256_min_ps(_mm256_max_ps(doppler, lowest), highest));
+      __m256 take = l == 0 ? _mm256_castsi256_ps(_mm256_set1_epi32(-1)) : _mm256_cmp_ps(gain, bestGain, _CMP_GT_OQ);
+      bestGain = _mm256_blendv_ps(bestGain, gain, take);
+      bestPan = _mm256_blendv_ps(bestPan, pan, take);
+      bestPitch = _mm256_blendv_ps(bestPitch, pitch, take);
+    }
+    _mm256_storeu_ps(scene->outGain + i, bestGain);
+    _mm256_storeu_ps(scene->outPan + i, bestPan);
+    _mm256_storeu_ps(scene->outPitch + i, bestPitch);
+  }
+}
+
+struct spatial_kernels {
+  const char *name;
+  spatial_kernel *spatialize;
+};
+
+// Ordered slowest to fastest, the last supported one wins
+static spatial_kernels GetSpatialKernels(int index) {
+  cpu_features *cpu = GetCpuFeatures();
+  spatial_kernels result = {};
+  switch(index) {
+    case 0: {
+      result.name = "scalar";
+      result.spatialize = SpatialScalar;
+    } break;
+    case 1: {
+      if(cpu->sse2) {
+        result.name = "sse2";
+        result.spatialize = SpatialSSE2;
+      }
+    } break;
+    case 2: {
+      if(cpu->avx2) {
+        result.name = "avx2";
+        result.spatialize = SpatialAVX2;
+      }
+    } break;
+  }
+  return result;
+}
+#define SPATIAL_KERNEL_COUNT 3
+
+static spatial_kernels globalSpatialKernels;
+
+static spatial_kernels *PickSpatialKernels() {
+  if(!globalSpatialKernels.name) {
+    for(int i = 0; i < SPATIAL_KERNEL_COUNT; ++i) {
+      spatial_kernels kernels = GetSpatialKernels(i);
+      if(kernels.name) {
+        globalSpatialKernels = kernels;
+      }
+    }
+  }
+  return &globalSpatialKernels;
+}
+
+// Culling
+// Moves the keep loudest entries of order to its front, by quickselect
+static void SelectLoudest(float *gains, uint16_t *order, int count, int keep) {
+  int low = 0, high = count - 1;
+  while(low < high) {
+    float pivot = gains[order[(low + high) / 2]];
+    int i = low, j = high;
+    while(i <= j) {
+      while(gains[order[i]] > pivot) {
+        ++i;
+      }
+      while(gains[order[j]] < pivot) {
+        --j;
+      }
+      if(i <= j) {
+        uint16_t swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+        ++i;
+        --j;
+      }
+    }
+    if(keep - 1 <= j) {
+      high = j;
+    } else if(keep - 1 >= i) {
+      low = i;
+    } else {
+      break;
+    }
+  }
+}
+
+// Once a frame: spatializes every emitter, then starts, updates and stops
+// mixer voices to match
+static void UpdateSpatialAudioWith(spatial_kernels *kernels, spatial_scene *scene, mixer *mix) {
+  int count = (scene->count + 7) & ~7;
+  if(scene->listenerCount) {
+    kernels->spatialize(scene, count);
+  } else {
+    memset(scene->outGain, 0, count * sizeof(float));
+  }
+
+  // One shots that played out stay silent until they are removed
+  int audible = 0;
+  for(int i = 0; i < scene->count; ++i) {
+    if(scene->voices[i] && !GetVoice(mix, scene->voices[i])) {
+      scene->voices[i] = 0;
+      scene->finished[i] = !scene->loop[i];
+    }
+    float threshold = scene->voices[i] ? 0.5f * SPATIAL_CULL_GAIN : SPATIAL_CULL_GAIN;
+    if(scene->used[i] && !scene->finished[i] && scene->outGain[i] >= threshold) {
+      scene->order[audible++] = (uint16_t) i;
+    }
+  }
+  scene->audibleCount = audible;
+  int keep = audible < scene->maxVoices ? audible : scene->maxVoices;
+  if(keep < audible) {
+    SelectLoudest(scene->outGain, scene->order, audible, keep);
+  }
+  scene->droppedCount = audible - keep;
+
+  // Everything past keep loses its voice, marked by a zero gain
+  for(int o = keep; o < audible; ++o) {
+    scene->outGain[scene->order[o]] = 0.0f;
+  }
+  int voiceCount = 0;
+  for(int i = 0; i < scene->count; ++i) {
+    bool wanted = scene->used[i] && scene->samples[i] && !scene->finished[i] && scene->outGain[i] >= 0.5f * SPATIAL_CULL_GAIN &&
+                  (scene->voices[i] || scene->outGain[i] >= SPATIAL_CULL_GAIN);
+    if(!wanted) {
+      if(scene->voices[i]) {
+        StopVoice(mix, scene->voices[i]);
+        scene->voices[i] = 0;
+      }
+      continue;
+    }
+    if(!scene->voices[i]) {
+      // Stays culled when the mixer is out of voices
+      scene->voices[i] = PlaySample(mix, scene->samples[i], scene->outGain[i], scene->outPan[i], scene->loop[i]);
+      SetVoiceGroup(mix, scene->voices[i], scene->groups[i]);
+    } else {
+      SetVoiceGain(mix, scene->voices[i], scene->outGain[i]);
+      SetVoicePan(mix, scene->voices[i], scene->outPan[i]);
+    }
+    SetVoicePitch(mix, scene->voices[i], scene->outPitch[i]);
+    voiceCount += scene->voices[i] != 0;
+  }
+  scene->voiceCount = voiceCount;
+}
+
+inline void UpdateSpatialAudio(spatial_scene *scene, mixer *mix) {
+  UpdateSpatialAudioWith(PickSpatialKernels(), scene, mix);
+}
+
+inline void FormatSpatialStats(spatial_scene *scene, char *out, int outSize) {
+  snprintf(
+    out, outSize, "  spatial %d emitters, %d audible, %d voices, %d over budget\n",
+    scene->count, scene->audibleCount, scene->voiceCount, scene->droppedCount
+  );
+}
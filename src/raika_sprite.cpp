@@ -0,0 +1,255 @@
+// Sprites
+// Sprites are loaded_bitmaps with premultiplied alpha, converted once at load
+// time so blending is dest = source + dest * (255 - alpha) / 255 with no
+// per pixel multiply of the source.
+
+static void PremultiplyBitmap(loaded_bitmap *bitmap) {
+  uint8_t *row = (uint8_t *) bitmap->memory;
+  for(int y = 0; y < bitmap->height; ++y) {
+    uint32_t *pixel = (uint32_t *) row;
+    for(int x = 0; x < bitmap->width; ++x) {
+      uint32_t color = pixel[x];
+      uint32_t a = color >> 24;
+      uint32_t r = (((color >> 16) & 0xFF) * a + 127) / 255;
+      uint32_t g = (((color >> 8) & 0xFF) * a + 127) / 255;
+      uint32_t b = ((color & 0xFF) * a + 127) / 255;
+      pixel[x] = (a << 24) | (r << 16) | (g << 8) | b;
+    }
+    row += bitmap->pitch;
+  }
+}
+
+inline loaded_bitmap ReadSprite(char *filename) {
+  loaded_bitmap result = ReadBitmap(filename);
+  if(result.memory) {
+    PremultiplyBitmap(&result);
+  }
+  return result;
+}
+
+// Row kernels
+// Blend kernels must match the scalar version bit for bit. Groups of pixels
+// that are all transparent or all opaque skip the multiply.
+typedef void sprite_row_kernel(uint32_t *dest, uint32_t *source, int count);
+
+static void SpriteRowCopy(uint32_t *dest, uint32_t *source, int count) {
+  memcpy(dest, source, count * sizeof(uint32_t));
+}
+
+// x * (255 - a) / 255 rounded, without a divide
+inline uint32_t BlendPremultiplied(uint32_t dest, uint32_t source) {
+  uint32_t alpha = source >> 24;
+  if(alpha == 0) {
+    return dest;
+  }
+  if(alpha == 255) {
+    return source;
+  }
+  uint32_t inverse = 255 - alpha;
+  uint32_t result = 0;
+  for(int shift = 0; shift < 32; shift += 8) {
+    uint32_t t = ((dest >> shift) & 0xFF) * inverse + 128;
+    uint32_t c = ((t + (t >> 8)) >> 8) + ((source >> shift) & 0xFF);
+    result |= (c > 255 ? 255 : c) << shift;
+  }
+  return result;
+}
+
+static void SpriteRowBlendScalar(uint32_t *dest, uint32_t *source, int count) {
+  for(int x = 0; x < count; ++x) {
+    dest[x] = BlendPremultiplied(dest[x], source[x]);
+  }
+}
+
+static void SpriteRowBlendSSE2(uint32_t *dest, uint32_t *source, int count) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i alphaMask = _mm_set1_epi32(0xFF000000);
+  __m128i max = _mm_set1_epi16(255);
+  __m128i round = _mm_set1_epi16(128);
+
+  int x = 0;
+  for(; x + 4 <= count; x += 4) {
+    __m128i s = _mm_loadu_si128((__m128i *) (source + x));
+    __m128i alpha = _mm_and_si128(s, alphaMask);
+    if(_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero)) == 0xFFFF) {
+      continue;
+    }
+    if(_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, alphaMask)) == 0xFFFF) {
+      _mm_storeu_si128((__m128i *) (dest + x), s);
+      continue;
+    }
+
+    __m128i d = _mm_loadu_si128((__m128i *) (dest + x));
+    __m128i sLo = _mm_unpacklo_epi8(s, zero);
+    __m128i sHi = _mm_unpackhi_epi8(s, zero);
+    __m128i inverseLo = _mm_sub_epi16(max, _mm_shufflehi_epi16(_mm_shufflelo_epi16(sLo, 0xFF), 0xFF));
+    __m128i inverseHi = _mm_sub_epi16(max, _mm_shufflehi_epi16(_mm_shufflelo_epi16(sHi, 0xFF), 0xFF));
+    __m128i tLo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), inverseLo), round);
+    __m128i tHi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), inverseHi), round);
+    tLo = _mm_srli_epi16(_mm_add_epi16(tLo, _mm_srli_epi16(tLo, 8)), 8);
+    tHi = _mm_srli_epi16(_mm_add_epi16(tHi, _mm_srli_epi16(tHi, 8)), 8);
+    _mm_storeu_si128((__m128i *) (dest + x), _mm_adds_epu8(_mm_packus_epi16(tLo, tHi), s));
+  }
+  SpriteRowBlendScalar(dest + x, source + x, count - x);
+}
+
+RAIKA_TARGET_AVX2
+static void SpriteRowBlendAVX2(uint32_t *dest, uint32_t *source, int count) {
+  __m256i zero = _mm256_setzero_si256();
+  __m256i alphaMask = _mm256_set1_epi32(0xFF000000);
+  __m256i max = _mm256_set1_epi16(255);
+  __m256i round = _mm256_set1_epi16(128);
+
+  int x = 0;
+  for(; x + 8 <= count; x += 8) {
+    __m256i s = _mm256_loadu_si256((__m256i *) (source + x));
+    __m256i alpha = _mm256_and_si256(s, alphaMask);
+    if(_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, zero)) == -1) {
+      continue;
+    }
+    if(_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, alphaMask)) == -1) {
+      _mm256_storeu_si256((__m256i *) (dest + x), s);
+      continue;
+    }
+
+    // Unpack and pack both work within 128 bit lanes, so pixel order survives
+    __m256i d = _mm256_loadu_si256((__m256i *) (dest + x));
+    __m256i sLo = _mm256_unpacklo_epi8(s, zero);
+    __m256i sHi = _mm256_unpackhi_epi8(s, zero);
+    __m256i inverseLo = _mm256_sub_epi16(max, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(sLo, 0xFF), 0xFF));
+    __m256i inverseHi = _mm256_sub_epi16(max, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(sHi, 0xFF), 0xFF));
+    __m256i tLo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), inverseLo), round);
+    __m256i tHi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), inverseHi), round);
+    tLo = _mm256_srli_epi16(_mm256_add_epi16(tLo, _mm256_srli_epi16(tLo, 8)), 8);
+    tHi = _mm256_srli_epi16(_mm256_add_epi16(tHi, _mm256_srli_epi16(tHi, 8)), 8);
+    _mm256_storeu_si256((__m256i *) (dest + x), _mm256_adds_epu8(_mm256_packus_epi16(tLo, tHi), s));
+  }
+  // GCC turns this into a tail jump without clearing the upper halves, and
+  // the legacy SSE code after it then pays for the dirty AVX state
+  _mm256_zeroupper();
+  SpriteRowBlendSSE2(dest + x, source + x, count - x);
+}
+
+struct sprite_kernel_info {
+  const char *name;
+  sprite_row_kernel *kernel;
+};
+
+// Ordered slowest to fastest, the last supported one wins
+static sprite_kernel_info GetSpriteBlendKernel(int index) {
+  cpu_features *cpu = GetCpuFeatures();
+  sprite_kernel_info result = {};
+  switch(index) {
+    case 0: {
+      result.name = "scalar";
+      result.kernel = SpriteRowBlendScalar;
+    } break;
+    case 1: {
+      if(cpu->sse2) {
+        result.name = "sse2";
+        result.kernel = SpriteRowBlendSSE2;
+      }
+    } break;
+    case 2: {
+      if(cpu->avx2) {
+        result.name = "avx2";
+        result.kernel = SpriteRowBlendAVX2;
+      }
+    } break;
+  }
+  return result;
+}
+#define SPRITE_KERNEL_COUNT 3
+
+static sprite_row_kernel *globalSpriteBlendRow;
+
+static sprite_row_kernel *PickSpriteBlendKernel() {
+  if(!globalSpriteBlendRow) {
+    for(int i = 0; i < SPRITE_KERNEL_COUNT; ++i) {
+      sprite_kernel_info info = GetSpriteBlendKernel(i);
+      if(info.kernel) {
+        globalSpriteBlendRow = info.kernel;
+      }
+    }
+  }
+  return globalSpriteBlendRow;
+}
+
+// Blitting
+// Scaled sprites are expanded one source row at a time into a small span on
+// the stack and that span is written to scale destination rows.
+#define SPRITE_SPAN_WIDTH 256
+
+static void DrawSpriteWith(
+    sprite_row_kernel *kernel,
+    graphics_buffer *buffer,
+    graphics_rect clip,
+    loaded_bitmap *sprite,
+    int x, int y,
+    int scale
+) {
+  if(!sprite->memory || scale < 1) {
+    return;
+  }
+  graphics_rect bounds = {0, 0, buffer->width, buffer->height};
+  graphics_rect dest = {x, y, sprite->width * scale, sprite->height * scale};
+  graphics_rect visible = IntersectRect(IntersectRect(clip, bounds), dest);
+  if(RectIsEmpty(visible)) {
+    return;
+  }
+
+  int offsetX = visible.x - x;
+  int offsetY = visible.y - y;
+  uint8_t *destRow = (uint8_t *) buffer->memory + (size_t) visible.y * buffer->pitch + visible.x * 4;
+
+  if(scale == 1) {
+    uint8_t *sourceRow = (uint8_t *) sprite->memory + offsetY * sprite->pitch + offsetX * 4;
+    for(int row = 0; row < visible.height; ++row) {
+      kernel((uint32_t *) destRow, (uint32_t *) sourceRow, visible.width);
+      destRow += buffer->pitch;
+      sourceRow += sprite->pitch;
+    }
+    return;
+  }
+
+  uint32_t span[SPRITE_SPAN_WIDTH];
+  for(int row = 0; row < visible.height;) {
+    int sourceY = (offsetY + row) / scale;
+    int repeat = scale - (offsetY + row) % scale;
+    repeat = repeat < visible.height - row ? repeat : visible.height - row;
+    uint32_t *sourceRow = (uint32_t *) ((uint8_t *) sprite->memory + sourceY * sprite->pitch);
+
+    for(int start = 0; start < visible.width; start += SPRITE_SPAN_WIDTH) {
+      int count = visible.width - start;
+      count = count < SPRITE_SPAN_WIDTH ? count : SPRITE_SPAN_WIDTH;
+      int sourceX = (offsetX + start) / scale;
+      int phase = (offsetX + start) % scale;
+      for(int i = 0; i < count; ++i) {
+        span[i] = sourceRow[sourceX];
+        if(++phase == scale) {
+          phase = 0;
+          ++sourceX;
+        }
+      }
+      uint8_t *spanRow = destRow + start * 4;
+      for(int r = 0; r < repeat; ++r) {
+        kernel((uint32_t *) spanRow, span, count);
+        spanRow += buffer->pitch;
+      }
+    }
+    destRow += repeat * buffer->pitch;
+    row += repeat;
+  }
+}
+
+// Alpha blended, clipped to the buffer
+inline void DrawSprite(graphics_buffer *buffer, loaded_bitmap *sprite, int x, int y, int scale) {
+  graphics_rect clip = {0, 0, buffer->width, buffer->height};
+  DrawSpriteWith(PickSpriteBlendKernel(), buffer, clip, sprite, x, y, scale);
+}
+
+// Ignores alpha, for backgrounds and tiles
+inline void DrawSpriteOpaque(graphics_buffer *buffer, loaded_bitmap *sprite, int x, int y, int scale) {
+  graphics_rect clip = {0, 0, buffer->width, buffer->height};
+  DrawSpriteWith(SpriteRowCopy, buffer, clip, sprite, x, y, scale);
+}
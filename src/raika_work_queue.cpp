@@ -0,0 +1,209 @@
+// Work queue shared by the platform layers. Include after raika.cpp.
+//
+// Single producer (the game thread), many consumers. Workers sleep on a
+// semaphore while the queue is empty and the thread that calls
+// PlatformCompleteAllWork helps drain it instead of blocking.
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#define WORK_QUEUE_ENTRY_COUNT 1024
+#define WORK_QUEUE_MAX_THREADS 16
+
+// The ring keeps one entry empty to tell full from empty, and the game
+// queues this many entries at most before waiting on them
+static_assert(RENDER_TILE_MAX <= WORK_QUEUE_ENTRY_COUNT - 1, "render tiles overflow the work queue");
+static_assert(SCALE_MAX_WORK <= WORK_QUEUE_ENTRY_COUNT - 1, "scale bands overflow the work queue");
+
+struct platform_work_queue_entry {
+  platform_work_callback *callback;
+  void *data;
+};
+
+// Index 0 is whichever thread calls PlatformCompleteAllWork, workers are 1..n
+struct platform_work_thread_stats {
+  uint64_t busyNanos;
+  uint32_t entriesDone;
+};
+
+struct work_thread_info {
+  platform_work_queue *queue;
+  int threadIndex;
+};
+
+struct platform_work_queue {
+  volatile uint32_t completionGoal;
+  volatile uint32_t completionCount;
+  volatile uint32_t nextEntryToWrite;
+  volatile uint32_t nextEntryToRead;
+#if defined(_WIN32)
+  HANDLE semaphore;
+#else
+  sem_t semaphore;
+#endif
+  int threadCount;
+  platform_work_thread_stats stats[WORK_QUEUE_MAX_THREADS + 1];
+  work_thread_info threadInfo[WORK_QUEUE_MAX_THREADS];
+  platform_work_queue_entry entries[WORK_QUEUE_ENTRY_COUNT];
+};
+
+static uint64_t WorkQueueNanos() {
+#if defined(_WIN32)
+  LARGE_INTEGER counter, frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (uint64_t) ((double) counter.QuadPart * 1e9 / (double) frequency.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static int GetLogicalProcessorCount() {
+#if defined(_WIN32)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (int) info.dwNumberOfProcessors;
+#else
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (int) count : 1;
+#endif
+}
+
+static void PlatformAddWorkEntry(platform_work_queue *queue, platform_work_callback *callback, void *data) {
+  uint32_t newNextEntryToWrite = (queue->nextEntryToWrite + 1) % WORK_QUEUE_ENTRY_COUNT;
+  Assert(newNextEntryToWrite != queue->nextEntryToRead);
+  platform_work_queue_entry *entry = queue->entries + queue->nextEntryToWrite;
+  entry->callback = callback;
+  entry->data = data;
+  ++queue->completionGoal;
+  WriteBarrier();
+  queue->nextEntryToWrite = newNextEntryToWrite;
+#if defined(_WIN32)
+  ReleaseSemaphore(queue->semaphore, 1, 0);
+#else
+  sem_post(&queue->semaphore);
+#endif
+}
+
+// Returns true when there was nothing to do
+static bool DoNextWorkQueueEntry(platform_work_queue *queue, int threadIndex) {
+  bool shouldSleep = false;
+
+  uint32_t originalNextEntryToRead = queue->nextEntryToRead;
+  uint32_t newNextEntryToRead = (originalNextEntryToRead + 1) % WORK_QUEUE_ENTRY_COUNT;
+  if(originalNextEntryToRead != queue->nextEntryToWrite) {
+    uint32_t index = AtomicCompareExchangeU32(
+      &queue->nextEntryToRead, newNextEntryToRead, originalNextEntryToRead
+    );
+    if(index == originalNextEntryToRead) {
+      ReadBarrier();
+      platform_work_queue_entry entry = queue->entries[index];
+      uint64_t start = WorkQueueNanos();
+      entry.callback(queue, entry.data);
+      platform_work_thread_stats *stats = queue->stats + threadIndex;
+      stats->busyNanos += WorkQueueNanos() - start;
+      ++stats->entriesDone;
+      AtomicAddU32(&queue->completionCount, 1);
+    }
+  } else {
+    shouldSleep = true;
+  }
+
+  return shouldSleep;
+}
+
+static void PlatformCompleteAllWork(platform_work_queue *queue) {
+  while(queue->completionGoal != queue->completionCount) {
+    DoNextWorkQueueEntry(queue, 0);
+  }
+  queue->completionGoal = 0;
+  queue->completionCount = 0;
+}
+
+static void ResetWorkQueueStats(platform_work_queue *queue) {
+  for(int i = 0; i <= queue->threadCount; ++i) {
+    queue->stats[i] = {};
+  }
+}
+
+// Writes one line per thread that did any work into out
+inline void FormatWorkQueueStats(platform_work_queue *queue, char *out, int outSize) {
+  int written = 0;
+  for(int i = 0; i <= queue->threadCount && written < outSize; ++i) {
+    platform_work_thread_stats *stats = queue->stats + i;
+    if(stats->entriesDone) {
+      written += snprintf(
+        out + written, outSize - written, "  thread %2d: %4u entries %8.3fms\n",
+        i, stats->entriesDone, (double) stats->busyNanos / 1e6
+      );
+    }
+  }
+  if(written == 0 && outSize > 0) {
+    out[0] = 0;
+  }
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI WorkThreadProc(LPVOID param) {
+  work_thread_info *info = (work_thread_info *) param;
+  for(;;) {
+    if(DoNextWorkQueueEntry(info->queue, info->threadIndex)) {
+      WaitForSingleObjectEx(info->queue->semaphore, INFINITE, FALSE);
+    }
+  }
+}
+#else
+static void *WorkThreadProc(void *param) {
+  work_thread_info *info = (work_thread_info *) param;
+  for(;;) {
+    if(DoNextWorkQueueEntry(info->queue, info->threadIndex)) {
+      sem_wait(&info->queue->semaphore);
+    }
+  }
+  return 0;
+}
+#endif
+
+// Starts threadCount workers. Zero is valid, the queue then runs everything
+// inside PlatformCompleteAllWork on the calling thread.
+static void MakeWorkQueue(platform_work_queue *queue, int threadCount) {
+  if(threadCount > WORK_QUEUE_MAX_THREADS) {
+    threadCount = WORK_QUEUE_MAX_THREADS;
+  }
+  if(threadCount < 0) {
+    threadCount = 0;
+  }
+  queue->completionGoal = 0;
+  queue->completionCount = 0;
+  queue->nextEntryToWrite = 0;
+  queue->nextEntryToRead = 0;
+  queue->threadCount = threadCount;
+#if defined(_WIN32)
+  queue->semaphore = CreateSemaphoreEx(0, 0, threadCount ? threadCount : 1, 0, 0, SEMAPHORE_ALL_ACCESS);
+#else
+  sem_init(&queue->semaphore, 0, 0);
+#endif
+  ResetWorkQueueStats(queue);
+
+  for(int i = 0; i < threadCount; ++i) {
+    work_thread_info *info = queue->threadInfo + i;
+    info->queue = queue;
+    info->threadIndex = i + 1;
+#if defined(_WIN32)
+    HANDLE thread = CreateThread(0, 0, WorkThreadProc, info, 0, 0);
+    CloseHandle(thread);
+#else
+    pthread_t thread;
+    pthread_create(&thread, 0, WorkThreadProc, info);
+    pthread_detach(thread);
+#endif
+  }
+}
@@ -1,22 +1,23 @@
+#include "raika.cpp"
+
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_vulkan.h>
 #include <vulkan/vulkan.h>
 
-#define GLM_FORCE_RADIANS
-#define GLM_FORCE_DEPTH_ZERO_TO_ONE
-#define GLM_FORCE_LEFT_HANDED
-#include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtx/string_cast.hpp>
-
 #include <stdlib.h>
 #include <malloc.h>
 #include <cstring>
 #include <string>
 #include <set>
+#if defined(_WIN32)
+#include <windows.h>
+#endif
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#include "raika_work_queue.cpp"
+#include "raika_audio_stats.cpp"
+#include "raika_audio_ring.cpp"
+#include "raika_game_memory.cpp"
+#include "raika_file_queue.cpp"
 
 // Debug macros
 #ifdef RAIKA_DEBUG
@@ -31,12 +32,84 @@
 #define DBG_LOGERROR(...) do{} while(0)
 #endif
 
+// Platform file IO
+// Windows reads through SDL and maps through the OS, everywhere else shares
+// the POSIX layers' files, which map whole file reads too
+#if defined(_WIN32)
+static bool PlatformWriteFile(char * filename, file_data file) {
+  bool ret = false;
+  SDL_RWops* rw = SDL_RWFromFile(filename, "wb");
+  if(rw) {
+    ret = SDL_RWwrite(rw, file.memory, 1, file.size) == file.size;
+    SDL_RWclose(rw);
+  }
+  return ret;
+}
+
+static file_data PlatformReadFile(char * filename) {
+  file_data file = {};
+  size_t size = 0;
+  file.memory = SDL_LoadFile(filename, &size);
+  if(file.memory) {
+    file.size = (uint64_t) size;
+  }
+  return file;
+}
+
+static void PlatformFreeFile(file_data file) {
+  if(file.memory) {
+    SDL_free(file.memory);
+  }
+}
+
+static mapped_file PlatformMapFile(char * filename) {
+  mapped_file file = {};
+  HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+  if(handle != INVALID_HANDLE_VALUE) {
+    LARGE_INTEGER fileSize;
+    if(GetFileSizeEx(handle, &fileSize) && fileSize.QuadPart > 0) {
+      HANDLE mapping = CreateFileMappingA(handle, 0, PAGE_READONLY, 0, 0, 0);
+      if(mapping) {
+        file.memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if(file.memory) {
+          file.size = fileSize.QuadPart;
+        }
+        CloseHandle(mapping);
+      }
+    }
+    CloseHandle(handle);
+  }
+  return file;
+}
+
+static void PlatformPrefetchFile(mapped_file *file, uint64_t offset, uint64_t size) {
+  if(file->memory && offset < file->size) {
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = (uint8_t *) file->memory + offset;
+    range.NumberOfBytes = (SIZE_T) (offset + size < file->size ? size : file->size - offset);
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+  }
+}
+
+static void PlatformEvictFile(mapped_file *file, uint64_t offset, uint64_t size) {
+  if(file->memory && offset < file->size) {
+    VirtualUnlock((uint8_t *) file->memory + offset, (SIZE_T) (offset + size < file->size ? size : file->size - offset));
+  }
+}
+
+static void PlatformUnmapFile(mapped_file *file) {
+  if(file->memory) {
+    UnmapViewOfFile(file->memory);
+  }
+  *file = {};
+}
+#else
+#include "raika_posix_file.cpp"
+#endif
+
 // Structs
-struct Vertex {
-  glm::vec3 pos;
-  glm::vec3 color;
-  glm::vec2 texPos;
-};
+typedef render_vertex Vertex;
 
 struct FrameData {
   VkSemaphore imgAvlSem, rndFnsdSem;
@@ -50,12 +123,60 @@ struct FrameData {
   void* ubMapped; 
 };
 
+// std140 column major, set from the frame's camera command
 struct ViewData {
-  glm::mat4 model;
-  glm::mat4 view;
-  glm::mat4 proj;
+  float view[16];
+  float proj[16];
+};
+
+// Per draw, pushed as a constant
+struct MeshData {
+  float model[16];
+};
+
+// Out of the asset pack, a view into its mapping unless it had to be
+// decompressed. Without a pack, or when it lacks the asset, the loose file
+// is read instead.
+struct PackedAsset {
+  void* data;
+  uint64_t size;
+  bool owned;
+  file_data file;
+};
+
+// GPU copy of a render_mesh, made the first time a command draws it
+struct VulkanMesh {
+  render_mesh *source;
+  uint32_t indexCount;
+  VkBuffer vertexBuffer;
+  VkDeviceMemory vertexMemory;
+  VkBuffer indexBuffer;
+  VkDeviceMemory indexMemory;
+};
+
+// GPU copy of a sprite's bitmap, made the first time a command draws it
+struct VulkanSprite {
+  loaded_bitmap *source;
+  VkImage image;
+  VkDeviceMemory memory;
+  VkImageView view;
+  VkDescriptorSet set;
 };
 
+// Per 2D draw, pushed as a constant laid out as the quad shaders declare it.
+// rect is in pixels and color is premultiplied, converted for the swapchain.
+struct QuadData {
+  float rect[4];
+  float color[4];
+  float extent[2];
+  int32_t gradientOffset[2];
+  int32_t mode;
+  int32_t srgbTarget;
+};
+
+static const int32_t QUAD_MODE_COLOR = 0;
+static const int32_t QUAD_MODE_GRADIENT = 1;
+
 // Constants
 static const char *TITLE = "Raika";
 #ifdef VULKAN_DEBUG
@@ -74,26 +195,22 @@ static const char* ACTIVE_DEV_EXTENSIONS[1] = {
 };
 static const int ACTIVE_DEV_EXTENSION_COUNT = 1;
 static const int FPS = 60;
-static const Vertex VERTICES[8] = {
-  {{-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
-  {{0.5f, -0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
-  {{0.5f, 0.5f, -0.5f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
-  {{-0.5f, 0.5f, -0.5f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}},
-
-  {{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
-  {{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
-  {{0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
-  {{-0.5f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}}
-};
-static const uint32_t INDICES[12] = {
-  0, 1, 2, 2, 3, 0,
-  4, 5, 6, 6, 7, 4
-};
-static const uint32_t VERTEX_COUNT = 8;
-static const uint32_t INDEX_COUNT = 12;
+// Geometry is shared with the software rasterizer in the game layer
 static const uint32_t FRAME_COUNT = 2;
+static const uint32_t MAX_MESHES = 16;
+static const uint32_t MAX_SPRITES = 64;
+// Uniform buffer slices per frame, the first is the identity for meshes
+// drawn before any camera
+static const uint32_t MAX_CAMERAS = 16;
 static const uint32_t HEIGHT = 500;
 static const uint32_t WIDTH = 500;
+// The device pulls AUDIO_DEVICE_SAMPLES at a time from the ring, and the game
+// keeps the ring that plus AUDIO_LEAD_FRAMES frames of audio ahead of it
+static const int AUDIO_SAMPLES_PER_SECOND = 48000;
+static const int AUDIO_CHANNELS = 2;
+static const int AUDIO_DEVICE_SAMPLES = 512;
+static const int AUDIO_LEAD_FRAMES = 2;
+static const uint32_t AUDIO_RING_SAMPLES = 8192;
 
 // Globals
 static bool running = false;
@@ -112,6 +229,7 @@ static VkImageView* vulkanImageViews = NULL;
 static VkImage vulkanTextureImage = NULL;
 static VkImageView vulkanTextureImageView = NULL;
 static VkSampler vulkanTextureImageSampler = NULL;
+static uint32_t vulkanTextureMipLevels = 1;
 static VkShaderModule vertModule = NULL;
 static VkShaderModule fragModule = NULL;
 static VkRenderPass vulkanRenderPass = NULL;
@@ -120,13 +238,23 @@ static VkDescriptorPool vulkanDescriptorPool = NULL;
 static VkDescriptorSet vulkanDescriptorSets[FRAME_COUNT] = {};
 static VkPipelineLayout vulkanPipelineLayout = NULL;
 static VkPipeline vulkanGraphicsPipeline = NULL;
+static VkShaderModule quadVertModule = NULL;
+static VkShaderModule quadFragModule = NULL;
+static VkShaderModule spriteFragModule = NULL;
+static VkDescriptorSetLayout vulkanSpriteSetLayout = NULL;
+static VkDescriptorPool vulkanSpriteDescriptorPool = NULL;
+static VkPipelineLayout vulkanQuadPipelineLayout = NULL;
+static VkPipeline vulkanQuadPipeline = NULL;
+static VkPipeline vulkanSpritePipeline = NULL;
+// Between camera slices of a frame's uniform buffer
+static VkDeviceSize viewDataStride = 0;
 static VkCommandPool vulkanGlobalCB = NULL;
 static FrameData vulkanFrames[FRAME_COUNT] = {};
 static VkFramebuffer* vulkanFramebuffers = NULL;
-static VkBuffer vulkanVertexBuffer = NULL;
-static VkBuffer vulkanIndexBuffer = NULL;
-static VkDeviceMemory vulkanVertexDeviceMemory = NULL;
-static VkDeviceMemory vulkanIndexDeviceMemory = NULL;
+static VulkanMesh vulkanMeshes[MAX_MESHES] = {};
+static uint32_t vulkanMeshCount = 0;
+static VulkanSprite vulkanSprites[MAX_SPRITES] = {};
+static uint32_t vulkanSpriteCount = 0;
 static VkDeviceMemory vulkanTextureImageMemory = NULL;
 static VkInstance vulkanInstance = NULL;
 static VkDevice vulkanLogicalDevice = NULL;
@@ -135,8 +263,21 @@ static VkQueue vulkanPresentQueue = NULL;
 static VkDebugUtilsMessengerEXT debugMessenger = NULL;
 static VkPhysicalDevice vulkanPhysicalDevice = VK_NULL_HANDLE;
 static VkResult res = VK_SUCCESS;
+static game_memory gameMemory = {};
+static platform_file_queue fileQueue = {};
+static mapped_file assetPackFile = {};
+static asset_pack assetPack = {};
+static render_commands renderCommands = {};
 static uint32_t graphicsQueueIndex = 0;
 static uint32_t presentQueueIndex = 0;
+static SDL_AudioDeviceID audioDevice = 0;
+static SDL_AudioSpec audioSpec = {};
+static audio_ring audioRing = {};
+static int16_t audioRingMemory[AUDIO_RING_SAMPLES * AUDIO_CHANNELS];
+// Where the game writes before it is copied into the ring
+static int16_t audioStaging[AUDIO_RING_SAMPLES * AUDIO_CHANNELS];
+static bool audioStarted = false;
+static audio_recorder audioRecorder = {};
 
 // Function load macro
 #define LOAD_VK_FN(INSTANCE, NAME) do { \
@@ -212,6 +353,9 @@ static PFN_vkCmdSetScissor fnCmdSetScissor = NULL;
 static PFN_vkCmdCopyBuffer fnCmdCopyBuffer = NULL;
 static PFN_vkCmdCopyBufferToImage fnCmdCopyBufferToImage = NULL;
 static PFN_vkCmdDrawIndexed fnCmdDrawIndexed = NULL;
+static PFN_vkCmdDraw fnCmdDraw = NULL;
+static PFN_vkCmdPushConstants fnCmdPushConstants = NULL;
+static PFN_vkCmdClearAttachments fnCmdClearAttachments = NULL;
 static PFN_vkCmdEndRenderPass fnCmdEndRenderPass = NULL;
 static PFN_vkCmdPipelineBarrier fnCmdPipelineBarrier = NULL;
 static PFN_vkEndCommandBuffer fnEndCommandBuffer = NULL;
@@ -295,6 +439,9 @@ int loadVulkanFns() {
   LOAD_VK_FN(vulkanInstance, CmdCopyBuffer);
   LOAD_VK_FN(vulkanInstance, CmdCopyBufferToImage);
   LOAD_VK_FN(vulkanInstance, CmdDrawIndexed);
+  LOAD_VK_FN(vulkanInstance, CmdDraw);
+  LOAD_VK_FN(vulkanInstance, CmdPushConstants);
+  LOAD_VK_FN(vulkanInstance, CmdClearAttachments);
   LOAD_VK_FN(vulkanInstance, CmdEndRenderPass);
   LOAD_VK_FN(vulkanInstance, CmdPipelineBarrier);
   LOAD_VK_FN(vulkanInstance, EndCommandBuffer);
@@ -430,28 +577,33 @@ int copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size) {
   return 0;
 }
 
-int copyBufferToImage(VkBuffer src, VkImage dst, uint32_t width, uint32_t height) {
+// One region per level, each straight out of the cooked layout
+int copyBufferToImage(VkBuffer src, VkImage dst, cooked_texture_header* texture) {
   VkCommandBuffer cb;
   beginSingleCommandBuffer(&cb);
 
-  VkBufferImageCopy bic = {};
-  bic.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  bic.imageSubresource.baseArrayLayer = 0;
-  bic.imageSubresource.layerCount = 1;
-  bic.imageSubresource.mipLevel = 0;
-
-  bic.imageExtent.width = width;
-  bic.imageExtent.height = height;
-  bic.imageExtent.depth = 1;
-  bic.imageOffset.x = 0;
-  bic.imageOffset.y = 0;
-  bic.imageOffset.z = 0;
-
-  bic.bufferOffset = 0;
-  bic.bufferImageHeight = 0;
-  bic.bufferRowLength = 0;
+  VkBufferImageCopy bics[COOKED_TEXTURE_MAX_MIPS] = {};
+  for(uint32_t level = 0; level < texture->mipCount; ++level) {
+    cooked_texture_mip* mip = &texture->mips[level];
+    VkBufferImageCopy* bic = &bics[level];
+    bic->imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    bic->imageSubresource.baseArrayLayer = 0;
+    bic->imageSubresource.layerCount = 1;
+    bic->imageSubresource.mipLevel = level;
+
+    bic->imageExtent.width = mip->width;
+    bic->imageExtent.height = mip->height;
+    bic->imageExtent.depth = 1;
+    bic->imageOffset.x = 0;
+    bic->imageOffset.y = 0;
+    bic->imageOffset.z = 0;
+
+    bic->bufferOffset = mip->offset;
+    bic->bufferImageHeight = 0;
+    bic->bufferRowLength = mip->rowPitch / 4;
+  }
 
-  fnCmdCopyBufferToImage(cb, src, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bic);
+  fnCmdCopyBufferToImage(cb, src, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture->mipCount, bics);
 
   endSingleCommandBuffer(&cb);
   return 0;
@@ -597,7 +749,7 @@ int initSwapchain() {
   return 0;
 }
 
-int createImageView(VkImage image, VkFormat format, VkImageView* imageView) {
+int createImageView(VkImage image, VkFormat format, uint32_t mipLevels, VkImageView* imageView) {
   VkImageViewCreateInfo ivci = {};
     ivci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     ivci.pNext = NULL;
@@ -611,7 +763,7 @@ int createImageView(VkImage image, VkFormat format, VkImageView* imageView) {
     ivci.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
     ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     ivci.subresourceRange.baseMipLevel = 0;
-    ivci.subresourceRange.levelCount = 1;
+    ivci.subresourceRange.levelCount = mipLevels;
     ivci.subresourceRange.baseArrayLayer = 0;
     ivci.subresourceRange.layerCount = 1;
 
@@ -639,7 +791,7 @@ int initImageViews() {
   // Get image views from images
   vulkanImageViews = (VkImageView*) malloc(sizeof(VkImageView) * vulkanSwapchainImageCount);
   for(uint32_t i = 0; i < vulkanSwapchainImageCount; i++) {
-    createImageView(vulkanSwapchainImages[i], swapchainImageFormat, &vulkanImageViews[i]);
+    createImageView(vulkanSwapchainImages[i], swapchainImageFormat, 1, &vulkanImageViews[i]);
   }
   DBG_LOG("Successfully created image views.\n");
   return 0;
@@ -754,7 +906,7 @@ int createDoubleBuffer(VkBuffer* buffer, VkDeviceMemory* devMem, VkDeviceSize si
   return 0;
 }
 
-int transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
+int transitionImageLayout(VkImage image, VkFormat format, uint32_t mipLevels, VkImageLayout oldLayout, VkImageLayout newLayout) {
   VkCommandBuffer cb = NULL;
   beginSingleCommandBuffer(&cb);
 
@@ -772,7 +924,7 @@ int transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayou
   imb.subresourceRange.baseArrayLayer = 0;
   imb.subresourceRange.baseMipLevel = 0;
   imb.subresourceRange.layerCount = 1;
-  imb.subresourceRange.levelCount = 1;
+  imb.subresourceRange.levelCount = mipLevels;
   
   if(oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
     imb.srcAccessMask = 0;
@@ -801,7 +953,7 @@ int transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayou
   return 0;
 }
 
-int createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, 
+int createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, 
                 VkMemoryPropertyFlags properties, VkImageUsageFlags usage, VkImage* image, VkDeviceMemory* imageMem) {
   VkImageCreateInfo ici = {};
   ici.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -811,7 +963,7 @@ int createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling
   ici.extent.width = width;
   ici.extent.height = height;
   ici.extent.depth = 1;
-  ici.mipLevels = 1;
+  ici.mipLevels = mipLevels;
   ici.arrayLayers = 1;
   ici.format = format;
   ici.tiling = tiling;
@@ -842,35 +994,125 @@ int createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling
   return 0;
 }
 
+// The loose file is looked for at loosePath under the base path, at name
+// when it is null
+PackedAsset loadPackedAsset(const char* name, const char* loosePath = NULL) {
+  PackedAsset asset = {};
+  asset_pack_entry* entry = FindAsset(&assetPack, name);
+  if(!entry) {
+    std::string path = basePath + (loosePath ? loosePath : name);
+    asset.file = PlatformReadFile((char*) path.c_str());
+    asset.data = asset.file.memory;
+    asset.size = asset.file.size;
+    if(asset.data) {
+      DBG_LOG("No %s in the asset pack, read %s instead.\n", name, path.c_str());
+    } else {
+      DBG_LOGERROR("No %s in the asset pack or at %s.\n", name, path.c_str());
+    }
+    return asset;
+  }
+  asset.data = AssetMemory(&assetPack, entry);
+  if(!asset.data) {
+    asset.data = malloc(entry->size);
+    asset.owned = true;
+    if(asset.data && !UnpackAsset(&assetPack, entry, asset.data)) {
+      free(asset.data);
+      asset.data = NULL;
+    }
+  }
+  if(asset.data) {
+    asset.size = entry->size;
+  }
+  return asset;
+}
+
+void freePackedAsset(PackedAsset* asset) {
+  if(asset->owned) {
+    free(asset->data);
+  }
+  PlatformFreeFile(asset->file);
+  *asset = {};
+}
+
+// The packer's cook of the scene texture, or one made here the same way
+// from the source when the pack has none. owned is what to free after.
+cooked_texture_header* cookSceneTexture(void** owned) {
+  *owned = NULL;
+  asset_pack_entry* source = FindAsset(&assetPack, SCENE_TEXTURE_ASSET);
+  cooked_texture_header* cooked = source ? FindCookedTexture(&assetPack, source) : NULL;
+  if(cooked) {
+    return cooked;
+  }
+  DBG_LOG("No cook of %s in the asset pack, cooking it now.\n", SCENE_TEXTURE_ASSET);
+  PackedAsset sourceAsset = loadPackedAsset(SCENE_TEXTURE_ASSET, SCENE_TEXTURE_PATH);
+  int width = 0, height = 0, channels = 0;
+  stbi_uc* pixels = NULL;
+  if(sourceAsset.data && sourceAsset.size <= 0x7FFFFFFF) {
+    pixels = stbi_load_from_memory((stbi_uc*) sourceAsset.data, (int) sourceAsset.size, &width, &height, &channels, 4);
+  }
+  cooked_texture_header layout;
+  uint64_t size = pixels ? CookedTextureLayout(&layout, (uint32_t) width, (uint32_t) height) : 0;
+  *owned = size ? calloc(1, size) : NULL;
+  if(*owned) {
+    CookTexture(*owned, AssetContentHash(sourceAsset.data, sourceAsset.size), pixels, (uint32_t) width, (uint32_t) height, (uint32_t) width * 4);
+    cooked = (cooked_texture_header*) *owned;
+  }
+  stbi_image_free(pixels);
+  freePackedAsset(&sourceAsset);
+  return cooked;
+}
+
 int createTextureImage(VkImage* image, VkDeviceMemory* imageMem) {
-  int texW, texH, texCh;
   VkBuffer stagingBuffer;
   VkDeviceMemory stagingBufferMemory;
 
-  stbi_uc* pixels = stbi_load((basePath + "../textures/texture.bmp").c_str(), &texW, &texH, &texCh, STBI_rgb_alpha);
-  VkDeviceSize imageSize = texW * texH * 4;
-
-  if(!pixels) {
+  Uint64 start = SDL_GetPerformanceCounter();
+  void* owned = NULL;
+  cooked_texture_header* texture = cookSceneTexture(&owned);
+  if(!texture) {
     DBG_LOGERROR("Failed to load image texture.\n");
     return -1;
   }
+  vulkanTextureMipLevels = texture->mipCount;
 
   createBuffer(
-    imageSize, 
+    texture->size, 
     VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
     &stagingBuffer,
     &stagingBufferMemory
   );
 
+  // Already in the layout the copy wants, header and all, so the regions
+  // can use the cooked offsets
   void* data;
-  fnMapMemory(vulkanLogicalDevice, stagingBufferMemory, 0, imageSize, 0, &data);
-  memcpy(data, pixels, (size_t) imageSize);
+  fnMapMemory(vulkanLogicalDevice, stagingBufferMemory, 0, texture->size, 0, &data);
+  memcpy(data, texture, (size_t) texture->size);
   fnUnmapMemory(vulkanLogicalDevice, stagingBufferMemory);
-  stbi_image_free(pixels);
+  double stagedMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+  DBG_LOG("Staged %s, %ux%u with %u mips, in %.3f ms%s.\n", SCENE_TEXTURE_ASSET, texture->width, texture->height,
+    texture->mipCount, stagedMs, owned ? " cooking it first" : "");
+#ifdef RAIKA_DEBUG
+  if(!owned) {
+    // What decoding the source into the staging buffer used to cost, mips
+    // aside
+    PackedAsset sourceAsset = loadPackedAsset(SCENE_TEXTURE_ASSET, SCENE_TEXTURE_PATH);
+    start = SDL_GetPerformanceCounter();
+    loaded_bitmap decoded = DecodeBitmap(sourceAsset.data, sourceAsset.size);
+    void* swizzled = malloc((size_t) decoded.pitch * decoded.height);
+    ConvertImage(PixelConversion_SwizzleRB, swizzled, decoded.pitch, decoded.memory, decoded.pitch,
+      decoded.width, decoded.height, false);
+    double decodeMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    DBG_LOG("Decoding %s would take %.3f ms, the cook saves %.3f ms.\n", SCENE_TEXTURE_ASSET, decodeMs,
+      decodeMs - stagedMs);
+    free(swizzled);
+    free(decoded.memory);
+    freePackedAsset(&sourceAsset);
+  }
+#endif
 
   createImage(
-    (uint32_t) texW, (uint32_t) texH, 
+    texture->width, texture->height, texture->mipCount,
     VK_FORMAT_R8G8B8A8_SRGB, 
     VK_IMAGE_TILING_OPTIMAL, 
     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
@@ -879,12 +1121,13 @@ int createTextureImage(VkImage* image, VkDeviceMemory* imageMem) {
     imageMem
   );
 
-  transitionImageLayout(*image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-  copyBufferToImage(stagingBuffer, *image, (uint32_t) texW, (uint32_t) texH);
-  transitionImageLayout(*image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  transitionImageLayout(*image, VK_FORMAT_R8G8B8A8_SRGB, texture->mipCount, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  copyBufferToImage(stagingBuffer, *image, texture);
+  transitionImageLayout(*image, VK_FORMAT_R8G8B8A8_SRGB, texture->mipCount, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
   
   fnDestroyBuffer(vulkanLogicalDevice, stagingBuffer, NULL);
   fnFreeMemory(vulkanLogicalDevice, stagingBufferMemory, NULL);
+  free(owned);
 
   DBG_LOG("Successfully created texture image.\n");
   return 0;
@@ -909,7 +1152,7 @@ int createTextureSampler(VkSampler* sampler) {
   sci.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
   sci.mipLodBias = 0.0f;
   sci.minLod = 0.0f;
-  sci.maxLod = 0.0f;
+  sci.maxLod = (float) (vulkanTextureMipLevels - 1);
 
   if(fnCreateSampler(vulkanLogicalDevice, &sci, NULL, sampler) != VK_SUCCESS) {
     DBG_LOGERROR("Failed to create sampler.\n");
@@ -920,6 +1163,41 @@ int createTextureSampler(VkSampler* sampler) {
   return 0;
 }
 
+// Audio
+double secondsNow() {
+  return (double) SDL_GetPerformanceCounter() / SDL_GetPerformanceFrequency();
+}
+
+// Runs on SDL's audio thread, the only reader of the ring
+void audioCallback(void *userdata, Uint8 *stream, int len) {
+  audio_ring *ring = (audio_ring *) userdata;
+  ReadAudioRing(ring, stream, (uint32_t) len / ring->sampleBytes);
+}
+
+// Asks for 16 bit stereo and lets SDL convert to whatever the device wants.
+// The device stays paused until the game has queued its first frame.
+int openAudio() {
+  SDL_AudioSpec want = {};
+  want.freq = AUDIO_SAMPLES_PER_SECOND;
+  want.format = AUDIO_S16SYS;
+  want.channels = AUDIO_CHANNELS;
+  want.samples = AUDIO_DEVICE_SAMPLES;
+  want.callback = audioCallback;
+  want.userdata = &audioRing;
+
+  audioDevice = SDL_OpenAudioDevice(NULL, 0, &want, &audioSpec, 0);
+  if(audioDevice == 0) {
+    DBG_LOGERROR("Failed to open audio device. Error: %s\n", SDL_GetError());
+    return -1;
+  }
+  MakeAudioRing(&audioRing, audioRingMemory, AUDIO_RING_SAMPLES, AUDIO_CHANNELS * sizeof(int16_t));
+  InitAudioRecorder(&audioRecorder, AUDIO_SAMPLES_PER_SECOND);
+  OpenAudioCsv(&audioRecorder, secondsNow());
+  DBG_LOG("Opened audio device: %dHz, %d channels, %d samples per callback\n",
+    audioSpec.freq, audioSpec.channels, audioSpec.samples);
+  return 0;
+}
+
 int init() {
   // Init SDL
   if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0) {
@@ -927,9 +1205,23 @@ int init() {
     return -1;
   }
 
+  // Carry on without sound if there is no device
+  openAudio();
+
   basePath = std::string(SDL_GetBasePath());
   DBG_LOG("Base path: %s\n", basePath.c_str());
 
+  MakeFileQueue(&fileQueue);
+  DBG_LOG("File reads through %s.\n", FileQueueName(&fileQueue));
+
+  // Everything the pipeline and texture need, paged in while the Vulkan
+  // setup runs
+  assetPackFile = PlatformMapFile((char*) (basePath + ASSET_PACK_FILENAME).c_str());
+  PlatformPrefetchFile(&assetPackFile, 0, assetPackFile.size);
+  if(!OpenAssetPack(&assetPack, assetPackFile)) {
+    DBG_LOG("No %s, reading loose files.\n", ASSET_PACK_FILENAME);
+  }
+
   // Load vulkan driver
   SDL_Vulkan_LoadLibrary(NULL);
 
@@ -1269,10 +1561,13 @@ int init() {
     return -1;
   }
 
-  // Uniform buffers
+  // Uniform buffers, a slice per camera picked with a dynamic offset
+  VkDeviceSize uboAlignment = vulkanDeviceProperties.limits.minUniformBufferOffsetAlignment;
+  uboAlignment = uboAlignment ? uboAlignment : 1;
+  viewDataStride = (sizeof(ViewData) + uboAlignment - 1) / uboAlignment * uboAlignment;
   for(uint32_t i = 0; i < FRAME_COUNT; i++) {
     if(createBuffer(
-        sizeof(ViewData),
+        viewDataStride * MAX_CAMERAS,
         VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
         &(vulkanFrames[i].ub),
@@ -1281,14 +1576,14 @@ int init() {
       DBG_LOGERROR("Failed to initialize uniform buffer.\n");
       return -1;
     }
-    fnMapMemory(vulkanLogicalDevice, vulkanFrames[i].ubMem, 0, sizeof(ViewData), 0, &(vulkanFrames[i].ubMapped));
+    fnMapMemory(vulkanLogicalDevice, vulkanFrames[i].ubMem, 0, viewDataStride * MAX_CAMERAS, 0, &(vulkanFrames[i].ubMapped));
   }
 
   // Descriptor Set Layout
   uint32_t dsBindingCount = 2;
   VkDescriptorSetLayoutBinding* dslbs = (VkDescriptorSetLayoutBinding*) malloc(sizeof(VkDescriptorSetLayoutBinding) * dsBindingCount);
   dslbs[0].binding = 0;
-  dslbs[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  dslbs[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   dslbs[0].descriptorCount = 1;
   dslbs[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
@@ -1313,9 +1608,12 @@ int init() {
 
   // Create the graphics pipeline
   // Load shaders
-  size_t fragSize, vertSize; 
-  uint32_t* shaderFrag = (uint32_t*) SDL_LoadFile((basePath + "/frag.spv").c_str(), &fragSize);
-  uint32_t* shaderVert = (uint32_t*) SDL_LoadFile((basePath + "/vert.spv").c_str(), &vertSize);
+  PackedAsset fragShader = loadPackedAsset("frag.spv");
+  PackedAsset vertShader = loadPackedAsset("vert.spv");
+  size_t fragSize = (size_t) fragShader.size;
+  size_t vertSize = (size_t) vertShader.size;
+  uint32_t* shaderFrag = (uint32_t*) fragShader.data;
+  uint32_t* shaderVert = (uint32_t*) vertShader.data;
 
   DBG_LOG("Frag size: %zu\n", fragSize);
   DBG_LOG("Vert size: %zu\n", vertSize);
@@ -1323,8 +1621,8 @@ int init() {
   fragModule = createShaderModule(shaderFrag, fragSize);
   vertModule = createShaderModule(shaderVert, vertSize);
 
-  SDL_free(shaderFrag); 
-  SDL_free(shaderVert); 
+  freePackedAsset(&fragShader);
+  freePackedAsset(&vertShader);
 
   if(fragModule == NULL || vertModule == NULL) {
     DBG_LOGERROR("Failed to initialize shaders.\n");
@@ -1426,7 +1724,12 @@ int init() {
   plci.flags = 0;
   plci.setLayoutCount = 1;
   plci.pSetLayouts = vulkanDescriptorSetLayouts;
-  plci.pushConstantRangeCount = 0;
+  VkPushConstantRange pcr = {};
+  pcr.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  pcr.offset = 0;
+  pcr.size = sizeof(MeshData);
+  plci.pushConstantRangeCount = 1;
+  plci.pPushConstantRanges = &pcr;
 
   if(fnCreatePipelineLayout(vulkanLogicalDevice, &plci, NULL, &vulkanPipelineLayout) != VK_SUCCESS) {
     DBG_LOGERROR("Failed to make pipeline layout.\n");
@@ -1507,6 +1810,85 @@ int init() {
 
   DBG_LOG("Successfully initialized graphics pipeline.\n");
 
+  // 2D pipelines. Quads come from the vertex index alone and blend as
+  // premultiplied colour; they share a layout whose one set is a sprite.
+  VkDescriptorSetLayoutBinding spriteBinding = {};
+  spriteBinding.binding = 0;
+  spriteBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  spriteBinding.descriptorCount = 1;
+  spriteBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+  spriteBinding.pImmutableSamplers = NULL;
+  VkDescriptorSetLayoutCreateInfo sdslci = {};
+  sdslci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  sdslci.pNext = NULL;
+  sdslci.bindingCount = 1;
+  sdslci.pBindings = &spriteBinding;
+  if(fnCreateDescriptorSetLayout(vulkanLogicalDevice, &sdslci, NULL, &vulkanSpriteSetLayout) != VK_SUCCESS) {
+    DBG_LOGERROR("Failed to create sprite desc set layout.\n");
+    return -1;
+  }
+
+  VkPushConstantRange qpcr = {};
+  qpcr.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+  qpcr.offset = 0;
+  qpcr.size = sizeof(QuadData);
+  VkPipelineLayoutCreateInfo qplci = {};
+  qplci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  qplci.pNext = NULL;
+  qplci.flags = 0;
+  qplci.setLayoutCount = 1;
+  qplci.pSetLayouts = &vulkanSpriteSetLayout;
+  qplci.pushConstantRangeCount = 1;
+  qplci.pPushConstantRanges = &qpcr;
+  if(fnCreatePipelineLayout(vulkanLogicalDevice, &qplci, NULL, &vulkanQuadPipelineLayout) != VK_SUCCESS) {
+    DBG_LOGERROR("Failed to make quad pipeline layout.\n");
+    return -1;
+  }
+
+  PackedAsset quadVertShader = loadPackedAsset("quad_vert.spv");
+  PackedAsset quadFragShader = loadPackedAsset("quad_frag.spv");
+  PackedAsset spriteFragShader = loadPackedAsset("sprite_frag.spv");
+  if(quadVertShader.data && quadFragShader.data && spriteFragShader.data) {
+    quadVertModule = createShaderModule((uint32_t*) quadVertShader.data, (size_t) quadVertShader.size);
+    quadFragModule = createShaderModule((uint32_t*) quadFragShader.data, (size_t) quadFragShader.size);
+    spriteFragModule = createShaderModule((uint32_t*) spriteFragShader.data, (size_t) spriteFragShader.size);
+  }
+  freePackedAsset(&quadVertShader);
+  freePackedAsset(&quadFragShader);
+  freePackedAsset(&spriteFragShader);
+  if(quadVertModule == NULL || quadFragModule == NULL || spriteFragModule == NULL) {
+    DBG_LOGERROR("Failed to initialize quad shaders.\n");
+    return -1;
+  }
+
+  pvisci.vertexAttributeDescriptionCount = 0;
+  pvisci.pVertexAttributeDescriptions = NULL;
+  pvisci.vertexBindingDescriptionCount = 0;
+  pvisci.pVertexBindingDescriptions = NULL;
+  piasci.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+  prsci.cullMode = VK_CULL_MODE_NONE;
+  pcbas.blendEnable = VK_TRUE;
+  pcbas.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+  pcbas.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  pcbas.colorBlendOp = VK_BLEND_OP_ADD;
+  pcbas.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+  pcbas.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  pcbas.alphaBlendOp = VK_BLEND_OP_ADD;
+  pssci[0].module = quadVertModule;
+  pssci[1].module = quadFragModule;
+  gpci.layout = vulkanQuadPipelineLayout;
+  if(fnCreateGraphicsPipelines(vulkanLogicalDevice, NULL, 1, &gpci, NULL, &vulkanQuadPipeline) != VK_SUCCESS) {
+    DBG_LOGERROR("Failed to make quad pipeline.\n");
+    return -1;
+  }
+  pssci[1].module = spriteFragModule;
+  if(fnCreateGraphicsPipelines(vulkanLogicalDevice, NULL, 1, &gpci, NULL, &vulkanSpritePipeline) != VK_SUCCESS) {
+    DBG_LOGERROR("Failed to make sprite pipeline.\n");
+    return -1;
+  }
+
+  DBG_LOG("Successfully initialized quad pipelines.\n");
+
   // Framebuffer
   if(initFramebuffers() != 0) {
     DBG_LOGERROR("Failed to initialize framebuffer.\n");
@@ -1548,24 +1930,28 @@ int init() {
   }
   DBG_LOG("Successfully initialized command buffer.\n");
 
-  // Vertex Buffer
-  VkDeviceSize vertBufferSize = sizeof(Vertex) * VERTEX_COUNT;
-  createDoubleBuffer(&vulkanVertexBuffer, &vulkanVertexDeviceMemory, vertBufferSize, (void*) VERTICES, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  // Render commands, mesh buffers are made as the game draws them
+  renderCommands = MakeRenderCommands(malloc(RENDER_PUSH_BUFFER_SIZE), RENDER_PUSH_BUFFER_SIZE);
 
-  // Index Buffer
-  VkDeviceSize indexBufferSize = sizeof(uint32_t) * INDEX_COUNT;
-  createDoubleBuffer(&vulkanIndexBuffer, &vulkanIndexDeviceMemory, indexBufferSize, (void*) INDICES, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  // Game memory
+  if(!PlatformAllocateGameMemory(&gameMemory, GAME_PERMANENT_STORAGE_SIZE, GAME_TRANSIENT_STORAGE_SIZE)) {
+    DBG_LOGERROR("Failed to reserve game memory.\n");
+    return -1;
+  }
+  DBG_LOG("Reserved game memory, %s.\n", gameMemory.hugePages ? "huge pages" : "4KB pages");
+  gameMemory.fileQueue = &fileQueue;
+  gameMemory.assetPack = assetPackFile;
 
   // Textures
   createTextureImage(&vulkanTextureImage, &vulkanTextureImageMemory);
-  createImageView(vulkanTextureImage, VK_FORMAT_R8G8B8A8_SRGB, &vulkanTextureImageView);
+  createImageView(vulkanTextureImage, VK_FORMAT_R8G8B8A8_SRGB, vulkanTextureMipLevels, &vulkanTextureImageView);
   createTextureSampler(&vulkanTextureImageSampler);
 
   DBG_LOG("Successfully initialized texture image objects.\n");
 
   // Descriptor Pool
   VkDescriptorPoolSize* dpss = (VkDescriptorPoolSize*) malloc(sizeof(VkDescriptorPoolSize) * dsBindingCount);
-  dpss[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  dpss[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   dpss[0].descriptorCount = FRAME_COUNT;
   dpss[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
   dpss[1].descriptorCount = FRAME_COUNT;
@@ -1582,6 +1968,21 @@ int init() {
   }
   DBG_LOG("Successfully initialized desc pool.\n");
 
+  // A set per sprite, allocated as each is uploaded
+  VkDescriptorPoolSize spritePoolSize = {};
+  spritePoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  spritePoolSize.descriptorCount = MAX_SPRITES;
+  VkDescriptorPoolCreateInfo sdpci = {};
+  sdpci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  sdpci.pNext = NULL;
+  sdpci.poolSizeCount = 1;
+  sdpci.pPoolSizes = &spritePoolSize;
+  sdpci.maxSets = MAX_SPRITES;
+  if(fnCreateDescriptorPool(vulkanLogicalDevice, &sdpci, NULL, &vulkanSpriteDescriptorPool) != VK_SUCCESS) {
+    DBG_LOGERROR("Failed to initialize sprite desc pool.\n");
+    return -1;
+  }
+
   // Descriptor Set
   VkDescriptorSetAllocateInfo dsai = {};
   dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
@@ -1599,7 +2000,7 @@ int init() {
     VkDescriptorBufferInfo dbi = {};
     dbi.buffer = vulkanFrames[i].ub;
     dbi.offset = 0;
-    dbi.range = VK_WHOLE_SIZE;
+    dbi.range = sizeof(ViewData);
 
     VkDescriptorImageInfo dii = {};
     dii.sampler = vulkanTextureImageSampler;
@@ -1613,7 +2014,7 @@ int init() {
     wdss[0].dstBinding = 0;
     wdss[0].dstArrayElement = 0;
     wdss[0].descriptorCount = 1;
-    wdss[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    wdss[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     wdss[0].pBufferInfo = &dbi;
 
     wdss[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -1650,7 +2051,212 @@ int init() {
   return 0;
 }
 
-int recordCommandBuffer(uint32_t index, uint32_t frame) {
+// m4x4 is row major, GLSL wants columns
+void storeColumnMajor(float* dest, m4x4 m) {
+  for(int col = 0; col < 4; col++) {
+    for(int row = 0; row < 4; row++) {
+      dest[col * 4 + row] = m.e[row][col];
+    }
+  }
+}
+
+// The game's colours are sRGB encoded bytes, which an sRGB swapchain would
+// encode a second time on write
+bool swapchainIsSrgb() {
+  return swapchainImageFormat == VK_FORMAT_B8G8R8A8_SRGB || swapchainImageFormat == VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+float channelForSwapchain(float encoded) {
+  if(!swapchainIsSrgb()) {
+    return encoded;
+  }
+  return encoded <= 0.04045f ? encoded / 12.92f : powf((encoded + 0.055f) / 1.055f, 2.4f);
+}
+
+VkClearValue clearValueFromColor(uint32_t color) {
+  VkClearValue value = {};
+  value.color.float32[0] = channelForSwapchain(((color >> 16) & 0xFF) / 255.0f);
+  value.color.float32[1] = channelForSwapchain(((color >> 8) & 0xFF) / 255.0f);
+  value.color.float32[2] = channelForSwapchain((color & 0xFF) / 255.0f);
+  value.color.float32[3] = 1.0f;
+  return value;
+}
+
+// A premultiplied 0xAARRGGBB for the quad blend. The straight colour is what
+// gets converted; an sRGB swapchain then blends in linear light, so edges of
+// translucent rects differ slightly from the software blend of the bytes.
+void quadColorFromColor(float* dest, uint32_t color) {
+  float alpha = (color >> 24) / 255.0f;
+  for(int i = 0; i < 3; i++) {
+    float premultiplied = ((color >> (16 - 8 * i)) & 0xFF) / 255.0f;
+    float straight = alpha > 0.0f ? fminf(premultiplied / alpha, 1.0f) : 0.0f;
+    dest[i] = channelForSwapchain(straight) * alpha;
+  }
+  dest[3] = alpha;
+}
+
+VulkanMesh* findMesh(render_mesh* mesh) {
+  for(uint32_t i = 0; i < vulkanMeshCount; i++) {
+    if(vulkanMeshes[i].source == mesh) {
+      return &vulkanMeshes[i];
+    }
+  }
+  return NULL;
+}
+
+// Copies go through their own command buffers, so this runs before recording
+int uploadMeshes(render_commands* commands) {
+  render_sort_entry* entries = GetSortEntries(commands);
+  for(uint32_t i = 0; i < commands->commandCount; i++) {
+    render_command_header* header = GetRenderCommand(commands, entries + i);
+    if(header->type != RenderCommand_Mesh) {
+      continue;
+    }
+    render_mesh* mesh = ((render_command_mesh*) (header + 1))->mesh;
+    if(findMesh(mesh)) {
+      continue;
+    }
+    if(vulkanMeshCount == MAX_MESHES) {
+      DBG_LOGERROR("Out of mesh slots.\n");
+      return -1;
+    }
+    VulkanMesh* vm = &vulkanMeshes[vulkanMeshCount];
+    if(createDoubleBuffer(
+        &vm->vertexBuffer, &vm->vertexMemory, sizeof(Vertex) * mesh->vertexCount, (void*) mesh->vertices,
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+       ) != 0 ||
+       createDoubleBuffer(
+        &vm->indexBuffer, &vm->indexMemory, sizeof(uint32_t) * mesh->indexCount, (void*) mesh->indices,
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+       ) != 0) {
+      DBG_LOGERROR("Failed to upload mesh.\n");
+      return -1;
+    }
+    vm->source = mesh;
+    vm->indexCount = mesh->indexCount;
+    vulkanMeshCount++;
+  }
+  return 0;
+}
+
+VulkanSprite* findSprite(loaded_bitmap* bitmap) {
+  for(uint32_t i = 0; i < vulkanSpriteCount; i++) {
+    if(vulkanSprites[i].source == bitmap) {
+      return &vulkanSprites[i];
+    }
+  }
+  return NULL;
+}
+
+// The premultiplied 0xAARRGGBB pixels are B8G8R8A8 bytes. UNORM rather than
+// SRGB since sprite.frag converts the straight colour itself.
+int createSpriteImage(loaded_bitmap* bitmap, VulkanSprite* sprite) {
+  VkFormat format = VK_FORMAT_B8G8R8A8_UNORM;
+  VkDeviceSize rowSize = (VkDeviceSize) bitmap->width * 4;
+  VkDeviceSize size = rowSize * bitmap->height;
+  VkBuffer stagingBuffer;
+  VkDeviceMemory stagingMemory;
+  if(createBuffer(
+      size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      &stagingBuffer, &stagingMemory
+     ) != 0) {
+    return -1;
+  }
+  void* data;
+  fnMapMemory(vulkanLogicalDevice, stagingMemory, 0, size, 0, &data);
+  for(int y = 0; y < bitmap->height; y++) {
+    memcpy((uint8_t*) data + y * rowSize, (uint8_t*) bitmap->memory + (ptrdiff_t) y * bitmap->pitch, (size_t) rowSize);
+  }
+  fnUnmapMemory(vulkanLogicalDevice, stagingMemory);
+
+  int result = createImage(
+    (uint32_t) bitmap->width, (uint32_t) bitmap->height, 1, format, VK_IMAGE_TILING_OPTIMAL,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+    &sprite->image, &sprite->memory
+  );
+  if(result == 0) {
+    transitionImageLayout(sprite->image, format, 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    VkCommandBuffer cb;
+    beginSingleCommandBuffer(&cb);
+    VkBufferImageCopy bic = {};
+    bic.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    bic.imageSubresource.layerCount = 1;
+    bic.imageExtent.width = (uint32_t) bitmap->width;
+    bic.imageExtent.height = (uint32_t) bitmap->height;
+    bic.imageExtent.depth = 1;
+    fnCmdCopyBufferToImage(cb, stagingBuffer, sprite->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bic);
+    endSingleCommandBuffer(&cb);
+    transitionImageLayout(sprite->image, format, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    result = createImageView(sprite->image, format, 1, &sprite->view);
+  }
+  fnDestroyBuffer(vulkanLogicalDevice, stagingBuffer, NULL);
+  fnFreeMemory(vulkanLogicalDevice, stagingMemory, NULL);
+
+  if(result == 0) {
+    VkDescriptorSetAllocateInfo dsai = {};
+    dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    dsai.pNext = NULL;
+    dsai.descriptorPool = vulkanSpriteDescriptorPool;
+    dsai.descriptorSetCount = 1;
+    dsai.pSetLayouts = &vulkanSpriteSetLayout;
+    if(fnAllocateDescriptorSets(vulkanLogicalDevice, &dsai, &sprite->set) != VK_SUCCESS) {
+      DBG_LOGERROR("Failed to allocate sprite desc set.\n");
+      return -1;
+    }
+    // texelFetch ignores the sampler's filtering, any will do
+    VkDescriptorImageInfo dii = {};
+    dii.sampler = vulkanTextureImageSampler;
+    dii.imageView = sprite->view;
+    dii.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    VkWriteDescriptorSet wds = {};
+    wds.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    wds.pNext = NULL;
+    wds.dstSet = sprite->set;
+    wds.dstBinding = 0;
+    wds.dstArrayElement = 0;
+    wds.descriptorCount = 1;
+    wds.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    wds.pImageInfo = &dii;
+    fnUpdateDescriptorSets(vulkanLogicalDevice, 1, &wds, 0, NULL);
+  }
+  return result;
+}
+
+// Like the meshes, before recording
+int uploadSprites(render_commands* commands) {
+  render_sort_entry* entries = GetSortEntries(commands);
+  for(uint32_t i = 0; i < commands->commandCount; i++) {
+    render_command_header* header = GetRenderCommand(commands, entries + i);
+    if(header->type != RenderCommand_Sprite) {
+      continue;
+    }
+    loaded_bitmap* bitmap = ((render_command_sprite*) (header + 1))->bitmap;
+    if(!bitmap->memory || findSprite(bitmap)) {
+      continue;
+    }
+    if(vulkanSpriteCount == MAX_SPRITES) {
+      DBG_LOGERROR("Out of sprite slots.\n");
+      return -1;
+    }
+    VulkanSprite* sprite = &vulkanSprites[vulkanSpriteCount];
+    *sprite = {};
+    if(createSpriteImage(bitmap, sprite) != 0) {
+      DBG_LOGERROR("Failed to upload sprite.\n");
+      return -1;
+    }
+    sprite->source = bitmap;
+    vulkanSpriteCount++;
+  }
+  return 0;
+}
+
+// Walks the sorted render commands the way the software backend does.
+// Clears and opaque rects become attachment clears; translucent rects, the
+// gradient and sprites are blended quads. Each camera writes its own slice
+// of the frame's uniform buffer for the meshes after it. Every mesh samples
+// the one texture bound at init, and nothing is depth tested.
+int recordCommandBuffer(uint32_t index, uint32_t frame, render_commands* commands) {
   VkCommandBufferBeginInfo cbbi = {};
   cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
   cbbi.pNext = NULL;
@@ -1659,6 +2265,20 @@ int recordCommandBuffer(uint32_t index, uint32_t frame) {
     DBG_LOG("Failed to begin buffer\n");
     return -1;
   }
+  VkCommandBuffer cb = vulkanFrames[frame].cb;
+  render_sort_entry* entries = GetSortEntries(commands);
+
+  // A clear that sorts first is folded into the render pass
+  uint32_t firstCommand = 0;
+  VkClearValue clearColor = clearValueFromColor(0);
+  if(commands->commandCount > 0) {
+    render_command_header* header = GetRenderCommand(commands, entries);
+    if(header->type == RenderCommand_Clear) {
+      clearColor = clearValueFromColor(((render_command_clear*) (header + 1))->color);
+      firstCommand = 1;
+    }
+  }
+
   VkRenderPassBeginInfo rpbi = {};
   rpbi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   rpbi.pNext = NULL;
@@ -1667,16 +2287,9 @@ int recordCommandBuffer(uint32_t index, uint32_t frame) {
   rpbi.renderArea.offset = {0, 0};
   rpbi.renderArea.extent = vulkanSwapExtent;
   rpbi.clearValueCount = 1;
-  VkClearValue clearColor = {0.0f, 0.0f, 0.0f, 1.0f};
   rpbi.pClearValues = &clearColor;
 
-  fnCmdBeginRenderPass(vulkanFrames[frame].cb, &rpbi, VK_SUBPASS_CONTENTS_INLINE);
-  fnCmdBindPipeline(vulkanFrames[frame].cb, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanGraphicsPipeline);
-
-  VkBuffer vertBuffers[1] = {vulkanVertexBuffer};
-  VkDeviceSize offsets[1] = {0};
-  fnCmdBindVertexBuffers(vulkanFrames[frame].cb, 0, 1, vertBuffers, offsets);
-  fnCmdBindIndexBuffer(vulkanFrames[frame].cb, vulkanIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+  fnCmdBeginRenderPass(cb, &rpbi, VK_SUBPASS_CONTENTS_INLINE);
 
   VkViewport viewport = {};
   viewport.x = 0.0f;
@@ -1685,24 +2298,168 @@ int recordCommandBuffer(uint32_t index, uint32_t frame) {
   viewport.height = (float) vulkanSwapExtent.height;
   viewport.minDepth = 0.0f;
   viewport.maxDepth = 1.0f;
-  fnCmdSetViewport(vulkanFrames[frame].cb, 0, 1, &viewport);
+  fnCmdSetViewport(cb, 0, 1, &viewport);
 
   VkRect2D scissor = {};
   scissor.offset = {0, 0};
   scissor.extent = vulkanSwapExtent;
-  fnCmdSetScissor(vulkanFrames[frame].cb, 0, 1, &scissor);
-  fnCmdBindDescriptorSets(vulkanFrames[frame].cb, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanPipelineLayout, 0, 1, &vulkanDescriptorSets[frame], 0, NULL);
-  fnCmdDrawIndexed(vulkanFrames[frame].cb, INDEX_COUNT, 1, 0, 0, 0);
+  fnCmdSetScissor(cb, 0, 1, &scissor);
+
+  // Meshes before any camera draw in clip space, as in the software path
+  uint8_t* views = (uint8_t*) vulkanFrames[frame].ubMapped;
+  ViewData identity = {};
+  storeColumnMajor(identity.view, Identity());
+  storeColumnMajor(identity.proj, Identity());
+  memcpy(views, &identity, sizeof(identity));
+  uint32_t cameraCount = 1;
+  uint32_t viewOffset = 0;
+  bool viewBound = false;
+
+  QuadData quad = {};
+  quad.extent[0] = (float) vulkanSwapExtent.width;
+  quad.extent[1] = (float) vulkanSwapExtent.height;
+  quad.srgbTarget = swapchainIsSrgb() ? 1 : 0;
+  graphics_rect bounds = {0, 0, (int) vulkanSwapExtent.width, (int) vulkanSwapExtent.height};
+
+  // The 2D pipelines' layout disturbs the mesh set and the other way round,
+  // so each is bound again after a switch
+  VkPipeline boundPipeline = NULL;
+  VulkanMesh* boundMesh = NULL;
+  VulkanSprite* boundSprite = NULL;
+  for(uint32_t i = firstCommand; i < commands->commandCount; i++) {
+    render_command_header* header = GetRenderCommand(commands, entries + i);
+    void* data = header + 1;
+    VkClearAttachment ca = {};
+    ca.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    ca.colorAttachment = 0;
+    VkClearRect cr = {};
+    cr.rect = scissor;
+    cr.layerCount = 1;
+    switch(header->type) {
+      case RenderCommand_Clear: {
+        ca.clearValue = clearValueFromColor(((render_command_clear*) data)->color);
+        fnCmdClearAttachments(cb, 1, &ca, 1, &cr);
+      } break;
+      case RenderCommand_Rect: {
+        render_command_rect* command = (render_command_rect*) data;
+        graphics_rect rect = IntersectRect(command->rect, bounds);
+        uint32_t alpha = command->color >> 24;
+        // Fully transparent leaves the pixels alone, as BlendPremultiplied does
+        if(RectIsEmpty(rect) || alpha == 0) {
+          break;
+        }
+        if(alpha == 0xFF) {
+          ca.clearValue = clearValueFromColor(command->color);
+          cr.rect.offset = {rect.x, rect.y};
+          cr.rect.extent = {(uint32_t) rect.width, (uint32_t) rect.height};
+          fnCmdClearAttachments(cb, 1, &ca, 1, &cr);
+          break;
+        }
+        if(boundPipeline != vulkanQuadPipeline) {
+          fnCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanQuadPipeline);
+          boundPipeline = vulkanQuadPipeline;
+        }
+        quad.mode = QUAD_MODE_COLOR;
+        quad.rect[0] = (float) rect.x;
+        quad.rect[1] = (float) rect.y;
+        quad.rect[2] = (float) rect.width;
+        quad.rect[3] = (float) rect.height;
+        quadColorFromColor(quad.color, command->color);
+        fnCmdPushConstants(cb, vulkanQuadPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(quad), &quad);
+        fnCmdDraw(cb, 4, 1, 0, 0);
+      } break;
+      case RenderCommand_Gradient: {
+        render_command_gradient* command = (render_command_gradient*) data;
+        if(boundPipeline != vulkanQuadPipeline) {
+          fnCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanQuadPipeline);
+          boundPipeline = vulkanQuadPipeline;
+        }
+        quad.mode = QUAD_MODE_GRADIENT;
+        quad.rect[0] = 0.0f;
+        quad.rect[1] = 0.0f;
+        quad.rect[2] = quad.extent[0];
+        quad.rect[3] = quad.extent[1];
+        quad.gradientOffset[0] = command->xoffset;
+        quad.gradientOffset[1] = command->yoffset;
+        fnCmdPushConstants(cb, vulkanQuadPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(quad), &quad);
+        fnCmdDraw(cb, 4, 1, 0, 0);
+      } break;
+      case RenderCommand_Sprite: {
+        render_command_sprite* command = (render_command_sprite*) data;
+        VulkanSprite* sprite = findSprite(command->bitmap);
+        if(!sprite || command->scale < 1) {
+          break;
+        }
+        if(boundPipeline != vulkanSpritePipeline) {
+          fnCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanSpritePipeline);
+          boundPipeline = vulkanSpritePipeline;
+        }
+        if(sprite != boundSprite) {
+          fnCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanQuadPipelineLayout, 0, 1, &sprite->set, 0, NULL);
+          boundSprite = sprite;
+        }
+        quad.rect[0] = (float) command->x;
+        quad.rect[1] = (float) command->y;
+        quad.rect[2] = (float) (command->bitmap->width * command->scale);
+        quad.rect[3] = (float) (command->bitmap->height * command->scale);
+        fnCmdPushConstants(cb, vulkanQuadPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(quad), &quad);
+        fnCmdDraw(cb, 4, 1, 0, 0);
+      } break;
+      case RenderCommand_Camera: {
+        if(cameraCount == MAX_CAMERAS) {
+          DBG_LOGERROR("Out of camera slots, meshes keep the last camera.\n");
+          break;
+        }
+        render_command_camera* command = (render_command_camera*) data;
+        ViewData vd = {};
+        storeColumnMajor(vd.view, command->view);
+        storeColumnMajor(vd.proj, command->proj);
+        viewOffset = (uint32_t) (cameraCount++ * viewDataStride);
+        memcpy(views + viewOffset, &vd, sizeof(vd));
+        viewBound = false;
+      } break;
+      case RenderCommand_Mesh: {
+        render_command_mesh* command = (render_command_mesh*) data;
+        VulkanMesh* mesh = findMesh(command->mesh);
+        if(!mesh) {
+          break;
+        }
+        if(boundPipeline != vulkanGraphicsPipeline) {
+          fnCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanGraphicsPipeline);
+          boundPipeline = vulkanGraphicsPipeline;
+          boundSprite = NULL;
+          viewBound = false;
+        }
+        if(!viewBound) {
+          fnCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanPipelineLayout, 0, 1, &vulkanDescriptorSets[frame], 1, &viewOffset);
+          viewBound = true;
+        }
+        if(mesh != boundMesh) {
+          VkDeviceSize offsets[1] = {0};
+          fnCmdBindVertexBuffers(cb, 0, 1, &mesh->vertexBuffer, offsets);
+          fnCmdBindIndexBuffer(cb, mesh->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+          boundMesh = mesh;
+        }
+        MeshData md = {};
+        storeColumnMajor(md.model, command->model);
+        fnCmdPushConstants(cb, vulkanPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(md), &md);
+        fnCmdDrawIndexed(cb, mesh->indexCount, 1, 0, 0, 0);
+      } break;
+      default: {
+        DBG_LOGERROR("Render command %u has no Vulkan path.\n", header->type);
+      } break;
+    }
+  }
 
-  fnCmdEndRenderPass(vulkanFrames[frame].cb);
-  if(fnEndCommandBuffer(vulkanFrames[frame].cb) != VK_SUCCESS) {
+  fnCmdEndRenderPass(cb);
+  if(fnEndCommandBuffer(cb) != VK_SUCCESS) {
     DBG_LOGERROR("Failed to write to buffer.\n");
     return -1;
   }
   return 0;
 }
 
-int drawFrame(uint32_t frame) {
+int drawFrame(uint32_t frame, render_commands* commands) {
   // Wait for previous frame
   fnWaitForFences(vulkanLogicalDevice, 1, &(vulkanFrames[frame].inFlight), VK_TRUE, UINT64_MAX);
   uint32_t imageIndex;
@@ -1715,16 +2472,9 @@ int drawFrame(uint32_t frame) {
   }
   fnResetFences(vulkanLogicalDevice, 1, &(vulkanFrames[frame].inFlight));
   fnResetCommandBuffer(vulkanFrames[frame].cb, 0);
-  recordCommandBuffer(imageIndex, frame);
-  // Update uniform
-  ViewData vd = {};
-
-  vd.model = glm::rotate(glm::mat4(1.0f), glm::radians(currentFrame + 90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-  vd.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-  vd.proj = glm::perspective(glm::radians(45.0f), vulkanSwapExtent.width / (float) vulkanSwapExtent.height, 0.1f, 10.0f);
-  vd.proj[1][1] *= -1;
-
-  memcpy(vulkanFrames[frame].ubMapped, &vd, sizeof(vd));
+  uploadMeshes(commands);
+  uploadSprites(commands);
+  recordCommandBuffer(imageIndex, frame, commands);
 
   VkSubmitInfo submitInfo = {};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -1777,23 +2527,39 @@ void cleanupVulkan() {
     fnFreeMemory(vulkanLogicalDevice, vulkanFrames[i].ubMem, NULL);
   }
   fnDestroyCommandPool(vulkanLogicalDevice, vulkanGlobalCB, NULL);
-  fnDestroyBuffer(vulkanLogicalDevice, vulkanVertexBuffer, NULL);
-  fnFreeMemory(vulkanLogicalDevice, vulkanVertexDeviceMemory, NULL);
-  fnDestroyBuffer(vulkanLogicalDevice, vulkanIndexBuffer, NULL);
-  fnFreeMemory(vulkanLogicalDevice, vulkanIndexDeviceMemory, NULL);
+  for(uint32_t i = 0; i < vulkanMeshCount; i++) {
+    fnDestroyBuffer(vulkanLogicalDevice, vulkanMeshes[i].vertexBuffer, NULL);
+    fnFreeMemory(vulkanLogicalDevice, vulkanMeshes[i].vertexMemory, NULL);
+    fnDestroyBuffer(vulkanLogicalDevice, vulkanMeshes[i].indexBuffer, NULL);
+    fnFreeMemory(vulkanLogicalDevice, vulkanMeshes[i].indexMemory, NULL);
+  }
+  for(uint32_t i = 0; i < vulkanSpriteCount; i++) {
+    fnDestroyImageView(vulkanLogicalDevice, vulkanSprites[i].view, NULL);
+    fnDestroyImage(vulkanLogicalDevice, vulkanSprites[i].image, NULL);
+    fnFreeMemory(vulkanLogicalDevice, vulkanSprites[i].memory, NULL);
+  }
+  free(renderCommands.pushBufferBase);
   for(uint32_t i = 0; i < vulkanSwapchainImageCount; i++) {
     fnDestroyFramebuffer(vulkanLogicalDevice, vulkanFramebuffers[i], NULL);
   }
   free(vulkanFramebuffers);
   fnDestroyDescriptorPool(vulkanLogicalDevice, vulkanDescriptorPool, NULL);
+  fnDestroyDescriptorPool(vulkanLogicalDevice, vulkanSpriteDescriptorPool, NULL);
+  fnDestroyDescriptorSetLayout(vulkanLogicalDevice, vulkanSpriteSetLayout, NULL);
   for(uint32_t i = 0; i < FRAME_COUNT; i++) {
     fnDestroyDescriptorSetLayout(vulkanLogicalDevice, vulkanDescriptorSetLayouts[i], NULL);
   }
   fnDestroyPipeline(vulkanLogicalDevice, vulkanGraphicsPipeline, NULL);
+  fnDestroyPipeline(vulkanLogicalDevice, vulkanQuadPipeline, NULL);
+  fnDestroyPipeline(vulkanLogicalDevice, vulkanSpritePipeline, NULL);
+  fnDestroyPipelineLayout(vulkanLogicalDevice, vulkanQuadPipelineLayout, NULL);
   fnDestroyRenderPass(vulkanLogicalDevice, vulkanRenderPass, NULL);
   fnDestroyPipelineLayout(vulkanLogicalDevice, vulkanPipelineLayout, NULL);
   fnDestroyShaderModule(vulkanLogicalDevice, vertModule, NULL);
   fnDestroyShaderModule(vulkanLogicalDevice, fragModule, NULL);
+  fnDestroyShaderModule(vulkanLogicalDevice, quadVertModule, NULL);
+  fnDestroyShaderModule(vulkanLogicalDevice, quadFragModule, NULL);
+  fnDestroyShaderModule(vulkanLogicalDevice, spriteFragModule, NULL);
   for(uint32_t i = 0; i < vulkanSwapchainImageCount; i++) {
     fnDestroyImageView(vulkanLogicalDevice, vulkanImageViews[i], NULL);
   }
@@ -1806,7 +2572,14 @@ void cleanupVulkan() {
 
 void cleanupSDL() {
   // Cleanup
+  if(audioDevice) {
+    SDL_CloseAudioDevice(audioDevice);
+    CloseAudioCsv(&audioRecorder);
+  }
   cleanupVulkan();
+  FreeFileQueue(&fileQueue);
+  PlatformUnmapFile(&assetPackFile);
+  PlatformFreeGameMemory(&gameMemory);
   SDL_DestroyWindow(window);
   SDL_Quit();
 }
@@ -1822,8 +2595,9 @@ int main(int argc, char *argv[]) {
   running = true;
   uint64_t perfFreq = SDL_GetPerformanceFrequency();
   uint64_t perfCountPerFrame = (perfFreq / FPS);
-  recordCommandBuffer(0, currentFrame % FRAME_COUNT);
   uint64_t startTime;
+  game_input gameInput = {};
+  sound_buffer soundBuffer = {};
   while(running) {
     startTime = SDL_GetPerformanceCounter();
     // Handle events
@@ -1850,10 +2624,57 @@ int main(int argc, char *argv[]) {
         }
       }
     }
-    drawFrame(currentFrame % FRAME_COUNT);
+    // The game only fills in render commands here, nothing to draw into
+    graphics_buffer graphicsBuffer = {};
+    graphicsBuffer.width = (int) vulkanSwapExtent.width;
+    graphicsBuffer.height = (int) vulkanSwapExtent.height;
+    graphicsBuffer.commands = &renderCommands;
+    ResetRenderCommands(&renderCommands);
+
+    // Top the ring back up to its lead over the device
+    soundBuffer = {};
+    if(audioDevice) {
+      if(audioStarted) {
+        RecordAudioRing(&audioRecorder, &audioRing, secondsNow());
+        RecordAudioQueued(&audioRecorder, AudioRingQueued(&audioRing));
+      }
+      uint32_t lead = audioSpec.samples + AUDIO_LEAD_FRAMES * AUDIO_SAMPLES_PER_SECOND / FPS;
+      soundBuffer.memory = audioStaging;
+      soundBuffer.samplesPerSecond = AUDIO_SAMPLES_PER_SECOND;
+      soundBuffer.samplesRequested = (int) AudioRingRequest(&audioRing, lead);
+      soundBuffer.bytesPerSample = sizeof(int16_t);
+      soundBuffer.channels = AUDIO_CHANNELS;
+      soundBuffer.stats = &audioRecorder.stats;
+    }
+    bool gameInitialized = gameMemory.isInitialized;
+    uint64_t heapAllocations = PlatformHeapAllocationCount();
+    GameUpdateAndRender(&gameMemory, &graphicsBuffer, &soundBuffer, &gameInput);
+    // Past its first frame the game lives in its arenas
+    Assert(!gameInitialized || PlatformHeapAllocationCount() == heapAllocations);
+    SortRenderCommands(&renderCommands);
+    if(audioDevice) {
+      uint32_t written = WriteAudioRing(&audioRing, audioStaging, (uint32_t) soundBuffer.samplesRequested);
+      // SDL's own buffer past the ring is not counted
+      RecordAudioWrite(&audioRecorder, AudioRingQueued(&audioRing), (uint32_t) soundBuffer.samplesRequested - written);
+      WriteAudioCsv(&audioRecorder, secondsNow());
+      if(!audioStarted) {
+        SDL_PauseAudioDevice(audioDevice, 0);
+        audioStarted = true;
+      }
+    }
+
+    drawFrame(currentFrame % FRAME_COUNT, &renderCommands);
     currentFrame++;
     uint64_t counterSpent = SDL_GetPerformanceCounter() - startTime;
     DBG_LOG("Frame %d: Finished in %.2f/%.2fms\n", currentFrame, counterSpent * 1000.0f / perfFreq, perfCountPerFrame * 1000.0f / perfFreq);
+    if(audioDevice && currentFrame % FPS == 0) {
+      char audioStats[256];
+      FormatAudioRingStats(&audioRing, AUDIO_SAMPLES_PER_SECOND, audioStats, sizeof(audioStats));
+      DBG_LOG("%s", audioStats);
+      FormatAudioStats(&audioRecorder.stats, audioStats, sizeof(audioStats));
+      DBG_LOG("%s", audioStats);
+      ResetAudioRingStats(&audioRing);
+    }
     while(counterSpent < perfCountPerFrame) {
       uint64_t counterLeft = (perfCountPerFrame - counterSpent);
       uint64_t msToWait = ((1000 * counterLeft) / perfFreq);
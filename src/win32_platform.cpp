@@ -6,6 +6,12 @@
 #include <audioclient.h>
 #include <comdef.h>
 
+#include "raika_work_queue.cpp"
+#include "raika_present.cpp"
+#include "raika_audio_stats.cpp"
+#include "raika_game_memory.cpp"
+#include "raika_file_queue.cpp"
+
 #define SAMPLES_PER_SECOND 48000
 #define FPS 30
 #define TRIGGER_DEADZONE 100
@@ -18,6 +24,9 @@
 struct win32_graphics_buffer {
   BITMAPINFO info;
   VOID *memory;
+  // The game draws top down into this at its internal resolution, which is
+  // then scaled into the bottom up DIB above
+  VOID *gameMemory;
   int width;
   int height;
   int pitch;
@@ -43,7 +52,12 @@ struct win32_audio_client {
 static bool running;
 static win32_graphics_buffer globalGraphicsBuffer;
 static win32_audio_client globalAudioClient; 
+static audio_recorder globalAudioRecorder;
 static int64_t globalPerfFrequency;
+static platform_work_queue globalRenderQueue;
+static render_commands globalRenderCommands;
+static game_memory globalGameMemory;
+static platform_file_queue globalFileQueue;
 
 // Manually load XInput functions
 #define X_INPUT_GET_STATE(name) DWORD WINAPI name(DWORD dwUserIndex, XINPUT_STATE* pState)
@@ -145,11 +159,24 @@ static HRESULT InitAudio(
   return EXIT_SUCCESS;
 }
 
+static double GetAudioWallSeconds() {
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return (double) counter.QuadPart / globalPerfFrequency;
+}
+
 static HRESULT MakeAudioBuffer(sound_buffer *buffer) {
   UINT32 currentlyWrittenFrames;
   RETURN_IF_FAILED(
     globalAudioClient.audioClient->GetCurrentPadding(&currentlyWrittenFrames)
   );
+  // The buffer starts full of silence, so an empty one means the device ran
+  // dry. WASAPI does not say for how long.
+  if(currentlyWrittenFrames == 0) {
+    RecordAudioUnderruns(&globalAudioRecorder, 1, 0);
+  }
+  RecordAudioQueued(&globalAudioRecorder, currentlyWrittenFrames);
+  buffer->stats = &globalAudioRecorder.stats;
   buffer->samplesRequested = globalAudioClient.bufferSize - currentlyWrittenFrames;
   buffer->samplesPerSecond = SAMPLES_PER_SECOND;
   buffer->bytesPerSample = globalAudioClient.bitDepth / 8;
@@ -161,6 +188,21 @@ static HRESULT MakeAudioBuffer(sound_buffer *buffer) {
   return EXIT_SUCCESS;
 }
 
+// After ReleaseBuffer. The game is only asked for what fits, so nothing is
+// ever dropped.
+static void RecordAudioRelease() {
+  UINT32 currentlyWrittenFrames;
+  if(SUCCEEDED(globalAudioClient.audioClient->GetCurrentPadding(&currentlyWrittenFrames))) {
+    RecordAudioWrite(&globalAudioRecorder, currentlyWrittenFrames, 0);
+  }
+  UINT64 frequency, position;
+  if(SUCCEEDED(globalAudioClient.audioClock->GetFrequency(&frequency)) &&
+     SUCCEEDED(globalAudioClient.audioClock->GetPosition(&position, NULL)) && frequency) {
+    RecordAudioClock(&globalAudioRecorder, (double) position / frequency, GetAudioWallSeconds());
+  }
+  WriteAudioCsv(&globalAudioRecorder, GetAudioWallSeconds());
+}
+
 static win32_window_dimension GetWindowDimension(
   HWND Window
 ) {
@@ -182,6 +224,7 @@ static void ResizeDIBSection(
 
   if(buffer->memory) {
     VirtualFree(buffer->memory, NULL, MEM_RELEASE);
+    VirtualFree(buffer->gameMemory, NULL, MEM_RELEASE);
   }
 
   buffer->info.bmiHeader.biSize = sizeof(buffer->info.bmiHeader);
@@ -202,6 +245,12 @@ static void ResizeDIBSection(
     MEM_COMMIT,
     PAGE_READWRITE
   );
+  buffer->gameMemory = VirtualAlloc(
+    NULL, 
+    bitmapMemSize,
+    MEM_COMMIT,
+    PAGE_READWRITE
+  );
 
   buffer->pitch = buffer->width * bytesPerPixel;
 }
@@ -226,6 +275,36 @@ static void CopyBufferToWindow(
   );
 }
 
+// Blits only what changed. The DIB matches the window, so this only stretches
+// for the frame or two until a resize catches up. Source rows in the bottom up
+// DIB count from the bottom.
+static void CopyDirtyRectsToWindow(
+  HDC context,
+  int winWidth,
+  int winHeight,
+  win32_graphics_buffer *buffer,
+  graphics_buffer *outputBuffer
+) {
+  float scaleX = (float) winWidth / (float) buffer->width;
+  float scaleY = (float) winHeight / (float) buffer->height;
+  for(int i = 0; i < outputBuffer->dirtyRectCount; ++i) {
+    graphics_rect rect = outputBuffer->dirtyRects[i];
+    int destMinX = (int) (rect.x * scaleX);
+    int destMaxX = (int) ((rect.x + rect.width) * scaleX + 0.999f);
+    int destMinY = (int) (rect.y * scaleY);
+    int destMaxY = (int) ((rect.y + rect.height) * scaleY + 0.999f);
+    int dibY = buffer->height - rect.y - rect.height;
+    StretchDIBits(
+      context,
+      destMinX, destMinY, destMaxX - destMinX, destMaxY - destMinY,
+      rect.x, dibY, rect.width, rect.height,
+      buffer->memory, &(buffer->info),
+      DIB_RGB_COLORS,
+      SRCCOPY
+    );
+  }
+}
+
 LRESULT MainWindowCallback(
   HWND Window,
   UINT Message,
@@ -340,7 +419,9 @@ static bool PlatformWriteFile(
     0
   );
   if(handle != INVALID_HANDLE_VALUE) {
-    WriteFile(handle, file.memory, file.size, &bytesWritten, 0);
+    // WriteFile takes at most 4GB a call
+    Assert(file.size <= 0xFFFFFFFF);
+    WriteFile(handle, file.memory, (DWORD) file.size, &bytesWritten, 0);
     if(bytesWritten == file.size) {
       ret = true;
     }
@@ -368,12 +449,14 @@ static file_data PlatformReadFile(
   if(handle != INVALID_HANDLE_VALUE) {
     LARGE_INTEGER fileSize;
     if(GetFileSizeEx(handle, &fileSize)) {
-      file.memory = VirtualAlloc(0, fileSize.QuadPart, MEM_COMMIT, PAGE_READWRITE);
+      // Copied rather than mapped, and ReadFile takes at most 4GB a call
       Assert(fileSize.QuadPart <= 0xFFFFFFFF);
-      if(ReadFile(handle, file.memory, fileSize.QuadPart, &bytesRead, 0) && (fileSize.QuadPart == bytesRead)) {
+      file.memory = VirtualAlloc(0, fileSize.QuadPart, MEM_COMMIT, PAGE_READWRITE);
+      if(ReadFile(handle, file.memory, (DWORD) fileSize.QuadPart, &bytesRead, 0) && (fileSize.QuadPart == bytesRead)) {
         file.size = bytesRead;
       } else {
         PlatformFreeFile(file);
+        file = {};
       }
     }
     CloseHandle(handle);
@@ -390,6 +473,73 @@ static void PlatformFreeFile(
   }
 }
 
+static mapped_file PlatformMapFile(
+  char * filename
+) {
+  mapped_file file = {};
+
+  HANDLE handle = CreateFileA(
+    filename,
+    GENERIC_READ,
+    FILE_SHARE_READ,
+    0,
+    OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+    0
+  );
+  if(handle != INVALID_HANDLE_VALUE) {
+    LARGE_INTEGER fileSize;
+    if(GetFileSizeEx(handle, &fileSize) && fileSize.QuadPart > 0) {
+      HANDLE mapping = CreateFileMappingA(handle, 0, PAGE_READONLY, 0, 0, 0);
+      if(mapping) {
+        file.memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if(file.memory) {
+          file.size = fileSize.QuadPart;
+        }
+        // The view keeps the mapping and the file open
+        CloseHandle(mapping);
+      }
+    }
+    CloseHandle(handle);
+  }
+
+  return file;
+}
+
+static void PlatformPrefetchFile(
+  mapped_file *file,
+  uint64_t offset,
+  uint64_t size
+) {
+  if(file->memory && offset < file->size) {
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = (uint8_t *) file->memory + offset;
+    range.NumberOfBytes = (SIZE_T) (offset + size < file->size ? size : file->size - offset);
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+  }
+}
+
+// Unlocking pages that were never locked takes them out of the working set
+static void PlatformEvictFile(
+  mapped_file *file,
+  uint64_t offset,
+  uint64_t size
+) {
+  if(file->memory && offset < file->size) {
+    SIZE_T bytes = (SIZE_T) (offset + size < file->size ? size : file->size - offset);
+    VirtualUnlock((uint8_t *) file->memory + offset, bytes);
+  }
+}
+
+static void PlatformUnmapFile(
+  mapped_file *file
+) {
+  if(file->memory) {
+    UnmapViewOfFile(file->memory);
+  }
+  *file = {};
+}
+
 inline LARGE_INTEGER GetWallClock() {
   LARGE_INTEGER result;
   QueryPerformanceCounter(&result);
@@ -410,6 +560,20 @@ int APIENTRY WinMain(
     // dynamically load some stuff
     LoadXInput();
 
+    // Render workers, the main thread makes up the last core
+    MakeWorkQueue(&globalRenderQueue, GetLogicalProcessorCount() - 1);
+    globalRenderCommands = MakeRenderCommands(
+      VirtualAlloc(NULL, RENDER_PUSH_BUFFER_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE),
+      RENDER_PUSH_BUFFER_SIZE
+    );
+    if(!PlatformAllocateGameMemory(&globalGameMemory, GAME_PERMANENT_STORAGE_SIZE, GAME_TRANSIENT_STORAGE_SIZE)) {
+      return 1;
+    }
+    MakeFileQueue(&globalFileQueue);
+    globalGameMemory.fileQueue = &globalFileQueue;
+    globalGameMemory.assetPack = PlatformMapFile((char *) ASSET_PACK_FILENAME);
+    PlatformPrefetchFile(&globalGameMemory.assetPack, 0, globalGameMemory.assetPack.size);
+
     WNDCLASSEX WindowClass = {};
 
     ResizeDIBSection(&globalGraphicsBuffer, 1280, 720);
@@ -449,6 +613,8 @@ int APIENTRY WinMain(
 
       // Load audio
       RETURN_IF_FAILED(InitAudio(bufferNS, SAMPLES_PER_SECOND)); // 10ms buffer
+      InitAudioRecorder(&globalAudioRecorder, SAMPLES_PER_SECOND);
+      OpenAudioCsv(&globalAudioRecorder, GetAudioWallSeconds());
 
       if(WindowHandle) {
         // Window successfully retrieved!
@@ -461,6 +627,15 @@ int APIENTRY WinMain(
         game_input gameInput = {};
         graphics_buffer graphicsBuffer = {};
         sound_buffer soundBuffer = {};
+        present_stats presentStats = {};
+#ifdef RAIKA_DEBUG
+        // Frames since the stats were last printed
+        int statsFrames = 0;
+#endif
+        // Three quarters of a frame, the rest is for the blit and the OS
+        dynamic_resolution resolution = MakeDynamicResolution(targetSecondsPerFrame * 1000.0f * 0.75f);
+        bool outputLost = true;
+        bool internalLost = true;
 
         while(running) { // Running loop
           beginTimestamp = __rdtsc();
@@ -532,18 +707,60 @@ int APIENTRY WinMain(
             }
           }
 
+          // Follow the window size
+          win32_window_dimension windowDim = GetWindowDimension(WindowHandle);
+          if(windowDim.width > 0 && windowDim.height > 0 &&
+             (windowDim.width != globalGraphicsBuffer.width || windowDim.height != globalGraphicsBuffer.height)) {
+            ResizeDIBSection(&globalGraphicsBuffer, windowDim.width, windowDim.height);
+            outputLost = true;
+            internalLost = true;
+          }
+          LARGE_INTEGER renderStart = GetWallClock();
+
           // Fill graphics buffer
-          graphicsBuffer.memory = globalGraphicsBuffer.memory;
-          graphicsBuffer.width = globalGraphicsBuffer.width;
-          graphicsBuffer.height = globalGraphicsBuffer.height;
-          graphicsBuffer.pitch = globalGraphicsBuffer.pitch;
-          
+          int internalWidth, internalHeight;
+          GetInternalResolution(
+            &resolution, globalGraphicsBuffer.width, globalGraphicsBuffer.height,
+            &internalWidth, &internalHeight
+          );
+          graphicsBuffer.memory = globalGraphicsBuffer.gameMemory;
+          graphicsBuffer.width = internalWidth;
+          graphicsBuffer.height = internalHeight;
+          graphicsBuffer.pitch = internalWidth * 4;
+          graphicsBuffer.contentsLost = internalLost;
+          graphicsBuffer.commands = &globalRenderCommands;
+          internalLost = false;
+          ResetRenderCommands(&globalRenderCommands);
+
           // Create audio buffer
           MakeAudioBuffer(&soundBuffer);
 
           // Pass into the game!
-          GameUpdateAndRender(&graphicsBuffer, &soundBuffer, &gameInput);
+          bool gameInitialized = globalGameMemory.isInitialized;
+          uint64_t heapAllocations = PlatformHeapAllocationCount();
+          GameUpdateAndRender(&globalGameMemory, &graphicsBuffer, &soundBuffer, &gameInput);
+          // Past its first frame the game lives in its arenas
+          Assert(!gameInitialized || PlatformHeapAllocationCount() == heapAllocations);
+          SoftwareRenderCommands(&globalRenderQueue, &graphicsBuffer, &globalRenderCommands);
+          PlatformCompleteAllWork(&globalRenderQueue);
+
+          // Scale into the DIB, written top down through a negative pitch
+          graphics_buffer outputBuffer = {};
+          outputBuffer.width = globalGraphicsBuffer.width;
+          outputBuffer.height = globalGraphicsBuffer.height;
+          outputBuffer.pitch = -globalGraphicsBuffer.pitch;
+          outputBuffer.memory = (uint8_t *) globalGraphicsBuffer.memory +
+            (size_t) (globalGraphicsBuffer.height - 1) * globalGraphicsBuffer.pitch;
+          ScaleDirtyRects(&outputBuffer, &graphicsBuffer);
+          if(outputLost) {
+            MarkAllDirty(&outputBuffer);
+            outputLost = false;
+          }
+          ScaleImageTiled(&globalRenderQueue, resolution.filter, &outputBuffer, &graphicsBuffer);
+          PlatformCompleteAllWork(&globalRenderQueue);
+          UpdateDynamicResolution(&resolution, GetSecondsElapsed(renderStart, GetWallClock()) * 1000.0f);
           globalAudioClient.renderClient->ReleaseBuffer(soundBuffer.samplesRequested, 0);
+          RecordAudioRelease();
 
           // Timing code
           float elapsedSecondsPerFrame = GetSecondsElapsed(beginCounter, GetWallClock());
@@ -566,16 +783,14 @@ int APIENTRY WinMain(
           // Draw what we got
           HDC deviceContext = GetDC(WindowHandle);
           win32_window_dimension dim = GetWindowDimension(WindowHandle);
-          CopyBufferToWindow(
-            deviceContext, 
+          CopyDirtyRectsToWindow(
+            deviceContext,
             dim.width, dim.height,
             &globalGraphicsBuffer,
-            0, 
-            0, 
-            dim.width,
-            dim.height
+            &outputBuffer
           );
           ReleaseDC(WindowHandle, deviceContext);
+          RecordPresent(&presentStats, &outputBuffer);
 
           // Profiling
           endTimestamp = __rdtsc();
@@ -584,6 +799,26 @@ int APIENTRY WinMain(
           char Buffer[256];
           sprintf(Buffer, "ms/frame: %.04fs/f, %lld\n", elapsedSecondsPerFrame, timestampElapsed);
           OutputDebugString(Buffer);
+#ifdef RAIKA_DEBUG
+          // Once a second, covering every frame since the last time
+          if(++statsFrames >= gameUpdateHz) {
+            char threadBuffer[1024];
+            FormatWorkQueueStats(&globalRenderQueue, threadBuffer, sizeof(threadBuffer));
+            OutputDebugString(threadBuffer);
+            FormatPresentStats(&presentStats, threadBuffer, sizeof(threadBuffer));
+            OutputDebugString(threadBuffer);
+            FormatSoftwareStats(threadBuffer, sizeof(threadBuffer));
+            OutputDebugString(threadBuffer);
+            FormatDynamicResolution(&resolution, internalWidth, internalHeight, threadBuffer, sizeof(threadBuffer));
+            OutputDebugString(threadBuffer);
+            FormatAudioStats(&globalAudioRecorder.stats, threadBuffer, sizeof(threadBuffer));
+            OutputDebugString(threadBuffer);
+            ResetWorkQueueStats(&globalRenderQueue);
+            ResetPresentStats(&presentStats);
+            ResetSoftwareStats();
+            statsFrames = 0;
+          }
+#endif
         }
       } else {
         // Handle failed
@@ -592,6 +827,10 @@ int APIENTRY WinMain(
       // TODO: Window Failed to register
     }
 
+    CloseAudioCsv(&globalAudioRecorder);
+    FreeFileQueue(&globalFileQueue);
+    PlatformUnmapFile(&globalGameMemory.assetPack);
+    PlatformFreeGameMemory(&globalGameMemory);
     timeBeginPeriod(1); // End the time granuality
     return 0;
 }
\ No newline at end of file
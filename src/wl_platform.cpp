@@ -11,6 +11,28 @@
 #include "../build/xdg-shell-client-protocol.h"
 #include <xkbcommon/xkbcommon.h>
 #include <pipewire/pipewire.h>
+#include <spa/param/audio/format-utils.h>
+
+#include "raika_work_queue.cpp"
+#include "raika_posix_file.cpp"
+#include "raika_present.cpp"
+#include "raika_audio_stats.cpp"
+#include "raika_audio_ring.cpp"
+#include "raika_game_memory.cpp"
+#include "raika_file_queue.cpp"
+
+// PipeWire pulls one quantum at a time from the ring on its real-time data
+// thread. The game tops the ring up once per frame, so it keeps a frame of
+// audio plus AUDIO_LEAD_QUANTA quanta ahead: one for the quantum being pulled
+// and one for frames that arrive late.
+#define AUDIO_SAMPLES_PER_SECOND 48000
+#define AUDIO_CHANNELS 2
+#define AUDIO_FRAMES_PER_SECOND 60
+#define AUDIO_LEAD_QUANTA 2
+#define AUDIO_RING_SAMPLES 8192
+#define AUDIO_DEFAULT_QUANTUM 128
+#define AUDIO_MIN_QUANTUM 32
+#define AUDIO_MAX_QUANTUM 1024
 
 struct wl_state { // This will hold the stuff we grab from wl_display
   struct wl_compositor *compositor;
@@ -29,6 +51,19 @@ struct wl_doubleBuffer {
   struct wl_buffer_with_mem b;
 };
 
+struct wl_audio {
+  struct pw_thread_loop *loop;
+  struct pw_stream *stream;
+  struct audio_ring ring;
+  int16_t *ringMemory;
+  int16_t *staging;
+  // What we asked the graph for, and what the last process call was given
+  uint32_t quantum;
+  volatile uint32_t lastQuantum;
+  bool started;
+  struct audio_recorder recorder;
+};
+
 // globals
 static bool running;
 static bool currentA;
@@ -37,6 +72,32 @@ static struct wl_doubleBuffer globalDoubleBuffer;
 static bool updateSurface;
 static struct xkb_state *xkbState;
 static struct game_input globalGameInput;
+static struct platform_work_queue globalRenderQueue;
+static struct render_commands globalRenderCommands;
+static struct game_memory globalGameMemory;
+static struct platform_file_queue globalFileQueue;
+static struct present_stats globalPresentStats;
+// What the buffer on screen changed, the back buffer is missing it
+static int globalLastDirtyRectCount;
+static struct graphics_rect globalLastDirtyRects[GRAPHICS_MAX_DIRTY_RECTS];
+// shm buffers are the window size, the game draws into the internal buffer
+// below it and that gets scaled up
+static int globalOutputWidth;
+static int globalOutputHeight;
+static int globalPendingWidth;
+static int globalPendingHeight;
+static int globalShmFd = -1;
+static void *globalShmMemory;
+static size_t globalShmSize;
+static bool globalBuffersLost;
+static void *globalInternalMemory;
+static bool globalInternalLost;
+static struct dynamic_resolution globalResolution;
+static struct wl_audio globalAudio;
+#ifdef RAIKA_DEBUG
+// When the stats were last printed
+static double globalStatsMs;
+#endif
 
 // Helpers
 static wl_buffer_with_mem getBuffer(bool first) {
@@ -72,6 +133,12 @@ static int create_shm_file() {
   return -1;
 }
 
+static double wallMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
 int allocate_shm_file(size_t size) {
 	int fd = create_shm_file();
 	if (fd < 0)
@@ -87,6 +154,185 @@ int allocate_shm_file(size_t size) {
 	return fd;
 }
 
+// Replaces both shm buffers and the internal buffer, old contents are gone
+static void resizeBuffers(int width, int height) {
+  int bytesPerPixel = 4;
+  if(globalDoubleBuffer.a.buffer) {
+    wl_buffer_destroy(globalDoubleBuffer.a.buffer);
+    wl_buffer_destroy(globalDoubleBuffer.b.buffer);
+    munmap(globalShmMemory, globalShmSize);
+    close(globalShmFd);
+  }
+
+  globalShmSize = (size_t) bytesPerPixel * width * height * 2; // we want 2 of these
+  globalShmFd = allocate_shm_file(globalShmSize);
+  globalShmMemory = mmap(NULL, globalShmSize, PROT_READ | PROT_WRITE, MAP_SHARED, globalShmFd, 0);
+
+  struct wl_shm_pool *pool = wl_shm_create_pool(globalState.shm, globalShmFd, globalShmSize);
+  globalDoubleBuffer.a.buffer = wl_shm_pool_create_buffer(pool, 0, width, height, bytesPerPixel * width, WL_SHM_FORMAT_XRGB8888);
+  globalDoubleBuffer.b.buffer = wl_shm_pool_create_buffer(pool, height * width * bytesPerPixel, width, height, bytesPerPixel * width, WL_SHM_FORMAT_XRGB8888);
+  globalDoubleBuffer.a.mem = globalShmMemory;
+  globalDoubleBuffer.b.mem = (void*)(((int8_t*) globalShmMemory) + (bytesPerPixel * width * height));
+  wl_shm_pool_destroy(pool);
+
+  free(globalInternalMemory);
+  globalInternalMemory = malloc((size_t) bytesPerPixel * width * height);
+
+  globalOutputWidth = width;
+  globalOutputHeight = height;
+  globalLastDirtyRectCount = 0;
+  globalBuffersLost = true;
+  globalInternalLost = true;
+}
+
+// Audio
+// Samples from the game to the speaker: what is still in our ring, what the
+// stream has queued and the graph's own delay down to the device
+static double audioAheadSamples() {
+  struct pw_time time = {};
+  pw_thread_loop_lock(globalAudio.loop);
+#if PW_CHECK_VERSION(0, 3, 50)
+  int result = pw_stream_get_time_n(globalAudio.stream, &time, sizeof(time));
+#else
+  int result = pw_stream_get_time(globalAudio.stream, &time);
+#endif
+  pw_thread_loop_unlock(globalAudio.loop);
+
+  double samples = AudioRingQueued(&globalAudio.ring);
+  if(result == 0) {
+    samples += (double) time.queued / globalAudio.ring.sampleBytes;
+    if(time.rate.denom) {
+      samples += (double) time.delay * time.rate.num * AUDIO_SAMPLES_PER_SECOND / time.rate.denom;
+    }
+  }
+  return samples;
+}
+
+static void formatAudioStats(char *out, int outSize) {
+  FormatAudioRingStats(&globalAudio.ring, AUDIO_SAMPLES_PER_SECOND, out, outSize);
+  int length = (int) strlen(out);
+  FormatAudioStats(&globalAudio.recorder.stats, out + length, outSize - length);
+  length = (int) strlen(out);
+  snprintf(
+    out + length, outSize - length, "  audio quantum %u (asked %u)\n",
+    globalAudio.lastQuantum, globalAudio.quantum
+  );
+}
+
+// pw_stream, runs on PipeWire's real-time data thread, the only reader of the ring
+static void stream_handle_process(void *data) {
+  struct pw_buffer *buffer = pw_stream_dequeue_buffer(globalAudio.stream);
+  if(!buffer) {
+    return;
+  }
+  struct spa_data *out = &buffer->buffer->datas[0];
+  uint32_t stride = globalAudio.ring.sampleBytes;
+  uint32_t count = out->maxsize / stride;
+#if PW_CHECK_VERSION(0, 3, 49)
+  if(buffer->requested && buffer->requested < count) {
+    count = (uint32_t) buffer->requested;
+  }
+#endif
+  if(out->data) {
+    ReadAudioRing(&globalAudio.ring, out->data, count);
+  } else {
+    count = 0;
+  }
+  globalAudio.lastQuantum = count;
+  out->chunk->offset = 0;
+  out->chunk->stride = stride;
+  out->chunk->size = count * stride;
+  // pw_time.queued only sums what we say a buffer holds, in bytes here
+  buffer->size = (uint64_t) count * stride;
+  pw_stream_queue_buffer(globalAudio.stream, buffer);
+}
+
+static void stream_handle_state_changed(void *data, enum pw_stream_state old, enum pw_stream_state state, const char *error) {
+  if(state == PW_STREAM_STATE_ERROR) {
+    fprintf(stderr, "PipeWire stream error: %s\n", error ? error : "unknown");
+  }
+}
+
+static const struct pw_stream_events stream_events = {
+  .version = PW_VERSION_STREAM_EVENTS,
+  .state_changed = stream_handle_state_changed,
+  .process = stream_handle_process,
+};
+
+// Connects an inactive stream, the first frame of game audio starts it.
+// Without PipeWire the game carries on silent.
+static bool openAudio(uint32_t quantum) {
+  globalAudio.quantum = quantum;
+  globalAudio.loop = pw_thread_loop_new("raika-audio", NULL);
+  if(!globalAudio.loop) {
+    return false;
+  }
+
+  char latency[32];
+  snprintf(latency, sizeof(latency), "%u/%u", quantum, AUDIO_SAMPLES_PER_SECOND);
+  struct pw_properties *props = pw_properties_new(
+    PW_KEY_MEDIA_TYPE, "Audio",
+    PW_KEY_MEDIA_CATEGORY, "Playback",
+    PW_KEY_MEDIA_ROLE, "Game",
+    PW_KEY_NODE_LATENCY, latency,
+    NULL
+  );
+  globalAudio.stream = pw_stream_new_simple(
+    pw_thread_loop_get_loop(globalAudio.loop), "Raika", props, &stream_events, NULL
+  );
+  if(!globalAudio.stream) {
+    pw_thread_loop_destroy(globalAudio.loop);
+    globalAudio.loop = NULL;
+    return false;
+  }
+
+  globalAudio.ringMemory = (int16_t *) malloc(AUDIO_RING_SAMPLES * AUDIO_CHANNELS * sizeof(int16_t));
+  globalAudio.staging = (int16_t *) malloc(AUDIO_RING_SAMPLES * AUDIO_CHANNELS * sizeof(int16_t));
+  MakeAudioRing(&globalAudio.ring, globalAudio.ringMemory, AUDIO_RING_SAMPLES, AUDIO_CHANNELS * sizeof(int16_t));
+  InitAudioRecorder(&globalAudio.recorder, AUDIO_SAMPLES_PER_SECOND);
+  OpenAudioCsv(&globalAudio.recorder, wallMs() / 1000.0);
+
+  uint8_t podMemory[1024];
+  struct spa_pod_builder builder = SPA_POD_BUILDER_INIT(podMemory, sizeof(podMemory));
+  struct spa_audio_info_raw info = {};
+  info.format = SPA_AUDIO_FORMAT_S16;
+  info.rate = AUDIO_SAMPLES_PER_SECOND;
+  info.channels = AUDIO_CHANNELS;
+  info.position[0] = SPA_AUDIO_CHANNEL_FL;
+  info.position[1] = SPA_AUDIO_CHANNEL_FR;
+  const struct spa_pod *params[1];
+  params[0] = spa_format_audio_raw_build(&builder, SPA_PARAM_EnumFormat, &info);
+
+  // RT_PROCESS calls process straight from the data thread instead of
+  // bouncing it through our loop
+  int result = pw_stream_connect(
+    globalAudio.stream, PW_DIRECTION_OUTPUT, PW_ID_ANY,
+    (enum pw_stream_flags) (PW_STREAM_FLAG_AUTOCONNECT | PW_STREAM_FLAG_MAP_BUFFERS |
+                            PW_STREAM_FLAG_RT_PROCESS | PW_STREAM_FLAG_INACTIVE),
+    params, 1
+  );
+  if(result < 0 || pw_thread_loop_start(globalAudio.loop) < 0) {
+    pw_stream_destroy(globalAudio.stream);
+    pw_thread_loop_destroy(globalAudio.loop);
+    globalAudio.stream = NULL;
+    globalAudio.loop = NULL;
+    return false;
+  }
+  return true;
+}
+
+static void closeAudio() {
+  if(globalAudio.loop) {
+    pw_thread_loop_stop(globalAudio.loop);
+    pw_stream_destroy(globalAudio.stream);
+    pw_thread_loop_destroy(globalAudio.loop);
+    free(globalAudio.ringMemory);
+    free(globalAudio.staging);
+    CloseAudioCsv(&globalAudio.recorder);
+    globalAudio = {};
+  }
+}
+
 // Listeners
 // xdg_wm_base
 static void xdgBase_handle_ping(void *data, struct xdg_wm_base *wmBase, uint serial) {
@@ -112,6 +358,24 @@ static const struct xdg_surface_listener xdgSurface_listener = {
   .configure = xdgSurface_handle_configure,
 };
 
+// xdg_toplevel
+static void xdgToplevel_handle_configure(void *data, struct xdg_toplevel *toplevel, int width, int height, wl_array *states) {
+  // Zero leaves the size to us, keep what we have
+  if(width > 0 && height > 0) {
+    globalPendingWidth = width;
+    globalPendingHeight = height;
+  }
+}
+
+static void xdgToplevel_handle_close(void *data, struct xdg_toplevel *toplevel) {
+  running = false;
+}
+
+static const struct xdg_toplevel_listener xdgToplevel_listener = {
+  .configure = xdgToplevel_handle_configure,
+  .close = xdgToplevel_handle_close,
+};
+
 // wl_callback
 static void callback_done(void *data, struct wl_callback *cb, uint callback_data);
 static const struct wl_callback_listener callback_listener = {
@@ -124,21 +388,118 @@ static void callback_done(void *data, struct wl_callback *cb, uint callback_data
   struct wl_callback *newcb = wl_surface_frame(wlsurface);
   wl_callback_add_listener(newcb, &callback_listener, data);
   
-  int width = 1920;
-  int height = 1080;
+  // A new window size takes effect between frames
+  if(globalPendingWidth &&
+     (globalPendingWidth != globalOutputWidth || globalPendingHeight != globalOutputHeight)) {
+    resizeBuffers(globalPendingWidth, globalPendingHeight);
+  }
+  double frameStart = wallMs();
+
   int bytesPerPixel = 4;
+  int width, height;
+  GetInternalResolution(&globalResolution, globalOutputWidth, globalOutputHeight, &width, &height);
+  bool scaled = width != globalOutputWidth || height != globalOutputHeight;
 
   struct graphics_buffer graphicsBuffer = {0};
+  struct graphics_buffer internalBuffer = {0};
   struct sound_buffer soundBuffer = {0};
 
   graphicsBuffer.memory = getBuffer(false).mem,
-  graphicsBuffer.width = width,
-  graphicsBuffer.height = height,
-  graphicsBuffer.pitch = width * bytesPerPixel;
+  graphicsBuffer.width = globalOutputWidth,
+  graphicsBuffer.height = globalOutputHeight,
+  graphicsBuffer.pitch = globalOutputWidth * bytesPerPixel;
+  graphicsBuffer.contentsLost = globalBuffersLost;
+  CopyDirtyRects(&graphicsBuffer, getBuffer(true).mem, globalLastDirtyRects, globalLastDirtyRectCount);
+
+  // The internal buffer is ours alone, so it always holds the last frame
+  // drawn at that size
+  struct graphics_buffer *gameBuffer = &graphicsBuffer;
+  if(scaled) {
+    internalBuffer.memory = globalInternalMemory;
+    internalBuffer.width = width;
+    internalBuffer.height = height;
+    internalBuffer.pitch = width * bytesPerPixel;
+    internalBuffer.contentsLost = globalInternalLost;
+    gameBuffer = &internalBuffer;
+    globalInternalLost = false;
+  }
+  gameBuffer->commands = &globalRenderCommands;
+  ResetRenderCommands(&globalRenderCommands);
+
+  if(globalAudio.stream) {
+    if(globalAudio.started) {
+      RecordAudioRing(&globalAudio.recorder, &globalAudio.ring, wallMs() / 1000.0);
+      RecordAudioQueued(&globalAudio.recorder, AudioRingQueued(&globalAudio.ring));
+    }
+    uint32_t lead = AUDIO_SAMPLES_PER_SECOND / AUDIO_FRAMES_PER_SECOND + AUDIO_LEAD_QUANTA * globalAudio.quantum;
+    soundBuffer.memory = globalAudio.staging;
+    soundBuffer.samplesPerSecond = AUDIO_SAMPLES_PER_SECOND;
+    soundBuffer.samplesRequested = (int) AudioRingRequest(&globalAudio.ring, lead);
+    soundBuffer.bytesPerSample = sizeof(int16_t);
+    soundBuffer.channels = AUDIO_CHANNELS;
+    soundBuffer.stats = &globalAudio.recorder.stats;
+  }
 
-  GameUpdateAndRender(&graphicsBuffer, &soundBuffer, &globalGameInput);
+  bool gameInitialized = globalGameMemory.isInitialized;
+  uint64_t heapAllocations = PlatformHeapAllocationCount();
+  GameUpdateAndRender(&globalGameMemory, gameBuffer, &soundBuffer, &globalGameInput);
+  // Past its first frame the game lives in its arenas
+  Assert(!gameInitialized || PlatformHeapAllocationCount() == heapAllocations);
+  if(globalAudio.stream) {
+    uint32_t written = WriteAudioRing(&globalAudio.ring, globalAudio.staging, (uint32_t) soundBuffer.samplesRequested);
+    if(!globalAudio.started) {
+      pw_thread_loop_lock(globalAudio.loop);
+      pw_stream_set_active(globalAudio.stream, true);
+      pw_thread_loop_unlock(globalAudio.loop);
+      globalAudio.started = true;
+    }
+    RecordAudioWrite(&globalAudio.recorder, audioAheadSamples(), (uint32_t) soundBuffer.samplesRequested - written);
+    WriteAudioCsv(&globalAudio.recorder, wallMs() / 1000.0);
+  }
+  SoftwareRenderCommands(&globalRenderQueue, gameBuffer, &globalRenderCommands);
+  PlatformCompleteAllWork(&globalRenderQueue);
+  if(scaled) {
+    ScaleDirtyRects(&graphicsBuffer, &internalBuffer);
+    if(globalBuffersLost) {
+      MarkAllDirty(&graphicsBuffer);
+    }
+    ScaleImageTiled(&globalRenderQueue, globalResolution.filter, &graphicsBuffer, &internalBuffer);
+    PlatformCompleteAllWork(&globalRenderQueue);
+  }
+  globalBuffersLost = false;
+  UpdateDynamicResolution(&globalResolution, (float) (wallMs() - frameStart));
+  RecordPresent(&globalPresentStats, &graphicsBuffer);
+#ifdef RAIKA_DEBUG
+  // Once a second, covering every frame since the last time. Frames come
+  // when the compositor asks, so this goes by the clock.
+  if(frameStart - globalStatsMs >= 1000.0) {
+    char stats[1024];
+    FormatWorkQueueStats(&globalRenderQueue, stats, sizeof(stats));
+    printf("Render threads:\n%s", stats);
+    FormatPresentStats(&globalPresentStats, stats, sizeof(stats));
+    printf("%s", stats);
+    FormatSoftwareStats(stats, sizeof(stats));
+    printf("%s", stats);
+    FormatDynamicResolution(&globalResolution, width, height, stats, sizeof(stats));
+    printf("%s", stats);
+    if(globalAudio.stream) {
+      formatAudioStats(stats, sizeof(stats));
+      printf("%s", stats);
+      ResetAudioRingStats(&globalAudio.ring);
+    }
+    ResetWorkQueueStats(&globalRenderQueue);
+    ResetPresentStats(&globalPresentStats);
+    ResetSoftwareStats();
+    globalStatsMs = frameStart;
+  }
+#endif
   wl_surface_attach(wlsurface, getBuffer(false).buffer, 0, 0);
-  wl_surface_damage_buffer(wlsurface, 0, 0, INT32_MAX, INT32_MAX);
+  for(int i = 0; i < graphicsBuffer.dirtyRectCount; ++i) {
+    graphics_rect rect = graphicsBuffer.dirtyRects[i];
+    wl_surface_damage_buffer(wlsurface, rect.x, rect.y, rect.width, rect.height);
+    globalLastDirtyRects[i] = rect;
+  }
+  globalLastDirtyRectCount = graphicsBuffer.dirtyRectCount;
   wl_surface_commit(wlsurface);
   currentA = !currentA;
 }
@@ -242,7 +603,8 @@ static void registry_handle_global(
   } else if(strcmp(interface, wl_shm_interface.name) == 0) {
     state->shm = (wl_shm*) wl_registry_bind(registry, name, &wl_shm_interface, version);
   } else if(strcmp(interface, xdg_wm_base_interface.name) == 0) {
-    state->xdgBase = (xdg_wm_base*) wl_registry_bind(registry, name, &xdg_wm_base_interface, version);
+    // Later versions add toplevel events we have no listeners for
+    state->xdgBase = (xdg_wm_base*) wl_registry_bind(registry, name, &xdg_wm_base_interface, version < 3 ? version : 3);
   } else if(strcmp(interface, wl_seat_interface.name) == 0) {
     state->seat = (wl_seat*) wl_registry_bind(registry, name, &wl_seat_interface, version);
     wl_seat_add_listener(state->seat, &seat_listener, NULL);
@@ -277,26 +639,41 @@ int main(int argc, char *argv[]) {
   xdg_wm_base_add_listener(globalState.xdgBase, &xdgBase_listener, NULL);
   struct wl_surface *surface = wl_compositor_create_surface(globalState.compositor);
 
-  // init pipewire
-  pw_init(&argc, &argv);
+  // Render workers, the main thread makes up the last core
+  MakeWorkQueue(&globalRenderQueue, GetLogicalProcessorCount() - 1);
+  globalRenderCommands = MakeRenderCommands(malloc(RENDER_PUSH_BUFFER_SIZE), RENDER_PUSH_BUFFER_SIZE);
+  if(!PlatformAllocateGameMemory(&globalGameMemory, GAME_PERMANENT_STORAGE_SIZE, GAME_TRANSIENT_STORAGE_SIZE)) {
+    fprintf(stderr, "Failed to reserve game memory.\n");
+    return 1;
+  }
+  MakeFileQueue(&globalFileQueue);
+  globalGameMemory.fileQueue = &globalFileQueue;
+  globalGameMemory.assetPack = PlatformMapFile((char *) ASSET_PACK_FILENAME);
+  PlatformPrefetchFile(&globalGameMemory.assetPack, 0, globalGameMemory.assetPack.size);
 
-  // init memory
-  int width = 1920;
-  int height = 1080;
-  int bytesPerPixel = 4;
-  int shmMemSize = bytesPerPixel * width * height * 2; // we want 2 of these
-  int fd = allocate_shm_file(shmMemSize);
-  void *memory = mmap(NULL, shmMemSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  // init pipewire, --quantum N picks the frames per PipeWire cycle
+  pw_init(&argc, &argv);
+  uint32_t quantum = AUDIO_DEFAULT_QUANTUM;
+  for(int i = 1; i + 1 < argc; ++i) {
+    if(strcmp(argv[i], "--quantum") == 0) {
+      quantum = (uint32_t) atoi(argv[++i]);
+    }
+  }
+  quantum = quantum < AUDIO_MIN_QUANTUM ? AUDIO_MIN_QUANTUM : quantum;
+  quantum = quantum > AUDIO_MAX_QUANTUM ? AUDIO_MAX_QUANTUM : quantum;
+  if(!openAudio(quantum)) {
+    fprintf(stderr, "Failed to open a PipeWire stream, running without sound.\n");
+  }
 
-  struct wl_shm_pool *pool = wl_shm_create_pool(globalState.shm, fd, shmMemSize);
-  globalDoubleBuffer.a.buffer = wl_shm_pool_create_buffer(pool, 0, width, height, bytesPerPixel * width, WL_SHM_FORMAT_XRGB8888);
-  globalDoubleBuffer.b.buffer = wl_shm_pool_create_buffer(pool, height * width * bytesPerPixel, width, height, bytesPerPixel * width, WL_SHM_FORMAT_XRGB8888);
-  globalDoubleBuffer.a.mem = memory;
-  globalDoubleBuffer.b.mem = (void*)(((int8_t*) memory) + (bytesPerPixel * width * height));
+  // init memory, the first toplevel configure may replace this
+  resizeBuffers(1920, 1080);
+  // Three quarters of a 60Hz frame, leaving room for the compositor
+  globalResolution = MakeDynamicResolution(1000.0f / 60.0f * 0.75f);
 
   struct xdg_surface *xdgSurface = xdg_wm_base_get_xdg_surface(globalState.xdgBase, surface);
   xdg_surface_add_listener(xdgSurface, &xdgSurface_listener, surface);
   struct xdg_toplevel *xdgToplevel = xdg_surface_get_toplevel(xdgSurface);
+  xdg_toplevel_add_listener(xdgToplevel, &xdgToplevel_listener, NULL);
   xdg_toplevel_set_title(xdgToplevel, "Raika");
   wl_surface_commit(surface);
   struct wl_callback *cb = wl_surface_frame(surface);
@@ -309,6 +686,11 @@ int main(int argc, char *argv[]) {
     wl_display_flush(display);
   }
   // Cleanup
+  closeAudio();
+  pw_deinit();
+  FreeFileQueue(&globalFileQueue);
+  PlatformUnmapFile(&globalGameMemory.assetPack);
+  PlatformFreeGameMemory(&globalGameMemory);
   wl_display_disconnect(display);
   return 0;
 }
\ No newline at end of file
@@ -3,6 +3,10 @@
 #include <stdio.h>
 #include <xcb/xcb.h>
 
+#include "raika_work_queue.cpp"
+#include "raika_posix_file.cpp"
+#include "raika_file_queue.cpp"
+
 // globals
 static bool running;
 static xcb_intern_atom_cookie_t protocols_cookie;